@@ -0,0 +1,393 @@
+// Times single functions of the interpreter, linked against libblunt, so hot paths can be
+// measured without the noise of reading, parsing and running a whole script.
+#define _GNU_SOURCE
+#include "../src/include/heap/heap.h"
+#include "../src/include/lexer/lexer.h"
+#include "../src/include/parser/parser.h"
+#include "../src/include/scope/scope.h"
+#include "../src/include/visitor/visitor.h"
+#include "../src/include/ast/AST.h"
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MICRO_NAME_SIZE 64
+
+typedef struct MICRO_CASE_STRUCT
+{
+    char name[MICRO_NAME_SIZE];
+    void (*setup)(struct MICRO_CASE_STRUCT *micro_case);
+    void (*run)(struct MICRO_CASE_STRUCT *micro_case, long iterations);
+    // Statements, variables or scopes, depending on the case
+    int size;
+
+    // Built by setup on the heap of the harness, and only read by run
+    char *source;
+    lexer_T *lexer;
+    scope_T *scope;
+    visitor_T *visitor;
+    AST_T *node;
+    char *variable_name;
+} micro_case_T;
+
+// Results go here so that the compiler cannot drop the calls that produce them
+static void *volatile micro_sink;
+
+static void print_help()
+{
+    fprintf(stderr, "Usage: micro [--cpu <cpu>] [--batches <batches>] [--batch-ms <milliseconds>] [<case name prefix>...]\n");
+}
+
+static long micro_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// A program with a bit of everything the parser knows, statements times
+static char *micro_source(int statements)
+{
+    size_t size = 0;
+    char *source = NULL;
+    FILE *stream = open_memstream(&source, &size);
+    for (int i = 0; i < statements; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            fprintf(stream, "roll x%d with %d;\n", i, i);
+            break;
+        case 1:
+            fprintf(stream, "x%d = x%d * 2 + (%d - 1) / 3;\n", i - 1, i - 1, i);
+            break;
+        case 2:
+            fprintf(stream, "if (x%d > %d) { println(\"big\", x%d); } else { x%d = 0; }\n", i - 2, i, i - 2, i - 2);
+            break;
+        default:
+            fprintf(stream, "blunt f%d(a, b) { smoke a + b; }\n", i);
+            break;
+        }
+    }
+    fclose(stream);
+
+    char *copy = heap_strdup(source);
+    free(source);
+    return copy;
+}
+
+static AST_T *micro_variable_definition(const char *name)
+{
+    AST_VARIABLE_DEFINITION_T *definition = (AST_VARIABLE_DEFINITION_T *)init_ast(AST_VARIABLE_DEFINITION);
+    definition->variable_definition_variable_name = heap_strdup(name);
+    definition->variable_definition_value = init_ast(AST_INT);
+    return (AST_T *)definition;
+}
+
+static void micro_setup_lexer(micro_case_T *micro_case)
+{
+    micro_case->source = micro_source(micro_case->size);
+    micro_case->lexer = init_lexer(micro_case->source);
+}
+
+// One op is one token, starting over at the end of the source
+static void micro_run_lexer(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        token_T *token = lexer_get_next_token(micro_case->lexer);
+        if (token->type == TOKEN_EOF)
+        {
+            micro_case->lexer->i = 0;
+            micro_case->lexer->c = micro_case->source[0];
+        }
+        micro_sink = token;
+    }
+}
+
+static void micro_setup_parser(micro_case_T *micro_case)
+{
+    micro_case->source = micro_source(micro_case->size);
+}
+
+static void micro_run_parser(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        parser_T *parser = init_parser(init_lexer(micro_case->source));
+        micro_sink = parser_parse(parser);
+    }
+}
+
+// The name looked up is the last one defined, which the scope reaches after every other
+static void micro_setup_scope(micro_case_T *micro_case)
+{
+    char name[32];
+    micro_case->scope = init_scope();
+    for (int i = 0; i < micro_case->size; i++)
+    {
+        snprintf(name, sizeof(name), "variable%d", i);
+        scope_add_variable_definition(micro_case->scope, micro_variable_definition(name));
+    }
+    micro_case->variable_name = heap_strdup(name);
+}
+
+static void micro_run_scope(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        micro_sink = scope_get_variable_definition(micro_case->scope, micro_case->variable_name);
+    }
+}
+
+// A global looked up from under size scopes of four locals each, like a deep recursion
+static void micro_setup_scope_depth(micro_case_T *micro_case)
+{
+    micro_case->visitor = init_visitor();
+    scope_add_variable_definition(micro_case->visitor->global_scope, micro_variable_definition("global"));
+    for (int depth = 0; depth < micro_case->size; depth++)
+    {
+        scope_T *scope = init_scope();
+        for (int i = 0; i < 4; i++)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "local%d", i);
+            scope_add_variable_definition(scope, micro_variable_definition(name));
+        }
+        micro_case->visitor->scope_stack = push_scope_to_stack(micro_case->visitor->scope_stack, scope);
+    }
+    micro_case->variable_name = heap_strdup("global");
+}
+
+static void micro_run_scope_depth(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        micro_sink = visitor_get_variable_definition(micro_case->visitor, micro_case->variable_name);
+    }
+}
+
+static void micro_setup_nothing(micro_case_T *micro_case)
+{
+    (void)micro_case;
+}
+
+static void micro_run_init_ast(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        micro_sink = init_ast(AST_INT);
+    }
+}
+
+static AST_T *micro_int(int value)
+{
+    AST_INT_T *node = (AST_INT_T *)init_ast(AST_INT);
+    node->int_value = value;
+    return (AST_T *)node;
+}
+
+static AST_T *micro_string(int length)
+{
+    char *value = heap_calloc(length + 1, 1);
+    memset(value, 'a', length);
+    return (AST_T *)init_ast_string(value, length);
+}
+
+static AST_T *micro_term(int type, AST_T *left, AST_T *right)
+{
+    AST_ADD_OP_T *node = (AST_ADD_OP_T *)init_ast(type);
+    node->left = left;
+    node->right = right;
+    return (AST_T *)node;
+}
+
+static void micro_setup_int_add(micro_case_T *micro_case)
+{
+    micro_case->visitor = init_visitor();
+    micro_case->node = micro_term(AST_ADD_OP, micro_int(40), micro_int(2));
+}
+
+static void micro_setup_int_compare(micro_case_T *micro_case)
+{
+    micro_case->visitor = init_visitor();
+    micro_case->node = micro_term(AST_LT_OP, micro_int(40), micro_int(2));
+}
+
+static void micro_setup_string_concat(micro_case_T *micro_case)
+{
+    micro_case->visitor = init_visitor();
+    micro_case->node = micro_term(AST_ADD_OP, micro_string(micro_case->size), micro_string(micro_case->size));
+}
+
+static void micro_setup_string_equal(micro_case_T *micro_case)
+{
+    micro_case->visitor = init_visitor();
+    micro_case->node = micro_term(AST_EQUAL_OP, micro_string(micro_case->size), micro_string(micro_case->size));
+}
+
+static void micro_run_term(micro_case_T *micro_case, long iterations)
+{
+    for (long i = 0; i < iterations; i++)
+    {
+        micro_sink = visitor_visit_term(micro_case->visitor, micro_case->node);
+    }
+}
+
+static micro_case_T micro_cases[] = {
+    {"lexer_get_next_token", micro_setup_lexer, micro_run_lexer, 100},
+    {"parser_parse/10", micro_setup_parser, micro_run_parser, 10},
+    {"parser_parse/100", micro_setup_parser, micro_run_parser, 100},
+    {"parser_parse/1000", micro_setup_parser, micro_run_parser, 1000},
+    {"scope_get_variable_definition/1", micro_setup_scope, micro_run_scope, 1},
+    {"scope_get_variable_definition/16", micro_setup_scope, micro_run_scope, 16},
+    {"scope_get_variable_definition/256", micro_setup_scope, micro_run_scope, 256},
+    {"visitor_get_variable_definition/1", micro_setup_scope_depth, micro_run_scope_depth, 1},
+    {"visitor_get_variable_definition/16", micro_setup_scope_depth, micro_run_scope_depth, 16},
+    {"visitor_get_variable_definition/256", micro_setup_scope_depth, micro_run_scope_depth, 256},
+    {"init_ast", micro_setup_nothing, micro_run_init_ast, 0},
+    {"visitor_visit_term/int add", micro_setup_int_add, micro_run_term, 0},
+    {"visitor_visit_term/int compare", micro_setup_int_compare, micro_run_term, 0},
+    {"visitor_visit_term/string concat/64", micro_setup_string_concat, micro_run_term, 64},
+    {"visitor_visit_term/string equal/64", micro_setup_string_equal, micro_run_term, 64},
+    {"visitor_visit_term/string equal/4096", micro_setup_string_equal, micro_run_term, 4096},
+};
+
+// Whatever a batch allocates goes to a heap of its own, released once the batch is timed
+static long micro_time_batch(micro_case_T *micro_case, long iterations)
+{
+    heap_T *heap = init_heap();
+    heap_T *previous_heap = heap_use(heap);
+
+    long start = micro_now_ns();
+    micro_case->run(micro_case, iterations);
+    long elapsed = micro_now_ns() - start;
+
+    heap_use(previous_heap);
+    heap_release(heap);
+    return elapsed;
+}
+
+static int micro_compare_doubles(const void *left, const void *right)
+{
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+    return (a > b) - (a < b);
+}
+
+static void micro_bench(micro_case_T *micro_case, int batches, long batch_ns)
+{
+    micro_case->setup(micro_case);
+
+    // Doubles the iterations until a batch is long enough for the clock, which also warms up the caches
+    long iterations = 1;
+    while (micro_time_batch(micro_case, iterations) < batch_ns && iterations < (1L << 40))
+    {
+        iterations *= 2;
+    }
+
+    double *ns_per_op = calloc(batches, sizeof(double));
+    double mean = 0;
+    for (int i = 0; i < batches; i++)
+    {
+        ns_per_op[i] = (double)micro_time_batch(micro_case, iterations) / iterations;
+        mean += ns_per_op[i];
+    }
+    mean /= batches;
+
+    double variance = 0;
+    for (int i = 0; i < batches; i++)
+    {
+        variance += (ns_per_op[i] - mean) * (ns_per_op[i] - mean);
+    }
+    double stddev = batches > 1 ? sqrt(variance / (batches - 1)) : 0;
+
+    qsort(ns_per_op, batches, sizeof(double), micro_compare_doubles);
+    double median = batches % 2 ? ns_per_op[batches / 2] : (ns_per_op[batches / 2 - 1] + ns_per_op[batches / 2]) / 2;
+
+    printf("%-40s %12ld %12.1f %12.1f %12.1f %7.1f%%\n",
+           micro_case->name, iterations, median, mean, stddev, mean > 0 ? 100 * stddev / mean : 0);
+    fflush(stdout);
+    free(ns_per_op);
+}
+
+static int micro_selected(const char *name, char **prefixes, int prefixes_size)
+{
+    if (prefixes_size == 0)
+    {
+        return 1;
+    }
+    for (int i = 0; i < prefixes_size; i++)
+    {
+        if (strncmp(name, prefixes[i], strlen(prefixes[i])) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int cpu = sched_getcpu();
+    int batches = 15;
+    long batch_ms = 20;
+
+    int first_prefix = 1;
+    for (; first_prefix < argc && strncmp(argv[first_prefix], "--", 2) == 0; first_prefix += 2)
+    {
+        if (first_prefix + 1 >= argc)
+        {
+            print_help();
+            return 1;
+        }
+
+        const char *value = argv[first_prefix + 1];
+        if (strcmp(argv[first_prefix], "--cpu") == 0)
+            cpu = atoi(value);
+        else if (strcmp(argv[first_prefix], "--batches") == 0)
+            batches = atoi(value);
+        else if (strcmp(argv[first_prefix], "--batch-ms") == 0)
+            batch_ms = atol(value);
+        else
+        {
+            print_help();
+            return 1;
+        }
+    }
+
+    if (batches < 1 || batch_ms < 1)
+    {
+        print_help();
+        return 1;
+    }
+
+    // Migrating between CPUs mid batch would cost cold caches, so every case runs on one
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpus) != 0)
+    {
+        fprintf(stderr, "Could not pin to CPU %d, timings will be noisier\n", cpu);
+    }
+    else
+    {
+        fprintf(stderr, "Pinned to CPU %d, %d batches of about %ld ms per case\n", cpu, batches, batch_ms);
+    }
+
+    // The cases build their inputs on a heap of their own, kept until the end
+    heap_T *heap = init_heap();
+    heap_use(heap);
+
+    printf("%-40s %12s %12s %12s %12s %8s\n", "case", "ops/batch", "median ns", "mean ns", "stddev ns", "stddev");
+    for (size_t i = 0; i < sizeof(micro_cases) / sizeof(micro_cases[0]); i++)
+    {
+        if (micro_selected(micro_cases[i].name, argv + first_prefix, argc - first_prefix))
+            micro_bench(&micro_cases[i], batches, batch_ms * 1000000);
+    }
+
+    heap_use(NULL);
+    heap_release(heap);
+    return 0;
+}
@@ -0,0 +1,422 @@
+// Runs the benchmark scripts a number of times each, prints their median and p95 wall time,
+// peak RSS, allocation count and a hash of their output as JSON, and compares them against a
+// stored baseline.
+#include <math.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define RUNNER_NAME_SIZE 128
+
+typedef struct RUNNER_RESULT_STRUCT
+{
+    char name[RUNNER_NAME_SIZE];
+    int runs;
+    double median_ms;
+    double p95_ms;
+    long max_rss_kb;
+    long allocations;
+    // FNV-1a hash of what the script printed, in hex, empty in baselines saved before it was recorded
+    char output[17];
+} runner_result_T;
+
+static void print_help()
+{
+    fprintf(stderr, "Usage: runner [--blunt <interpreter>] [--repeat <runs>] [--threshold <percent>] [--baseline <json file>] [--save <json file>] <script>...\n");
+}
+
+static double runner_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// Runs the interpreter on a script with its output thrown away, or with stdout and stderr kept in pipes
+static int runner_spawn(const char *blunt, const char *script, int with_mem_stats, int *stdout_pipe, int *stderr_pipe)
+{
+    int stdout_ends[2];
+    int stderr_ends[2];
+    if (stdout_pipe && pipe(stdout_ends) != 0)
+    {
+        return -1;
+    }
+    if (stderr_pipe && pipe(stderr_ends) != 0)
+    {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if (stdout_pipe)
+        {
+            close(stdout_ends[0]);
+            dup2(stdout_ends[1], STDOUT_FILENO);
+        }
+        else
+        {
+            dup2(null, STDOUT_FILENO);
+        }
+        if (stderr_pipe)
+        {
+            close(stderr_ends[0]);
+            dup2(stderr_ends[1], STDERR_FILENO);
+        }
+        else
+        {
+            dup2(null, STDERR_FILENO);
+        }
+
+        if (with_mem_stats)
+            execl(blunt, blunt, script, "--mem-stats", "/dev/null", (char *)NULL);
+        else
+            execl(blunt, blunt, script, (char *)NULL);
+        _exit(127);
+    }
+
+    if (stdout_pipe)
+    {
+        close(stdout_ends[1]);
+        *stdout_pipe = stdout_ends[0];
+    }
+    if (stderr_pipe)
+    {
+        close(stderr_ends[1]);
+        *stderr_pipe = stderr_ends[0];
+    }
+    return pid;
+}
+
+static int runner_time(const char *blunt, const char *script, double *wall_ms, long *max_rss_kb)
+{
+    double start = runner_now_ms();
+    int pid = runner_spawn(blunt, script, 0, NULL, NULL);
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0)
+    {
+        return -1;
+    }
+    *wall_ms = runner_now_ms() - start;
+    *max_rss_kb = usage.ru_maxrss;
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Hashes what the script printed, so a change of the result shows up like a change of the timings
+static void runner_hash_output(const char *output, size_t size, char *hash)
+{
+    uint64_t value = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        value = (value ^ (unsigned char)output[i]) * 1099511628211ULL;
+    }
+    snprintf(hash, 17, "%016llx", (unsigned long long)value);
+}
+
+// Reads both pipes until the script closes them, polling so that neither fills up while the other is read
+static void runner_read_pipes(int pipes[2], char *outputs[2], size_t sizes[2])
+{
+    struct pollfd events[2] = {{pipes[0], POLLIN, 0}, {pipes[1], POLLIN, 0}};
+    int open_pipes = 2;
+    while (open_pipes > 0 && poll(events, 2, -1) >= 0)
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (events[i].fd < 0 || !events[i].revents)
+                continue;
+
+            char buffer[4096];
+            ssize_t size = read(events[i].fd, buffer, sizeof(buffer));
+            if (size <= 0)
+            {
+                close(events[i].fd);
+                events[i].fd = -1;
+                open_pipes--;
+                continue;
+            }
+            outputs[i] = realloc(outputs[i], sizes[i] + size + 1);
+            memcpy(outputs[i] + sizes[i], buffer, size);
+            sizes[i] += size;
+            outputs[i][sizes[i]] = '\0';
+        }
+    }
+}
+
+// Allocations come from a run of their own, since recording them slows the interpreter down, and the output is kept from it
+static int runner_count_allocations(const char *blunt, const char *script, long *allocations, char *output_hash)
+{
+    int pipes[2];
+    int pid = runner_spawn(blunt, script, 1, &pipes[0], &pipes[1]);
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    char *outputs[2] = {NULL, NULL};
+    size_t sizes[2] = {0, 0};
+    runner_read_pipes(pipes, outputs, sizes);
+
+    int status;
+    waitpid(pid, &status, 0);
+
+    runner_hash_output(outputs[0] ? outputs[0] : "", sizes[0], output_hash);
+    char *line = outputs[1] ? strstr(outputs[1], "Memory: ") : NULL;
+    int found = line && sscanf(line, "Memory: %ld allocations", allocations) == 1;
+    free(outputs[0]);
+    free(outputs[1]);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        return -1;
+    }
+    return found ? 0 : -1;
+}
+
+static int runner_compare_doubles(const void *left, const void *right)
+{
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+    return (a > b) - (a < b);
+}
+
+static void runner_name(const char *script, char *name)
+{
+    const char *base = strrchr(script, '/');
+    base = base ? base + 1 : script;
+    snprintf(name, RUNNER_NAME_SIZE, "%s", base);
+
+    char *extension = strrchr(name, '.');
+    if (extension && strcmp(extension, ".blunt") == 0)
+    {
+        *extension = '\0';
+    }
+}
+
+static int runner_bench(const char *blunt, const char *script, int repeat, runner_result_T *result)
+{
+    memset(result, 0, sizeof(struct RUNNER_RESULT_STRUCT));
+    runner_name(script, result->name);
+    result->runs = repeat;
+
+    if (runner_count_allocations(blunt, script, &result->allocations, result->output) != 0)
+    {
+        fprintf(stderr, "%s: the run with --mem-stats failed\n", script);
+        return -1;
+    }
+
+    double *times = calloc(repeat, sizeof(double));
+    for (int i = 0; i < repeat; i++)
+    {
+        long max_rss_kb;
+        if (runner_time(blunt, script, &times[i], &max_rss_kb) != 0)
+        {
+            fprintf(stderr, "%s: run %d failed\n", script, i + 1);
+            free(times);
+            return -1;
+        }
+        if (max_rss_kb > result->max_rss_kb)
+            result->max_rss_kb = max_rss_kb;
+    }
+
+    qsort(times, repeat, sizeof(double), runner_compare_doubles);
+    result->median_ms = repeat % 2 ? times[repeat / 2] : (times[repeat / 2 - 1] + times[repeat / 2]) / 2;
+    // Nearest rank, which is the slowest run below 20 runs
+    result->p95_ms = times[(int)ceil(0.95 * repeat) - 1];
+    free(times);
+    return 0;
+}
+
+static void runner_write_json(FILE *file, runner_result_T *results, int results_size)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < results_size; i++)
+    {
+        // One benchmark per line, which is what runner_read_baseline expects
+        fprintf(file, "    {\"name\": \"%s\", \"runs\": %d, \"median_ms\": %.3f, \"p95_ms\": %.3f, \"max_rss_kb\": %ld, \"allocations\": %ld, \"output\": \"%s\"}%s\n",
+                results[i].name,
+                results[i].runs,
+                results[i].median_ms,
+                results[i].p95_ms,
+                results[i].max_rss_kb,
+                results[i].allocations,
+                results[i].output,
+                i + 1 < results_size ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+static runner_result_T *runner_read_baseline(const char *filename, int *baseline_size)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    runner_result_T *baseline = NULL;
+    *baseline_size = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        runner_result_T result;
+        memset(&result, 0, sizeof(struct RUNNER_RESULT_STRUCT));
+        // Baselines saved before the output was recorded stop after the allocations
+        if (sscanf(line, " {\"name\": \"%127[^\"]\", \"runs\": %d, \"median_ms\": %lf, \"p95_ms\": %lf, \"max_rss_kb\": %ld, \"allocations\": %ld, \"output\": \"%16[0-9a-f]\"",
+                   result.name, &result.runs, &result.median_ms, &result.p95_ms, &result.max_rss_kb, &result.allocations, result.output) < 6)
+            continue;
+
+        baseline = realloc(baseline, (*baseline_size + 1) * sizeof(struct RUNNER_RESULT_STRUCT));
+        baseline[(*baseline_size)++] = result;
+    }
+
+    fclose(file);
+    return baseline;
+}
+
+static int runner_regressed(const char *name, const char *metric, int decimals, double baseline, double current, double threshold)
+{
+    double change = baseline > 0 ? (current - baseline) / baseline * 100 : 0;
+    int regressed = change > threshold;
+    fprintf(stderr, "  %-20s %-12s %14.*f -> %14.*f  %+7.1f%%%s\n",
+            name, metric, decimals, baseline, decimals, current, change, regressed ? "  REGRESSION" : "");
+    return regressed;
+}
+
+// Wall time, RSS and allocations may each grow by threshold percent before it counts as a regression, the output may not change
+static int runner_compare(runner_result_T *results, int results_size, runner_result_T *baseline, int baseline_size, double threshold)
+{
+    int regressions = 0;
+    fprintf(stderr, "Compared with the baseline, regression threshold %.1f%%:\n", threshold);
+    for (int i = 0; i < results_size; i++)
+    {
+        runner_result_T *previous = NULL;
+        for (int j = 0; j < baseline_size && !previous; j++)
+        {
+            if (strcmp(baseline[j].name, results[i].name) == 0)
+                previous = &baseline[j];
+        }
+
+        if (!previous)
+        {
+            fprintf(stderr, "  %-20s not in the baseline\n", results[i].name);
+            continue;
+        }
+
+        regressions += runner_regressed(results[i].name, "median_ms", 3, previous->median_ms, results[i].median_ms, threshold);
+        regressions += runner_regressed(results[i].name, "max_rss_kb", 0, previous->max_rss_kb, results[i].max_rss_kb, threshold);
+        regressions += runner_regressed(results[i].name, "allocations", 0, previous->allocations, results[i].allocations, threshold);
+
+        // A different result is never within the threshold
+        if (previous->output[0] && strcmp(previous->output, results[i].output) != 0)
+        {
+            fprintf(stderr, "  %-20s %-12s %14s -> %14s  OUTPUT CHANGED\n", results[i].name, "output", previous->output, results[i].output);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *blunt = "./blunt.out";
+    const char *baseline_filename = NULL;
+    const char *save_filename = NULL;
+    int repeat = 5;
+    double threshold = 10;
+
+    int first_script = 1;
+    for (; first_script < argc && strncmp(argv[first_script], "--", 2) == 0; first_script += 2)
+    {
+        if (first_script + 1 >= argc)
+        {
+            print_help();
+            return 1;
+        }
+
+        const char *value = argv[first_script + 1];
+        if (strcmp(argv[first_script], "--blunt") == 0)
+            blunt = value;
+        else if (strcmp(argv[first_script], "--repeat") == 0)
+            repeat = atoi(value);
+        else if (strcmp(argv[first_script], "--threshold") == 0)
+            threshold = atof(value);
+        else if (strcmp(argv[first_script], "--baseline") == 0)
+            baseline_filename = value;
+        else if (strcmp(argv[first_script], "--save") == 0)
+            save_filename = value;
+        else
+        {
+            print_help();
+            return 1;
+        }
+    }
+
+    if (first_script >= argc || repeat < 1)
+    {
+        print_help();
+        return 1;
+    }
+
+    int results_size = argc - first_script;
+    runner_result_T *results = calloc(results_size, sizeof(struct RUNNER_RESULT_STRUCT));
+    int failures = 0;
+    for (int i = 0; i < results_size; i++)
+    {
+        fprintf(stderr, "Running %s\n", argv[first_script + i]);
+        if (runner_bench(blunt, argv[first_script + i], repeat, &results[i]) != 0)
+            failures++;
+    }
+
+    runner_write_json(stdout, results, results_size);
+
+    if (save_filename)
+    {
+        FILE *file = fopen(save_filename, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Could not open file %s\n", save_filename);
+            return 1;
+        }
+        runner_write_json(file, results, results_size);
+        fclose(file);
+    }
+
+    int regressions = 0;
+    if (baseline_filename)
+    {
+        int baseline_size;
+        runner_result_T *baseline = runner_read_baseline(baseline_filename, &baseline_size);
+        if (baseline)
+        {
+            regressions = runner_compare(results, results_size, baseline, baseline_size, threshold);
+            free(baseline);
+        }
+        else
+        {
+            fprintf(stderr, "No baseline in %s, save one with make bench-baseline\n", baseline_filename);
+        }
+    }
+
+    free(results);
+    return failures || regressions ? 1 : 0;
+}
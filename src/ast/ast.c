@@ -1,4 +1,7 @@
 #include "../include/ast/AST.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/stats/stats.h"
 #include "../include/io/logger.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -114,6 +117,12 @@ size_t ast_get_size(AST_T *ast)
     case AST_DOT_DOT:
         size = sizeof(AST_DOT_DOT_T);
         break;
+    case AST_DOT_DOT_EXPRESSION:
+        size = sizeof(AST_DOT_DOT_EXPRESSION_T);
+        break;
+    case AST_RUNTIME_FUNCTION_DEFINITION:
+        size = sizeof(AST_RUNTIME_FUNCTION_DEFINITION_T);
+        break;
     default:
         size = sizeof(AST_T);
         break;
@@ -122,16 +131,33 @@ size_t ast_get_size(AST_T *ast)
     return size;
 }
 
+static AST_T *ast_allocate(int type);
+
 AST_T *init_ast(int type)
 {
-    AST_T *ast = calloc(1, sizeof(struct AST_STRUCT));
+    // --mem-stats counts the blocks of a node under its type
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_NODE + type;
+    AST_T *ast = ast_allocate(type);
+    heap_tag = tag;
+
+    if (stats_active)
+    {
+        stats_active->nodes[type]++;
+    }
+    return ast;
+}
+
+static AST_T *ast_allocate(int type)
+{
+    AST_T *ast = heap_calloc(1, sizeof(struct AST_STRUCT));
     ast->type = type;
 
     switch (type)
     {
     case AST_VARIABLE_DEFINITION:
     {
-        AST_VARIABLE_DEFINITION_T *variable_definition = calloc(1, sizeof(struct AST_VARIABLE_DEFINITION_STRUCT));
+        AST_VARIABLE_DEFINITION_T *variable_definition = heap_calloc(1, sizeof(struct AST_VARIABLE_DEFINITION_STRUCT));
         variable_definition->base = *ast;
         variable_definition->variable_definition_variable_name = NULL;
         variable_definition->variable_definition_value = NULL;
@@ -140,7 +166,7 @@ AST_T *init_ast(int type)
     }
     case AST_DOT_EXPRESSION:
     {
-        AST_DOT_EXPRESSION_T *dot_expression = calloc(1, sizeof(struct AST_DOT_EXPRESSION_STRUCT));
+        AST_DOT_EXPRESSION_T *dot_expression = heap_calloc(1, sizeof(struct AST_DOT_EXPRESSION_STRUCT));
         dot_expression->base = *ast;
         dot_expression->dot_expression_variable_name = NULL;
         dot_expression->dot_index = NULL;
@@ -148,14 +174,14 @@ AST_T *init_ast(int type)
     }
     case AST_VARIABLE:
     {
-        AST_VARIABLE_T *variable = calloc(1, sizeof(struct AST_VARIABLE_STRUCT));
+        AST_VARIABLE_T *variable = heap_calloc(1, sizeof(struct AST_VARIABLE_STRUCT));
         variable->base = *ast;
         variable->variable_name = NULL;
         return (AST_T *)variable;
     }
     case AST_VARIABLE_ASSIGNMENT:
     {
-        AST_VARIABLE_ASSIGNMENT_T *variable_assignment = calloc(1, sizeof(struct AST_VARIABLE_ASSIGNMENT_STRUCT));
+        AST_VARIABLE_ASSIGNMENT_T *variable_assignment = heap_calloc(1, sizeof(struct AST_VARIABLE_ASSIGNMENT_STRUCT));
         variable_assignment->base = *ast;
         variable_assignment->variable_assignment_name = NULL;
         variable_assignment->variable_assignment_value = NULL;
@@ -163,18 +189,19 @@ AST_T *init_ast(int type)
     }
     case AST_FUNCTION_DEFINITION:
     {
-        AST_FUNCTION_DEFINITION_T *function_definition = calloc(1, sizeof(struct AST_FUNCTION_DEFINITION_STRUCT));
+        AST_FUNCTION_DEFINITION_T *function_definition = heap_calloc(1, sizeof(struct AST_FUNCTION_DEFINITION_STRUCT));
         function_definition->base = *ast;
         function_definition->function_definition_name = NULL;
         function_definition->function_definition_arguments = NULL;
         function_definition->function_definition_arguments_size = 0;
         function_definition->function_definition_body = NULL;
+        function_definition->function_definition_pure = 0;
 
         return (AST_T *)function_definition;
     }
     case AST_RUNTIME_FUNCTION_DEFINITION:
     {
-        AST_RUNTIME_FUNCTION_DEFINITION_T *runtime_function_definition = calloc(1, sizeof(struct AST_RUNTIME_FUNCTION_DEFINITION_STRUCT));
+        AST_RUNTIME_FUNCTION_DEFINITION_T *runtime_function_definition = heap_calloc(1, sizeof(struct AST_RUNTIME_FUNCTION_DEFINITION_STRUCT));
         runtime_function_definition->base = *ast;
         runtime_function_definition->runtime_function_definition_name = NULL;
         runtime_function_definition->runtime_function_definition_body = NULL;
@@ -184,7 +211,7 @@ AST_T *init_ast(int type)
     }
     case AST_FUNCTION_CALL:
     {
-        AST_FUNCTION_CALL_T *function_call = calloc(1, sizeof(struct AST_FUNCTION_CALL_STRUCT));
+        AST_FUNCTION_CALL_T *function_call = heap_calloc(1, sizeof(struct AST_FUNCTION_CALL_STRUCT));
         function_call->base = *ast;
         function_call->function_call_name = NULL;
         function_call->function_call_arguments = NULL;
@@ -193,36 +220,52 @@ AST_T *init_ast(int type)
     }
     case AST_RETURN:
     {
-        AST_RETURN_T *return_node = calloc(1, sizeof(struct AST_RETURN_STRUCT));
+        AST_RETURN_T *return_node = heap_calloc(1, sizeof(struct AST_RETURN_STRUCT));
         return_node->base = *ast;
         return_node->return_value = NULL;
+        return_node->return_tail_call = 0;
         return (AST_T *)return_node;
     }
     case AST_STRING:
     {
-        AST_STRING_T *string_node = calloc(1, sizeof(struct AST_STRING_STRUCT));
+        AST_STRING_T *string_node = heap_calloc(1, sizeof(struct AST_STRING_STRUCT));
         string_node->base = *ast;
         string_node->string_value = NULL;
+        string_node->string_rope_left = NULL;
+        string_node->string_rope_right = NULL;
+        string_node->string_length = 0;
+        string_node->string_hash = 0;
+        string_node->string_hash_computed = 0;
+        string_node->string_slice_parent = NULL;
         return (AST_T *)string_node;
     }
     case AST_INT:
     {
-        AST_INT_T *int_node = calloc(1, sizeof(struct AST_INT_STRUCT));
+        AST_INT_T *int_node = heap_calloc(1, sizeof(struct AST_INT_STRUCT));
         int_node->base = *ast;
         int_node->int_value = 0;
         return (AST_T *)int_node;
     }
     case AST_ARRAY:
     {
-        AST_ARRAY_T *array_node = calloc(1, sizeof(struct AST_ARRAY_STRUCT));
+        AST_ARRAY_T *array_node = heap_calloc(1, sizeof(struct AST_ARRAY_STRUCT));
         array_node->base = *ast;
         array_node->array_value = NULL;
         array_node->array_size = 0;
+        array_node->array_runs = NULL;
+        array_node->array_runs_size = 0;
+        array_node->array_runs_capacity = 0;
+        array_node->array_ints = NULL;
+        array_node->array_fields = NULL;
+        array_node->array_mapped = 0;
+        array_node->array_slice_parent = NULL;
+        array_node->array_shared = 0;
+        array_node->array_literal = 0;
         return (AST_T *)array_node;
     }
     case AST_COMPOUND:
     {
-        AST_COMPOUND_T *compound_node = calloc(1, sizeof(struct AST_COMPOUND_STRUCT));
+        AST_COMPOUND_T *compound_node = heap_calloc(1, sizeof(struct AST_COMPOUND_STRUCT));
         compound_node->base = *ast;
         compound_node->compound_value = NULL;
         compound_node->compound_size = 0;
@@ -230,7 +273,7 @@ AST_T *init_ast(int type)
     }
     case AST_IF:
     {
-        AST_IF_T *if_branch_node = calloc(1, sizeof(struct AST_IF_STRUCT));
+        AST_IF_T *if_branch_node = heap_calloc(1, sizeof(struct AST_IF_STRUCT));
         if_branch_node->base = *ast;
         if_branch_node->if_body = NULL;
         if_branch_node->if_condition = NULL;
@@ -238,14 +281,14 @@ AST_T *init_ast(int type)
     }
     case AST_ELSE:
     {
-        AST_ELSE_T *else_node = calloc(1, sizeof(struct AST_ELSE_STRUCT));
+        AST_ELSE_T *else_node = heap_calloc(1, sizeof(struct AST_ELSE_STRUCT));
         else_node->base = *ast;
         else_node->else_body = NULL;
         return (AST_T *)else_node;
     }
     case AST_ELSEIF:
     {
-        AST_ELSEIF_T *elseif_node = calloc(1, sizeof(struct AST_ELSEIF_STRUCT));
+        AST_ELSEIF_T *elseif_node = heap_calloc(1, sizeof(struct AST_ELSEIF_STRUCT));
         elseif_node->base = *ast;
         elseif_node->elseif_body = NULL;
         elseif_node->elseif_condition = NULL;
@@ -253,7 +296,7 @@ AST_T *init_ast(int type)
     }
     case AST_IF_ELSE_BRANCH:
     {
-        AST_IF_ELSE_BRANCH_T *if_else_branch_node = calloc(1, sizeof(struct AST_IF_ELSE_BRANCH_STRUCT));
+        AST_IF_ELSE_BRANCH_T *if_else_branch_node = heap_calloc(1, sizeof(struct AST_IF_ELSE_BRANCH_STRUCT));
         if_else_branch_node->base = *ast;
         if_else_branch_node->if_else_compound_value = NULL;
         if_else_branch_node->if_else_compound_size = 0;
@@ -261,7 +304,7 @@ AST_T *init_ast(int type)
     }
     case AST_ADD_OP:
     {
-        AST_ADD_OP_T *add_node = calloc(1, sizeof(struct AST_ADD_OP_STRUCT));
+        AST_ADD_OP_T *add_node = heap_calloc(1, sizeof(struct AST_ADD_OP_STRUCT));
         add_node->base = *ast;
         add_node->left = NULL;
         add_node->right = NULL;
@@ -269,7 +312,7 @@ AST_T *init_ast(int type)
     }
     case AST_SUB_OP:
     {
-        AST_SUB_OP_T *sub_node = calloc(1, sizeof(struct AST_SUB_OP_STRUCT));
+        AST_SUB_OP_T *sub_node = heap_calloc(1, sizeof(struct AST_SUB_OP_STRUCT));
         sub_node->base = *ast;
         sub_node->left = NULL;
         sub_node->right = NULL;
@@ -277,7 +320,7 @@ AST_T *init_ast(int type)
     }
     case AST_MUL_OP:
     {
-        AST_MUL_OP_T *mul_node = calloc(1, sizeof(struct AST_MUL_OP_STRUCT));
+        AST_MUL_OP_T *mul_node = heap_calloc(1, sizeof(struct AST_MUL_OP_STRUCT));
         mul_node->base = *ast;
         mul_node->left = NULL;
         mul_node->right = NULL;
@@ -285,7 +328,7 @@ AST_T *init_ast(int type)
     }
     case AST_DIV_OP:
     {
-        AST_DIV_OP_T *div_node = calloc(1, sizeof(struct AST_DIV_OP_STRUCT));
+        AST_DIV_OP_T *div_node = heap_calloc(1, sizeof(struct AST_DIV_OP_STRUCT));
         div_node->base = *ast;
         div_node->left = NULL;
         div_node->right = NULL;
@@ -293,7 +336,7 @@ AST_T *init_ast(int type)
     }
     case AST_GT_OP:
     {
-        AST_GT_OP_T *gt_node = calloc(1, sizeof(struct AST_GT_OP_STRUCT));
+        AST_GT_OP_T *gt_node = heap_calloc(1, sizeof(struct AST_GT_OP_STRUCT));
         gt_node->base = *ast;
         gt_node->left = NULL;
         gt_node->right = NULL;
@@ -301,7 +344,7 @@ AST_T *init_ast(int type)
     }
     case AST_LT_OP:
     {
-        AST_LT_OP_T *lt_node = calloc(1, sizeof(struct AST_LT_OP_STRUCT));
+        AST_LT_OP_T *lt_node = heap_calloc(1, sizeof(struct AST_LT_OP_STRUCT));
         lt_node->base = *ast;
         lt_node->left = NULL;
         lt_node->right = NULL;
@@ -309,7 +352,7 @@ AST_T *init_ast(int type)
     }
     case AST_GTE_OP:
     {
-        AST_GTE_OP_T *gte_node = calloc(1, sizeof(struct AST_GTE_OP_STRUCT));
+        AST_GTE_OP_T *gte_node = heap_calloc(1, sizeof(struct AST_GTE_OP_STRUCT));
         gte_node->base = *ast;
         gte_node->left = NULL;
         gte_node->right = NULL;
@@ -317,7 +360,7 @@ AST_T *init_ast(int type)
     }
     case AST_LTE_OP:
     {
-        AST_LTE_OP_T *lte_node = calloc(1, sizeof(struct AST_LTE_OP_STRUCT));
+        AST_LTE_OP_T *lte_node = heap_calloc(1, sizeof(struct AST_LTE_OP_STRUCT));
         lte_node->base = *ast;
         lte_node->left = NULL;
         lte_node->right = NULL;
@@ -326,7 +369,7 @@ AST_T *init_ast(int type)
 
     case AST_AND_OP:
     {
-        AST_AND_OP_T *and_node = calloc(1, sizeof(struct AST_AND_OP_STRUCT));
+        AST_AND_OP_T *and_node = heap_calloc(1, sizeof(struct AST_AND_OP_STRUCT));
         and_node->base = *ast;
         and_node->left = NULL;
         and_node->right = NULL;
@@ -334,7 +377,7 @@ AST_T *init_ast(int type)
     }
     case AST_OR_OP:
     {
-        AST_OR_OP_T *or_node = calloc(1, sizeof(struct AST_OR_OP_STRUCT));
+        AST_OR_OP_T *or_node = heap_calloc(1, sizeof(struct AST_OR_OP_STRUCT));
         or_node->base = *ast;
         or_node->left = NULL;
         or_node->right = NULL;
@@ -342,7 +385,7 @@ AST_T *init_ast(int type)
     }
     case AST_EQUAL_OP:
     {
-        AST_EQUAL_OP_T *equal_node = calloc(1, sizeof(struct AST_EQUAL_OP_STRUCT));
+        AST_EQUAL_OP_T *equal_node = heap_calloc(1, sizeof(struct AST_EQUAL_OP_STRUCT));
         equal_node->base = *ast;
         equal_node->left = NULL;
         equal_node->right = NULL;
@@ -350,51 +393,53 @@ AST_T *init_ast(int type)
     }
     case AST_NOT:
     {
-        AST_NOT_T *not_node = calloc(1, sizeof(struct AST_NOT_STRUCT));
+        AST_NOT_T *not_node = heap_calloc(1, sizeof(struct AST_NOT_STRUCT));
         not_node->base = *ast;
         not_node->not_expression = NULL;
         return (AST_T *)not_node;
     }
     case AST_NESTED_EXPRESSION:
     {
-        AST_NESTED_EXPRESSION_T *nested_expression_node = calloc(1, sizeof(struct AST_NESTED_EXPRESSION_STRUCT));
+        AST_NESTED_EXPRESSION_T *nested_expression_node = heap_calloc(1, sizeof(struct AST_NESTED_EXPRESSION_STRUCT));
         nested_expression_node->base = *ast;
         nested_expression_node->nested_expression = NULL;
         return (AST_T *)nested_expression_node;
     }
     case AST_VARIABLE_COUNT:
     {
-        AST_VARIABLE_COUNT_T *variable_count_node = calloc(1, sizeof(struct AST_VARIABLE_COUNT_STRUCT));
+        AST_VARIABLE_COUNT_T *variable_count_node = heap_calloc(1, sizeof(struct AST_VARIABLE_COUNT_STRUCT));
         variable_count_node->base = *ast;
         variable_count_node->variable_count_value = 0;
         return (AST_T *)variable_count_node;
     }
     case AST_FOR_LOOP:
     {
-        AST_FOR_LOOP_T *for_loop_node = calloc(1, sizeof(struct AST_FOR_LOOP_STRUCT));
+        AST_FOR_LOOP_T *for_loop_node = heap_calloc(1, sizeof(struct AST_FOR_LOOP_STRUCT));
         for_loop_node->base = *ast;
         for_loop_node->for_loop_increment = NULL;
         for_loop_node->for_loop_condition = NULL;
         for_loop_node->for_loop_variable = NULL;
         for_loop_node->for_loop_body = NULL;
+        for_loop_node->for_loop_parallel = 0;
+        for_loop_node->for_loop_lines = NULL;
         return (AST_T *)for_loop_node;
     }
     case AST_SAVE:
     {
-        AST_SAVE_T *save_node = calloc(1, sizeof(struct AST_SAVE_STRUCT));
+        AST_SAVE_T *save_node = heap_calloc(1, sizeof(struct AST_SAVE_STRUCT));
         save_node->base = *ast;
         save_node->save_value = NULL;
         return (AST_T *)save_node;
     }
     case AST_DOT_DOT:
     {
-        AST_DOT_DOT_T *dot_dot_node = calloc(1, sizeof(struct AST_DOT_DOT_STRUCT));
+        AST_DOT_DOT_T *dot_dot_node = heap_calloc(1, sizeof(struct AST_DOT_DOT_STRUCT));
         dot_dot_node->base = *ast;
         return (AST_T *)dot_dot_node;
     }
     case AST_DOT_DOT_EXPRESSION:
     {
-        AST_DOT_DOT_EXPRESSION_T *dot_dot_expression_node = calloc(1, sizeof(struct AST_DOT_DOT_EXPRESSION_STRUCT));
+        AST_DOT_DOT_EXPRESSION_T *dot_dot_expression_node = heap_calloc(1, sizeof(struct AST_DOT_DOT_EXPRESSION_STRUCT));
         dot_dot_expression_node->base = *ast;
         dot_dot_expression_node->dot_dot_first_index = NULL;
         dot_dot_expression_node->dot_dot_last_index = NULL;
@@ -515,6 +560,11 @@ void ast_print(AST_T *node, int indent)
         print_indent(indent + 1);
         AST_FUNCTION_DEFINITION_T *function_definition = (AST_FUNCTION_DEFINITION_T *)node;
         LOG_PRINT("Name: %s\n", function_definition->function_definition_name);
+        if (function_definition->function_definition_pure)
+        {
+            print_indent(indent + 1);
+            LOG_PRINT("Pure\n");
+        }
         for (size_t i = 0; i < function_definition->function_definition_arguments_size; i++)
             ast_print((AST_VARIABLE_DEFINITION_T *)(function_definition->function_definition_arguments[i]), indent + 1);
         ast_print(function_definition->function_definition_body, indent + 1);
@@ -537,11 +587,16 @@ void ast_print(AST_T *node, int indent)
             ast_print(((AST_FUNCTION_CALL_T *)node)->function_call_arguments[i], indent + 1);
         break;
     case AST_RETURN:
+        if (((AST_RETURN_T *)node)->return_tail_call)
+        {
+            print_indent(indent + 1);
+            LOG_PRINT("Tail call\n");
+        }
         ast_print(((AST_RETURN_T *)node)->return_value, indent + 1);
         break;
     case AST_STRING:
         print_indent(indent + 1);
-        LOG_PRINT("Value: %s\n", ((AST_STRING_T *)node)->string_value);
+        LOG_PRINT("Value: %.*s\n", (int)ast_string_length((AST_STRING_T *)node), ast_string_value((AST_STRING_T *)node));
         break;
     case AST_INT:
         print_indent(indent + 1);
@@ -549,7 +604,7 @@ void ast_print(AST_T *node, int indent)
         break;
     case AST_ARRAY:
         for (size_t i = 0; i < ((AST_ARRAY_T *)node)->array_size; i++)
-            ast_print(((AST_ARRAY_T *)node)->array_value[i], indent + 1);
+            ast_print(ast_array_get((AST_ARRAY_T *)node, i), indent + 1);
         break;
     case AST_VARIABLE_ASSIGNMENT:
         print_indent(indent + 1);
@@ -601,7 +656,13 @@ void ast_print(AST_T *node, int indent)
         ast_print(((AST_DOT_EXPRESSION_T *)node)->dot_index, indent + 1);
         break;
     case AST_FOR_LOOP:
+        if (((AST_FOR_LOOP_T *)node)->for_loop_parallel)
+        {
+            print_indent(indent + 1);
+            LOG_PRINT("Parallel\n");
+        }
         ast_print(((AST_FOR_LOOP_T *)node)->for_loop_variable, indent + 1);
+        ast_print(((AST_FOR_LOOP_T *)node)->for_loop_lines, indent + 1);
         ast_print(((AST_FOR_LOOP_T *)node)->for_loop_condition, indent + 1);
         ast_print(((AST_FOR_LOOP_T *)node)->for_loop_increment, indent + 1);
         ast_print(((AST_FOR_LOOP_T *)node)->for_loop_body, indent + 1);
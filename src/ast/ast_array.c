@@ -0,0 +1,469 @@
+#include "../include/ast/AST.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <string.h>
+
+// The ints of a mapped array are the file, so they cannot be turned into anything else
+static void ast_array_check_mapped_value(AST_T *value)
+{
+    if (value->type != AST_INT)
+    {
+        log_error("Arrays mapped to a file can only hold ints, got %s\n", ast_type_to_string(value->type));
+        error_exit(1);
+    }
+}
+
+AST_ARRAY_T *init_ast_array_filled(size_t size, AST_T *value)
+{
+    AST_ARRAY_T *array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    array->array_size = size;
+    array->array_runs_capacity = 4;
+    array->array_runs = heap_calloc(array->array_runs_capacity, sizeof(AST_ARRAY_RUN_T));
+    array->array_runs[0].run_start = 0;
+    array->array_runs[0].run_value = value;
+    array->array_runs_size = 1;
+
+    return array;
+}
+
+void ast_array_fill(AST_ARRAY_T *array, AST_T *value)
+{
+    if (array->array_mapped)
+    {
+        ast_array_check_mapped_value(value);
+        for (size_t i = 0; i < array->array_size; i++)
+        {
+            array->array_ints[i] = ((AST_INT_T *)value)->int_value;
+        }
+        return;
+    }
+
+    // Buffers shared with slices stay alive for them
+    if (!array->array_shared)
+    {
+        heap_free(array->array_value);
+        heap_free(array->array_ints);
+        heap_free(array->array_fields);
+    }
+    array->array_value = NULL;
+    array->array_ints = NULL;
+    array->array_fields = NULL;
+    array->array_slice_parent = NULL;
+    array->array_shared = 0;
+
+    if (!array->array_runs)
+    {
+        array->array_runs_capacity = 4;
+        array->array_runs = heap_calloc(array->array_runs_capacity, sizeof(AST_ARRAY_RUN_T));
+    }
+    array->array_runs[0].run_start = 0;
+    array->array_runs[0].run_value = value;
+    array->array_runs_size = 1;
+}
+
+// Index of the run holding the element at index
+static size_t ast_array_find_run(AST_ARRAY_T *array, size_t index)
+{
+    size_t low = 0;
+    size_t high = array->array_runs_size - 1;
+    while (low < high)
+    {
+        size_t middle = (low + high + 1) / 2;
+        if (array->array_runs[middle].run_start <= index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+
+    return low;
+}
+
+size_t ast_array_run_end(AST_ARRAY_T *array, size_t run)
+{
+    return run + 1 < array->array_runs_size ? array->array_runs[run + 1].run_start : array->array_size;
+}
+
+static AST_T *ast_array_box_int(int32_t value)
+{
+    AST_INT_T *element = (AST_INT_T *)init_ast(AST_INT);
+    element->int_value = value;
+    return (AST_T *)element;
+}
+
+static AST_T *ast_array_box_field(AST_ARRAY_FIELD_T *field)
+{
+    return (AST_T *)init_ast_string(field->field_value, field->field_length);
+}
+
+AST_T *ast_array_get(AST_ARRAY_T *array, size_t index)
+{
+    if (array->array_ints)
+    {
+        return ast_array_box_int(array->array_ints[index]);
+    }
+
+    if (array->array_fields)
+    {
+        return ast_array_box_field(&array->array_fields[index]);
+    }
+
+    if (array->array_runs)
+    {
+        return array->array_runs[ast_array_find_run(array, index)].run_value;
+    }
+
+    return array->array_value[index];
+}
+
+// Expands the runs into one slot per element, packed or boxed
+static void ast_array_expand_runs(AST_ARRAY_T *array, int packed)
+{
+    LOG_PRINT("Materializing array of %lu elements from %lu runs\n", array->array_size, array->array_runs_size);
+
+    size_t size = array->array_size ? array->array_size : 1;
+    if (packed)
+    {
+        array->array_ints = heap_calloc(size, sizeof(int32_t));
+    }
+    else
+    {
+        array->array_value = heap_calloc(size, sizeof(struct AST_STRUCT *));
+    }
+
+    for (size_t run = 0; run < array->array_runs_size; run++)
+    {
+        size_t end = ast_array_run_end(array, run);
+        AST_T *value = array->array_runs[run].run_value;
+        for (size_t i = array->array_runs[run].run_start; i < end; i++)
+        {
+            if (packed)
+            {
+                array->array_ints[i] = ((AST_INT_T *)value)->int_value;
+            }
+            else
+            {
+                array->array_value[i] = value;
+            }
+        }
+    }
+
+    heap_free(array->array_runs);
+    array->array_runs = NULL;
+    array->array_runs_size = 0;
+    array->array_runs_capacity = 0;
+}
+
+void ast_array_materialize(AST_ARRAY_T *array)
+{
+    if (!array->array_runs)
+    {
+        return;
+    }
+
+    int packed = 1;
+    for (size_t run = 0; run < array->array_runs_size && packed; run++)
+    {
+        packed = array->array_runs[run].run_value->type == AST_INT;
+    }
+
+    ast_array_expand_runs(array, packed);
+}
+
+int ast_array_pack(AST_ARRAY_T *array)
+{
+    if (array->array_ints)
+    {
+        return 1;
+    }
+
+    // Runs and fields are already compact
+    if (array->array_runs || array->array_fields || array->array_size == 0)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < array->array_size; i++)
+    {
+        if (array->array_value[i]->type != AST_INT)
+        {
+            return 0;
+        }
+    }
+
+    LOG_PRINT("Packing array of %lu ints\n", array->array_size);
+
+    array->array_ints = heap_calloc(array->array_size, sizeof(int32_t));
+    for (size_t i = 0; i < array->array_size; i++)
+    {
+        array->array_ints[i] = ((AST_INT_T *)array->array_value[i])->int_value;
+    }
+
+    // Slices keep pointing into the old elements, so they are only freed when nothing shares them
+    if (!array->array_shared)
+    {
+        heap_free(array->array_value);
+    }
+    array->array_value = NULL;
+    array->array_slice_parent = NULL;
+    array->array_shared = 0;
+
+    return 1;
+}
+
+int32_t *ast_array_ints(AST_ARRAY_T *array, int writable)
+{
+    ast_array_materialize(array);
+    if (!ast_array_pack(array))
+    {
+        return NULL;
+    }
+
+    if (writable && array->array_shared)
+    {
+        LOG_PRINT("Copying shared packed array before writing it\n");
+        int32_t *elements = heap_calloc(array->array_size, sizeof(int32_t));
+        memcpy(elements, array->array_ints, array->array_size * sizeof(int32_t));
+        array->array_ints = elements;
+        array->array_slice_parent = NULL;
+        array->array_shared = 0;
+    }
+
+    return array->array_ints;
+}
+
+void ast_array_box(AST_ARRAY_T *array)
+{
+    if (array->array_runs)
+    {
+        ast_array_expand_runs(array, 0);
+        return;
+    }
+
+    if (!array->array_ints && !array->array_fields)
+    {
+        return;
+    }
+
+    if (array->array_mapped)
+    {
+        log_error("Arrays mapped to a file can only hold ints\n");
+        error_exit(1);
+    }
+
+    LOG_PRINT("Boxing packed array of %lu elements\n", array->array_size);
+
+    array->array_value = heap_calloc(array->array_size ? array->array_size : 1, sizeof(struct AST_STRUCT *));
+    for (size_t i = 0; i < array->array_size; i++)
+    {
+        array->array_value[i] = array->array_ints ? ast_array_box_int(array->array_ints[i]) : ast_array_box_field(&array->array_fields[i]);
+    }
+
+    // The boxed elements are a private copy, so the array no longer shares anything
+    if (!array->array_shared)
+    {
+        heap_free(array->array_ints);
+        heap_free(array->array_fields);
+    }
+    array->array_ints = NULL;
+    array->array_fields = NULL;
+    array->array_slice_parent = NULL;
+    array->array_shared = 0;
+}
+
+void ast_array_make_private(AST_ARRAY_T *array)
+{
+    if (array->array_mapped)
+    {
+        return;
+    }
+
+    ast_array_box(array);
+
+    if (array->array_shared)
+    {
+        LOG_PRINT("Copying shared array elements before making them private\n");
+        AST_T **elements = heap_calloc(array->array_size ? array->array_size : 1, sizeof(struct AST_STRUCT *));
+        memcpy(elements, array->array_value, array->array_size * sizeof(struct AST_STRUCT *));
+        array->array_value = elements;
+        array->array_slice_parent = NULL;
+        array->array_shared = 0;
+    }
+}
+
+AST_ARRAY_T *ast_array_slice(AST_ARRAY_T *array, size_t first, size_t size)
+{
+    if (array->array_runs)
+    {
+        // Copy the runs covering the slice, which is proportional to the runs and not to the elements
+        AST_ARRAY_T *slice = init_ast_array_filled(size, ast_array_get(array, first));
+        if (size == 0)
+        {
+            return slice;
+        }
+
+        size_t last_run = ast_array_find_run(array, first + size - 1);
+        for (size_t run = ast_array_find_run(array, first) + 1; run <= last_run; run++)
+        {
+            if (slice->array_runs_size == slice->array_runs_capacity)
+            {
+                slice->array_runs_capacity *= 2;
+                slice->array_runs = heap_realloc(slice->array_runs, slice->array_runs_capacity * sizeof(AST_ARRAY_RUN_T));
+            }
+            slice->array_runs[slice->array_runs_size].run_start = array->array_runs[run].run_start - first;
+            slice->array_runs[slice->array_runs_size].run_value = array->array_runs[run].run_value;
+            slice->array_runs_size++;
+        }
+
+        return slice;
+    }
+
+    AST_ARRAY_T *slice = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    if (array->array_ints)
+    {
+        slice->array_ints = array->array_ints + first;
+    }
+    else if (array->array_fields)
+    {
+        slice->array_fields = array->array_fields + first;
+    }
+    else
+    {
+        slice->array_value = array->array_value + first;
+    }
+    slice->array_size = size;
+    slice->array_slice_parent = array->array_slice_parent ? array->array_slice_parent : array;
+
+    // Both sides now have to copy before writing, except a mapped array, whose writes belong to its file
+    if (!array->array_mapped)
+    {
+        array->array_shared = 1;
+    }
+    slice->array_shared = 1;
+
+    return slice;
+}
+
+// Replaces the run at index run with the given runs, then merges equal neighbours around them
+static void ast_array_replace_run(AST_ARRAY_T *array, size_t run, AST_ARRAY_RUN_T *runs, size_t runs_size)
+{
+    size_t needed = array->array_runs_size - 1 + runs_size;
+    if (needed > array->array_runs_capacity)
+    {
+        while (array->array_runs_capacity < needed)
+        {
+            array->array_runs_capacity *= 2;
+        }
+        array->array_runs = heap_realloc(array->array_runs, array->array_runs_capacity * sizeof(AST_ARRAY_RUN_T));
+    }
+
+    memmove(&array->array_runs[run + runs_size],
+            &array->array_runs[run + 1],
+            (array->array_runs_size - run - 1) * sizeof(AST_ARRAY_RUN_T));
+    memcpy(&array->array_runs[run], runs, runs_size * sizeof(AST_ARRAY_RUN_T));
+    array->array_runs_size = needed;
+
+    size_t first = run > 0 ? run - 1 : 0;
+    size_t last = run + runs_size;
+    for (size_t i = first; i < last && i + 1 < array->array_runs_size;)
+    {
+        if (array->array_runs[i].run_value == array->array_runs[i + 1].run_value)
+        {
+            memmove(&array->array_runs[i + 1],
+                    &array->array_runs[i + 2],
+                    (array->array_runs_size - i - 2) * sizeof(AST_ARRAY_RUN_T));
+            array->array_runs_size--;
+            last--;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+AST_T *ast_array_set(AST_ARRAY_T *array, size_t index, AST_T *value)
+{
+    if (array->array_runs)
+    {
+        size_t run = ast_array_find_run(array, index);
+        if (array->array_runs[run].run_value == value)
+        {
+            return value;
+        }
+
+        // Split the run into the part before the element, the element itself and the part after it
+        size_t start = array->array_runs[run].run_start;
+        size_t end = ast_array_run_end(array, run);
+        AST_ARRAY_RUN_T runs[3];
+        size_t runs_size = 0;
+        if (start < index)
+        {
+            runs[runs_size++] = (AST_ARRAY_RUN_T){start, array->array_runs[run].run_value};
+        }
+        runs[runs_size++] = (AST_ARRAY_RUN_T){index, value};
+        if (index + 1 < end)
+        {
+            runs[runs_size++] = (AST_ARRAY_RUN_T){index + 1, array->array_runs[run].run_value};
+        }
+        ast_array_replace_run(array, run, runs, runs_size);
+
+        // A run takes twice the memory of an element, past that point a plain array is smaller
+        if (array->array_runs_size * 2 > array->array_size)
+        {
+            ast_array_materialize(array);
+        }
+
+        return value;
+    }
+
+    if (array->array_ints)
+    {
+        if (array->array_mapped)
+        {
+            ast_array_check_mapped_value(value);
+        }
+        if (value->type != AST_INT)
+        {
+            ast_array_box(array);
+            return ast_array_set(array, index, value);
+        }
+
+        if (array->array_shared)
+        {
+            LOG_PRINT("Copying shared packed array before writing index %lu\n", index);
+            int32_t *elements = heap_calloc(array->array_size ? array->array_size : 1, sizeof(int32_t));
+            memcpy(elements, array->array_ints, array->array_size * sizeof(int32_t));
+            array->array_ints = elements;
+            array->array_slice_parent = NULL;
+            array->array_shared = 0;
+        }
+
+        array->array_ints[index] = ((AST_INT_T *)value)->int_value;
+        return value;
+    }
+
+    // Fields only hold characters and the value may be a rope or not a string at all, so writes go to the boxed form
+    if (array->array_fields)
+    {
+        ast_array_box(array);
+        return ast_array_set(array, index, value);
+    }
+
+    if (array->array_shared)
+    {
+        LOG_PRINT("Copying shared array elements before writing index %lu\n", index);
+        AST_T **elements = heap_calloc(array->array_size ? array->array_size : 1, sizeof(struct AST_STRUCT *));
+        memcpy(elements, array->array_value, array->array_size * sizeof(struct AST_STRUCT *));
+        array->array_value = elements;
+        array->array_slice_parent = NULL;
+        array->array_shared = 0;
+    }
+
+    array->array_value[index] = value;
+    return value;
+}
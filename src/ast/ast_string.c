@@ -0,0 +1,134 @@
+#include "../include/ast/AST.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/io/logger.h"
+#include <string.h>
+
+AST_STRING_T *init_ast_string(char *value, size_t length)
+{
+    AST_STRING_T *string = (AST_STRING_T *)init_ast(AST_STRING);
+    string->string_value = value;
+    string->string_length = length;
+    return string;
+}
+
+AST_STRING_T *ast_string_concat(AST_STRING_T *left, AST_STRING_T *right)
+{
+    AST_STRING_T *rope = (AST_STRING_T *)init_ast(AST_STRING);
+    rope->string_rope_left = left;
+    rope->string_rope_right = right;
+    rope->string_length = ast_string_length(left) + ast_string_length(right);
+    return rope;
+}
+
+AST_STRING_T *ast_string_slice(AST_STRING_T *string, size_t first, size_t length)
+{
+    // Slices of slices point straight into the string that owns the characters
+    AST_STRING_T *owner = string->string_slice_parent ? string->string_slice_parent : string;
+
+    AST_STRING_T *slice = init_ast_string(ast_string_value(string) + first, length);
+    slice->string_slice_parent = owner;
+    return slice;
+}
+
+size_t ast_string_length(AST_STRING_T *string)
+{
+    return string->string_length;
+}
+
+unsigned long ast_string_hash(AST_STRING_T *string)
+{
+    if (string->string_hash_computed)
+        return string->string_hash;
+
+    const unsigned char *value = (const unsigned char *)ast_string_value(string);
+    unsigned long hash = 14695981039346656037UL;
+    for (size_t i = 0; i < string->string_length; i++)
+    {
+        hash ^= value[i];
+        hash *= 1099511628211UL;
+    }
+
+    string->string_hash = hash;
+    string->string_hash_computed = 1;
+    return hash;
+}
+
+int ast_string_equal(AST_STRING_T *left, AST_STRING_T *right)
+{
+    if (left == right)
+        return 1;
+
+    if (left->string_length != right->string_length)
+        return 0;
+
+    if (ast_string_hash(left) != ast_string_hash(right))
+        return 0;
+
+    return memcmp(left->string_value, right->string_value, left->string_length) == 0;
+}
+
+int ast_string_compare(AST_STRING_T *left, AST_STRING_T *right)
+{
+    size_t left_length = left->string_length;
+    size_t right_length = right->string_length;
+    size_t length = left_length < right_length ? left_length : right_length;
+
+    int result = memcmp(ast_string_value(left), ast_string_value(right), length);
+    if (result != 0)
+        return result;
+
+    return (left_length > right_length) - (left_length < right_length);
+}
+
+char *ast_string_value(AST_STRING_T *string)
+{
+    if (string->string_value)
+        return string->string_value;
+
+    LOG_PRINT("Flattening rope of length %lu\n", string->string_length);
+
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_STRING;
+    char *value = heap_calloc(string->string_length + 1, sizeof(char));
+    size_t offset = 0;
+
+    // Ropes built in loops are deeply left-leaning, so walk them with an explicit stack
+    size_t stack_capacity = 16;
+    size_t stack_size = 0;
+    AST_STRING_T **stack = heap_calloc(stack_capacity, sizeof(struct AST_STRING_STRUCT *));
+    stack[stack_size++] = string;
+
+    while (stack_size > 0)
+    {
+        AST_STRING_T *node = stack[--stack_size];
+
+        if (node->string_value)
+        {
+            size_t length = ast_string_length(node);
+            memcpy(value + offset, node->string_value, length);
+            offset += length;
+            continue;
+        }
+
+        if (stack_size + 2 > stack_capacity)
+        {
+            stack_capacity *= 2;
+            stack = heap_realloc(stack, stack_capacity * sizeof(struct AST_STRING_STRUCT *));
+        }
+
+        stack[stack_size++] = node->string_rope_right;
+        stack[stack_size++] = node->string_rope_left;
+    }
+
+    heap_free(stack);
+    heap_tag = tag;
+
+    value[offset] = '\0';
+    string->string_value = value;
+    // The pieces are no longer needed by this node
+    string->string_rope_left = NULL;
+    string->string_rope_right = NULL;
+
+    return value;
+}
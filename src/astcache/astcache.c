@@ -0,0 +1,515 @@
+#include "../include/astcache/astcache.h"
+#include "../include/heap/heap.h"
+#include "../include/io/logger.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char astcache_magic[8] = "BLUNTC\0";
+
+// Everything in a file starts at a multiple of this, so the nodes and pointer arrays keep their alignment
+#define ASTCACHE_ALIGNMENT 8
+
+// The file being built, with the nodes already written found again by address so a shared node is written once
+typedef struct ASTCACHE_WRITER_STRUCT
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+
+    uint64_t *relocations;
+    size_t relocations_size;
+    size_t relocations_capacity;
+
+    AST_T **nodes;
+    size_t *offsets;
+    size_t nodes_capacity;
+    size_t nodes_size;
+    uint64_t types[AST_NOOP + 1];
+
+    // Set on a node the file cannot hold, like an array built at runtime
+    int failed;
+} astcache_writer_T;
+
+static uint64_t astcache_hash(const char *bytes, size_t size)
+{
+    uint64_t hash = 14695981039346656037UL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static uint32_t astcache_layout()
+{
+    uint64_t hash = 14695981039346656037UL;
+    for (int type = 0; type <= AST_NOOP; type++)
+    {
+        AST_T node = {type};
+        hash ^= ast_get_size(&node);
+        hash *= 1099511628211UL;
+    }
+    hash ^= sizeof(void *);
+    hash *= 1099511628211UL;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+char *astcache_path(const char *filename)
+{
+    size_t length = strlen(filename);
+    char *path = heap_malloc(length + sizeof(ASTCACHE_SUFFIX));
+    memcpy(path, filename, length);
+    memcpy(path + length, ASTCACHE_SUFFIX, sizeof(ASTCACHE_SUFFIX));
+    return path;
+}
+
+// Makes room for size zeroed bytes at the end of the file and returns their offset
+static size_t astcache_reserve(astcache_writer_T *writer, size_t size, size_t alignment)
+{
+    size_t offset = (writer->size + alignment - 1) & ~(alignment - 1);
+    if (offset + size > writer->capacity)
+    {
+        size_t capacity = writer->capacity * 2;
+        while (offset + size > capacity)
+        {
+            capacity *= 2;
+        }
+        writer->data = heap_realloc(writer->data, capacity);
+        writer->capacity = capacity;
+    }
+    memset(writer->data + writer->size, 0, offset + size - writer->size);
+    writer->size = offset + size;
+    return offset;
+}
+
+// Points the pointer at slot to target, both offsets, and remembers the slot for the loader
+static void astcache_link(astcache_writer_T *writer, size_t slot, size_t target)
+{
+    uint64_t value = target;
+    memcpy(writer->data + slot, &value, sizeof(value));
+    if (!target)
+    {
+        return;
+    }
+
+    if (writer->relocations_size == writer->relocations_capacity)
+    {
+        writer->relocations_capacity *= 2;
+        writer->relocations = heap_realloc(writer->relocations, writer->relocations_capacity * sizeof(uint64_t));
+    }
+    writer->relocations[writer->relocations_size++] = slot;
+}
+
+static void astcache_write_bytes(astcache_writer_T *writer, size_t slot, const char *bytes, size_t size)
+{
+    if (!bytes)
+    {
+        astcache_link(writer, slot, 0);
+        return;
+    }
+
+    // Strings keep their NUL, names are read with strlen
+    size_t offset = astcache_reserve(writer, size + 1, 1);
+    memcpy(writer->data + offset, bytes, size);
+    astcache_link(writer, slot, offset);
+}
+
+static void astcache_write_name(astcache_writer_T *writer, size_t slot, const char *name)
+{
+    astcache_write_bytes(writer, slot, name, name ? strlen(name) : 0);
+}
+
+static size_t astcache_find(astcache_writer_T *writer, AST_T *node)
+{
+    size_t mask = writer->nodes_capacity - 1;
+    size_t i = ((uintptr_t)node >> 4) & mask;
+    while (writer->nodes[i] && writer->nodes[i] != node)
+    {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void astcache_remember(astcache_writer_T *writer, AST_T *node, size_t offset)
+{
+    // Half full at most, so that probing stays short
+    if ((writer->nodes_size + 1) * 2 > writer->nodes_capacity)
+    {
+        AST_T **nodes = writer->nodes;
+        size_t *offsets = writer->offsets;
+        size_t capacity = writer->nodes_capacity;
+        writer->nodes_capacity *= 2;
+        writer->nodes = heap_calloc(writer->nodes_capacity, sizeof(AST_T *));
+        writer->offsets = heap_malloc(writer->nodes_capacity * sizeof(size_t));
+        for (size_t i = 0; i < capacity; i++)
+        {
+            if (nodes[i])
+            {
+                size_t slot = astcache_find(writer, nodes[i]);
+                writer->nodes[slot] = nodes[i];
+                writer->offsets[slot] = offsets[i];
+            }
+        }
+        heap_free(nodes);
+        heap_free(offsets);
+    }
+
+    size_t slot = astcache_find(writer, node);
+    writer->nodes[slot] = node;
+    writer->offsets[slot] = offset;
+    writer->nodes_size++;
+}
+
+static size_t astcache_write_node(astcache_writer_T *writer, AST_T *node);
+
+static void astcache_write_child(astcache_writer_T *writer, size_t slot, void *child)
+{
+    size_t target = astcache_write_node(writer, child);
+    astcache_link(writer, slot, target);
+}
+
+static void astcache_write_children(astcache_writer_T *writer, size_t slot, void *children, size_t size)
+{
+    if (!children)
+    {
+        astcache_link(writer, slot, 0);
+        return;
+    }
+
+    // An empty list keeps a slot, the parser allocates one for it too
+    size_t offset = astcache_reserve(writer, (size ? size : 1) * sizeof(AST_T *), ASTCACHE_ALIGNMENT);
+    astcache_link(writer, slot, offset);
+    for (size_t i = 0; i < size; i++)
+    {
+        astcache_write_child(writer, offset + i * sizeof(AST_T *), ((AST_T **)children)[i]);
+    }
+}
+
+// Copies a node and writes what its pointers point to, replacing every pointer it holds with an offset
+static size_t astcache_write_node(astcache_writer_T *writer, AST_T *node)
+{
+    if (!node)
+    {
+        return 0;
+    }
+
+    size_t slot = astcache_find(writer, node);
+    if (writer->nodes[slot])
+    {
+        return writer->offsets[slot];
+    }
+
+    size_t size = ast_get_size(node);
+    size_t offset = astcache_reserve(writer, size, ASTCACHE_ALIGNMENT);
+    memcpy(writer->data + offset, node, size);
+    astcache_remember(writer, node, offset);
+    writer->types[node->type]++;
+
+#define FIELD(type, field) (offset + offsetof(type, field))
+
+    switch (node->type)
+    {
+    case AST_VARIABLE_DEFINITION:
+    {
+        AST_VARIABLE_DEFINITION_T *definition = (AST_VARIABLE_DEFINITION_T *)node;
+        astcache_write_name(writer, FIELD(AST_VARIABLE_DEFINITION_T, variable_definition_variable_name), definition->variable_definition_variable_name);
+        astcache_write_child(writer, FIELD(AST_VARIABLE_DEFINITION_T, variable_definition_value), definition->variable_definition_value);
+        astcache_write_child(writer, FIELD(AST_VARIABLE_DEFINITION_T, variable_definition_variable_count), definition->variable_definition_variable_count);
+        break;
+    }
+    case AST_VARIABLE:
+        astcache_write_name(writer, FIELD(AST_VARIABLE_T, variable_name), ((AST_VARIABLE_T *)node)->variable_name);
+        break;
+    case AST_VARIABLE_ASSIGNMENT:
+    {
+        AST_VARIABLE_ASSIGNMENT_T *assignment = (AST_VARIABLE_ASSIGNMENT_T *)node;
+        astcache_write_name(writer, FIELD(AST_VARIABLE_ASSIGNMENT_T, variable_assignment_name), assignment->variable_assignment_name);
+        astcache_write_child(writer, FIELD(AST_VARIABLE_ASSIGNMENT_T, variable_assignment_value), assignment->variable_assignment_value);
+        break;
+    }
+    case AST_FUNCTION_DEFINITION:
+    {
+        AST_FUNCTION_DEFINITION_T *definition = (AST_FUNCTION_DEFINITION_T *)node;
+        astcache_write_name(writer, FIELD(AST_FUNCTION_DEFINITION_T, function_definition_name), definition->function_definition_name);
+        astcache_write_child(writer, FIELD(AST_FUNCTION_DEFINITION_T, function_definition_body), definition->function_definition_body);
+        astcache_write_children(writer, FIELD(AST_FUNCTION_DEFINITION_T, function_definition_arguments), definition->function_definition_arguments, definition->function_definition_arguments_size);
+        break;
+    }
+    case AST_FUNCTION_CALL:
+    {
+        AST_FUNCTION_CALL_T *call = (AST_FUNCTION_CALL_T *)node;
+        astcache_write_name(writer, FIELD(AST_FUNCTION_CALL_T, function_call_name), call->function_call_name);
+        astcache_write_children(writer, FIELD(AST_FUNCTION_CALL_T, function_call_arguments), call->function_call_arguments, call->function_call_arguments_size);
+        break;
+    }
+    case AST_RETURN:
+        astcache_write_child(writer, FIELD(AST_RETURN_T, return_value), ((AST_RETURN_T *)node)->return_value);
+        break;
+    case AST_STRING:
+    {
+        // Ropes and slices are flattened into a string of their own
+        AST_STRING_T *string = (AST_STRING_T *)node;
+        char *value = ast_string_value(string);
+        astcache_write_bytes(writer, FIELD(AST_STRING_T, string_value), value, ast_string_length(string));
+        astcache_link(writer, FIELD(AST_STRING_T, string_rope_left), 0);
+        astcache_link(writer, FIELD(AST_STRING_T, string_rope_right), 0);
+        astcache_link(writer, FIELD(AST_STRING_T, string_slice_parent), 0);
+        break;
+    }
+    case AST_ARRAY:
+    {
+        // The parser only builds literals, the other forms come from running
+        AST_ARRAY_T *array = (AST_ARRAY_T *)node;
+        if (array->array_runs || array->array_ints || array->array_fields || array->array_mapped || array->array_slice_parent)
+        {
+            writer->failed = 1;
+            break;
+        }
+        astcache_write_children(writer, FIELD(AST_ARRAY_T, array_value), array->array_value, array->array_size);
+        break;
+    }
+    case AST_COMPOUND:
+    {
+        AST_COMPOUND_T *compound = (AST_COMPOUND_T *)node;
+        astcache_write_children(writer, FIELD(AST_COMPOUND_T, compound_value), compound->compound_value, compound->compound_size);
+        break;
+    }
+    case AST_ADD_OP:
+    case AST_SUB_OP:
+    case AST_MUL_OP:
+    case AST_DIV_OP:
+    case AST_GT_OP:
+    case AST_LT_OP:
+    case AST_GTE_OP:
+    case AST_LTE_OP:
+    case AST_AND_OP:
+    case AST_OR_OP:
+    case AST_EQUAL_OP:
+    {
+        // Every binary operation is laid out like an addition
+        AST_ADD_OP_T *operation = (AST_ADD_OP_T *)node;
+        astcache_write_child(writer, FIELD(AST_ADD_OP_T, left), operation->left);
+        astcache_write_child(writer, FIELD(AST_ADD_OP_T, right), operation->right);
+        break;
+    }
+    case AST_NOT:
+        astcache_write_child(writer, FIELD(AST_NOT_T, not_expression), ((AST_NOT_T *)node)->not_expression);
+        break;
+    case AST_NESTED_EXPRESSION:
+        astcache_write_child(writer, FIELD(AST_NESTED_EXPRESSION_T, nested_expression), ((AST_NESTED_EXPRESSION_T *)node)->nested_expression);
+        break;
+    case AST_IF:
+    {
+        AST_IF_T *branch = (AST_IF_T *)node;
+        astcache_write_child(writer, FIELD(AST_IF_T, if_condition), branch->if_condition);
+        astcache_write_child(writer, FIELD(AST_IF_T, if_body), branch->if_body);
+        break;
+    }
+    case AST_ELSE:
+        astcache_write_child(writer, FIELD(AST_ELSE_T, else_body), ((AST_ELSE_T *)node)->else_body);
+        break;
+    case AST_ELSEIF:
+    {
+        AST_ELSEIF_T *branch = (AST_ELSEIF_T *)node;
+        astcache_write_child(writer, FIELD(AST_ELSEIF_T, elseif_condition), branch->elseif_condition);
+        astcache_write_child(writer, FIELD(AST_ELSEIF_T, elseif_body), branch->elseif_body);
+        break;
+    }
+    case AST_IF_ELSE_BRANCH:
+    {
+        AST_IF_ELSE_BRANCH_T *branch = (AST_IF_ELSE_BRANCH_T *)node;
+        astcache_write_children(writer, FIELD(AST_IF_ELSE_BRANCH_T, if_else_compound_value), branch->if_else_compound_value, branch->if_else_compound_size);
+        break;
+    }
+    case AST_DOT_EXPRESSION:
+    {
+        AST_DOT_EXPRESSION_T *dot = (AST_DOT_EXPRESSION_T *)node;
+        astcache_write_name(writer, FIELD(AST_DOT_EXPRESSION_T, dot_expression_variable_name), dot->dot_expression_variable_name);
+        astcache_write_child(writer, FIELD(AST_DOT_EXPRESSION_T, dot_index), dot->dot_index);
+        break;
+    }
+    case AST_DOT_DOT_EXPRESSION:
+    {
+        AST_DOT_DOT_EXPRESSION_T *dot_dot = (AST_DOT_DOT_EXPRESSION_T *)node;
+        astcache_write_name(writer, FIELD(AST_DOT_DOT_EXPRESSION_T, dot_dot_expression_variable_name), dot_dot->dot_dot_expression_variable_name);
+        astcache_write_child(writer, FIELD(AST_DOT_DOT_EXPRESSION_T, dot_dot_first_index), dot_dot->dot_dot_first_index);
+        astcache_write_child(writer, FIELD(AST_DOT_DOT_EXPRESSION_T, dot_dot_last_index), dot_dot->dot_dot_last_index);
+        break;
+    }
+    case AST_FOR_LOOP:
+    {
+        AST_FOR_LOOP_T *loop = (AST_FOR_LOOP_T *)node;
+        astcache_write_child(writer, FIELD(AST_FOR_LOOP_T, for_loop_variable), loop->for_loop_variable);
+        astcache_write_child(writer, FIELD(AST_FOR_LOOP_T, for_loop_condition), loop->for_loop_condition);
+        astcache_write_child(writer, FIELD(AST_FOR_LOOP_T, for_loop_increment), loop->for_loop_increment);
+        astcache_write_child(writer, FIELD(AST_FOR_LOOP_T, for_loop_body), loop->for_loop_body);
+        astcache_write_child(writer, FIELD(AST_FOR_LOOP_T, for_loop_lines), loop->for_loop_lines);
+        break;
+    }
+    case AST_SAVE:
+        astcache_write_child(writer, FIELD(AST_SAVE_T, save_value), ((AST_SAVE_T *)node)->save_value);
+        break;
+    case AST_VARIABLE_COUNT:
+    case AST_INT:
+    case AST_DOT_DOT:
+    case AST_NOOP:
+        break;
+    default:
+        // Runtime function definitions only exist while running
+        writer->failed = 1;
+        break;
+    }
+
+#undef FIELD
+
+    return offset;
+}
+
+int astcache_write(const char *path, const char *source, size_t source_size, AST_T *root)
+{
+    astcache_writer_T writer = {0};
+    writer.capacity = 64 * 1024;
+    writer.data = heap_malloc(writer.capacity);
+    writer.relocations_capacity = 1024;
+    writer.relocations = heap_malloc(writer.relocations_capacity * sizeof(uint64_t));
+    writer.nodes_capacity = 1024;
+    writer.nodes = heap_calloc(writer.nodes_capacity, sizeof(AST_T *));
+    writer.offsets = heap_malloc(writer.nodes_capacity * sizeof(size_t));
+
+    // The header sits at offset 0, so no node ever gets the offset that stands for NULL
+    astcache_reserve(&writer, sizeof(astcache_header_T), ASTCACHE_ALIGNMENT);
+    size_t root_offset = astcache_write_node(&writer, root);
+
+    size_t relocations = astcache_reserve(&writer, writer.relocations_size * sizeof(uint64_t), ASTCACHE_ALIGNMENT);
+    memcpy(writer.data + relocations, writer.relocations, writer.relocations_size * sizeof(uint64_t));
+
+    astcache_header_T *header = (astcache_header_T *)writer.data;
+    memcpy(header->magic, astcache_magic, sizeof(header->magic));
+    header->version = ASTCACHE_VERSION;
+    header->layout = astcache_layout();
+    header->source_hash = astcache_hash(source, source_size);
+    header->source_size = source_size;
+    header->size = writer.size;
+    header->root = root_offset;
+    header->relocations = relocations;
+    header->relocations_size = writer.relocations_size;
+    memcpy(header->nodes, writer.types, sizeof(header->nodes));
+
+    int written = 0;
+    if (!writer.failed && root_offset)
+    {
+        // Written next to the file and renamed over it, so another run reading it sees the old file or the new one
+        char temporary[4096];
+        snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+        FILE *file = fopen(temporary, "wb");
+        if (file)
+        {
+            written = fwrite(writer.data, 1, writer.size, file) == writer.size;
+            written = fclose(file) == 0 && written;
+            written = written && rename(temporary, path) == 0;
+            if (!written)
+            {
+                unlink(temporary);
+            }
+        }
+    }
+    LOG_PRINT("%s the tree cache %s, %lu bytes\n", written ? "Wrote" : "Could not write", path, writer.size);
+
+    heap_free(writer.data);
+    heap_free(writer.relocations);
+    heap_free(writer.nodes);
+    heap_free(writer.offsets);
+    return written;
+}
+
+// Checks everything the loader trusts before it writes a single pointer
+static int astcache_valid(const char *data, size_t size, const char *source, size_t source_size)
+{
+    const astcache_header_T *header = (const astcache_header_T *)data;
+    if (size < sizeof(astcache_header_T) || memcmp(header->magic, astcache_magic, sizeof(header->magic)) != 0)
+    {
+        return 0;
+    }
+    if (header->version != ASTCACHE_VERSION || header->layout != astcache_layout() || header->size != size)
+    {
+        return 0;
+    }
+    if (header->source_size != source_size || header->source_hash != astcache_hash(source, source_size))
+    {
+        return 0;
+    }
+    if (header->root < sizeof(astcache_header_T) || header->root >= size || header->relocations > size ||
+        header->relocations_size > (size - header->relocations) / sizeof(uint64_t))
+    {
+        return 0;
+    }
+
+    const uint64_t *relocations = (const uint64_t *)(data + header->relocations);
+    for (uint64_t i = 0; i < header->relocations_size; i++)
+    {
+        uint64_t slot = relocations[i];
+        if (slot % sizeof(uint64_t) != 0 || slot > size - sizeof(uint64_t) || *(const uint64_t *)(data + slot) >= size)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+astcache_T *astcache_load(const char *path, const char *source, size_t source_size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat status;
+    char *data = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0)
+    {
+        // Private and writable, so the pointers can be fixed in place and strings can cache their hash
+        data = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    size_t size = status.st_size;
+    if (!astcache_valid(data, size, source, source_size))
+    {
+        LOG_PRINT("The tree cache %s is stale\n", path);
+        munmap(data, size);
+        return NULL;
+    }
+
+    astcache_header_T *header = (astcache_header_T *)data;
+    const uint64_t *relocations = (const uint64_t *)(data + header->relocations);
+    for (uint64_t i = 0; i < header->relocations_size; i++)
+    {
+        char **slot = (char **)(data + relocations[i]);
+        *slot = data + (uintptr_t)*slot;
+    }
+
+    astcache_T *cache = heap_calloc(1, sizeof(struct ASTCACHE_STRUCT));
+    cache->data = data;
+    cache->size = size;
+    cache->root = (AST_T *)(data + header->root);
+    cache->nodes = header->nodes;
+    LOG_PRINT("Loaded the tree cache %s, %lu bytes\n", path, size);
+    return cache;
+}
+
+void astcache_free(astcache_T *cache)
+{
+    munmap(cache->data, cache->size);
+    heap_free(cache);
+}
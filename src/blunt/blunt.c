@@ -0,0 +1,609 @@
+#include "../include/blunt/blunt.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include "../include/io/io.h"
+#include "../include/io/output.h"
+#include "../include/lexer/lexer.h"
+#include "../include/parser/parser.h"
+#include "../include/visitor/visitor.h"
+#include "../include/memo/memo.h"
+#include "../include/profile/profile.h"
+#include "../include/sample/sample.h"
+#include "../include/memstats/memstats.h"
+#include "../include/stats/stats.h"
+#include "../include/ast/AST.h"
+#include "../include/astcache/astcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct BLUNT_STRUCT
+{
+    // Everything below, except the interpreter itself and what a run allocates, is allocated from this heap
+    heap_T *heap;
+    // What a run allocates, emptied when the next run starts, NULL before the first one
+    heap_T *run_heap;
+    int logging;
+    int memo;
+    int profile;
+    int sampling;
+    int caching;
+    // Watches the heap from the moment it is turned on, so parsing is recorded too
+    memstats_T *memstats;
+    // Phase timings and counters for --stats, NULL when they are off
+    stats_T *stats;
+    // What the last run printed, when it is kept instead of going to stdout
+    output_capture_T *capture;
+
+    const char *filename;
+    char *source;
+    AST_T *root;
+    // The mapping the tree lives in when it came from a cache file
+    astcache_T *cache;
+    visitor_T *visitor;
+
+    error_trap_T trap;
+    char error[ERROR_MESSAGE_SIZE];
+};
+
+typedef void (*blunt_step_T)(blunt_T *blunt);
+
+// Runs one step on the interpreter's heap and logging, turning the errors it raises into a status
+static blunt_status_T blunt_call(blunt_T *blunt, blunt_step_T step, blunt_status_T failure)
+{
+    heap_T *previous_heap = heap_use(blunt->heap);
+    int previous_logging = LOGGING_ENABLED;
+    LOGGING_ENABLED = blunt->logging;
+    // Errors raised in the middle of a tagged allocation leave its tag behind
+    int previous_tag = heap_tag;
+    heap_tag = MEMSTATS_OTHER;
+    stats_T *previous_stats = stats_active;
+    stats_active = blunt->stats;
+
+    blunt_status_T status = BLUNT_OK;
+    error_trap_set(&blunt->trap);
+    if (setjmp(blunt->trap.jump) == 0)
+    {
+        step(blunt);
+    }
+    else if (blunt->trap.status != 0)
+    {
+        status = failure;
+    }
+    error_trap_clear(&blunt->trap);
+
+    memcpy(blunt->error, blunt->trap.message, blunt->trap.message_size + 1);
+
+    stats_active = previous_stats;
+    heap_tag = previous_tag;
+    LOGGING_ENABLED = previous_logging;
+    heap_use(previous_heap);
+    return status;
+}
+
+// Runs a step like blunt_call, adding its wall time to a phase of --stats. Steps that stop on an
+// error or on exit() are timed too, so the timing stays out here.
+static blunt_status_T blunt_call_phase(blunt_T *blunt, blunt_step_T step, blunt_status_T failure, int phase)
+{
+    stats_T *stats = blunt->stats;
+    if (!stats)
+    {
+        return blunt_call(blunt, step, failure);
+    }
+
+    stats->nodes = phase == STATS_RUN ? stats->run_nodes : stats->parsed_nodes;
+    long lex_ns = stats->phases_ns[STATS_LEX];
+    long start = stats_now_ns();
+
+    blunt_status_T status = blunt_call(blunt, step, failure);
+
+    // The parser lexes as it goes, and the lexer times its tokens itself
+    stats->phases_ns[phase] += stats_now_ns() - start - (stats->phases_ns[STATS_LEX] - lex_ns);
+    return status;
+}
+
+static void blunt_step_read(blunt_T *blunt)
+{
+    blunt->source = read_file(blunt->filename);
+}
+
+static void blunt_step_parse(blunt_T *blunt)
+{
+    if (stats_active)
+    {
+        stats_active->cached = 0;
+    }
+
+    LOG_PRINT("\nSTARTING PARSER\n");
+    parser_T *parser = init_parser(init_lexer(blunt->source));
+    blunt->root = parser_parse(parser);
+
+    LOG_PRINT("\n ----- PARSER TREE -----\n");
+    ast_print(blunt->root, 0);
+    LOG_PRINT("\n -----------------------\n");
+}
+
+// Uses the tree of a cache file that was just mapped, counting its nodes as the parser would have
+static void blunt_use_cache(blunt_T *blunt)
+{
+    blunt->root = blunt->cache->root;
+    if (stats_active)
+    {
+        stats_active->cached = 1;
+        for (int type = 0; type <= AST_NOOP; type++)
+        {
+            stats_active->parsed_nodes[type] += blunt->cache->nodes[type];
+        }
+    }
+}
+
+// Takes the tree from the cache file of the script when it was parsed from the same source, and
+// parses the script otherwise, writing the tree for the next time
+static void blunt_step_parse_cached(blunt_T *blunt)
+{
+    char *path = astcache_path(blunt->filename);
+    size_t source_size = strlen(blunt->source);
+    blunt->cache = astcache_load(path, blunt->source, source_size);
+    if (blunt->cache)
+    {
+        blunt_use_cache(blunt);
+        LOG_PRINT("\n ----- CACHED TREE -----\n");
+        ast_print(blunt->root, 0);
+        LOG_PRINT("\n -----------------------\n");
+    }
+    else
+    {
+        blunt_step_parse(blunt);
+        astcache_write(path, blunt->source, source_size, blunt->root);
+    }
+    heap_free(path);
+}
+
+// Takes the tree from the cache file of the script, never parsing it
+static void blunt_step_map_cached(blunt_T *blunt)
+{
+    char *path = astcache_path(blunt->filename);
+    blunt->cache = astcache_load(path, blunt->source, strlen(blunt->source));
+    heap_free(path);
+    if (!blunt->cache)
+    {
+        log_error("No cache file matches %s\n", blunt->filename);
+        error_exit(1);
+    }
+    blunt_use_cache(blunt);
+}
+
+static void blunt_step_lex(blunt_T *blunt)
+{
+    lexer_T *lexer = init_lexer(blunt->source);
+    while (lexer->i < strlen(lexer->contents))
+    {
+        token_T *token = lexer_get_next_token(lexer);
+        LOG_PRINT("TOKEN(%s, %s)\n", token_type_to_string(token->type), token->value);
+    }
+}
+
+static void blunt_step_run(blunt_T *blunt)
+{
+    // A run starts from fresh scopes and from the first line of its files, but keeps the threads and the cache of the previous one
+    visitor_T *previous = blunt->visitor;
+    pool_T *pool = previous ? previous->pool : NULL;
+    memo_T *memo = previous ? previous->memo : NULL;
+    profile_T *profile = previous ? previous->profile : NULL;
+    sample_T *sample = previous ? previous->sample : NULL;
+    if (!previous)
+    {
+        memo = blunt->memo ? init_memo(MEMO_DEFAULT_CAPACITY) : NULL;
+        profile = blunt->profile ? init_profile() : NULL;
+        sample = blunt->sampling ? init_sample() : NULL;
+    }
+
+    // Only the tree, the threads and the caches outlive a run, so everything else of the previous one goes
+    if (!blunt->run_heap)
+    {
+        blunt->run_heap = init_heap();
+        if (blunt->memstats)
+        {
+            memstats_observe(blunt->memstats, blunt->run_heap);
+        }
+    }
+    else
+    {
+        heap_use(blunt->run_heap);
+        if (previous->input)
+        {
+            input_free(previous->input);
+        }
+        blunt->visitor = NULL;
+        heap_reset(blunt->run_heap);
+    }
+    heap_use(blunt->run_heap);
+
+    visitor_T *visitor = init_visitor();
+    visitor->heap = blunt->heap;
+    visitor->pool = pool;
+    visitor->memo = memo;
+    visitor->profile = profile;
+    visitor->sample = sample;
+    visitor->memstats = blunt->memstats;
+    blunt->visitor = visitor;
+
+    if (visitor->memstats)
+    {
+        memstats_reset_calls(visitor->memstats);
+    }
+
+    if (visitor->profile)
+    {
+        profile_start(visitor->profile);
+    }
+    if (visitor->sample)
+    {
+        sample_start(visitor->sample);
+    }
+
+    LOG_PRINT("\nSTARTING VISITOR\n");
+    visitor_visit(visitor, blunt->root);
+}
+
+blunt_T *init_blunt()
+{
+    blunt_T *blunt = calloc(1, sizeof(struct BLUNT_STRUCT));
+    if (!blunt)
+    {
+        return NULL;
+    }
+
+    blunt->heap = init_heap();
+    return blunt;
+}
+
+void blunt_set_logging(blunt_T *blunt, int enabled)
+{
+    blunt->logging = enabled;
+}
+
+void blunt_set_memo(blunt_T *blunt, int enabled)
+{
+    blunt->memo = enabled;
+}
+
+void blunt_set_profile(blunt_T *blunt, int enabled)
+{
+    blunt->profile = enabled;
+}
+
+void blunt_set_sampling(blunt_T *blunt, int enabled)
+{
+    blunt->sampling = enabled;
+}
+
+void blunt_set_cache(blunt_T *blunt, int enabled)
+{
+    blunt->caching = enabled;
+}
+
+void blunt_set_mem_stats(blunt_T *blunt, int enabled)
+{
+    if (!enabled)
+    {
+        heap_set_observer(blunt->heap, NULL);
+        if (blunt->run_heap)
+        {
+            heap_set_observer(blunt->run_heap, NULL);
+        }
+        return;
+    }
+
+    if (!blunt->memstats)
+    {
+        blunt->memstats = init_memstats();
+    }
+    memstats_observe(blunt->memstats, blunt->heap);
+    if (blunt->run_heap)
+    {
+        memstats_observe(blunt->memstats, blunt->run_heap);
+    }
+}
+
+void blunt_set_stats(blunt_T *blunt, int enabled)
+{
+    if (enabled && !blunt->stats)
+    {
+        blunt->stats = init_stats();
+    }
+    else if (!enabled && blunt->stats)
+    {
+        stats_free(blunt->stats);
+        blunt->stats = NULL;
+    }
+}
+
+void blunt_set_capture(blunt_T *blunt, int enabled)
+{
+    if (enabled && !blunt->capture)
+    {
+        blunt->capture = calloc(1, sizeof(struct OUTPUT_CAPTURE_STRUCT));
+    }
+    else if (!enabled && blunt->capture)
+    {
+        free(blunt->capture->data);
+        free(blunt->capture);
+        blunt->capture = NULL;
+    }
+}
+
+// Unmaps the tree of the program loaded before, if it came from a cache file
+static void blunt_free_cache(blunt_T *blunt)
+{
+    if (blunt->cache)
+    {
+        heap_T *previous_heap = heap_use(blunt->heap);
+        astcache_free(blunt->cache);
+        heap_use(previous_heap);
+        blunt->cache = NULL;
+    }
+}
+
+blunt_status_T blunt_load(blunt_T *blunt, const char *source)
+{
+    blunt_free_cache(blunt);
+    heap_T *previous_heap = heap_use(blunt->heap);
+    blunt->source = heap_strdup(source);
+    heap_use(previous_heap);
+
+    blunt->root = NULL;
+    return blunt_call_phase(blunt, blunt_step_parse, BLUNT_ERROR_PARSE, STATS_PARSE);
+}
+
+blunt_status_T blunt_load_file(blunt_T *blunt, const char *filename)
+{
+    blunt_free_cache(blunt);
+    blunt->filename = filename;
+    blunt->root = NULL;
+    blunt_status_T status = blunt_call_phase(blunt, blunt_step_read, BLUNT_ERROR_IO, STATS_READ);
+    if (status != BLUNT_OK)
+    {
+        return status;
+    }
+
+    return blunt_call_phase(blunt, blunt->caching ? blunt_step_parse_cached : blunt_step_parse, BLUNT_ERROR_PARSE, STATS_PARSE);
+}
+
+blunt_status_T blunt_load_cached_file(blunt_T *blunt, const char *filename)
+{
+    blunt_free_cache(blunt);
+    blunt->filename = filename;
+    blunt->root = NULL;
+    blunt_status_T status = blunt_call_phase(blunt, blunt_step_read, BLUNT_ERROR_IO, STATS_READ);
+    if (status != BLUNT_OK)
+    {
+        return status;
+    }
+
+    return blunt_call_phase(blunt, blunt_step_map_cached, BLUNT_ERROR_IO, STATS_PARSE);
+}
+
+blunt_status_T blunt_share(blunt_T *blunt, const blunt_T *source)
+{
+    if (!source->root)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "No program loaded\n");
+        return BLUNT_ERROR_PARSE;
+    }
+
+    // Everything a run allocates comes from blunt's heap, the tree stays in the heap of source
+    blunt->root = source->root;
+    blunt->error[0] = '\0';
+    return BLUNT_OK;
+}
+
+blunt_status_T blunt_lex_file(blunt_T *blunt, const char *filename)
+{
+    blunt->filename = filename;
+    blunt_status_T status = blunt_call_phase(blunt, blunt_step_read, BLUNT_ERROR_IO, STATS_READ);
+    if (status != BLUNT_OK)
+    {
+        return status;
+    }
+
+    return blunt_call_phase(blunt, blunt_step_lex, BLUNT_ERROR_PARSE, STATS_LEX);
+}
+
+blunt_status_T blunt_run(blunt_T *blunt)
+{
+    if (!blunt->root)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "No program loaded\n");
+        return BLUNT_ERROR_RUNTIME;
+    }
+
+    if (blunt->capture)
+    {
+        blunt->capture->size = 0;
+        output_capture(blunt->capture);
+    }
+    blunt_status_T status = blunt_call_phase(blunt, blunt_step_run, BLUNT_ERROR_RUNTIME, STATS_RUN);
+    output_capture(NULL);
+    // Whatever the program printed is out once the run is over, even if it stopped on an error or on exit()
+    output_flush();
+
+    // Errors and exit() leave the calls they stopped open
+    if (blunt->visitor && blunt->visitor->profile)
+    {
+        profile_stop(blunt->visitor->profile);
+    }
+    if (blunt->visitor && blunt->visitor->sample)
+    {
+        sample_stop(blunt->visitor->sample);
+    }
+    return status;
+}
+
+const char *blunt_error(blunt_T *blunt)
+{
+    return blunt->error;
+}
+
+const char *blunt_output(blunt_T *blunt, size_t *size)
+{
+    if (!blunt->capture || !blunt->capture->data)
+    {
+        *size = 0;
+        return "";
+    }
+
+    *size = blunt->capture->size;
+    return blunt->capture->data;
+}
+
+void blunt_print_memo_stats(blunt_T *blunt)
+{
+    if (blunt->visitor && blunt->visitor->memo)
+    {
+        output_flush();
+        memo_print_stats(blunt->visitor->memo);
+    }
+}
+
+void blunt_print_profile(blunt_T *blunt)
+{
+    if (blunt->visitor && blunt->visitor->profile)
+    {
+        output_flush();
+        heap_T *previous_heap = heap_use(blunt->heap);
+        profile_print_stats(blunt->visitor->profile);
+        heap_use(previous_heap);
+    }
+}
+
+blunt_status_T blunt_write_profile(blunt_T *blunt, const char *filename)
+{
+    if (!blunt->visitor || !blunt->visitor->profile)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "No profile recorded\n");
+        return BLUNT_ERROR_RUNTIME;
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not open file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+
+    heap_T *previous_heap = heap_use(blunt->heap);
+    profile_write_folded(blunt->visitor->profile, file);
+    heap_use(previous_heap);
+
+    if (fclose(file) != 0)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not write file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+    return BLUNT_OK;
+}
+
+blunt_status_T blunt_write_samples(blunt_T *blunt, const char *filename)
+{
+    if (!blunt->visitor || !blunt->visitor->sample)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "No samples taken\n");
+        return BLUNT_ERROR_RUNTIME;
+    }
+
+    FILE *file = fopen(filename, "w");
+    if (!file)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not open file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+
+    heap_T *previous_heap = heap_use(blunt->heap);
+    sample_write_histogram(blunt->visitor->sample, file);
+    heap_use(previous_heap);
+
+    if (fclose(file) != 0)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not write file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+    return BLUNT_OK;
+}
+
+void blunt_print_mem_stats(blunt_T *blunt)
+{
+    if (blunt->memstats)
+    {
+        output_flush();
+        memstats_print_stats(blunt->memstats);
+    }
+}
+
+void blunt_print_stats(blunt_T *blunt)
+{
+    if (blunt->stats)
+    {
+        output_flush();
+        stats_print(blunt->stats);
+    }
+}
+
+blunt_status_T blunt_write_mem_profile(blunt_T *blunt, const char *filename)
+{
+    if (!blunt->memstats)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "No allocations recorded\n");
+        return BLUNT_ERROR_RUNTIME;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not open file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+
+    memstats_write_pprof(blunt->memstats, file);
+
+    if (fclose(file) != 0)
+    {
+        snprintf(blunt->error, ERROR_MESSAGE_SIZE, "Could not write file %s\n", filename);
+        return BLUNT_ERROR_IO;
+    }
+    return BLUNT_OK;
+}
+
+void blunt_free(blunt_T *blunt)
+{
+    heap_T *previous_heap = heap_use(blunt->heap);
+    if (blunt->visitor && blunt->visitor->pool)
+    {
+        pool_free(blunt->visitor->pool);
+    }
+    heap_use(blunt->run_heap);
+    if (blunt->visitor && blunt->visitor->input)
+    {
+        input_free(blunt->visitor->input);
+    }
+    heap_use(previous_heap);
+    blunt_free_cache(blunt);
+
+    if (blunt->run_heap)
+    {
+        heap_release(blunt->run_heap);
+    }
+    heap_release(blunt->heap);
+    // The heap tells the statistics about its blocks until it is released
+    if (blunt->memstats)
+    {
+        memstats_free(blunt->memstats);
+    }
+    if (blunt->stats)
+    {
+        stats_free(blunt->stats);
+    }
+    blunt_set_capture(blunt, 0);
+    free(blunt);
+}
@@ -0,0 +1,423 @@
+#include "../include/heap/heap.h"
+#include "../include/io/logger.h"
+#include "../include/io/error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The headers keep the blocks as aligned as malloc makes them
+_Static_assert(sizeof(heap_chunk_T) % _Alignof(max_align_t) == 0, "heap chunk header breaks alignment");
+_Static_assert(sizeof(heap_large_T) % _Alignof(max_align_t) == 0, "heap large block header breaks alignment");
+
+static heap_T heap_process = {
+    .list = {
+        .heap = &heap_process,
+        .large = {.previous = &heap_process.list.large, .next = &heap_process.list.large},
+        .shared = 1,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+    },
+    .workers = NULL,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .concurrent = 1,
+};
+
+// The list the calling thread allocates from, NULL for the process wide heap
+static _Thread_local heap_list_T *heap_list = NULL;
+_Thread_local int heap_tag = 0;
+
+static void heap_init_list(heap_T *heap, heap_list_T *list)
+{
+    memset(list, 0, sizeof(struct HEAP_LIST_STRUCT));
+    list->heap = heap;
+    list->large.previous = &list->large;
+    list->large.next = &list->large;
+    pthread_mutex_init(&list->lock, NULL);
+}
+
+static void heap_free_blocks(heap_list_T *list, size_t *chunks_size, size_t *large_size)
+{
+    heap_chunk_T *chunk = list->chunks;
+    while (chunk)
+    {
+        heap_chunk_T *next = chunk->next;
+        free(chunk);
+        chunk = next;
+        (*chunks_size)++;
+    }
+
+    heap_large_T *large = list->large.next;
+    while (large != &list->large)
+    {
+        heap_large_T *next = large->next;
+        free(large);
+        large = next;
+        (*large_size)++;
+    }
+}
+
+static void heap_release_list(heap_list_T *list, size_t *chunks_size, size_t *large_size)
+{
+    heap_free_blocks(list, chunks_size, large_size);
+    pthread_mutex_destroy(&list->lock);
+}
+
+// Tells the observer about every block of a list, including the ones already freed, which it does not know about
+static void heap_observe_release(heap_list_T *list, heap_observer_T *observer)
+{
+    for (heap_chunk_T *chunk = list->chunks; chunk; chunk = chunk->next)
+    {
+        char *end = chunk == list->chunks ? list->bump : chunk->end;
+        char *header = (char *)(chunk + 1) + HEAP_CLASS_SIZE - sizeof(size_t);
+        while (header < end)
+        {
+            observer->freed(observer->context, header + sizeof(size_t));
+            header += *(size_t *)header * HEAP_CLASS_SIZE;
+        }
+    }
+
+    for (heap_large_T *large = list->large.next; large != &list->large; large = large->next)
+    {
+        observer->freed(observer->context, large + 1);
+    }
+}
+
+static void heap_reset_list(heap_list_T *list, size_t *chunks_size, size_t *large_size)
+{
+    if (list->heap->observer)
+    {
+        heap_observe_release(list, list->heap->observer);
+    }
+
+    heap_free_blocks(list, chunks_size, large_size);
+    list->chunks = NULL;
+    list->bump = NULL;
+    list->bump_end = NULL;
+    memset(list->free_blocks, 0, sizeof(list->free_blocks));
+    list->large.previous = &list->large;
+    list->large.next = &list->large;
+}
+
+heap_T *init_heap()
+{
+    heap_T *heap = calloc(1, sizeof(struct HEAP_STRUCT));
+    if (!heap)
+    {
+        log_error("Failed to allocate memory for heap\n");
+        error_exit(1);
+    }
+
+    heap_init_list(heap, &heap->list);
+    pthread_mutex_init(&heap->lock, NULL);
+
+    return heap;
+}
+
+void heap_release(heap_T *heap)
+{
+    if (heap_list && heap_list->heap == heap)
+    {
+        heap_list = NULL;
+    }
+
+    size_t chunks_size = 0;
+    size_t large_size = 0;
+    heap_release_list(&heap->list, &chunks_size, &large_size);
+    heap_list_T *worker = heap->workers;
+    while (worker)
+    {
+        heap_list_T *next = worker->next;
+        heap_release_list(worker, &chunks_size, &large_size);
+        free(worker);
+        worker = next;
+    }
+    LOG_PRINT("Released heap with %lu chunks and %lu large blocks\n", chunks_size, large_size);
+
+    pthread_mutex_destroy(&heap->lock);
+    free(heap);
+}
+
+void heap_reset(heap_T *heap)
+{
+    size_t chunks_size = 0;
+    size_t large_size = 0;
+    heap_reset_list(&heap->list, &chunks_size, &large_size);
+    for (heap_list_T *worker = heap->workers; worker; worker = worker->next)
+    {
+        heap_reset_list(worker, &chunks_size, &large_size);
+    }
+    LOG_PRINT("Reset heap with %lu chunks and %lu large blocks\n", chunks_size, large_size);
+}
+
+heap_T *heap_use(heap_T *heap)
+{
+    heap_T *previous = heap_list ? heap_list->heap : NULL;
+    heap_list = heap ? &heap->list : NULL;
+    return previous;
+}
+
+void heap_attach(heap_T *heap)
+{
+    if (heap_list && heap_list->heap == heap && heap_list != &heap->list)
+    {
+        return;
+    }
+
+    heap_list_T *list = malloc(sizeof(struct HEAP_LIST_STRUCT));
+    if (!list)
+    {
+        log_error("Failed to allocate memory for heap list\n");
+        error_exit(1);
+    }
+    heap_init_list(heap, list);
+
+    pthread_mutex_lock(&heap->lock);
+    list->next = heap->workers;
+    heap->workers = list;
+    pthread_mutex_unlock(&heap->lock);
+
+    heap_list = list;
+}
+
+heap_T *heap_current()
+{
+    return heap_list ? heap_list->heap : &heap_process;
+}
+
+void heap_set_concurrent(heap_T *heap, int concurrent)
+{
+    // The process wide heap is always shared
+    if (heap != &heap_process)
+    {
+        heap->concurrent = concurrent;
+    }
+}
+
+void heap_set_observer(heap_T *heap, heap_observer_T *observer)
+{
+    heap->observer = observer;
+}
+
+static void *heap_out_of_memory(size_t size)
+{
+    log_error("Out of memory allocating %lu bytes\n", size);
+    error_exit(1);
+}
+
+static heap_list_T *heap_lock_list()
+{
+    heap_list_T *list = heap_list ? heap_list : &heap_process.list;
+    if (list->shared)
+        pthread_mutex_lock(&list->lock);
+    return list;
+}
+
+static void heap_unlock_list(heap_list_T *list)
+{
+    if (list->shared)
+        pthread_mutex_unlock(&list->lock);
+}
+
+static void *heap_malloc_small(size_t size_class)
+{
+    heap_list_T *list = heap_lock_list();
+    size_t *block = list->free_blocks[size_class - 1];
+    if (block)
+    {
+        list->free_blocks[size_class - 1] = *(void **)block;
+        heap_unlock_list(list);
+        return block;
+    }
+
+    size_t block_size = size_class * HEAP_CLASS_SIZE;
+    if ((size_t)(list->bump_end - list->bump) < block_size)
+    {
+        heap_chunk_T *chunk = malloc(HEAP_CHUNK_SIZE);
+        if (!chunk)
+        {
+            heap_unlock_list(list);
+            return heap_out_of_memory(HEAP_CHUNK_SIZE);
+        }
+        if (list->chunks)
+        {
+            list->chunks->end = list->bump;
+        }
+        chunk->next = list->chunks;
+        list->chunks = chunk;
+        // Classes sit in front of their blocks, so the blocks end up on the alignment of the chunk
+        list->bump = (char *)(chunk + 1) + HEAP_CLASS_SIZE - sizeof(size_t);
+        list->bump_end = (char *)chunk + HEAP_CHUNK_SIZE;
+    }
+
+    size_t *header = (size_t *)list->bump;
+    list->bump += block_size;
+    heap_unlock_list(list);
+
+    *header = size_class;
+    return header + 1;
+}
+
+static void heap_link_large(heap_list_T *list, heap_large_T *large)
+{
+    int locked = list->shared || list->heap->concurrent;
+    if (locked)
+        pthread_mutex_lock(&list->lock);
+
+    large->list = list;
+    large->size_class = 0;
+    large->previous = &list->large;
+    large->next = list->large.next;
+    list->large.next->previous = large;
+    list->large.next = large;
+
+    if (locked)
+        pthread_mutex_unlock(&list->lock);
+}
+
+// Large blocks go back to the list they were allocated from, which may belong to another thread
+static void heap_unlink_large(heap_large_T *large)
+{
+    heap_list_T *list = large->list;
+    int locked = list->shared || list->heap->concurrent;
+    if (locked)
+        pthread_mutex_lock(&list->lock);
+
+    large->previous->next = large->next;
+    large->next->previous = large->previous;
+
+    if (locked)
+        pthread_mutex_unlock(&list->lock);
+}
+
+void *heap_malloc(size_t size)
+{
+    void *pointer;
+    size_t size_class = (size + sizeof(size_t) + HEAP_CLASS_SIZE - 1) / HEAP_CLASS_SIZE;
+    if (size_class <= HEAP_CLASSES)
+    {
+        pointer = heap_malloc_small(size_class);
+    }
+    else
+    {
+        heap_large_T *large = malloc(sizeof(heap_large_T) + size);
+        if (!large)
+        {
+            return heap_out_of_memory(size);
+        }
+
+        heap_link_large(heap_list ? heap_list : &heap_process.list, large);
+        pointer = large + 1;
+    }
+
+    // Observers watch the heap of the thread, which is where its blocks come from and go back to
+    if (heap_list && heap_list->heap->observer)
+    {
+        heap_observer_T *observer = heap_list->heap->observer;
+        observer->allocated(observer->context, pointer, size, heap_tag);
+    }
+    return pointer;
+}
+
+void *heap_calloc(size_t count, size_t size)
+{
+    void *pointer = heap_malloc(count * size);
+    memset(pointer, 0, count * size);
+    return pointer;
+}
+
+void *heap_realloc(void *pointer, size_t size)
+{
+    if (!pointer)
+    {
+        return heap_malloc(size);
+    }
+
+    heap_observer_T *observer = heap_list ? heap_list->heap->observer : NULL;
+    size_t size_class = ((size_t *)pointer)[-1];
+    if (size_class)
+    {
+        // Small blocks keep their class, so they only move once they outgrow it
+        size_t capacity = size_class * HEAP_CLASS_SIZE - sizeof(size_t);
+        if (size <= capacity)
+        {
+            if (observer)
+            {
+                observer->freed(observer->context, pointer);
+                observer->allocated(observer->context, pointer, size, heap_tag);
+            }
+            return pointer;
+        }
+
+        void *resized = heap_malloc(size);
+        memcpy(resized, pointer, capacity);
+        heap_free(pointer);
+        return resized;
+    }
+
+    // Told before the move, since the old address may be handed out again as soon as it is done
+    if (observer)
+    {
+        observer->freed(observer->context, pointer);
+    }
+
+    // The block moves, so it is relinked under its new address
+    heap_large_T *large = (heap_large_T *)pointer - 1;
+    heap_list_T *list = large->list;
+    heap_unlink_large(large);
+    heap_large_T *resized = realloc(large, sizeof(heap_large_T) + size);
+    if (!resized)
+    {
+        heap_link_large(list, large);
+        return heap_out_of_memory(size);
+    }
+
+    heap_link_large(list, resized);
+    if (observer)
+    {
+        observer->allocated(observer->context, resized + 1, size, heap_tag);
+    }
+    return resized + 1;
+}
+
+void heap_free(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+
+    if (heap_list && heap_list->heap->observer)
+    {
+        heap_observer_T *observer = heap_list->heap->observer;
+        observer->freed(observer->context, pointer);
+    }
+
+    size_t size_class = ((size_t *)pointer)[-1];
+    if (!size_class)
+    {
+        heap_large_T *large = (heap_large_T *)pointer - 1;
+        heap_unlink_large(large);
+        free(large);
+        return;
+    }
+
+    heap_list_T *list = heap_lock_list();
+    *(void **)pointer = list->free_blocks[size_class - 1];
+    list->free_blocks[size_class - 1] = pointer;
+    heap_unlock_list(list);
+}
+
+char *heap_strdup(const char *string)
+{
+    size_t size = strlen(string) + 1;
+    char *copy = heap_malloc(size);
+    memcpy(copy, string, size);
+    return copy;
+}
+
+char *heap_strndup(const char *string, size_t size)
+{
+    size_t length = strnlen(string, size);
+    char *copy = heap_malloc(length + 1);
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
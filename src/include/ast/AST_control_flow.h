@@ -52,6 +52,10 @@ typedef struct AST_FOR_LOOP_STRUCT
     struct AST_STRUCT *for_loop_condition;
     struct AST_STRUCT *for_loop_increment;
     struct AST_STRUCT *for_loop_body;
+    // Set by 'light parallel': iterations are spread over the thread pool
+    int for_loop_parallel;
+    // Set by 'light line with "path"': the expression naming the file whose lines the loop reads, with no increment
+    struct AST_STRUCT *for_loop_lines;
 } AST_FOR_LOOP_T;
 
 #endif // AST_CONTROL_FLOW_H
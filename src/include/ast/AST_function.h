@@ -24,6 +24,8 @@ typedef struct AST_FUNCTION_DEFINITION_STRUCT
     struct AST_STRUCT *function_definition_body;
     struct AST_VARIABLE_T **function_definition_arguments;
     size_t function_definition_arguments_size;
+    // Set by the parser when the body has no visible side effects and its result can be memoized
+    int function_definition_pure;
 } AST_FUNCTION_DEFINITION_T;
 
 /**
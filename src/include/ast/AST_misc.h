@@ -2,6 +2,7 @@
 #define AST_MISC_H
 
 #include "AST.h"
+#include <stdint.h>
 
 /**
  * @brief Structure representing a string AST node.
@@ -10,8 +11,81 @@ typedef struct AST_STRING_STRUCT
 {
     AST_T base;
     char *string_value;
+    // Concatenations build ropes: string_value stays NULL until the string is flattened
+    struct AST_STRING_STRUCT *string_rope_left;
+    struct AST_STRING_STRUCT *string_rope_right;
+    // Byte length, set when the node is created
+    size_t string_length;
+    // Hash of the characters, computed on first use
+    unsigned long string_hash;
+    int string_hash_computed;
+    // Slices point into the characters of this string instead of copying them
+    struct AST_STRING_STRUCT *string_slice_parent;
 } AST_STRING_T;
 
+/**
+ * Initializes a flat string node.
+ * @param value The NUL terminated characters.
+ * @param length The byte length of value.
+ * @return A pointer to the initialized string node.
+ */
+AST_STRING_T *init_ast_string(char *value, size_t length);
+
+/**
+ * Concatenates two strings in O(1) by building a rope node on top of them.
+ * @param left The left string.
+ * @param right The right string.
+ * @return The rope node.
+ */
+AST_STRING_T *ast_string_concat(AST_STRING_T *left, AST_STRING_T *right);
+
+/**
+ * Takes a slice of a string without copying its characters.
+ * @param string The string node.
+ * @param first The index of the first character.
+ * @param length The number of characters.
+ * @return The slice node, pointing into the characters of string.
+ */
+AST_STRING_T *ast_string_slice(AST_STRING_T *string, size_t first, size_t length);
+
+/**
+ * Returns the characters of a string, flattening it first if it is a rope.
+ * Slices are not NUL terminated, so the characters must be read up to ast_string_length.
+ * @param string The string node.
+ * @return The characters.
+ */
+char *ast_string_value(AST_STRING_T *string);
+
+/**
+ * Returns the byte length of a string without flattening it.
+ * @param string The string node.
+ * @return The length, excluding the NUL terminator.
+ */
+size_t ast_string_length(AST_STRING_T *string);
+
+/**
+ * Returns the hash of a string, computing and caching it on first use.
+ * @param string The string node.
+ * @return The hash of the characters.
+ */
+unsigned long ast_string_hash(AST_STRING_T *string);
+
+/**
+ * Compares two strings, rejecting different lengths and hashes before comparing the characters.
+ * @param left The left string.
+ * @param right The right string.
+ * @return 1 if the strings are equal, 0 otherwise.
+ */
+int ast_string_equal(AST_STRING_T *left, AST_STRING_T *right);
+
+/**
+ * Compares two strings byte by byte.
+ * @param left The left string.
+ * @param right The right string.
+ * @return A negative, zero or positive value like memcmp.
+ */
+int ast_string_compare(AST_STRING_T *left, AST_STRING_T *right);
+
 /**
  * @brief Structure representing an integer AST node.
  */
@@ -21,6 +95,29 @@ typedef struct AST_INT_STRUCT
     int int_value;
 } AST_INT_T;
 
+/**
+ * @brief Structure representing a run of equal values in an array.
+ */
+typedef struct AST_ARRAY_RUN_STRUCT
+{
+    // Index of the first element of the run, the run ends where the next one starts
+    size_t run_start;
+    struct AST_STRUCT *run_value;
+} AST_ARRAY_RUN_T;
+
+/**
+ * @brief Structure representing a string element stored inline in an array, as the characters it points to.
+ */
+typedef struct AST_ARRAY_FIELD_STRUCT
+{
+    char *field_value;
+    size_t field_length;
+} AST_ARRAY_FIELD_T;
+
+// Values of array_mapped: writes to a private mapping stay in memory, writes to a shared one reach the file
+#define AST_ARRAY_MAPPED_PRIVATE 1
+#define AST_ARRAY_MAPPED_SHARED 2
+
 /**
  * @brief Structure representing an array AST node.
  */
@@ -29,8 +126,111 @@ typedef struct AST_ARRAY_STRUCT
     AST_T base;
     struct AST_STRUCT **array_value;
     size_t array_size;
+    // Run-length form: array_value stays NULL and the elements are described by runs
+    AST_ARRAY_RUN_T *array_runs;
+    size_t array_runs_size;
+    size_t array_runs_capacity;
+    // Packed form: array_value stays NULL and every element is an int stored inline
+    int32_t *array_ints;
+    // Field form: array_value stays NULL and every element is a string stored inline, like the fields of a loaded file
+    AST_ARRAY_FIELD_T *array_fields;
+    // Set on packed arrays whose ints are a mapped file, which are written in place and never unpacked
+    int array_mapped;
+    // Slices share the elements of the array they were taken from
+    struct AST_ARRAY_STRUCT *array_slice_parent;
+    // Set when slices share the elements of this array, so a write must copy them first
+    int array_shared;
+    // Set on arrays written in the source, which every visit builds a new array from
+    int array_literal;
 } AST_ARRAY_T;
 
+/**
+ * Initializes an array whose elements all hold the same value, stored as a single run.
+ * @param size The number of elements.
+ * @param value The value of every element.
+ * @return A pointer to the initialized array node.
+ */
+AST_ARRAY_T *init_ast_array_filled(size_t size, AST_T *value);
+
+/**
+ * Sets every element of an array to the same value, storing it as a single run.
+ * @param array The array node.
+ * @param value The value of every element.
+ */
+void ast_array_fill(AST_ARRAY_T *array, AST_T *value);
+
+/**
+ * Returns where a run of a run-length array ends, the start of the next run or the size of the array.
+ * @param array The run-length array node.
+ * @param run The index of the run.
+ * @return The index one past the last element of the run.
+ */
+size_t ast_array_run_end(AST_ARRAY_T *array, size_t run);
+
+/**
+ * Returns an element of an array. Elements of packed arrays are boxed into a new int node,
+ * and elements of field arrays into a new string node pointing to the same characters.
+ * @param array The array node.
+ * @param index The index of the element.
+ * @return The element.
+ */
+AST_T *ast_array_get(AST_ARRAY_T *array, size_t index);
+
+/**
+ * Converts a run-length array into a plain one, packed when every run holds an int.
+ * @param array The array node.
+ */
+void ast_array_materialize(AST_ARRAY_T *array);
+
+/**
+ * Packs a plain array whose elements are all ints into a contiguous int buffer.
+ * @param array The array node.
+ * @return 1 if the array is packed, 0 if it has elements of other types.
+ */
+int ast_array_pack(AST_ARRAY_T *array);
+
+/**
+ * Returns the contiguous ints of an array, packing it first.
+ * @param array The array node.
+ * @param writable Whether the caller writes the ints, in which case a shared buffer is copied first.
+ * @return The ints, or NULL if the array is empty or has elements other than ints.
+ */
+int32_t *ast_array_ints(AST_ARRAY_T *array, int writable);
+
+/**
+ * Converts an array into the plain form with one node pointer per element.
+ * @param array The array node.
+ */
+void ast_array_box(AST_ARRAY_T *array);
+
+/**
+ * Boxes an array and gives it elements no slice shares, so that distinct elements can be set concurrently.
+ * Mapped arrays stay packed, since their ints never move.
+ * @param array The array node.
+ */
+void ast_array_make_private(AST_ARRAY_T *array);
+
+/**
+ * Takes a slice of an array without copying its elements. A mapped array goes on writing its file in place,
+ * so the slice sees those writes until it copies its elements on its own first write.
+ * @param array The array node.
+ * @param first The index of the first element.
+ * @param size The number of elements.
+ * @return The slice node, sharing the elements of array until one of them is written.
+ */
+AST_ARRAY_T *ast_array_slice(AST_ARRAY_T *array, size_t first, size_t size);
+
+/**
+ * Sets an element of an array, copying the elements first if they are shared with a slice.
+ * Run-length arrays split the run holding the element and stay run-length encoded.
+ * Packed arrays store ints inline and are boxed when any other type is stored, field arrays are boxed on any write.
+ * @param array The array node.
+ * @param index The index of the element.
+ * @param value The new value.
+ * @return The new value.
+ */
+AST_T *ast_array_set(AST_ARRAY_T *array, size_t index, AST_T *value);
+
 /**
  * @brief Structure representing a compound AST node.
  */
@@ -57,6 +257,8 @@ typedef struct AST_RETURN_STRUCT
 {
     AST_T base;
     struct AST_STRUCT *return_value;
+    // Set by the parser when the smoked value is a call to the enclosing blunt
+    int return_tail_call;
 } AST_RETURN_T;
 
 /**
@@ -0,0 +1,80 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include "../ast/AST.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever the parser builds a different tree from the same source, so older cache files are parsed again
+#define ASTCACHE_VERSION 3
+
+// Appended to the path of a script to get the path of its cache file
+#define ASTCACHE_SUFFIX "c"
+
+/**
+ * @brief Structure representing the start of a cache file. Pointers in the file are offsets from its
+ * start, 0 standing for NULL, and the relocation table lists where they are.
+ */
+typedef struct ASTCACHE_HEADER_STRUCT
+{
+    char magic[8];
+    uint32_t version;
+    // Hash of the size of every node type and of a pointer, so a file is never read by a build laid out otherwise
+    uint32_t layout;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t size;
+    uint64_t root;
+    uint64_t relocations;
+    uint64_t relocations_size;
+    // Nodes of each type in the tree, which --stats reports instead of the ones the parser would build
+    uint64_t nodes[AST_NOOP + 1];
+} astcache_header_T;
+
+/**
+ * @brief Structure representing a tree loaded from a cache file, which lives in the mapping of the file.
+ */
+typedef struct ASTCACHE_STRUCT
+{
+    char *data;
+    size_t size;
+    AST_T *root;
+    // Nodes of each type in the tree, in the header of the file
+    const uint64_t *nodes;
+} astcache_T;
+
+/**
+ * Returns the path of the cache file of a script, the script's path followed by ASTCACHE_SUFFIX.
+ * @param filename The path of the script.
+ * @return The path, allocated from the current heap.
+ */
+char *astcache_path(const char *filename);
+
+/**
+ * Maps a cache file and turns its offsets back into pointers. A missing file, one written by another
+ * version or layout, or one written for another source is a miss, never an error.
+ * @param path The path of the cache file.
+ * @param source The source the tree must have been parsed from.
+ * @param source_size The number of bytes of the source.
+ * @return The tree, which stays mapped until astcache_free, or NULL on a miss.
+ */
+astcache_T *astcache_load(const char *path, const char *source, size_t source_size);
+
+/**
+ * Writes a parsed tree to a cache file, replacing it at once so that readers never see half of it.
+ * Failing to write is not an error: the script is just parsed again next time.
+ * @param path The path of the cache file.
+ * @param source The source the tree was parsed from.
+ * @param source_size The number of bytes of the source.
+ * @param root The tree.
+ * @return 1 when the file was written, 0 otherwise.
+ */
+int astcache_write(const char *path, const char *source, size_t source_size, AST_T *root);
+
+/**
+ * Unmaps a loaded tree, which must not be used anymore.
+ * @param cache The loaded tree.
+ */
+void astcache_free(astcache_T *cache);
+
+#endif // ASTCACHE_H
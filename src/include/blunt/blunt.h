@@ -0,0 +1,223 @@
+#ifndef BLUNT_H
+#define BLUNT_H
+
+#include <stddef.h>
+
+/**
+ * @brief Embedding interface of the interpreter, built into libblunt.
+ * Every interpreter is a blunt_T that owns its lexer, parser, tree, scopes and memory, so a host
+ * can run several of them at once, each on its own thread. Errors are returned as a status
+ * instead of exiting the process, with the message kept in the interpreter.
+ */
+typedef struct BLUNT_STRUCT blunt_T;
+
+/**
+ * @brief Status returned by the functions that load and run a program.
+ */
+typedef enum
+{
+    BLUNT_OK = 0,
+    // The file could not be read
+    BLUNT_ERROR_IO,
+    // The program does not lex or parse
+    BLUNT_ERROR_PARSE,
+    // The program failed while running
+    BLUNT_ERROR_RUNTIME,
+} blunt_status_T;
+
+/**
+ * Initializes an interpreter with nothing loaded.
+ * @return A pointer to the interpreter, or NULL if it could not be allocated.
+ */
+blunt_T *init_blunt();
+
+/**
+ * Turns the verbose logs of the interpreter on or off. They are off by default.
+ * @param blunt The interpreter.
+ * @param enabled 1 to print the logs to stdout, 0 otherwise.
+ */
+void blunt_set_logging(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the memoization of pure blunts on or off. Must be called before the first run.
+ * @param blunt The interpreter.
+ * @param enabled 1 to cache the results of pure blunts, 0 otherwise.
+ */
+void blunt_set_memo(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the profiler on or off. Must be called before the first run. While it is on, every call
+ * of a blunt, method or builtin is timed, which costs a branch per call when it is off.
+ * @param blunt The interpreter.
+ * @param enabled 1 to record the calls, 0 otherwise.
+ */
+void blunt_set_profile(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the sampling profiler on or off. Must be called before the first run. While it is on, a
+ * SIGPROF timer records the blunt and the kind of node being evaluated every millisecond of CPU
+ * time, so only one interpreter of the process may sample at a time.
+ * @param blunt The interpreter.
+ * @param enabled 1 to take samples, 0 otherwise.
+ */
+void blunt_set_sampling(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the tree cache on or off. With it on, blunt_load_file writes the tree it parses to a file next to
+ * the script, its path with a "c" appended, and loads the tree from that file instead of
+ * parsing the script again for as long as the script does not change.
+ * @param blunt The interpreter.
+ * @param enabled 1 to cache trees, 0 otherwise.
+ */
+void blunt_set_cache(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the recording of allocations on or off. Allocations are recorded from the moment it is
+ * turned on, so call it before loading a program to record the parser too. Every block allocated
+ * is counted under the kind of what it holds and the blunt that allocated it.
+ * @param blunt The interpreter.
+ * @param enabled 1 to record the allocations, 0 otherwise.
+ */
+void blunt_set_mem_stats(blunt_T *blunt, int enabled);
+
+/**
+ * Turns the phase timings and counters on or off. Loading and running are timed from the moment
+ * they are turned on, together with the tokens, the nodes, the scopes and the calls they make.
+ * @param blunt The interpreter.
+ * @param enabled 1 to time and count, 0 otherwise.
+ */
+void blunt_set_stats(blunt_T *blunt, int enabled);
+
+/**
+ * Keeps what the runs print in the interpreter instead of writing it to stdout, so that interpreters
+ * running on several threads keep their outputs apart. Each run replaces what the previous one printed.
+ * @param blunt The interpreter.
+ * @param enabled 1 to keep the output, 0 to write it to stdout again.
+ */
+void blunt_set_capture(blunt_T *blunt, int enabled);
+
+/**
+ * Parses a program, replacing the one loaded before.
+ * @param blunt The interpreter.
+ * @param source The source of the program, which is copied.
+ * @return BLUNT_OK, or BLUNT_ERROR_PARSE.
+ */
+blunt_status_T blunt_load(blunt_T *blunt, const char *source);
+
+/**
+ * Reads and parses a program from a file, replacing the one loaded before.
+ * @param blunt The interpreter.
+ * @param filename The path of the file.
+ * @return BLUNT_OK, BLUNT_ERROR_IO or BLUNT_ERROR_PARSE.
+ */
+blunt_status_T blunt_load_file(blunt_T *blunt, const char *filename);
+
+/**
+ * Loads a program from the cache file of a script, written when blunt_load_file parsed it with the
+ * tree cache on, without ever parsing it. Replaces the program loaded before.
+ * @param blunt The interpreter.
+ * @param filename The path of the script.
+ * @return BLUNT_OK, or BLUNT_ERROR_IO when the script cannot be read or no cache file matches it.
+ */
+blunt_status_T blunt_load_cached_file(blunt_T *blunt, const char *filename);
+
+/**
+ * Makes an interpreter run the program loaded in another one instead of parsing it again.
+ * Running never writes into the tree, so both may run it at the same time, each on its own thread.
+ * @param blunt The interpreter.
+ * @param source The interpreter holding the program, which must not be freed or load another
+ * program while blunt runs it.
+ * @return BLUNT_OK, or BLUNT_ERROR_PARSE when source has no program loaded.
+ */
+blunt_status_T blunt_share(blunt_T *blunt, const blunt_T *source);
+
+/**
+ * Reads a file and logs its tokens without parsing it.
+ * @param blunt The interpreter.
+ * @param filename The path of the file.
+ * @return BLUNT_OK, BLUNT_ERROR_IO or BLUNT_ERROR_PARSE.
+ */
+blunt_status_T blunt_lex_file(blunt_T *blunt, const char *filename);
+
+/**
+ * Runs the loaded program from fresh scopes, so it can be run again. A call to exit() stops it with BLUNT_OK.
+ * @param blunt The interpreter.
+ * @return BLUNT_OK, or BLUNT_ERROR_RUNTIME.
+ */
+blunt_status_T blunt_run(blunt_T *blunt);
+
+/**
+ * Returns the message of the last error.
+ * @param blunt The interpreter.
+ * @return The message, empty when the last call succeeded.
+ */
+const char *blunt_error(blunt_T *blunt);
+
+/**
+ * Returns what the last run printed, when the output is kept with blunt_set_capture.
+ * @param blunt The interpreter.
+ * @param size Set to the number of bytes, which are not NUL-terminated.
+ * @return The bytes, valid until the next run or until the output is no longer kept.
+ */
+const char *blunt_output(blunt_T *blunt, size_t *size);
+
+/**
+ * Prints the memoization counters of the last run to stderr, when memoization is on.
+ * @param blunt The interpreter.
+ */
+void blunt_print_memo_stats(blunt_T *blunt);
+
+/**
+ * Prints the calls, inclusive and exclusive time of every blunt recorded so far to stderr,
+ * when the profiler is on.
+ * @param blunt The interpreter.
+ */
+void blunt_print_profile(blunt_T *blunt);
+
+/**
+ * Writes the call stacks recorded so far in the folded format flamegraph tools read,
+ * weighted by their exclusive time in microseconds.
+ * @param blunt The interpreter.
+ * @param filename The path of the file, which is overwritten.
+ * @return BLUNT_OK, BLUNT_ERROR_IO, or BLUNT_ERROR_RUNTIME when the profiler is off.
+ */
+blunt_status_T blunt_write_profile(blunt_T *blunt, const char *filename);
+
+/**
+ * Writes the samples taken so far as a histogram of blunts and one of node kinds.
+ * @param blunt The interpreter.
+ * @param filename The path of the file, which is overwritten.
+ * @return BLUNT_OK, BLUNT_ERROR_IO, or BLUNT_ERROR_RUNTIME when sampling is off.
+ */
+blunt_status_T blunt_write_samples(blunt_T *blunt, const char *filename);
+
+/**
+ * Prints the allocations, bytes and peak live bytes recorded so far for every kind of block,
+ * then the allocations of every blunt, to stderr, when allocations are recorded.
+ * @param blunt The interpreter.
+ */
+void blunt_print_mem_stats(blunt_T *blunt);
+
+/**
+ * Prints the time spent reading, lexing, parsing and running so far to stderr, then the tokens,
+ * the nodes of every type, the scopes and the calls, when they are counted.
+ * @param blunt The interpreter.
+ */
+void blunt_print_stats(blunt_T *blunt);
+
+/**
+ * Writes the allocations recorded so far as a heap profile pprof reads, with the allocated and
+ * live blocks and bytes of every call stack.
+ * @param blunt The interpreter.
+ * @param filename The path of the file, which is overwritten.
+ * @return BLUNT_OK, BLUNT_ERROR_IO, or BLUNT_ERROR_RUNTIME when allocations are not recorded.
+ */
+blunt_status_T blunt_write_mem_profile(blunt_T *blunt, const char *filename);
+
+/**
+ * Stops the threads of the interpreter and frees everything it allocated.
+ * @param blunt The interpreter.
+ */
+void blunt_free(blunt_T *blunt);
+
+#endif // BLUNT_H
@@ -0,0 +1,156 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Small blocks are carved out of chunks in classes of 16 bytes, header included
+#define HEAP_CLASS_SIZE 16
+#define HEAP_CLASSES 32
+#define HEAP_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Header of a chunk that small blocks are carved out of.
+ */
+typedef struct HEAP_CHUNK_STRUCT
+{
+    _Alignas(max_align_t) struct HEAP_CHUNK_STRUCT *next;
+    // Where the blocks carved out of the chunk end, set once the next chunk replaces it
+    char *end;
+} heap_chunk_T;
+
+/**
+ * @brief Header placed in front of every large block, linking the large blocks of a list.
+ */
+typedef struct HEAP_LARGE_STRUCT
+{
+    struct HEAP_LARGE_STRUCT *previous;
+    struct HEAP_LARGE_STRUCT *next;
+    struct HEAP_LIST_STRUCT *list;
+    // Right in front of the block like the class of a small block, 0 for large ones
+    size_t size_class;
+} heap_large_T;
+
+/**
+ * @brief Structure representing the memory one thread allocates from a heap.
+ * Small blocks freed by the thread go to its own free lists, whichever thread allocated them.
+ */
+typedef struct HEAP_LIST_STRUCT
+{
+    struct HEAP_STRUCT *heap;
+    heap_chunk_T *chunks;
+    char *bump;
+    char *bump_end;
+    void *free_blocks[HEAP_CLASSES];
+    // Sentinel of the circular list of large blocks
+    heap_large_T large;
+    // Set on the list of the process wide heap, which threads share
+    int shared;
+    pthread_mutex_t lock;
+    struct HEAP_LIST_STRUCT *next;
+} heap_list_T;
+
+/**
+ * @brief Callbacks told about every block allocated from a heap and freed back to it, with the tag
+ * set on the allocating thread. A reallocation frees the block before allocating the new one.
+ * They may be called from any thread using the heap, and must not allocate from it.
+ */
+typedef struct HEAP_OBSERVER_STRUCT
+{
+    void (*allocated)(void *context, void *pointer, size_t size, int tag);
+    void (*freed)(void *context, void *pointer);
+    void *context;
+} heap_observer_T;
+
+/**
+ * @brief Structure representing a heap: every block the interpreter allocated for one context,
+ * so that they can all be released together.
+ */
+typedef struct HEAP_STRUCT
+{
+    // Memory of the thread using the heap, and of each pool thread attached to it
+    heap_list_T list;
+    heap_list_T *workers;
+    pthread_mutex_t lock;
+    // Set while pool threads run, since they may free the large blocks of other lists
+    int concurrent;
+    // NULL unless something watches the allocations, such as --mem-stats
+    heap_observer_T *observer;
+} heap_T;
+
+/**
+ * Initializes an empty heap.
+ * @return A pointer to the initialized heap.
+ */
+heap_T *init_heap();
+
+/**
+ * Frees every block still allocated from the heap, then the heap itself.
+ * @param heap The heap.
+ */
+void heap_release(heap_T *heap);
+
+/**
+ * Frees every block still allocated from the heap but keeps the heap, and the lists of the pool
+ * threads attached to it, so it can be allocated from again. The observer is told about every
+ * block freed. No thread may allocate from the heap meanwhile.
+ * @param heap The heap.
+ */
+void heap_reset(heap_T *heap);
+
+/**
+ * Makes a heap the one the calling thread allocates from.
+ * Threads that never set one share a process wide heap that is never released.
+ * @param heap The heap, or NULL for the process wide one.
+ * @return The heap the thread used before, NULL for the process wide one.
+ */
+heap_T *heap_use(heap_T *heap);
+
+/**
+ * Makes a pool thread allocate from a list of its own in a heap, so that pool threads
+ * never share a list with the thread that started them.
+ * @param heap The heap.
+ */
+void heap_attach(heap_T *heap);
+
+/**
+ * Returns the heap the calling thread allocates from.
+ * @return The heap.
+ */
+heap_T *heap_current();
+
+/**
+ * Marks whether pool threads are running on the heap, which makes large allocations
+ * and frees take the lock of their list until it is cleared again.
+ * @param heap The heap.
+ * @param concurrent 1 while pool threads run, 0 otherwise.
+ */
+void heap_set_concurrent(heap_T *heap, int concurrent);
+
+/**
+ * Sets the observer told about the allocations of a heap.
+ * @param heap The heap.
+ * @param observer The observer, or NULL to stop observing.
+ */
+void heap_set_observer(heap_T *heap, heap_observer_T *observer);
+
+// Tag the observer of a heap gets with the blocks the thread allocates, 0 for untagged blocks.
+// Code tagging its blocks sets it back once they are allocated.
+extern _Thread_local int heap_tag;
+
+// Counterparts of the C allocation functions that allocate from the current heap.
+// Blocks must only be reallocated and freed with these.
+
+void *heap_malloc(size_t size);
+
+void *heap_calloc(size_t count, size_t size);
+
+void *heap_realloc(void *pointer, size_t size);
+
+void heap_free(void *pointer);
+
+char *heap_strdup(const char *string);
+
+char *heap_strndup(const char *string, size_t size);
+
+#endif // HEAP_H
@@ -0,0 +1,122 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "../ast/AST.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunk a stream that cannot be mapped reads at a time
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Structure representing a file, or stdin, read one line at a time.
+ * Regular files are mapped and their lines point into the mapping; pipes and terminals are read
+ * into a buffer and their lines copied out of it.
+ */
+typedef struct INPUT_STREAM_STRUCT
+{
+    // NULL for stdin
+    char *path;
+    int fd;
+
+    // The mapping of a regular file, NULL for the others
+    char *data;
+    size_t size;
+    size_t position;
+
+    // The buffer of the others, holding the bytes from start to end that no line has taken yet
+    char *buffer;
+    size_t buffer_capacity;
+    size_t buffer_start;
+    size_t buffer_end;
+    // Set once read returned 0
+    int ended;
+    // Set on int arrays whose writes go to the file
+    int shared;
+
+    struct INPUT_STREAM_STRUCT *next;
+} input_stream_T;
+
+/**
+ * @brief Structure representing the streams an interpreter opened, each open until it is freed.
+ */
+typedef struct INPUT_STRUCT
+{
+    input_stream_T *streams;
+    // Whole files mapped for loaders, apart from the streams so that loading never moves a stream
+    input_stream_T *maps;
+    // Files mapped as int arrays, the shared ones found again by path
+    input_stream_T *arrays;
+} input_T;
+
+/**
+ * Initializes an interpreter's input, with no stream open.
+ * @return A pointer to the initialized input.
+ */
+input_T *init_input();
+
+/**
+ * Unmaps and closes every stream. The lines read from mapped files point into the mappings,
+ * so the input must outlive them.
+ * @param input The input.
+ */
+void input_free(input_T *input);
+
+/**
+ * Starts every mapped file over from its first line, for a new run. Pipes and stdin go on.
+ * @param input The input.
+ */
+void input_rewind(input_T *input);
+
+/**
+ * Returns the stream of a file, opening it the first time.
+ * @param input The input.
+ * @param path The path of the file, NULL or "-" for stdin.
+ * @return The stream.
+ */
+input_stream_T *input_open(input_T *input, const char *path);
+
+/**
+ * Returns every byte of a file, mapping it the first time. Files that cannot be mapped, like stdin
+ * when it is a pipe, are read to their end into a buffer instead.
+ * @param input The input.
+ * @param path The path of the file, NULL or "-" for stdin.
+ * @param size Set to the number of bytes.
+ * @return The bytes, which stay valid until the input is freed, or NULL for an empty file.
+ */
+char *input_map(input_T *input, const char *path, size_t *size);
+
+/**
+ * Maps a file of native ints. A shared mapping writes the ints back to the file, which grows to hold size
+ * ints if it is shorter and is created if it does not exist; it is mapped once per path and size.
+ * A private mapping holds every whole int of the file, and writes to it never reach the file.
+ * @param input The input.
+ * @param path The path of the file.
+ * @param size The number of ints of a shared mapping, set to the number of ints of a private one.
+ * @param shared Whether the mapping is shared with the file.
+ * @return The ints, which stay mapped until the input is freed, or NULL when there are none.
+ */
+int32_t *input_map_ints(input_T *input, const char *path, size_t *size, int shared);
+
+/**
+ * Writes the ints of a shared mapping back to its file, and waits for the writes to finish.
+ * @param ints The first int.
+ * @param size The number of ints.
+ */
+void input_sync_ints(int32_t *ints, size_t size);
+
+/**
+ * Reads the next line of a stream, without its line ending.
+ * @param stream The stream.
+ * @return A string node, pointing into the mapping for mapped files, or NULL when no line is left.
+ */
+AST_STRING_T *input_read_line(input_stream_T *stream);
+
+/**
+ * Tells whether a stream has no line left, reading from it if that is the only way to know.
+ * @param stream The stream.
+ * @return 1 when no line is left, 0 otherwise.
+ */
+int input_eof(input_stream_T *stream);
+
+#endif // INPUT_H
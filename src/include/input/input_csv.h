@@ -0,0 +1,20 @@
+#ifndef INPUT_CSV_H
+#define INPUT_CSV_H
+
+#include "input.h"
+
+/**
+ * Loads one column of a CSV file into an array, in a single pass over the file mapped by the input.
+ * Fields are separated by ',' and rows by '\n' or "\r\n", and blank rows are skipped. A field in double
+ * quotes may hold both, with "" standing for a quote.
+ * A column whose fields are all ints becomes a packed array, any other column a field array whose
+ * strings point into the mapping. Only fields with "" in them are copied.
+ * @param input The input.
+ * @param path The path of the file, "-" for stdin.
+ * @param column The index of the column, from 0, when column_name is NULL.
+ * @param column_name The name of the column in the first row, which is then skipped, or NULL.
+ * @return The array.
+ */
+AST_ARRAY_T *input_load_csv(input_T *input, const char *path, int column, const char *column_name);
+
+#endif // INPUT_CSV_H
@@ -0,0 +1,55 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <setjmp.h>
+#include <stddef.h>
+
+#define ERROR_MESSAGE_SIZE 1024
+
+/**
+ * @brief Structure representing a point errors return to instead of exiting the process.
+ * Errors raised while a trap is set on the thread longjmp to it, with the logged message kept in the trap.
+ */
+typedef struct ERROR_TRAP_STRUCT
+{
+    jmp_buf jump;
+    // The status passed to error_exit
+    int status;
+    char message[ERROR_MESSAGE_SIZE];
+    size_t message_size;
+    struct ERROR_TRAP_STRUCT *parent;
+} error_trap_T;
+
+/**
+ * Sets a trap on the calling thread. The caller then calls setjmp on trap->jump,
+ * which returns again with a non zero value when an error is raised.
+ * @param trap The trap, which must stay alive until it is cleared.
+ */
+void error_trap_set(error_trap_T *trap);
+
+/**
+ * Clears the innermost trap of the calling thread, restoring the one set before it.
+ * @param trap The trap.
+ */
+void error_trap_clear(error_trap_T *trap);
+
+/**
+ * Returns the innermost trap of the calling thread.
+ * @return The trap, or NULL if none is set.
+ */
+error_trap_T *error_trap_current();
+
+/**
+ * Stops the current evaluation: jumps back to the innermost trap of the calling thread,
+ * or exits the process when there is none, as the interpreter always did.
+ * @param status The status, 0 when the script asked to exit.
+ */
+_Noreturn void error_exit(int status);
+
+/**
+ * Raises again on the calling thread an error caught by a trap, like one set on a pool worker.
+ * @param trap The trap holding the message and the status.
+ */
+_Noreturn void error_raise(error_trap_T *trap);
+
+#endif // ERROR_H
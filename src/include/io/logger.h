@@ -3,7 +3,8 @@
 
 #include <stdio.h>
 
-extern int LOGGING_ENABLED;
+// Per thread, so that interpreters running on different threads can log independently
+extern _Thread_local int LOGGING_ENABLED;
 
 #define LOG_PRINT(...)                    \
     do                                    \
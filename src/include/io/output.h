@@ -0,0 +1,65 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Structure representing the buffer everything a program prints goes through on its way to stdout.
+ * There is one per process, like stdout, shared by every interpreter and pool thread.
+ */
+typedef struct OUTPUT_STRUCT
+{
+    pthread_mutex_t lock;
+    // Set when stdout is a terminal, which gets every line as soon as it ends
+    int line_buffered;
+    size_t size;
+    char buffer[OUTPUT_BUFFER_SIZE];
+} output_T;
+
+/**
+ * @brief Structure representing a buffer that takes what one thread prints instead of the output,
+ * growing as needed. It is allocated with malloc, since it outlives the heaps of the runs writing into it.
+ */
+typedef struct OUTPUT_CAPTURE_STRUCT
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} output_capture_T;
+
+/**
+ * Appends bytes to the output, writing the buffer to stdout when it is full.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ */
+void output_write(const char *data, size_t size);
+
+/**
+ * Appends an integer in decimal to the output.
+ * @param value The integer.
+ */
+void output_write_int(int value);
+
+/**
+ * Appends integers in decimal to the output, separated by single spaces.
+ * @param values The integers.
+ * @param size The number of integers.
+ */
+void output_write_ints(const int *values, size_t size);
+
+/**
+ * Sends what the calling thread prints into a capture instead of the output, or back to the output.
+ * @param capture The capture, or NULL for the output.
+ */
+void output_capture(output_capture_T *capture);
+
+/**
+ * Writes everything buffered to stdout, after whatever stdio buffered for it.
+ * It also runs when the process exits.
+ */
+void output_flush();
+
+#endif // OUTPUT_H
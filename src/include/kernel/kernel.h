@@ -0,0 +1,40 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Structure representing a set of int array kernels for one instruction set.
+ */
+typedef struct KERNEL_STRUCT
+{
+    const char *name;
+    int32_t (*sum)(const int32_t *values, size_t size);
+    int32_t (*min)(const int32_t *values, size_t size);
+    int32_t (*max)(const int32_t *values, size_t size);
+    size_t (*count)(const int32_t *values, size_t size, int32_t value);
+    void (*fill)(int32_t *values, size_t size, int32_t value);
+    void (*scale)(int32_t *values, size_t size, int32_t factor);
+    void (*add)(int32_t *values, const int32_t *other, size_t size);
+    void (*sub)(int32_t *values, const int32_t *other, size_t size);
+    void (*mul)(int32_t *values, const int32_t *other, size_t size);
+    size_t (*find_either)(const char *bytes, size_t size, char first, char second);
+} kernel_T;
+
+/**
+ * Returns the fastest kernels supported by the CPU, chosen on the first call.
+ * Sums and products wrap around like the interpreter's int arithmetic.
+ * min and max must not be called with an empty array.
+ * find_either returns the index of the first byte equal to first or second, or size when there is none.
+ * @return The kernels.
+ */
+const kernel_T *kernel_get();
+
+/**
+ * Returns the portable scalar kernels.
+ * @return The kernels.
+ */
+const kernel_T *kernel_get_scalar();
+
+#endif // KERNEL_H
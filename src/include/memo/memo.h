@@ -0,0 +1,113 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "../ast/AST.h"
+#include "../heap/heap.h"
+
+// Default number of results kept before the least recently used one is evicted
+#define MEMO_DEFAULT_CAPACITY 4096
+
+/**
+ * @brief Structure representing a single int or string argument or result, copied out of the AST.
+ */
+typedef struct MEMO_VALUE_STRUCT
+{
+    int type;
+    int int_value;
+    char *string_value;
+} memo_value_T;
+
+/**
+ * @brief Structure representing the key of a memoized call: the blunt and its argument values.
+ */
+typedef struct MEMO_KEY_STRUCT
+{
+    AST_FUNCTION_DEFINITION_T *function_definition;
+    memo_value_T *arguments;
+    size_t arguments_size;
+    unsigned long hash;
+} memo_key_T;
+
+/**
+ * @brief Structure representing a cached call result, linked both in its bucket and in the LRU list.
+ */
+typedef struct MEMO_ENTRY_STRUCT
+{
+    memo_key_T *key;
+    memo_value_T result;
+    struct MEMO_ENTRY_STRUCT *bucket_next;
+    struct MEMO_ENTRY_STRUCT *lru_prev;
+    struct MEMO_ENTRY_STRUCT *lru_next;
+} memo_entry_T;
+
+/**
+ * @brief Structure representing a bounded memoization table with LRU eviction.
+ */
+typedef struct MEMO_STRUCT
+{
+    memo_entry_T **buckets;
+    size_t buckets_size;
+
+    // Most recently used entry first
+    memo_entry_T *lru_head;
+    memo_entry_T *lru_tail;
+
+    size_t entries_size;
+    size_t capacity;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+
+    // Heap the table was made on, which its keys and entries come from whichever heap the caller uses
+    heap_T *heap;
+} memo_T;
+
+/**
+ * Initializes a memoization table.
+ * @param capacity The maximum number of cached results.
+ * @return A pointer to the initialized table.
+ */
+memo_T *init_memo(size_t capacity);
+
+/**
+ * Builds the key of a call, copying the argument values.
+ * @param memo The memoization table the key is for.
+ * @param function_definition The blunt being called.
+ * @param arguments The evaluated arguments.
+ * @param arguments_size The number of arguments.
+ * @return The key, or NULL if an argument is not an int or a string.
+ */
+memo_key_T *memo_make_key(memo_T *memo, AST_FUNCTION_DEFINITION_T *function_definition, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Frees a key that was not inserted in the table.
+ * @param memo The memoization table the key was built for.
+ * @param key The key to free.
+ */
+void memo_free_key(memo_T *memo, memo_key_T *key);
+
+/**
+ * Looks up a cached result and marks it as the most recently used one.
+ * @param memo The memoization table.
+ * @param key The key of the call.
+ * @return A fresh AST node holding the cached result, or NULL on a miss.
+ */
+AST_T *memo_lookup(memo_T *memo, memo_key_T *key);
+
+/**
+ * Caches the result of a call, evicting the least recently used entry when the table is full.
+ * The table takes ownership of the key. Results that are not ints or strings are not cached.
+ * @param memo The memoization table.
+ * @param key The key of the call.
+ * @param result The result of the call.
+ */
+void memo_insert(memo_T *memo, memo_key_T *key, AST_T *result);
+
+/**
+ * Prints the hit, miss and eviction counters to stderr.
+ * @param memo The memoization table.
+ */
+void memo_print_stats(memo_T *memo);
+
+#endif // MEMO_H
@@ -0,0 +1,154 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include "../ast/AST.h"
+#include "../heap/heap.h"
+#include <pthread.h>
+#include <stdio.h>
+
+// Heap tags of the blocks --mem-stats tells apart, the nodes of each AST type come after the others
+#define MEMSTATS_OTHER 0
+#define MEMSTATS_TOKEN 1
+#define MEMSTATS_STRING 2
+#define MEMSTATS_SCOPE 3
+#define MEMSTATS_NODE 4
+#define MEMSTATS_TAGS (MEMSTATS_NODE + AST_NOOP + 1)
+
+/**
+ * @brief Structure representing the blocks of one tag allocated under one call stack.
+ */
+typedef struct MEMSTATS_SITE_STRUCT
+{
+    int tag;
+    struct MEMSTATS_FRAME_STRUCT *frame;
+    unsigned long allocations;
+    unsigned long bytes;
+    unsigned long live_blocks;
+    unsigned long live_bytes;
+    struct MEMSTATS_SITE_STRUCT *next;
+} memstats_site_T;
+
+/**
+ * @brief Structure representing a call stack: one blunt called from the stack of its parent.
+ * The frames form a tree whose root is everything allocated outside of a call, parsing included.
+ */
+typedef struct MEMSTATS_FRAME_STRUCT
+{
+    // Blunt whose method was called, NULL for blunts and builtins called by name
+    const char *owner;
+    const char *name;
+    struct MEMSTATS_FRAME_STRUCT *parent;
+    struct MEMSTATS_FRAME_STRUCT *children;
+    struct MEMSTATS_FRAME_STRUCT *next;
+    memstats_site_T *sites;
+} memstats_frame_T;
+
+/**
+ * @brief Structure representing a block that is still allocated.
+ */
+typedef struct MEMSTATS_BLOCK_STRUCT
+{
+    void *pointer;
+    size_t size;
+    memstats_site_T *site;
+} memstats_block_T;
+
+/**
+ * @brief Structure representing the totals of one tag.
+ */
+typedef struct MEMSTATS_TAG_STRUCT
+{
+    unsigned long allocations;
+    unsigned long bytes;
+    unsigned long live_bytes;
+    unsigned long peak_live_bytes;
+} memstats_tag_T;
+
+/**
+ * @brief Structure representing the allocations recorded while running with --mem-stats.
+ * Its own memory comes from malloc, so that recording a block never allocates another one.
+ */
+typedef struct MEMSTATS_STRUCT
+{
+    heap_observer_T observer;
+    // Pool threads allocate while the thread running the program moves through its calls
+    pthread_mutex_t lock;
+
+    memstats_frame_T *root;
+    memstats_frame_T *current;
+
+    // Live blocks by address, with open addressing, where removed blocks leave a tombstone behind
+    memstats_block_T *blocks;
+    size_t blocks_capacity;
+    size_t blocks_size;
+    // Slots taken by blocks and tombstones
+    size_t blocks_used;
+
+    memstats_tag_T tags[MEMSTATS_TAGS];
+    unsigned long live_bytes;
+    unsigned long peak_live_bytes;
+} memstats_T;
+
+/**
+ * Initializes empty allocation statistics.
+ * @return A pointer to the initialized statistics.
+ */
+memstats_T *init_memstats();
+
+/**
+ * Frees the statistics and everything they recorded.
+ * @param memstats The statistics.
+ */
+void memstats_free(memstats_T *memstats);
+
+/**
+ * Starts recording the blocks allocated from a heap, until the statistics are freed.
+ * @param memstats The statistics.
+ * @param heap The heap.
+ */
+void memstats_observe(memstats_T *memstats, heap_T *heap);
+
+/**
+ * Charges the allocations that follow to the top level again, for a new run or after one
+ * that stopped on an error or on exit().
+ * @param memstats The statistics.
+ */
+void memstats_reset_calls(memstats_T *memstats);
+
+/**
+ * Opens a call inside the current one.
+ * @param memstats The statistics.
+ * @param owner The blunt whose method is called, or NULL.
+ * @param name The name of the blunt or builtin called.
+ */
+void memstats_enter(memstats_T *memstats, const char *owner, const char *name);
+
+/**
+ * Closes the current call.
+ * @param memstats The statistics.
+ */
+void memstats_exit(memstats_T *memstats);
+
+/**
+ * Returns the name of a tag.
+ * @param tag The tag.
+ * @return The name, the AST type for nodes.
+ */
+const char *memstats_tag_to_string(int tag);
+
+/**
+ * Prints the allocations, bytes and peak live bytes of every tag to stderr, then the allocations
+ * made by every blunt itself, largest first.
+ * @param memstats The statistics.
+ */
+void memstats_print_stats(memstats_T *memstats);
+
+/**
+ * Writes a heap profile in the protocol buffer format of pprof, with the allocated and live
+ * blocks and bytes of every call stack. The innermost frame of a stack is the tag of its blocks.
+ * @param memstats The statistics.
+ * @param file The file to write to.
+ */
+void memstats_write_pprof(memstats_T *memstats, FILE *file);
+
+#endif // MEMSTATS_H
@@ -11,6 +11,9 @@ typedef struct PARSE_STRUCT
     token_T *current_token;
     token_T *peek_token;
     token_T *prev_token;
+    // Blunts of the script, found pure or not once all of them are parsed
+    AST_FUNCTION_DEFINITION_T **function_definitions;
+    size_t function_definitions_size;
 } parser_T;
 
 /**
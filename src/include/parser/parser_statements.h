@@ -17,6 +17,13 @@ AST_T *parser_parse_statement(parser_T *parser);
  */
 AST_T *parser_parse_statements(parser_T *parser);
 
+/**
+ * Marks the blunts of the script that are pure, which needs all of them parsed:
+ * a pure blunt may call sum, min, max and count only when the script defines no blunt of that name.
+ * @param parser The parser instance, done parsing.
+ */
+void parser_mark_pure_functions(parser_T *parser);
+
 /**
  * Parses a variable definition statement.
  * @param parser The parser instance.
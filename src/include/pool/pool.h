@@ -0,0 +1,91 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "../heap/heap.h"
+#include <pthread.h>
+#include <stddef.h>
+
+// Environment variable overriding the number of threads
+#define POOL_THREADS_ENV "BLUNT_THREADS"
+
+/**
+ * @brief Function running the chunk [begin, end) of a parallel range on a worker.
+ */
+typedef void (*pool_task_T)(void *context, size_t worker, size_t begin, size_t end);
+
+/**
+ * @brief Structure representing the chunks owned by one worker. The owner takes chunks from
+ * the bottom, idle workers steal them from the top.
+ */
+typedef struct POOL_DEQUE_STRUCT
+{
+    pthread_mutex_t lock;
+    size_t top;
+    size_t bottom;
+} pool_deque_T;
+
+/**
+ * @brief Structure representing a pool of worker threads running ranges with work stealing.
+ */
+typedef struct POOL_STRUCT
+{
+    // Worker 0 is the thread calling pool_run, the others are started once by init_pool
+    size_t threads_size;
+    pthread_t *threads;
+    struct POOL_WORKER_STRUCT *workers;
+    pool_deque_T *deques;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    // Incremented for every pool_run, so sleeping workers know there is a new range
+    unsigned long generation;
+    size_t workers_busy;
+    int shutting_down;
+
+    // The range being run
+    pool_task_T task;
+    void *context;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    // The caller's heap and logging, which the workers take on while they run the range
+    heap_T *heap;
+    int logging;
+
+    // Statistics
+    unsigned long chunks_stolen;
+} pool_T;
+
+/**
+ * Initializes a pool.
+ * @param threads_size The number of workers including the calling thread, 0 for BLUNT_THREADS or the number of CPUs.
+ * @return A pointer to the initialized pool.
+ */
+pool_T *init_pool(size_t threads_size);
+
+/**
+ * Runs task over [begin, end) split into chunks of grain iterations, and waits for every chunk.
+ * Each worker starts with a contiguous share of the chunks and steals from the others when it runs out.
+ * @param pool The pool.
+ * @param begin The first iteration.
+ * @param end The iteration after the last one.
+ * @param grain The number of iterations per chunk.
+ * @param task The function running a chunk.
+ * @param context The argument passed to task.
+ */
+void pool_run(pool_T *pool, size_t begin, size_t end, size_t grain, pool_task_T task, void *context);
+
+/**
+ * Returns the number of threads to use when none is given: BLUNT_THREADS if set, the number of CPUs otherwise.
+ * @return The number of threads.
+ */
+size_t pool_default_threads();
+
+/**
+ * Stops the workers and frees the pool.
+ * @param pool The pool.
+ */
+void pool_free(pool_T *pool);
+
+#endif // POOL_H
@@ -0,0 +1,96 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "../heap/heap.h"
+#include <stdio.h>
+
+/**
+ * @brief Structure representing a call stack: one blunt called from the stack of its parent.
+ * The frames form a tree whose root is the top level of the program.
+ */
+typedef struct PROFILE_FRAME_STRUCT
+{
+    // Blunt whose method was called, NULL for blunts and builtins called by name
+    const char *owner;
+    const char *name;
+    struct PROFILE_FRAME_STRUCT *parent;
+    struct PROFILE_FRAME_STRUCT *children;
+    struct PROFILE_FRAME_STRUCT *next;
+
+    unsigned long calls;
+    // Wall time spent in the stack, and the part of it spent in the stacks it called
+    unsigned long inclusive_ns;
+    unsigned long children_ns;
+    // When the open call of the stack started
+    unsigned long start_ns;
+} profile_frame_T;
+
+/**
+ * @brief Structure representing the calls recorded while running with --profile.
+ * Only the thread running the program records calls, time spent on pool threads counts for the
+ * call that started the loop.
+ */
+typedef struct PROFILE_STRUCT
+{
+    profile_frame_T *root;
+    // Innermost open call, NULL between runs
+    profile_frame_T *current;
+    // Heap the profile was made on, which its frames come from whichever heap the caller uses
+    heap_T *heap;
+} profile_T;
+
+/**
+ * Initializes a profile with no calls recorded.
+ * @return A pointer to the initialized profile.
+ */
+profile_T *init_profile();
+
+/**
+ * Opens the top level of a run.
+ * @param profile The profile.
+ */
+void profile_start(profile_T *profile);
+
+/**
+ * Closes the calls a run left open, including the top level, which happens when it stops
+ * on an error or on exit().
+ * @param profile The profile.
+ */
+void profile_stop(profile_T *profile);
+
+/**
+ * Opens a call inside the current one.
+ * @param profile The profile.
+ * @param owner The blunt whose method is called, or NULL.
+ * @param name The name of the blunt or builtin called.
+ */
+void profile_enter(profile_T *profile, const char *owner, const char *name);
+
+/**
+ * Closes the current call.
+ * @param profile The profile.
+ */
+void profile_exit(profile_T *profile);
+
+/**
+ * Counts one more call of the current blunt, for tail calls that reuse its frame.
+ * @param profile The profile.
+ */
+void profile_repeat(profile_T *profile);
+
+/**
+ * Prints the calls, inclusive and exclusive time of every blunt to stderr, most expensive first.
+ * Recursive calls count once in the inclusive time of a blunt.
+ * @param profile The profile.
+ */
+void profile_print_stats(profile_T *profile);
+
+/**
+ * Writes every call stack with its exclusive time in microseconds, one 'main;outer;inner 42' line
+ * per stack, the folded format flamegraph tools read.
+ * @param profile The profile.
+ * @param file The file to write to.
+ */
+void profile_write_folded(profile_T *profile, FILE *file);
+
+#endif // PROFILE_H
@@ -0,0 +1,117 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "../ast/AST.h"
+#include "../heap/heap.h"
+#include <signal.h>
+#include <stdio.h>
+
+// CPU time between two samples
+#define SAMPLE_INTERVAL_US 1000
+// Calls nested deeper than this are sampled as the call at the limit
+#define SAMPLE_STACK_SIZE 256
+#define SAMPLE_KINDS (AST_NOOP + 1)
+
+/**
+ * @brief Structure representing a blunt, a method or a builtin seen by the sampler,
+ * shared by every call site with the same name.
+ */
+typedef struct SAMPLE_FUNCTION_STRUCT
+{
+    // Blunt whose method was called, NULL for blunts and builtins called by name
+    const char *owner;
+    const char *name;
+    // Samples taken while it was the innermost call, and while it was anywhere on the stack
+    unsigned long self;
+    unsigned long total;
+    // Last sample counted in total, so that recursive calls count once
+    unsigned long last_sample;
+    struct SAMPLE_FUNCTION_STRUCT *next;
+} sample_function_T;
+
+/**
+ * @brief Structure representing a call site name mapped to its function.
+ */
+typedef struct SAMPLE_SLOT_STRUCT
+{
+    const char *owner;
+    const char *name;
+    sample_function_T *function;
+} sample_slot_T;
+
+/**
+ * @brief Structure representing the sampler of --sample: a shadow stack of the calls the visitor
+ * is in and the kind of node it is evaluating, which the SIGPROF handler reads, and the
+ * histograms the handler fills.
+ */
+typedef struct SAMPLE_STRUCT
+{
+    // Written by the visitor and read by the handler, which may interrupt it between any two writes
+    sample_function_T *stack[SAMPLE_STACK_SIZE];
+    volatile sig_atomic_t depth;
+    volatile sig_atomic_t kind;
+
+    // Written by the handler only, read once the timer is stopped
+    unsigned long samples;
+    unsigned long top_level;
+    unsigned long kinds[SAMPLE_KINDS];
+
+    // Functions by the address of the names at their call sites, so a call never compares strings
+    sample_slot_T *slots;
+    size_t slots_capacity;
+    size_t slots_size;
+    sample_function_T *functions;
+    // Heap the sampler was made on, which its slots and functions come from whichever heap the caller uses
+    heap_T *heap;
+} sample_T;
+
+/**
+ * Initializes a sampler with no samples.
+ * @return A pointer to the initialized sampler.
+ */
+sample_T *init_sample();
+
+/**
+ * Starts taking a sample every SAMPLE_INTERVAL_US of CPU time. The timer and the signal are
+ * process wide, so only one sampler may run at a time.
+ * @param sample The sampler.
+ */
+void sample_start(sample_T *sample);
+
+/**
+ * Stops the timer and empties the shadow stack, which errors and exit() leave as they were.
+ * @param sample The sampler.
+ */
+void sample_stop(sample_T *sample);
+
+/**
+ * Pushes a call on the shadow stack.
+ * @param sample The sampler.
+ * @param owner The blunt whose method is called, or NULL.
+ * @param name The name of the blunt or builtin called.
+ */
+void sample_enter(sample_T *sample, const char *owner, const char *name);
+
+/**
+ * Pops the innermost call from the shadow stack.
+ * @param sample The sampler.
+ */
+void sample_exit(sample_T *sample);
+
+/**
+ * Sets the kind of node being evaluated.
+ * @param sample The sampler.
+ * @param kind The type of the node.
+ * @return The kind evaluated before, to set back once the node is done.
+ */
+int sample_set_kind(sample_T *sample, int kind);
+
+/**
+ * Writes the samples of every blunt, with and without the blunts it called, and of every node kind,
+ * most sampled first.
+ * @param sample The sampler.
+ * @param file The file to write to.
+ */
+void sample_write_histogram(sample_T *sample, FILE *file);
+
+#endif // SAMPLE_H
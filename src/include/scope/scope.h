@@ -18,6 +18,8 @@ typedef struct SCOPE_STACK_STRUCT
 {
     scope_T *scope;
     struct SCOPE_STACK_STRUCT *parent;
+    // Scopes pushed under this one, 0 for the bottom of the stack
+    int depth;
 } scope_stack_T;
 
 scope_T *init_scope();
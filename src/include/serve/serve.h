@@ -0,0 +1,127 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "../blunt/blunt.h"
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Overrides the path of the socket; set to an empty string, it keeps scripts from using the daemon
+#define SERVE_SOCKET_ENV "BLUNT_SOCKET"
+
+// Scripts the daemon keeps parsed, the least recently run one is dropped for a new one
+#define SERVE_SCRIPTS 64
+
+// Longest request a client sends: its working directory and the path of the script, both NUL-terminated
+#define SERVE_REQUEST_SIZE 8192
+
+// The descriptors a client hands over: its stdin, stdout and stderr
+#define SERVE_DESCRIPTORS 3
+
+// Clients the daemon reads requests from or holds until a run ends, more wait in the backlog of the socket
+#define SERVE_CLIENTS 64
+
+// Time a client has to send its whole request before it is dropped
+#define SERVE_REQUEST_TIMEOUT_MS 5000
+
+/**
+ * @brief Structure representing a script the daemon parsed, kept until the file changes.
+ */
+typedef struct SERVE_SCRIPT_STRUCT
+{
+    char *path;
+    // What the file looked like when it was parsed
+    struct timespec mtime;
+    off_t size;
+    ino_t inode;
+
+    // The interpreter that mapped its tree from its cache file, never run in the daemon itself,
+    // NULL while there is no cache file matching it and the children of its runs parse it
+    blunt_T *blunt;
+    unsigned long used;
+
+    struct SERVE_SCRIPT_STRUCT *next;
+} serve_script_T;
+
+/**
+ * @brief Structure representing a client whose request is still arriving, or has arrived and waits for a run to end.
+ */
+typedef struct SERVE_CLIENT_STRUCT
+{
+    int connection;
+    char *request;
+    size_t size;
+    // The client's stdin, stdout and stderr, once they arrived with the request
+    int descriptors[SERVE_DESCRIPTORS];
+    int received;
+    int complete;
+    // When the request must have arrived, in milliseconds of the monotonic clock
+    long deadline;
+    // Clients run in the order they connected
+    unsigned long order;
+} serve_client_T;
+
+/**
+ * @brief Structure representing a run in progress, a child of the daemon.
+ */
+typedef struct SERVE_RUN_STRUCT
+{
+    pid_t pid;
+    // The client, which gets the exit status when the child is done
+    int connection;
+} serve_run_T;
+
+/**
+ * @brief Structure representing the daemon: its socket, its scripts and its runs.
+ */
+typedef struct SERVE_STRUCT
+{
+    const char *socket_path;
+    int listener;
+    // Written by the signal handlers, so that poll wakes up for them
+    int signals[2];
+
+    serve_script_T *scripts;
+    size_t scripts_size;
+    unsigned long clock;
+
+    // Clients read without blocking, so a slow one never holds up the others
+    serve_client_T clients[SERVE_CLIENTS];
+    int clients_size;
+    unsigned long arrivals;
+
+    // At most workers runs at a time, the clients whose request arrived wait for one to end
+    serve_run_T *runs;
+    int workers;
+    int running;
+} serve_T;
+
+/**
+ * Returns the path of the daemon's socket: SERVE_SOCKET_ENV when it is set, otherwise blunt.sock in
+ * $XDG_RUNTIME_DIR, or in a directory of the user in /tmp, which is only checked and never created.
+ * @param buffer Where to write the path.
+ * @param size The size of the buffer.
+ * @return The path, or NULL when SERVE_SOCKET_ENV is set to an empty string or the directory in /tmp is missing or not the user's alone.
+ */
+const char *serve_socket_path(char *buffer, size_t size);
+
+/**
+ * Runs the daemon until it gets SIGINT or SIGTERM. Each request runs in a child forked from the daemon,
+ * with the script already parsed and the client's stdin, stdout, stderr and working directory.
+ * The socket goes where serve_socket_path says, the directory in /tmp being created with no access
+ * for anyone else when it is missing.
+ * @param workers How many scripts may run at a time.
+ * @return 0 when it stopped on a signal, 1 when it could not start.
+ */
+int serve_run(int workers);
+
+/**
+ * Runs a script through the daemon, when one running as the user is listening on the socket.
+ * @param socket_path The path of the socket.
+ * @param filename The path of the script.
+ * @param exit_code Set to the exit code of the script when the daemon ran it.
+ * @return 1 when the daemon ran the script, 0 when no daemon took it and nothing ran.
+ */
+int serve_request(const char *socket_path, const char *filename, int *exit_code);
+
+#endif // SERVE_H
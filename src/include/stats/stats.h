@@ -0,0 +1,75 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "../ast/AST.h"
+
+// Phases of --stats, in the order they run
+#define STATS_READ 0
+#define STATS_LEX 1
+#define STATS_PARSE 2
+#define STATS_RUN 3
+#define STATS_PHASES 4
+
+/**
+ * @brief Structure representing the phase timings and counters reported by --stats.
+ */
+typedef struct STATS_STRUCT
+{
+    // Wall time of each phase, parsing without the time its tokens took to lex
+    long phases_ns[STATS_PHASES];
+
+    unsigned long tokens;
+    // Nodes of each type built by the parser and created while running
+    unsigned long parsed_nodes[AST_NOOP + 1];
+    unsigned long run_nodes[AST_NOOP + 1];
+    // The table init_ast counts into, one of the two above
+    unsigned long *nodes;
+    // Set when the tree came from its cache file, so nothing was lexed or parsed
+    int cached;
+
+    unsigned long scope_pushes;
+    int peak_scope_depth;
+    // Calls of blunts, methods and builtins, then those of blunts and methods alone
+    unsigned long calls;
+    unsigned long user_calls;
+} stats_T;
+
+/**
+ * The statistics the calling thread counts into, NULL when it counts nothing.
+ * Set directly, like the heap tag, so the counters cost one branch when --stats is off.
+ */
+extern _Thread_local stats_T *stats_active;
+
+/**
+ * Initializes empty statistics, counting nodes as parsed ones.
+ * @return A pointer to the initialized statistics.
+ */
+stats_T *init_stats();
+
+/**
+ * Frees the statistics.
+ * @param stats The statistics.
+ */
+void stats_free(stats_T *stats);
+
+/**
+ * Returns the time of a monotonic clock.
+ * @return The time in nanoseconds.
+ */
+long stats_now_ns();
+
+/**
+ * Returns the name of a phase.
+ * @param phase The phase.
+ * @return The name.
+ */
+const char *stats_phase_to_string(int phase);
+
+/**
+ * Prints the time of every phase, then the tokens, the nodes of every type, the scopes and the
+ * calls to stderr.
+ * @param stats The statistics.
+ */
+void stats_print(stats_T *stats);
+
+#endif // STATS_H
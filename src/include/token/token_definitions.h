@@ -105,6 +105,9 @@
 // Token type for the save keyword
 #define TOKEN_SAVE 35
 
+// Token type for the parallel for loop keyword
+#define TOKEN_PARALLEL 36
+
 // variable definition identifier
 #define ID_DEF_VAR "roll"
 
@@ -147,4 +150,7 @@
 // Save identifier
 #define ID_SAVE "keep"
 
+// Parallel for loop identifier
+#define ID_PARALLEL "parallel"
+
 #endif
\ No newline at end of file
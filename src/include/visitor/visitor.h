@@ -2,7 +2,14 @@
 #define VISITOR_H
 
 #include "../ast/AST.h"
+#include "../heap/heap.h"
 #include "../scope/scope.h"
+#include "../memo/memo.h"
+#include "../profile/profile.h"
+#include "../sample/sample.h"
+#include "../memstats/memstats.h"
+#include "../pool/pool.h"
+#include "../input/input.h"
 #include <stdlib.h>
 
 /**
@@ -13,6 +20,22 @@ typedef struct VISITOR_STRUCT
     scope_T *global_scope;
     scope_stack_T *scope_stack;
     AST_RUNTIME_FUNCTION_DEFINITION_T *current_function;
+    // Cache for the results of pure blunts, NULL when memoization is off
+    memo_T *memo;
+    // Calls recorded for --profile, NULL when profiling is off
+    profile_T *profile;
+    // Shadow stack sampled for --sample, NULL when sampling is off
+    sample_T *sample;
+    // Allocations recorded for --mem-stats, charged to the innermost call, NULL when they are not recorded
+    memstats_T *memstats;
+    // Threads running 'light parallel' loops, started by the first one
+    pool_T *pool;
+    // Heap the pool is made on, which outlives the heap of the run that starts it
+    heap_T *heap;
+    // Files read by readln, eof and loops over lines, opened by the first one
+    input_T *input;
+    // Set on the visitors of pool workers, which run nested parallel loops sequentially
+    int parallel_worker;
 } visitor_T;
 
 /**
@@ -37,6 +60,14 @@ AST_T *visitor_visit(visitor_T *visitor, AST_T *node);
  */
 AST_VARIABLE_DEFINITION_T *visitor_get_variable_definition(visitor_T *visitor, char *variable_name);
 
+/**
+ * Gets a function definition from the visitor, searching the scope stack first and then the global scope.
+ * @param visitor The visitor.
+ * @param function_name The name of the function.
+ * @return The function definition or NULL if it is not defined.
+ */
+AST_FUNCTION_DEFINITION_T *visitor_get_function_definition(visitor_T *visitor, char *function_name);
+
 // Function declarations
 
 /**
@@ -97,5 +128,8 @@ int visitor_get_node_value(visitor_T *visitor, AST_T *node);
 #include "visitor_function.h"
 #include "visitor_expression.h"
 #include "visitor_statement.h"
+#include "visitor_builtin.h"
+#include "visitor_idiom.h"
+#include "visitor_parallel.h"
 
 #endif // VISITOR_H
\ No newline at end of file
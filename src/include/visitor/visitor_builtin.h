@@ -0,0 +1,141 @@
+#ifndef VISITOR_BUILTIN_H
+#define VISITOR_BUILTIN_H
+
+#include "../ast/AST.h"
+#include "visitor.h"
+
+/**
+ * Sums the ints of an array: sum(array).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The sum, wrapping around on overflow.
+ */
+AST_T *builtin_sum(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Finds the smallest int of a non empty array: min(array).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The smallest int.
+ */
+AST_T *builtin_min(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Finds the largest int of a non empty array: max(array).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The largest int.
+ */
+AST_T *builtin_max(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Counts the elements of an int array equal to a value: count(array, value).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The number of equal elements.
+ */
+AST_T *builtin_count(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Sets every element of an array to a value: fill(array, value).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The array.
+ */
+AST_T *builtin_fill(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Multiplies every int of an array by a factor: scale(array, factor).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The array.
+ */
+AST_T *builtin_scale(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Adds the ints of a second array of the same length to the ints of the first one: add(array, other).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The first array.
+ */
+AST_T *builtin_add(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Folds an array with a blunt of two arguments, starting from init: reduce(array, blunt, init).
+ * Large int arrays reduced with a pure blunt are split into fixed chunks evaluated on the thread pool,
+ * and the chunk results are combined in order, so the blunt must be associative. The result does not
+ * depend on the number of threads. Small arrays and other blunts are folded in order on one thread.
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The folded value.
+ */
+AST_T *builtin_reduce(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Returns the stream of the file a string names, opening the visitor's input the first time.
+ * @param visitor The visitor.
+ * @param name The name of the builtin or statement reading the file, for errors.
+ * @param path The expression naming the file, "-" for stdin, or NULL for stdin.
+ * @return The stream.
+ */
+input_stream_T *builtin_input_stream(visitor_T *visitor, const char *name, AST_T *path);
+
+/**
+ * Reads the next line of a file, without its line ending: readln() from stdin or readln(path).
+ * Lines of regular files point into their mapping instead of being copied.
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The line, or an empty string when no line is left.
+ */
+AST_T *builtin_readln(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Tells whether a file has no line left: eof() for stdin or eof(path).
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return 1 when no line is left, 0 otherwise.
+ */
+AST_T *builtin_eof(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Loads one column of a CSV file: loadcsv(path, column), with the index of the column from 0, or its name
+ * in the header row. Int columns become packed arrays and other columns arrays of strings pointing into the file.
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The column.
+ */
+AST_T *builtin_loadcsv(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Binds an array of ints to a file of native ints: mapfile(path) maps every int of the file privately, so
+ * writes stay in memory, and mapfile(path, size) maps size ints shared, so writes go straight to the file,
+ * creating or growing it first. The array stays packed and is written in place.
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The mapped array.
+ */
+AST_T *builtin_mapfile(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+/**
+ * Writes the ints of an array mapped with mapfile(path, size) back to its file and waits for them: sync(array).
+ * Privately mapped arrays have nothing to write.
+ * @param visitor The visitor.
+ * @param arguments The arguments.
+ * @param arguments_size The size of the arguments.
+ * @return The array.
+ */
+AST_T *builtin_sync(visitor_T *visitor, AST_T **arguments, size_t arguments_size);
+
+#endif // VISITOR_BUILTIN_H
@@ -36,6 +36,16 @@ AST_T *visitor_visit_array(visitor_T *visitor, AST_ARRAY_T *node);
  */
 AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *node);
 
+/**
+ * Visits a dot expression whose value is only read, like an operand. An element of a packed array is
+ * read into scratch instead of a new node, so the result must not be kept past the next read into it.
+ * @param visitor The visitor.
+ * @param node The AST node representing the dot.
+ * @param scratch The int to read a packed element into.
+ * @return The result of the visit, scratch for a packed element.
+ */
+AST_T *visitor_visit_dot_expression_read(visitor_T *visitor, AST_DOT_EXPRESSION_T *node, AST_INT_T *scratch);
+
 /**
  * Visits a dot dot expresion node in the AST.
  * @param visitor The visitor.
@@ -37,4 +37,14 @@ AST_T *visitor_visit_function_definition(visitor_T *visitor, AST_FUNCTION_DEFINI
  */
 AST_T *visitor_visit_function_call_from_definition(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *function_definition, AST_FUNCTION_CALL_T *function_call);
 
+/**
+ * Rebinds the arguments of the current frame for a tail call to the same function.
+ * @param visitor The visitor.
+ * @param runtime_function_definition The runtime function definition of the current frame.
+ * @param arguments The argument definitions of the current frame.
+ * @param arguments_size The number of arguments.
+ * @param tail_call The AST node representing the tail call.
+ */
+void visitor_rebind_tail_call_arguments(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *runtime_function_definition, AST_VARIABLE_DEFINITION_T **arguments, size_t arguments_size, AST_FUNCTION_CALL_T *tail_call);
+
 #endif // VISITOR_FUNCTION_H
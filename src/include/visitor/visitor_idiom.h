@@ -0,0 +1,21 @@
+#ifndef VISITOR_IDIOM_H
+#define VISITOR_IDIOM_H
+
+#include "../ast/AST.h"
+#include "visitor.h"
+
+/**
+ * Runs a for loop as a native kernel when its body is a recognized idiom over int arrays:
+ * a map (x.i = <expression>, which covers fill and shift) or an accumulation (s = s + <expression>).
+ * Expressions may use +, -, *, int literals, ints not written by the loop, the iterator and
+ * array elements at the iterator plus a constant. Anything else, including calls, prints and
+ * reads of elements the loop has already written, is left to the interpreter.
+ * @param visitor The visitor.
+ * @param node The for loop.
+ * @param condition The condition of the loop, or the default one built for this run.
+ * @param increment_variable_definition The definition of the iterator.
+ * @return 1 if the loop ran, 0 if it must be interpreted.
+ */
+int visitor_run_loop_idiom(visitor_T *visitor, AST_FOR_LOOP_T *node, AST_T *condition, AST_VARIABLE_DEFINITION_T *increment_variable_definition);
+
+#endif // VISITOR_IDIOM_H
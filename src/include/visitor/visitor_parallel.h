@@ -0,0 +1,41 @@
+#ifndef VISITOR_PARALLEL_H
+#define VISITOR_PARALLEL_H
+
+#include "../ast/AST.h"
+#include "visitor.h"
+
+/**
+ * Runs a 'light parallel' loop, splitting its iterations over the visitor's thread pool.
+ * Every worker evaluates the shared body in its own scope frame, with its own iterator.
+ * The body may only write the element of the iterated array at the iterator and variables it rolls
+ * itself, may only read the iterated array at the iterator or through len, and may only call
+ * len, sum, min, max and count. Any other body is rejected with an error.
+ * @param visitor The visitor.
+ * @param node The for loop.
+ * @param condition The condition of the loop, or the default one built for this run.
+ * @param increment_variable_definition The definition of the iterator, left at the end of the range.
+ */
+void visitor_run_parallel_loop(visitor_T *visitor, AST_FOR_LOOP_T *node, AST_T *condition, AST_VARIABLE_DEFINITION_T *increment_variable_definition);
+
+/**
+ * Returns the thread pool of the visitor, starting it on first use.
+ * @param visitor The visitor.
+ * @return The pool.
+ */
+pool_T *visitor_get_pool(visitor_T *visitor);
+
+/**
+ * Creates the visitor of a pool worker. It shares the global scope and the scopes of visitor,
+ * with an empty frame of its own on top for the definitions only the worker may see.
+ * @param visitor The visitor starting the parallel work.
+ * @return The worker visitor.
+ */
+visitor_T *init_parallel_worker(visitor_T *visitor);
+
+/**
+ * Frees a worker visitor and its frame, leaving the shared scopes alone.
+ * @param worker The worker visitor.
+ */
+void free_parallel_worker(visitor_T *worker);
+
+#endif // VISITOR_PARALLEL_H
@@ -0,0 +1,353 @@
+#include "../include/input/input.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+input_T *init_input()
+{
+    return heap_calloc(1, sizeof(struct INPUT_STRUCT));
+}
+
+static void input_free_streams(input_stream_T *stream)
+{
+    while (stream)
+    {
+        input_stream_T *next = stream->next;
+        if (stream->data)
+        {
+            munmap(stream->data, stream->size);
+        }
+        if (stream->path && stream->fd >= 0)
+        {
+            close(stream->fd);
+        }
+        heap_free(stream->buffer);
+        heap_free(stream->path);
+        heap_free(stream);
+        stream = next;
+    }
+}
+
+void input_free(input_T *input)
+{
+    input_free_streams(input->streams);
+    input_free_streams(input->maps);
+    input_free_streams(input->arrays);
+    heap_free(input);
+}
+
+void input_rewind(input_T *input)
+{
+    for (input_stream_T *stream = input->streams; stream; stream = stream->next)
+    {
+        stream->position = 0;
+    }
+}
+
+// Maps a regular file, so its lines cost no copy; anything else gets a buffer
+static void input_start(input_stream_T *stream)
+{
+    struct stat status;
+    if (fstat(stream->fd, &status) == 0 && S_ISREG(status.st_mode))
+    {
+        stream->size = status.st_size;
+        if (stream->size == 0)
+        {
+            return;
+        }
+
+        // Private and writable, so that nothing writing into a string can reach the file
+        void *data = mmap(NULL, stream->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, stream->fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, stream->size, MADV_SEQUENTIAL);
+            stream->data = data;
+            return;
+        }
+        stream->size = 0;
+    }
+
+    stream->buffer_capacity = INPUT_BUFFER_SIZE;
+    stream->buffer = heap_malloc(stream->buffer_capacity);
+}
+
+// Finds the stream of a path in a list, NULL standing for stdin
+static input_stream_T *input_find(input_stream_T *stream, const char *path)
+{
+    for (; stream; stream = stream->next)
+    {
+        if (stream->path == path || (stream->path && path && strcmp(stream->path, path) == 0))
+        {
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static input_stream_T *input_start_stream(const char *path)
+{
+    int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0)
+    {
+        log_error("Could not open file %s\n", path);
+        error_exit(1);
+    }
+
+    input_stream_T *stream = heap_calloc(1, sizeof(struct INPUT_STREAM_STRUCT));
+    stream->path = path ? heap_strdup(path) : NULL;
+    stream->fd = fd;
+    input_start(stream);
+
+    // A mapping outlives the descriptor it came from
+    if (stream->data && path)
+    {
+        close(fd);
+        stream->fd = -1;
+    }
+    return stream;
+}
+
+input_stream_T *input_open(input_T *input, const char *path)
+{
+    if (path && strcmp(path, "-") == 0)
+    {
+        path = NULL;
+    }
+
+    input_stream_T *stream = input_find(input->streams, path);
+    if (!stream)
+    {
+        stream = input_start_stream(path);
+        stream->next = input->streams;
+        input->streams = stream;
+    }
+    return stream;
+}
+
+// Reads more bytes after the ones the buffer holds, making room for them first
+static void input_fill(input_stream_T *stream)
+{
+    if (stream->buffer_start > 0)
+    {
+        memmove(stream->buffer, stream->buffer + stream->buffer_start, stream->buffer_end - stream->buffer_start);
+        stream->buffer_end -= stream->buffer_start;
+        stream->buffer_start = 0;
+    }
+    // A line longer than the buffer grows it
+    if (stream->buffer_end == stream->buffer_capacity)
+    {
+        stream->buffer_capacity *= 2;
+        stream->buffer = heap_realloc(stream->buffer, stream->buffer_capacity);
+    }
+
+    ssize_t size;
+    do
+    {
+        size = read(stream->fd, stream->buffer + stream->buffer_end, stream->buffer_capacity - stream->buffer_end);
+    } while (size < 0 && errno == EINTR);
+
+    if (size < 0)
+    {
+        log_error("Could not read %s\n", stream->path ? stream->path : "stdin");
+        error_exit(1);
+    }
+    if (size == 0)
+    {
+        stream->ended = 1;
+    }
+    stream->buffer_end += size;
+}
+
+static size_t input_line_length(const char *line, size_t length)
+{
+    // Lines of files written on Windows end in "\r\n"
+    if (length > 0 && line[length - 1] == '\r')
+    {
+        return length - 1;
+    }
+    return length;
+}
+
+static AST_STRING_T *input_copy_line(const char *line, size_t length)
+{
+    length = input_line_length(line, length);
+
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_STRING;
+    char *value = heap_strndup(line, length);
+    heap_tag = tag;
+
+    return init_ast_string(value, length);
+}
+
+static AST_STRING_T *input_read_mapped_line(input_stream_T *stream)
+{
+    if (stream->position >= stream->size)
+    {
+        return NULL;
+    }
+
+    char *line = stream->data + stream->position;
+    size_t left = stream->size - stream->position;
+    // Strings are read up to their length, so a line can end at its newline, or at the end of the file for the last one
+    char *newline = memchr(line, '\n', left);
+    size_t length = newline ? (size_t)(newline - line) : left;
+    stream->position += newline ? length + 1 : length;
+    return init_ast_string(line, input_line_length(line, length));
+}
+
+AST_STRING_T *input_read_line(input_stream_T *stream)
+{
+    if (!stream->buffer)
+    {
+        return input_read_mapped_line(stream);
+    }
+
+    while (1)
+    {
+        char *line = stream->buffer + stream->buffer_start;
+        size_t left = stream->buffer_end - stream->buffer_start;
+        char *newline = memchr(line, '\n', left);
+        if (newline)
+        {
+            stream->buffer_start += newline - line + 1;
+            return input_copy_line(line, newline - line);
+        }
+
+        if (stream->ended)
+        {
+            if (left == 0)
+            {
+                return NULL;
+            }
+            stream->buffer_start = stream->buffer_end;
+            return input_copy_line(line, left);
+        }
+
+        input_fill(stream);
+    }
+}
+
+int input_eof(input_stream_T *stream)
+{
+    if (!stream->buffer)
+    {
+        return stream->position >= stream->size;
+    }
+
+    while (stream->buffer_start == stream->buffer_end && !stream->ended)
+    {
+        input_fill(stream);
+    }
+    return stream->buffer_start == stream->buffer_end;
+}
+
+char *input_map(input_T *input, const char *path, size_t *size)
+{
+    if (path && strcmp(path, "-") == 0)
+    {
+        path = NULL;
+    }
+
+    input_stream_T *map = input_find(input->maps, path);
+    if (!map)
+    {
+        map = input_start_stream(path);
+        if (map->buffer)
+        {
+            while (!map->ended)
+            {
+                input_fill(map);
+            }
+        }
+        map->next = input->maps;
+        input->maps = map;
+    }
+
+    if (map->buffer)
+    {
+        *size = map->buffer_end;
+        return map->buffer;
+    }
+    *size = map->size;
+    return map->data;
+}
+
+int32_t *input_map_ints(input_T *input, const char *path, size_t *size, int shared)
+{
+    if (shared)
+    {
+        for (input_stream_T *array = input->arrays; array; array = array->next)
+        {
+            if (array->shared && array->size == *size * sizeof(int32_t) && strcmp(array->path, path) == 0)
+            {
+                return (int32_t *)array->data;
+            }
+        }
+    }
+
+    int fd = shared ? open(path, O_RDWR | O_CREAT, 0644) : open(path, O_RDONLY);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0)
+    {
+        log_error("Could not open file %s\n", path);
+        error_exit(1);
+    }
+
+    size_t bytes = shared ? *size * sizeof(int32_t) : (size_t)status.st_size / sizeof(int32_t) * sizeof(int32_t);
+    if (shared && (size_t)status.st_size < bytes && ftruncate(fd, bytes) != 0)
+    {
+        log_error("Could not grow file %s to %lu ints\n", path, *size);
+        error_exit(1);
+    }
+
+    void *data = NULL;
+    if (bytes > 0)
+    {
+        // Private mappings are writable too, their writes stay in memory
+        data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            log_error("Could not map file %s\n", path);
+            error_exit(1);
+        }
+    }
+    close(fd);
+
+    input_stream_T *array = heap_calloc(1, sizeof(struct INPUT_STREAM_STRUCT));
+    array->path = heap_strdup(path);
+    array->fd = -1;
+    array->shared = shared;
+    array->data = data;
+    array->size = bytes;
+    array->next = input->arrays;
+    input->arrays = array;
+
+    *size = bytes / sizeof(int32_t);
+    return data;
+}
+
+void input_sync_ints(int32_t *ints, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    // msync wants the start of a page, and slices start anywhere
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)ints & ~(page_size - 1);
+    uintptr_t end = (uintptr_t)(ints + size);
+    if (msync((void *)start, end - start, MS_SYNC) != 0)
+    {
+        log_error("Could not write a mapped array back to its file\n");
+        error_exit(1);
+    }
+}
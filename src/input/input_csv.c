@@ -0,0 +1,250 @@
+#include "../include/input/input_csv.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/kernel/kernel.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdint.h>
+#include <string.h>
+
+// Reads the field starting at position and leaves position on the ',' or '\n' after it, or at the end.
+// Sets escaped when the field is quoted and holds "", which the caller has to turn into single quotes.
+static void input_csv_field(const kernel_T *kernel, char *data, size_t size, size_t *position, char **value, size_t *length, int *escaped)
+{
+    size_t start = *position;
+    *escaped = 0;
+
+    if (start < size && data[start] == '"')
+    {
+        size_t end = start + 1;
+        while (1)
+        {
+            char *quote = memchr(data + end, '"', size - end);
+            if (!quote)
+            {
+                log_error("loadcsv: a quoted field never ends\n");
+                error_exit(1);
+            }
+            end = quote - data + 1;
+            if (end < size && data[end] == '"')
+            {
+                *escaped = 1;
+                end++;
+                continue;
+            }
+            break;
+        }
+
+        *value = data + start + 1;
+        *length = end - start - 2;
+        // Anything between the closing quote and the delimiter, like the '\r' of "\r\n", is dropped
+        *position = end + kernel->find_either(data + end, size - end, ',', '\n');
+        return;
+    }
+
+    size_t end = start + kernel->find_either(data + start, size - start, ',', '\n');
+    *value = data + start;
+    *length = end - start;
+    if (*length > 0 && data[end - 1] == '\r')
+    {
+        (*length)--;
+    }
+    *position = end;
+}
+
+// Copies a quoted field with "" in it, keeping one quote of each pair
+static char *input_csv_unescape(const char *value, size_t *length)
+{
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_STRING;
+    char *unescaped = heap_malloc(*length + 1);
+    heap_tag = tag;
+
+    size_t size = 0;
+    for (size_t i = 0; i < *length; i++)
+    {
+        unescaped[size++] = value[i];
+        if (value[i] == '"')
+        {
+            i++;
+        }
+    }
+    unescaped[size] = '\0';
+
+    *length = size;
+    return unescaped;
+}
+
+// Parses a field as an int, returning 0 when it is anything else or does not fit
+static int input_csv_int(const char *value, size_t length, int32_t *result)
+{
+    size_t i = 0;
+    int negative = 0;
+    if (length > 0 && (value[0] == '-' || value[0] == '+'))
+    {
+        negative = value[0] == '-';
+        i = 1;
+    }
+    if (i == length)
+    {
+        return 0;
+    }
+
+    int64_t magnitude = 0;
+    for (; i < length; i++)
+    {
+        unsigned int digit = (unsigned char)value[i] - '0';
+        if (digit > 9)
+        {
+            return 0;
+        }
+        magnitude = magnitude * 10 + digit;
+        if (magnitude > (int64_t)INT32_MAX + 1)
+        {
+            return 0;
+        }
+    }
+    if (!negative && magnitude > INT32_MAX)
+    {
+        return 0;
+    }
+
+    *result = (int32_t)(negative ? -magnitude : magnitude);
+    return 1;
+}
+
+// Skips the rest of a row, leaving position on its first byte after the '\n'
+static void input_csv_skip_row(const kernel_T *kernel, char *data, size_t size, size_t *position)
+{
+    char *value;
+    size_t length;
+    int escaped;
+    while (*position < size && data[*position] == ',')
+    {
+        (*position)++;
+        input_csv_field(kernel, data, size, position, &value, &length, &escaped);
+    }
+    (*position)++;
+}
+
+// Finds the index of a column in the header row and skips the row
+static int input_csv_header(const kernel_T *kernel, char *data, size_t size, size_t *position, const char *column_name)
+{
+    size_t name_length = strlen(column_name);
+    int column = 0;
+    int found = -1;
+    while (1)
+    {
+        char *value;
+        size_t length;
+        int escaped;
+        input_csv_field(kernel, data, size, position, &value, &length, &escaped);
+        if (found < 0 && !escaped && length == name_length && memcmp(value, column_name, length) == 0)
+        {
+            found = column;
+        }
+
+        if (*position >= size || data[*position] != ',')
+        {
+            break;
+        }
+        (*position)++;
+        column++;
+    }
+    (*position)++;
+
+    if (found < 0)
+    {
+        log_error("loadcsv: no column %s in the header\n", column_name);
+        error_exit(1);
+    }
+    return found;
+}
+
+AST_ARRAY_T *input_load_csv(input_T *input, const char *path, int column, const char *column_name)
+{
+    size_t size;
+    char *data = input_map(input, path, &size);
+    const kernel_T *kernel = kernel_get();
+
+    size_t position = 0;
+    if (column_name)
+    {
+        column = input_csv_header(kernel, data, size, &position, column_name);
+    }
+    if (column < 0)
+    {
+        log_error("loadcsv: column %d does not exist\n", column);
+        error_exit(1);
+    }
+
+    // Every field is kept, and ints as well while every field so far was one
+    size_t capacity = 1024;
+    size_t rows = 0;
+    AST_ARRAY_FIELD_T *fields = heap_malloc(capacity * sizeof(AST_ARRAY_FIELD_T));
+    int32_t *ints = heap_malloc(capacity * sizeof(int32_t));
+
+    while (position < size)
+    {
+        if (data[position] == '\n' || (data[position] == '\r' && position + 1 < size && data[position + 1] == '\n'))
+        {
+            position += data[position] == '\n' ? 1 : 2;
+            continue;
+        }
+
+        char *value;
+        size_t length;
+        int escaped;
+        input_csv_field(kernel, data, size, &position, &value, &length, &escaped);
+        for (int field = 0; field < column; field++)
+        {
+            if (position >= size || data[position] != ',')
+            {
+                log_error("loadcsv: row %lu has no column %d\n", rows + 1, column);
+                error_exit(1);
+            }
+            position++;
+            input_csv_field(kernel, data, size, &position, &value, &length, &escaped);
+        }
+        if (escaped)
+        {
+            value = input_csv_unescape(value, &length);
+        }
+
+        if (rows == capacity)
+        {
+            capacity *= 2;
+            fields = heap_realloc(fields, capacity * sizeof(AST_ARRAY_FIELD_T));
+            if (ints)
+            {
+                ints = heap_realloc(ints, capacity * sizeof(int32_t));
+            }
+        }
+        fields[rows].field_value = value;
+        fields[rows].field_length = length;
+        if (ints && !input_csv_int(value, length, &ints[rows]))
+        {
+            heap_free(ints);
+            ints = NULL;
+        }
+        rows++;
+
+        input_csv_skip_row(kernel, data, size, &position);
+    }
+
+    LOG_PRINT("Loaded %lu rows of column %d as %s\n", rows, column, ints && rows ? "ints" : "fields");
+
+    AST_ARRAY_T *array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    array->array_size = rows;
+    if (ints && rows > 0)
+    {
+        array->array_ints = ints;
+        heap_free(fields);
+    }
+    else
+    {
+        array->array_fields = fields;
+        heap_free(ints);
+    }
+    return array;
+}
@@ -0,0 +1,41 @@
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdlib.h>
+
+static _Thread_local error_trap_T *error_trap = NULL;
+
+void error_trap_set(error_trap_T *trap)
+{
+    trap->status = 0;
+    trap->message[0] = '\0';
+    trap->message_size = 0;
+    trap->parent = error_trap;
+    error_trap = trap;
+}
+
+void error_trap_clear(error_trap_T *trap)
+{
+    error_trap = trap->parent;
+}
+
+error_trap_T *error_trap_current()
+{
+    return error_trap;
+}
+
+_Noreturn void error_exit(int status)
+{
+    if (!error_trap)
+    {
+        exit(status);
+    }
+
+    error_trap->status = status;
+    longjmp(error_trap->jump, 1);
+}
+
+_Noreturn void error_raise(error_trap_T *trap)
+{
+    log_error("%s", trap->message);
+    error_exit(trap->status);
+}
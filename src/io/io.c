@@ -1,4 +1,7 @@
 #include "../include/io/io.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -8,15 +11,15 @@ char *read_file(const char *filename)
 
     if (!file)
     {
-        fprintf(stderr, "Error opening file: %s\n", filename);
-        exit(1);
+        log_error("Error opening file: %s\n", filename);
+        error_exit(1);
     }
 
     fseek(file, 0, SEEK_END);
     long length = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    char *buffer = calloc(1, length + 1);
+    char *buffer = heap_calloc(1, length + 1);
     fread(buffer, 1, length, file);
     fclose(file);
 
@@ -1,12 +1,29 @@
 #include "../include/io/logger.h"
+#include "../include/io/error.h"
 #include <stdarg.h>
 
-int LOGGING_ENABLED = 0;
+_Thread_local int LOGGING_ENABLED = 0;
 
 void log_error(const char *format, ...)
 {
     va_list args;
     va_start(args, format);
-    vfprintf(stderr, format, args);
+
+    // Under a trap the message is kept for whoever set it, instead of going to stderr
+    error_trap_T *trap = error_trap_current();
+    if (trap)
+    {
+        size_t space = ERROR_MESSAGE_SIZE - trap->message_size;
+        int written = vsnprintf(trap->message + trap->message_size, space, format, args);
+        if (written > 0)
+        {
+            trap->message_size += (size_t)written < space ? (size_t)written : space - 1;
+        }
+    }
+    else
+    {
+        vfprintf(stderr, format, args);
+    }
+
     va_end(args);
-}
\ No newline at end of file
+}
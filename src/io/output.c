@@ -0,0 +1,219 @@
+#include "../include/io/output.h"
+#include "../include/io/logger.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest decimal int, sign included
+#define OUTPUT_INT_SIZE 11
+
+static output_T output = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static pthread_once_t output_once = PTHREAD_ONCE_INIT;
+// Only the thread printing writes into its capture, so it needs no lock
+static __thread output_capture_T *output_captured = NULL;
+
+// Two digits at a time halves the divisions
+static const char output_digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void output_init()
+{
+    output.line_buffered = isatty(STDOUT_FILENO);
+    atexit(output_flush);
+}
+
+static void output_write_all(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // Like stdio, a closed or broken stdout loses the output instead of stopping the program
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+static void output_flush_locked()
+{
+    // Verbose logs and hosts still print through stdio, and what they printed came first
+    fflush(stdout);
+    output_write_all(output.buffer, output.size);
+    output.size = 0;
+}
+
+static void output_begin()
+{
+    pthread_once(&output_once, output_init);
+    pthread_mutex_lock(&output.lock);
+}
+
+static void output_end(int ended_line)
+{
+    // Verbose logs go to stdout through stdio, so with them on the output cannot wait either
+    if (LOGGING_ENABLED || (ended_line && output.line_buffered))
+    {
+        output_flush_locked();
+    }
+    pthread_mutex_unlock(&output.lock);
+}
+
+// Writes the digits of value so that they end right before end, and returns where they start
+static char *output_format_int(int value, char *end)
+{
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    char *start = end;
+    while (magnitude >= 100)
+    {
+        unsigned int pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        *--start = output_digit_pairs[pair + 1];
+        *--start = output_digit_pairs[pair];
+    }
+    if (magnitude >= 10)
+    {
+        *--start = output_digit_pairs[magnitude * 2 + 1];
+        *--start = output_digit_pairs[magnitude * 2];
+    }
+    else
+    {
+        *--start = '0' + magnitude;
+    }
+
+    if (value < 0)
+    {
+        *--start = '-';
+    }
+    return start;
+}
+
+static void output_append_int(int value)
+{
+    if (OUTPUT_BUFFER_SIZE - output.size < OUTPUT_INT_SIZE + 1)
+    {
+        output_flush_locked();
+    }
+
+    char digits[OUTPUT_INT_SIZE];
+    char *start = output_format_int(value, digits + OUTPUT_INT_SIZE);
+    size_t size = digits + OUTPUT_INT_SIZE - start;
+    memcpy(output.buffer + output.size, start, size);
+    output.size += size;
+}
+
+static void output_capture_append(const char *data, size_t size)
+{
+    output_capture_T *capture = output_captured;
+    if (size > capture->capacity - capture->size)
+    {
+        size_t capacity = capture->capacity ? capture->capacity : 256;
+        while (size > capacity - capture->size)
+        {
+            capacity *= 2;
+        }
+        char *grown = realloc(capture->data, capacity);
+        if (!grown)
+        {
+            // Like a full disk, a capture that cannot grow loses the output instead of stopping the program
+            return;
+        }
+        capture->data = grown;
+        capture->capacity = capacity;
+    }
+    memcpy(capture->data + capture->size, data, size);
+    capture->size += size;
+}
+
+void output_capture(output_capture_T *capture)
+{
+    output_captured = capture;
+}
+
+void output_write(const char *data, size_t size)
+{
+    if (output_captured)
+    {
+        output_capture_append(data, size);
+        return;
+    }
+
+    output_begin();
+
+    if (size > OUTPUT_BUFFER_SIZE - output.size)
+    {
+        output_flush_locked();
+    }
+    if (size >= OUTPUT_BUFFER_SIZE)
+    {
+        // Too large to be worth copying, it goes out in one write
+        output_write_all(data, size);
+    }
+    else
+    {
+        memcpy(output.buffer + output.size, data, size);
+        output.size += size;
+    }
+
+    output_end(output.line_buffered && memchr(data, '\n', size) != NULL);
+}
+
+void output_write_int(int value)
+{
+    if (output_captured)
+    {
+        char digits[OUTPUT_INT_SIZE];
+        char *start = output_format_int(value, digits + OUTPUT_INT_SIZE);
+        output_capture_append(start, digits + OUTPUT_INT_SIZE - start);
+        return;
+    }
+
+    output_begin();
+    output_append_int(value);
+    output_end(0);
+}
+
+void output_write_ints(const int *values, size_t size)
+{
+    if (output_captured)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            output_write_int(values[i]);
+            if (i + 1 < size)
+            {
+                output_capture_append(" ", 1);
+            }
+        }
+        return;
+    }
+
+    output_begin();
+    for (size_t i = 0; i < size; i++)
+    {
+        output_append_int(values[i]);
+        if (i + 1 < size)
+        {
+            output.buffer[output.size++] = ' ';
+        }
+    }
+    output_end(0);
+}
+
+void output_flush()
+{
+    pthread_mutex_lock(&output.lock);
+    output_flush_locked();
+    pthread_mutex_unlock(&output.lock);
+}
@@ -0,0 +1,455 @@
+#include "../include/kernel/kernel.h"
+#include "../include/io/logger.h"
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86 1
+#endif
+
+// Scalar kernels, also used for the tails the vector loops leave behind.
+// Sums and products go through uint32_t so that overflow wraps instead of being undefined.
+
+static int32_t kernel_scalar_sum(const int32_t *values, size_t size)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += (uint32_t)values[i];
+    return (int32_t)sum;
+}
+
+static int32_t kernel_scalar_min(const int32_t *values, size_t size)
+{
+    int32_t min = values[0];
+    for (size_t i = 1; i < size; i++)
+        if (values[i] < min)
+            min = values[i];
+    return min;
+}
+
+static int32_t kernel_scalar_max(const int32_t *values, size_t size)
+{
+    int32_t max = values[0];
+    for (size_t i = 1; i < size; i++)
+        if (values[i] > max)
+            max = values[i];
+    return max;
+}
+
+static size_t kernel_scalar_count(const int32_t *values, size_t size, int32_t value)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < size; i++)
+        count += values[i] == value;
+    return count;
+}
+
+static void kernel_scalar_fill(int32_t *values, size_t size, int32_t value)
+{
+    for (size_t i = 0; i < size; i++)
+        values[i] = value;
+}
+
+static void kernel_scalar_scale(int32_t *values, size_t size, int32_t factor)
+{
+    for (size_t i = 0; i < size; i++)
+        values[i] = (int32_t)((uint32_t)values[i] * (uint32_t)factor);
+}
+
+static void kernel_scalar_add(int32_t *values, const int32_t *other, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        values[i] = (int32_t)((uint32_t)values[i] + (uint32_t)other[i]);
+}
+
+static void kernel_scalar_sub(int32_t *values, const int32_t *other, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        values[i] = (int32_t)((uint32_t)values[i] - (uint32_t)other[i]);
+}
+
+static void kernel_scalar_mul(int32_t *values, const int32_t *other, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        values[i] = (int32_t)((uint32_t)values[i] * (uint32_t)other[i]);
+}
+
+static size_t kernel_scalar_find_either(const char *bytes, size_t size, char first, char second)
+{
+    for (size_t i = 0; i < size; i++)
+        if (bytes[i] == first || bytes[i] == second)
+            return i;
+    return size;
+}
+
+static const kernel_T kernel_scalar = {
+    "scalar",
+    kernel_scalar_sum,
+    kernel_scalar_min,
+    kernel_scalar_max,
+    kernel_scalar_count,
+    kernel_scalar_fill,
+    kernel_scalar_scale,
+    kernel_scalar_add,
+    kernel_scalar_sub,
+    kernel_scalar_mul,
+    kernel_scalar_find_either,
+};
+
+#ifdef KERNEL_X86
+
+// SSE4.1 kernels, 4 ints per vector
+
+__attribute__((target("sse4.1"))) static int32_t kernel_sse_sum(const int32_t *values, size_t size)
+{
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i *)&values[i]));
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    return (int32_t)((uint32_t)kernel_scalar_sum(lanes, 4) + (uint32_t)kernel_scalar_sum(&values[i], size - i));
+}
+
+__attribute__((target("sse4.1"))) static int32_t kernel_sse_min(const int32_t *values, size_t size)
+{
+    if (size < 4)
+        return kernel_scalar_min(values, size);
+
+    __m128i min = _mm_loadu_si128((const __m128i *)values);
+    size_t i = 4;
+    for (; i + 4 <= size; i += 4)
+        min = _mm_min_epi32(min, _mm_loadu_si128((const __m128i *)&values[i]));
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, min);
+    int32_t result = kernel_scalar_min(lanes, 4);
+    if (i < size)
+    {
+        int32_t tail = kernel_scalar_min(&values[i], size - i);
+        result = tail < result ? tail : result;
+    }
+    return result;
+}
+
+__attribute__((target("sse4.1"))) static int32_t kernel_sse_max(const int32_t *values, size_t size)
+{
+    if (size < 4)
+        return kernel_scalar_max(values, size);
+
+    __m128i max = _mm_loadu_si128((const __m128i *)values);
+    size_t i = 4;
+    for (; i + 4 <= size; i += 4)
+        max = _mm_max_epi32(max, _mm_loadu_si128((const __m128i *)&values[i]));
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, max);
+    int32_t result = kernel_scalar_max(lanes, 4);
+    if (i < size)
+    {
+        int32_t tail = kernel_scalar_max(&values[i], size - i);
+        result = tail > result ? tail : result;
+    }
+    return result;
+}
+
+__attribute__((target("sse4.1"))) static size_t kernel_sse_count(const int32_t *values, size_t size, int32_t value)
+{
+    // Equal lanes compare to -1, so subtracting the comparison counts them
+    __m128i needle = _mm_set1_epi32(value);
+    __m128i counts = _mm_setzero_si128();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 4 <= size)
+    {
+        // Flush the 32 bit lane counters before they can overflow
+        size_t block_end = size - i > (size_t)INT32_MAX ? i + (size_t)INT32_MAX : size;
+        for (; i + 4 <= block_end; i += 4)
+            counts = _mm_sub_epi32(counts, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&values[i]), needle));
+
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, counts);
+        count += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        counts = _mm_setzero_si128();
+    }
+    return count + kernel_scalar_count(&values[i], size - i, value);
+}
+
+__attribute__((target("sse4.1"))) static void kernel_sse_fill(int32_t *values, size_t size, int32_t value)
+{
+    __m128i fill = _mm_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+        _mm_storeu_si128((__m128i *)&values[i], fill);
+    kernel_scalar_fill(&values[i], size - i, value);
+}
+
+__attribute__((target("sse4.1"))) static void kernel_sse_scale(int32_t *values, size_t size, int32_t factor)
+{
+    __m128i scale = _mm_set1_epi32(factor);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i *vector = (__m128i *)&values[i];
+        _mm_storeu_si128(vector, _mm_mullo_epi32(_mm_loadu_si128(vector), scale));
+    }
+    kernel_scalar_scale(&values[i], size - i, factor);
+}
+
+__attribute__((target("sse4.1"))) static void kernel_sse_add(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i *vector = (__m128i *)&values[i];
+        _mm_storeu_si128(vector, _mm_add_epi32(_mm_loadu_si128(vector), _mm_loadu_si128((const __m128i *)&other[i])));
+    }
+    kernel_scalar_add(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("sse4.1"))) static void kernel_sse_sub(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i *vector = (__m128i *)&values[i];
+        _mm_storeu_si128(vector, _mm_sub_epi32(_mm_loadu_si128(vector), _mm_loadu_si128((const __m128i *)&other[i])));
+    }
+    kernel_scalar_sub(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("sse4.1"))) static void kernel_sse_mul(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i *vector = (__m128i *)&values[i];
+        _mm_storeu_si128(vector, _mm_mullo_epi32(_mm_loadu_si128(vector), _mm_loadu_si128((const __m128i *)&other[i])));
+    }
+    kernel_scalar_mul(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("sse4.1"))) static size_t kernel_sse_find_either(const char *bytes, size_t size, char first, char second)
+{
+    __m128i firsts = _mm_set1_epi8(first);
+    __m128i seconds = _mm_set1_epi8(second);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)&bytes[i]);
+        unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, firsts), _mm_cmpeq_epi8(chunk, seconds)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + kernel_scalar_find_either(&bytes[i], size - i, first, second);
+}
+
+static const kernel_T kernel_sse = {
+    "sse4.1",
+    kernel_sse_sum,
+    kernel_sse_min,
+    kernel_sse_max,
+    kernel_sse_count,
+    kernel_sse_fill,
+    kernel_sse_scale,
+    kernel_sse_add,
+    kernel_sse_sub,
+    kernel_sse_mul,
+    kernel_sse_find_either,
+};
+
+// AVX2 kernels, 8 ints per vector, finishing with the SSE4.1 kernels
+
+__attribute__((target("avx2"))) static int32_t kernel_avx2_sum(const int32_t *values, size_t size)
+{
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+        sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i *)&values[i]));
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, sum);
+    return (int32_t)((uint32_t)kernel_scalar_sum(lanes, 8) + (uint32_t)kernel_sse_sum(&values[i], size - i));
+}
+
+__attribute__((target("avx2"))) static int32_t kernel_avx2_min(const int32_t *values, size_t size)
+{
+    if (size < 8)
+        return kernel_sse_min(values, size);
+
+    __m256i min = _mm256_loadu_si256((const __m256i *)values);
+    size_t i = 8;
+    for (; i + 8 <= size; i += 8)
+        min = _mm256_min_epi32(min, _mm256_loadu_si256((const __m256i *)&values[i]));
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, min);
+    int32_t result = kernel_scalar_min(lanes, 8);
+    if (i < size)
+    {
+        int32_t tail = kernel_scalar_min(&values[i], size - i);
+        result = tail < result ? tail : result;
+    }
+    return result;
+}
+
+__attribute__((target("avx2"))) static int32_t kernel_avx2_max(const int32_t *values, size_t size)
+{
+    if (size < 8)
+        return kernel_sse_max(values, size);
+
+    __m256i max = _mm256_loadu_si256((const __m256i *)values);
+    size_t i = 8;
+    for (; i + 8 <= size; i += 8)
+        max = _mm256_max_epi32(max, _mm256_loadu_si256((const __m256i *)&values[i]));
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *)lanes, max);
+    int32_t result = kernel_scalar_max(lanes, 8);
+    if (i < size)
+    {
+        int32_t tail = kernel_scalar_max(&values[i], size - i);
+        result = tail > result ? tail : result;
+    }
+    return result;
+}
+
+__attribute__((target("avx2"))) static size_t kernel_avx2_count(const int32_t *values, size_t size, int32_t value)
+{
+    __m256i needle = _mm256_set1_epi32(value);
+    __m256i counts = _mm256_setzero_si256();
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 8 <= size)
+    {
+        size_t block_end = size - i > (size_t)INT32_MAX ? i + (size_t)INT32_MAX : size;
+        for (; i + 8 <= block_end; i += 8)
+            counts = _mm256_sub_epi32(counts, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)&values[i]), needle));
+
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, counts);
+        for (int lane = 0; lane < 8; lane++)
+            count += lanes[lane];
+        counts = _mm256_setzero_si256();
+    }
+    return count + kernel_sse_count(&values[i], size - i, value);
+}
+
+__attribute__((target("avx2"))) static void kernel_avx2_fill(int32_t *values, size_t size, int32_t value)
+{
+    __m256i fill = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+        _mm256_storeu_si256((__m256i *)&values[i], fill);
+    kernel_sse_fill(&values[i], size - i, value);
+}
+
+__attribute__((target("avx2"))) static void kernel_avx2_scale(int32_t *values, size_t size, int32_t factor)
+{
+    __m256i scale = _mm256_set1_epi32(factor);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i *vector = (__m256i *)&values[i];
+        _mm256_storeu_si256(vector, _mm256_mullo_epi32(_mm256_loadu_si256(vector), scale));
+    }
+    kernel_sse_scale(&values[i], size - i, factor);
+}
+
+__attribute__((target("avx2"))) static void kernel_avx2_add(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i *vector = (__m256i *)&values[i];
+        _mm256_storeu_si256(vector, _mm256_add_epi32(_mm256_loadu_si256(vector), _mm256_loadu_si256((const __m256i *)&other[i])));
+    }
+    kernel_sse_add(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("avx2"))) static void kernel_avx2_sub(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i *vector = (__m256i *)&values[i];
+        _mm256_storeu_si256(vector, _mm256_sub_epi32(_mm256_loadu_si256(vector), _mm256_loadu_si256((const __m256i *)&other[i])));
+    }
+    kernel_sse_sub(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("avx2"))) static void kernel_avx2_mul(int32_t *values, const int32_t *other, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i *vector = (__m256i *)&values[i];
+        _mm256_storeu_si256(vector, _mm256_mullo_epi32(_mm256_loadu_si256(vector), _mm256_loadu_si256((const __m256i *)&other[i])));
+    }
+    kernel_sse_mul(&values[i], &other[i], size - i);
+}
+
+__attribute__((target("avx2"))) static size_t kernel_avx2_find_either(const char *bytes, size_t size, char first, char second)
+{
+    __m256i firsts = _mm256_set1_epi8(first);
+    __m256i seconds = _mm256_set1_epi8(second);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)&bytes[i]);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, firsts), _mm256_cmpeq_epi8(chunk, seconds)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + kernel_scalar_find_either(&bytes[i], size - i, first, second);
+}
+
+static const kernel_T kernel_avx2 = {
+    "avx2",
+    kernel_avx2_sum,
+    kernel_avx2_min,
+    kernel_avx2_max,
+    kernel_avx2_count,
+    kernel_avx2_fill,
+    kernel_avx2_scale,
+    kernel_avx2_add,
+    kernel_avx2_sub,
+    kernel_avx2_mul,
+    kernel_avx2_find_either,
+};
+
+#endif // KERNEL_X86
+
+static const kernel_T *kernel = NULL;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// Picks the kernels once per process, whichever thread asks first
+static void kernel_select()
+{
+    kernel = &kernel_scalar;
+#ifdef KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = &kernel_avx2;
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        kernel = &kernel_sse;
+    }
+#endif
+
+    LOG_PRINT("Using %s kernels\n", kernel->name);
+}
+
+const kernel_T *kernel_get()
+{
+    pthread_once(&kernel_once, kernel_select);
+    return kernel;
+}
+
+const kernel_T *kernel_get_scalar()
+{
+    return &kernel_scalar;
+}
@@ -1,4 +1,8 @@
 #include "../include/lexer/lexer.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/stats/stats.h"
+#include "../include/io/error.h"
 #include "../include/token/token.h"
 #include "../include/io/logger.h"
 #include <ctype.h>
@@ -9,7 +13,7 @@
 // Initialize the lexer with the given contents
 lexer_T *init_lexer(char *contents)
 {
-    lexer_T *lexer = calloc(1, sizeof(struct LEXER_STRUCT));
+    lexer_T *lexer = heap_calloc(1, sizeof(struct LEXER_STRUCT));
     lexer->contents = contents;
     lexer->i = 0;
     lexer->c = contents[lexer->i];
@@ -53,8 +57,31 @@ void lexer_skip_comment(lexer_T *lexer)
     }
 }
 
+static token_T *lexer_next_token(lexer_T *lexer);
+
 // Get the next token from the lexer
 token_T *lexer_get_next_token(lexer_T *lexer)
+{
+    // --mem-stats counts the tokens and their values together
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_TOKEN;
+    if (!stats_active)
+    {
+        token_T *token = lexer_next_token(lexer);
+        heap_tag = tag;
+        return token;
+    }
+
+    // --stats times the lexer on its own, apart from the parser calling it
+    long start = stats_now_ns();
+    token_T *token = lexer_next_token(lexer);
+    stats_active->phases_ns[STATS_LEX] += stats_now_ns() - start;
+    stats_active->tokens++;
+    heap_tag = tag;
+    return token;
+}
+
+static token_T *lexer_next_token(lexer_T *lexer)
 {
     while (lexer->c != '\0' && lexer->i < strlen(lexer->contents) - 1)
     {
@@ -130,8 +157,8 @@ token_T *lexer_get_next_token(lexer_T *lexer)
             }
         }
 
-        LOG_PRINT("Unexpected character: %c (%d)\n", lexer->c, lexer->c);
-        exit(1);
+        log_error("Unexpected character: %c (%d)\n", lexer->c, lexer->c);
+        error_exit(1);
     }
 
     if (lexer->i == strlen(lexer->contents) - 1)
@@ -151,7 +178,7 @@ token_T *lexer_advance_with_token(lexer_T *lexer, token_T *token)
 token_T *lexer_collect_string(lexer_T *lexer)
 {
     lexer_advance(lexer);
-    char *value = calloc(1, sizeof(char));
+    char *value = heap_calloc(1, sizeof(char));
     value[0] = '\0';
 
     while (lexer->c != '"')
@@ -162,23 +189,23 @@ token_T *lexer_collect_string(lexer_T *lexer)
             switch (lexer->c)
             {
             case 'n':
-                value = realloc(value, (strlen(value) + 2) * sizeof(char));
+                value = heap_realloc(value, (strlen(value) + 2) * sizeof(char));
                 strcat(value, "\n");
                 break;
             case 't':
-                value = realloc(value, (strlen(value) + 2) * sizeof(char));
+                value = heap_realloc(value, (strlen(value) + 2) * sizeof(char));
                 strcat(value, "\t");
                 break;
             case '\\':
-                value = realloc(value, (strlen(value) + 2) * sizeof(char));
+                value = heap_realloc(value, (strlen(value) + 2) * sizeof(char));
                 strcat(value, "\\");
                 break;
             case '"':
-                value = realloc(value, (strlen(value) + 2) * sizeof(char));
+                value = heap_realloc(value, (strlen(value) + 2) * sizeof(char));
                 strcat(value, "\"");
                 break;
             default:
-                value = realloc(value, (strlen(value) + 2) * sizeof(char));
+                value = heap_realloc(value, (strlen(value) + 2) * sizeof(char));
                 strncat(value, &lexer->c, 1);
                 break;
             }
@@ -186,7 +213,7 @@ token_T *lexer_collect_string(lexer_T *lexer)
         else
         {
             char *s = lexer_get_current_char_as_string(lexer);
-            value = realloc(value, (strlen(value) + strlen(s) + 1) * sizeof(char));
+            value = heap_realloc(value, (strlen(value) + strlen(s) + 1) * sizeof(char));
             strcat(value, s);
         }
         lexer_advance(lexer);
@@ -199,7 +226,7 @@ token_T *lexer_collect_string(lexer_T *lexer)
 // Get the current character as a string
 char *lexer_get_current_char_as_string(lexer_T *lexer)
 {
-    char *str = calloc(2, sizeof(char));
+    char *str = heap_calloc(2, sizeof(char));
     str[0] = lexer->c;
     str[1] = '\0';
     return str;
@@ -208,13 +235,13 @@ char *lexer_get_current_char_as_string(lexer_T *lexer)
 // Collect an identifier token
 token_T *lexer_collect_id(lexer_T *lexer)
 {
-    char *value = calloc(1, sizeof(char));
+    char *value = heap_calloc(1, sizeof(char));
     value[0] = '\0';
 
     while (isalnum(lexer->c))
     {
         char *s = lexer_get_current_char_as_string(lexer);
-        value = realloc(value, (strlen(value) + strlen(s) + 1) * sizeof(char));
+        value = heap_realloc(value, (strlen(value) + strlen(s) + 1) * sizeof(char));
         strcat(value, s);
         lexer_advance(lexer);
     }
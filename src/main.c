@@ -1,22 +1,23 @@
-#include "include/lexer/lexer.h"
-#include "include/parser/parser.h"
-#include "include/visitor/visitor.h"
-#include "include/io/logger.h"
-#include "include/io/io.h"
-#include "include/ast/AST.h"
+#include "include/blunt/blunt.h"
+#include "include/serve/serve.h"
 #include <stdio.h>
 #include <string.h>
-#include <stdlib.h> 
+#include <stdlib.h>
+#include <unistd.h>
 
 void print_help()
 {
-    printf("Usage: blunt <filename> [-v for verbose logs] [-l for use only the lexer]\n");
+    printf("Usage: blunt <filename> [-v for verbose logs] [-l for use only the lexer] [-m for memoizing pure blunts] [--profile <folded stacks file> for timing every call] [--sample <histogram file> for sampling long runs] [--mem-stats <pprof heap profile> for counting allocations] [--stats for timing every phase] [--no-cache for parsing without the .bluntc tree cache]\n");
+    printf("       blunt --serve for keeping scripts parsed in a daemon that runs them for the next runs\n");
 }
 
 int main(int argc, char *argv[])
 {
 
     int DO_LEXER = 0;
+    const char *profile_filename = NULL;
+    const char *sample_filename = NULL;
+    const char *mem_stats_filename = NULL;
 
     if (argc < 2)
     {
@@ -24,41 +25,139 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (strcmp(argv[1], "--serve") == 0)
+    {
+        return serve_run((int)sysconf(_SC_NPROCESSORS_ONLN));
+    }
+
+    // A script run without options goes through the daemon when one is serving
+    if (argc == 2)
+    {
+        char socket_buffer[108];
+        const char *socket_path = serve_socket_path(socket_buffer, sizeof(socket_buffer));
+        int exit_code;
+        if (socket_path && serve_request(socket_path, argv[1], &exit_code))
+        {
+            return exit_code;
+        }
+    }
+
+    blunt_T *blunt = init_blunt();
+    if (!blunt)
+    {
+        fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+        exit(1);
+    }
+    blunt_set_cache(blunt, 1);
+
     for (int i = 1; i < argc; i++)
     {
         if (strcmp(argv[i], "-v") == 0)
         {
-            LOGGING_ENABLED = 1;
+            blunt_set_logging(blunt, 1);
         }
         if (strcmp(argv[i], "-l") == 0)
         {
             DO_LEXER = 1;
         }
+        if (strcmp(argv[i], "-m") == 0)
+        {
+            blunt_set_memo(blunt, 1);
+        }
+        if (strcmp(argv[i], "--stats") == 0)
+        {
+            blunt_set_stats(blunt, 1);
+        }
+        if (strcmp(argv[i], "--no-cache") == 0)
+        {
+            blunt_set_cache(blunt, 0);
+        }
+        if (strcmp(argv[i], "--profile") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                print_help();
+                exit(1);
+            }
+            profile_filename = argv[++i];
+            blunt_set_profile(blunt, 1);
+        }
+        if (strcmp(argv[i], "--sample") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                print_help();
+                exit(1);
+            }
+            sample_filename = argv[++i];
+            blunt_set_sampling(blunt, 1);
+        }
+        if (strcmp(argv[i], "--mem-stats") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                print_help();
+                exit(1);
+            }
+            mem_stats_filename = argv[++i];
+            blunt_set_mem_stats(blunt, 1);
+        }
     }
 
-    lexer_T *lexer = init_lexer(read_file(argv[1]));
-
+    blunt_status_T status;
+    int ran = 0;
     if (DO_LEXER)
     {
-        while (lexer->i < strlen(lexer->contents))
+        status = blunt_lex_file(blunt, argv[1]);
+    }
+    else
+    {
+        status = blunt_load_file(blunt, argv[1]);
+        if (status == BLUNT_OK)
+        {
+            status = blunt_run(blunt);
+            ran = 1;
+        }
+        if (status == BLUNT_OK)
         {
-            token_T *token = lexer_get_next_token(lexer);
-            LOG_PRINT("TOKEN(%s, %s)\n", token_type_to_string(token->type), token->value);
+            blunt_print_memo_stats(blunt);
         }
-        return 0;
     }
 
-    LOG_PRINT("\nSTARTING PARSER\n");
-    parser_T *parser = init_parser(lexer);
-    AST_T *root = parser_parse(parser);
+    if (status != BLUNT_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s", blunt_error(blunt));
+    }
 
-    LOG_PRINT("\n ----- PARSER TREE -----\n");
-    ast_print(root, 0);
-    LOG_PRINT("\n -----------------------\n");
+    // A run that failed still shows where its time went until then
+    if (ran && profile_filename)
+    {
+        blunt_print_profile(blunt);
+        if (blunt_write_profile(blunt, profile_filename) != BLUNT_OK)
+        {
+            fprintf(stderr, "%s", blunt_error(blunt));
+            status = BLUNT_ERROR_IO;
+        }
+    }
+    if (ran && sample_filename && blunt_write_samples(blunt, sample_filename) != BLUNT_OK)
+    {
+        fprintf(stderr, "%s", blunt_error(blunt));
+        status = BLUNT_ERROR_IO;
+    }
+    if (ran && mem_stats_filename)
+    {
+        blunt_print_mem_stats(blunt);
+        if (blunt_write_mem_profile(blunt, mem_stats_filename) != BLUNT_OK)
+        {
+            fprintf(stderr, "%s", blunt_error(blunt));
+            status = BLUNT_ERROR_IO;
+        }
+    }
 
-    LOG_PRINT("\nSTARTING VISITOR\n");
-    visitor_T *visitor = init_visitor();
-    visitor_visit(visitor, root);
+    // Also shown when parsing failed, it may be what took so long
+    blunt_print_stats(blunt);
 
-    return 0;
+    blunt_free(blunt);
+    return status == BLUNT_OK ? 0 : 1;
 }
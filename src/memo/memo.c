@@ -0,0 +1,255 @@
+#include "../include/memo/memo.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdio.h>
+#include <string.h>
+
+static unsigned long memo_hash_bytes(unsigned long hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static int memo_copy_value(memo_value_T *value, AST_T *node)
+{
+    value->type = node->type;
+    value->int_value = 0;
+    value->string_value = NULL;
+
+    switch (node->type)
+    {
+    case AST_INT:
+        value->int_value = ((AST_INT_T *)node)->int_value;
+        return 1;
+    case AST_STRING:
+        value->string_value = heap_strndup(ast_string_value((AST_STRING_T *)node), ast_string_length((AST_STRING_T *)node));
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int memo_values_equal(memo_value_T *a, memo_value_T *b)
+{
+    if (a->type != b->type)
+        return 0;
+
+    if (a->type == AST_INT)
+        return a->int_value == b->int_value;
+
+    return strcmp(a->string_value, b->string_value) == 0;
+}
+
+static int memo_keys_equal(memo_key_T *a, memo_key_T *b)
+{
+    if (a->hash != b->hash ||
+        a->function_definition != b->function_definition ||
+        a->arguments_size != b->arguments_size)
+        return 0;
+
+    for (size_t i = 0; i < a->arguments_size; i++)
+    {
+        if (!memo_values_equal(&a->arguments[i], &b->arguments[i]))
+            return 0;
+    }
+
+    return 1;
+}
+
+static void memo_lru_unlink(memo_T *memo, memo_entry_T *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        memo->lru_head = entry->lru_next;
+
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        memo->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void memo_lru_push_front(memo_T *memo, memo_entry_T *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = memo->lru_head;
+
+    if (memo->lru_head)
+        memo->lru_head->lru_prev = entry;
+    memo->lru_head = entry;
+
+    if (!memo->lru_tail)
+        memo->lru_tail = entry;
+}
+
+static void memo_evict(memo_T *memo)
+{
+    memo_entry_T *victim = memo->lru_tail;
+    if (!victim)
+        return;
+
+    memo_lru_unlink(memo, victim);
+
+    memo_entry_T **link = &memo->buckets[victim->key->hash % memo->buckets_size];
+    while (*link != victim)
+        link = &(*link)->bucket_next;
+    *link = victim->bucket_next;
+
+    LOG_PRINT("Evicting memoized call to %s\n", victim->key->function_definition->function_definition_name);
+
+    memo_free_key(memo, victim->key);
+    heap_free(victim->result.string_value);
+    heap_free(victim);
+
+    memo->entries_size--;
+    memo->evictions++;
+}
+
+memo_T *init_memo(size_t capacity)
+{
+    memo_T *memo = heap_calloc(1, sizeof(struct MEMO_STRUCT));
+    if (!memo)
+    {
+        log_error("Failed to allocate memory for memo\n");
+        error_exit(1);
+    }
+
+    memo->capacity = capacity;
+    memo->heap = heap_current();
+    // Keep the load factor around 0.5 when the table is full
+    memo->buckets_size = capacity * 2 + 1;
+    memo->buckets = heap_calloc(memo->buckets_size, sizeof(struct MEMO_ENTRY_STRUCT *));
+    if (!memo->buckets)
+    {
+        log_error("Failed to allocate memory for memo buckets\n");
+        error_exit(1);
+    }
+
+    return memo;
+}
+
+memo_key_T *memo_make_key(memo_T *memo, AST_FUNCTION_DEFINITION_T *function_definition, AST_T **arguments, size_t arguments_size)
+{
+    // Keys outlive the run that made them once they are inserted
+    heap_T *previous_heap = heap_use(memo->heap);
+    memo_key_T *key = heap_calloc(1, sizeof(struct MEMO_KEY_STRUCT));
+    key->function_definition = function_definition;
+    key->arguments_size = arguments_size;
+    key->arguments = heap_calloc(arguments_size ? arguments_size : 1, sizeof(struct MEMO_VALUE_STRUCT));
+
+    unsigned long hash = memo_hash_bytes(14695981039346656037UL, &function_definition, sizeof(function_definition));
+
+    for (size_t i = 0; i < arguments_size; i++)
+    {
+        memo_value_T *value = &key->arguments[i];
+        if (!memo_copy_value(value, arguments[i]))
+        {
+            LOG_PRINT("Argument %lu of type %s can't be memoized\n", i, ast_type_to_string(arguments[i]->type));
+            key->arguments_size = i;
+            memo_free_key(memo, key);
+            heap_use(previous_heap);
+            return NULL;
+        }
+
+        hash = memo_hash_bytes(hash, &value->type, sizeof(value->type));
+        if (value->type == AST_INT)
+            hash = memo_hash_bytes(hash, &value->int_value, sizeof(value->int_value));
+        else
+            hash = memo_hash_bytes(hash, value->string_value, strlen(value->string_value));
+    }
+
+    key->hash = hash;
+    heap_use(previous_heap);
+    return key;
+}
+
+void memo_free_key(memo_T *memo, memo_key_T *key)
+{
+    heap_T *previous_heap = heap_use(memo->heap);
+    for (size_t i = 0; i < key->arguments_size; i++)
+        heap_free(key->arguments[i].string_value);
+
+    heap_free(key->arguments);
+    heap_free(key);
+    heap_use(previous_heap);
+}
+
+AST_T *memo_lookup(memo_T *memo, memo_key_T *key)
+{
+    memo_entry_T *entry = memo->buckets[key->hash % memo->buckets_size];
+
+    while (entry && !memo_keys_equal(entry->key, key))
+        entry = entry->bucket_next;
+
+    if (!entry)
+    {
+        memo->misses++;
+        return NULL;
+    }
+
+    memo->hits++;
+    memo_lru_unlink(memo, entry);
+    memo_lru_push_front(memo, entry);
+
+    // Hand out a fresh node so the caller can't alter the cached value
+    if (entry->result.type == AST_INT)
+    {
+        AST_INT_T *result = (AST_INT_T *)init_ast(AST_INT);
+        result->int_value = entry->result.int_value;
+        return (AST_T *)result;
+    }
+
+    // A copy, since the entry's buffer is freed when it is evicted and the string may outlive it
+    size_t length = strlen(entry->result.string_value);
+    return (AST_T *)init_ast_string(heap_strndup(entry->result.string_value, length), length);
+}
+
+void memo_insert(memo_T *memo, memo_key_T *key, AST_T *result)
+{
+    heap_T *previous_heap = heap_use(memo->heap);
+    memo_entry_T *entry = heap_calloc(1, sizeof(struct MEMO_ENTRY_STRUCT));
+
+    if (!memo_copy_value(&entry->result, result))
+    {
+        LOG_PRINT("Result of type %s can't be memoized\n", ast_type_to_string(result->type));
+        heap_free(entry);
+        memo_free_key(memo, key);
+        heap_use(previous_heap);
+        return;
+    }
+
+    if (memo->entries_size >= memo->capacity)
+        memo_evict(memo);
+
+    entry->key = key;
+
+    size_t bucket = key->hash % memo->buckets_size;
+    entry->bucket_next = memo->buckets[bucket];
+    memo->buckets[bucket] = entry;
+
+    memo_lru_push_front(memo, entry);
+    memo->entries_size++;
+    heap_use(previous_heap);
+}
+
+void memo_print_stats(memo_T *memo)
+{
+    unsigned long lookups = memo->hits + memo->misses;
+
+    fprintf(stderr, "Memo: %lu hits, %lu misses (%.1f%% hit rate), %lu evictions, %lu/%lu entries\n",
+            memo->hits,
+            memo->misses,
+            lookups ? 100.0 * memo->hits / lookups : 0.0,
+            memo->evictions,
+            memo->entries_size,
+            memo->capacity);
+}
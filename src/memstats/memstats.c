@@ -0,0 +1,619 @@
+#include "../include/memstats/memstats.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Slot of a block that was freed, which lookups skip over
+#define MEMSTATS_TOMBSTONE ((void *)1)
+
+static void *memstats_calloc(size_t count, size_t size)
+{
+    void *pointer = calloc(count, size);
+    if (!pointer)
+    {
+        log_error("Failed to allocate memory for memory statistics\n");
+        error_exit(1);
+    }
+    return pointer;
+}
+
+static memstats_frame_T *init_memstats_frame(memstats_frame_T *parent, const char *owner, const char *name)
+{
+    memstats_frame_T *frame = memstats_calloc(1, sizeof(struct MEMSTATS_FRAME_STRUCT));
+    frame->owner = owner;
+    frame->name = name;
+    frame->parent = parent;
+    return frame;
+}
+
+static void memstats_free_frame(memstats_frame_T *frame)
+{
+    memstats_frame_T *child = frame->children;
+    while (child)
+    {
+        memstats_frame_T *next = child->next;
+        memstats_free_frame(child);
+        child = next;
+    }
+
+    memstats_site_T *site = frame->sites;
+    while (site)
+    {
+        memstats_site_T *next = site->next;
+        free(site);
+        site = next;
+    }
+    free(frame);
+}
+
+static void memstats_allocated(void *context, void *pointer, size_t size, int tag);
+static void memstats_freed(void *context, void *pointer);
+
+memstats_T *init_memstats()
+{
+    memstats_T *memstats = memstats_calloc(1, sizeof(struct MEMSTATS_STRUCT));
+    memstats->observer.allocated = memstats_allocated;
+    memstats->observer.freed = memstats_freed;
+    memstats->observer.context = memstats;
+    pthread_mutex_init(&memstats->lock, NULL);
+
+    memstats->root = init_memstats_frame(NULL, NULL, "main");
+    memstats->current = memstats->root;
+
+    memstats->blocks_capacity = 1024;
+    memstats->blocks = memstats_calloc(memstats->blocks_capacity, sizeof(struct MEMSTATS_BLOCK_STRUCT));
+    return memstats;
+}
+
+void memstats_free(memstats_T *memstats)
+{
+    memstats_free_frame(memstats->root);
+    free(memstats->blocks);
+    pthread_mutex_destroy(&memstats->lock);
+    free(memstats);
+}
+
+void memstats_observe(memstats_T *memstats, heap_T *heap)
+{
+    heap_set_observer(heap, &memstats->observer);
+}
+
+void memstats_reset_calls(memstats_T *memstats)
+{
+    pthread_mutex_lock(&memstats->lock);
+    memstats->current = memstats->root;
+    pthread_mutex_unlock(&memstats->lock);
+}
+
+static int memstats_same_blunt(const char *owner, const char *name, const char *other_owner, const char *other_name)
+{
+    if (owner != other_owner && (!owner || !other_owner || strcmp(owner, other_owner) != 0))
+        return 0;
+
+    return name == other_name || strcmp(name, other_name) == 0;
+}
+
+void memstats_enter(memstats_T *memstats, const char *owner, const char *name)
+{
+    pthread_mutex_lock(&memstats->lock);
+    memstats_frame_T *parent = memstats->current;
+    memstats_frame_T *frame = parent->children;
+    while (frame && !memstats_same_blunt(frame->owner, frame->name, owner, name))
+    {
+        frame = frame->next;
+    }
+
+    if (!frame)
+    {
+        frame = init_memstats_frame(parent, owner, name);
+        frame->next = parent->children;
+        parent->children = frame;
+    }
+
+    memstats->current = frame;
+    pthread_mutex_unlock(&memstats->lock);
+}
+
+void memstats_exit(memstats_T *memstats)
+{
+    pthread_mutex_lock(&memstats->lock);
+    if (memstats->current->parent)
+    {
+        memstats->current = memstats->current->parent;
+    }
+    pthread_mutex_unlock(&memstats->lock);
+}
+
+static size_t memstats_block_index(memstats_T *memstats, void *pointer)
+{
+    uintptr_t hash = (uintptr_t)pointer >> 4;
+    return (hash ^ (hash >> 16)) & (memstats->blocks_capacity - 1);
+}
+
+// Rebuilds the table without its tombstones, twice as large when the blocks fill a quarter of it
+static void memstats_rehash(memstats_T *memstats)
+{
+    memstats_block_T *blocks = memstats->blocks;
+    size_t blocks_capacity = memstats->blocks_capacity;
+
+    if (memstats->blocks_size * 4 >= memstats->blocks_capacity)
+    {
+        memstats->blocks_capacity *= 2;
+    }
+    memstats->blocks = memstats_calloc(memstats->blocks_capacity, sizeof(struct MEMSTATS_BLOCK_STRUCT));
+    memstats->blocks_used = memstats->blocks_size;
+
+    for (size_t i = 0; i < blocks_capacity; i++)
+    {
+        if (!blocks[i].pointer || blocks[i].pointer == MEMSTATS_TOMBSTONE)
+            continue;
+
+        size_t index = memstats_block_index(memstats, blocks[i].pointer);
+        while (memstats->blocks[index].pointer)
+        {
+            index = (index + 1) & (memstats->blocks_capacity - 1);
+        }
+        memstats->blocks[index] = blocks[i];
+    }
+    free(blocks);
+}
+
+static memstats_site_T *memstats_site(memstats_frame_T *frame, int tag)
+{
+    memstats_site_T *site = frame->sites;
+    while (site && site->tag != tag)
+    {
+        site = site->next;
+    }
+
+    if (!site)
+    {
+        site = memstats_calloc(1, sizeof(struct MEMSTATS_SITE_STRUCT));
+        site->tag = tag;
+        site->frame = frame;
+        site->next = frame->sites;
+        frame->sites = site;
+    }
+    return site;
+}
+
+static void memstats_allocated(void *context, void *pointer, size_t size, int tag)
+{
+    memstats_T *memstats = context;
+    if (tag < 0 || tag >= MEMSTATS_TAGS)
+    {
+        tag = MEMSTATS_OTHER;
+    }
+
+    pthread_mutex_lock(&memstats->lock);
+    memstats_site_T *site = memstats_site(memstats->current, tag);
+    site->allocations++;
+    site->bytes += size;
+    site->live_blocks++;
+    site->live_bytes += size;
+
+    memstats_tag_T *totals = &memstats->tags[tag];
+    totals->allocations++;
+    totals->bytes += size;
+    totals->live_bytes += size;
+    if (totals->live_bytes > totals->peak_live_bytes)
+        totals->peak_live_bytes = totals->live_bytes;
+
+    memstats->live_bytes += size;
+    if (memstats->live_bytes > memstats->peak_live_bytes)
+        memstats->peak_live_bytes = memstats->live_bytes;
+
+    if ((memstats->blocks_used + 1) * 2 > memstats->blocks_capacity)
+    {
+        memstats_rehash(memstats);
+    }
+    size_t index = memstats_block_index(memstats, pointer);
+    while (memstats->blocks[index].pointer && memstats->blocks[index].pointer != MEMSTATS_TOMBSTONE)
+    {
+        index = (index + 1) & (memstats->blocks_capacity - 1);
+    }
+    if (!memstats->blocks[index].pointer)
+    {
+        memstats->blocks_used++;
+    }
+    memstats->blocks[index].pointer = pointer;
+    memstats->blocks[index].size = size;
+    memstats->blocks[index].site = site;
+    memstats->blocks_size++;
+    pthread_mutex_unlock(&memstats->lock);
+}
+
+static void memstats_freed(void *context, void *pointer)
+{
+    memstats_T *memstats = context;
+    pthread_mutex_lock(&memstats->lock);
+
+    size_t index = memstats_block_index(memstats, pointer);
+    while (memstats->blocks[index].pointer && memstats->blocks[index].pointer != pointer)
+    {
+        index = (index + 1) & (memstats->blocks_capacity - 1);
+    }
+
+    // Blocks allocated before the heap was observed are not in the table
+    memstats_block_T *block = &memstats->blocks[index];
+    if (block->pointer)
+    {
+        block->site->live_blocks--;
+        block->site->live_bytes -= block->size;
+        memstats->tags[block->site->tag].live_bytes -= block->size;
+        memstats->live_bytes -= block->size;
+
+        block->pointer = MEMSTATS_TOMBSTONE;
+        block->site = NULL;
+        memstats->blocks_size--;
+    }
+
+    pthread_mutex_unlock(&memstats->lock);
+}
+
+const char *memstats_tag_to_string(int tag)
+{
+    switch (tag)
+    {
+    case MEMSTATS_OTHER:
+        return "other";
+    case MEMSTATS_TOKEN:
+        return "token";
+    case MEMSTATS_STRING:
+        return "string";
+    case MEMSTATS_SCOPE:
+        return "scope";
+    default:
+        return ast_type_to_string(tag - MEMSTATS_NODE);
+    }
+}
+
+typedef struct MEMSTATS_BLUNT_STRUCT
+{
+    const char *owner;
+    const char *name;
+    unsigned long allocations;
+    unsigned long bytes;
+} memstats_blunt_T;
+
+static void memstats_count_sites(memstats_frame_T *frame, memstats_blunt_T *blunt)
+{
+    for (memstats_site_T *site = frame->sites; site; site = site->next)
+    {
+        blunt->allocations += site->allocations;
+        blunt->bytes += site->bytes;
+    }
+}
+
+static void memstats_collect(memstats_frame_T *frame, memstats_blunt_T **blunts, size_t *blunts_size)
+{
+    for (memstats_frame_T *child = frame->children; child; child = child->next)
+    {
+        // The first entry is the top level, which has no name
+        memstats_blunt_T *blunt = NULL;
+        for (size_t i = 1; i < *blunts_size && !blunt; i++)
+        {
+            if (memstats_same_blunt((*blunts)[i].owner, (*blunts)[i].name, child->owner, child->name))
+                blunt = &(*blunts)[i];
+        }
+
+        if (!blunt)
+        {
+            *blunts = realloc(*blunts, (*blunts_size + 1) * sizeof(struct MEMSTATS_BLUNT_STRUCT));
+            if (!*blunts)
+            {
+                log_error("Failed to allocate memory for memory statistics\n");
+                error_exit(1);
+            }
+            blunt = &(*blunts)[(*blunts_size)++];
+            memset(blunt, 0, sizeof(struct MEMSTATS_BLUNT_STRUCT));
+            blunt->owner = child->owner;
+            blunt->name = child->name;
+        }
+
+        memstats_count_sites(child, blunt);
+        memstats_collect(child, blunts, blunts_size);
+    }
+}
+
+static int memstats_compare_blunts(const void *left, const void *right)
+{
+    const memstats_blunt_T *a = left;
+    const memstats_blunt_T *b = right;
+    if (a->bytes != b->bytes)
+        return a->bytes < b->bytes ? 1 : -1;
+
+    return a->allocations < b->allocations ? 1 : a->allocations > b->allocations ? -1 : 0;
+}
+
+typedef struct MEMSTATS_TAG_ROW_STRUCT
+{
+    int tag;
+    memstats_tag_T *totals;
+} memstats_tag_row_T;
+
+static int memstats_compare_tags(const void *left, const void *right)
+{
+    const memstats_tag_row_T *a = left;
+    const memstats_tag_row_T *b = right;
+    if (a->totals->bytes != b->totals->bytes)
+        return a->totals->bytes < b->totals->bytes ? 1 : -1;
+
+    return a->tag - b->tag;
+}
+
+void memstats_print_stats(memstats_T *memstats)
+{
+    pthread_mutex_lock(&memstats->lock);
+
+    unsigned long allocations = 0;
+    unsigned long bytes = 0;
+    memstats_tag_row_T rows[MEMSTATS_TAGS];
+    for (int tag = 0; tag < MEMSTATS_TAGS; tag++)
+    {
+        rows[tag].tag = tag;
+        rows[tag].totals = &memstats->tags[tag];
+        allocations += memstats->tags[tag].allocations;
+        bytes += memstats->tags[tag].bytes;
+    }
+    qsort(rows, MEMSTATS_TAGS, sizeof(struct MEMSTATS_TAG_ROW_STRUCT), memstats_compare_tags);
+
+    fprintf(stderr, "Memory: %lu allocations, %lu bytes, %lu bytes live at the peak, %lu still live\n",
+            allocations,
+            bytes,
+            memstats->peak_live_bytes,
+            memstats->live_bytes);
+    fprintf(stderr, "%-32s %12s %14s %16s\n", "kind", "allocations", "bytes", "peak live bytes");
+    for (int i = 0; i < MEMSTATS_TAGS && rows[i].totals->allocations; i++)
+    {
+        fprintf(stderr, "%-32s %12lu %14lu %16lu\n",
+                memstats_tag_to_string(rows[i].tag),
+                rows[i].totals->allocations,
+                rows[i].totals->bytes,
+                rows[i].totals->peak_live_bytes);
+    }
+
+    memstats_blunt_T *blunts = memstats_calloc(1, sizeof(struct MEMSTATS_BLUNT_STRUCT));
+    size_t blunts_size = 1;
+    memstats_count_sites(memstats->root, &blunts[0]);
+    memstats_collect(memstats->root, &blunts, &blunts_size);
+    pthread_mutex_unlock(&memstats->lock);
+    qsort(blunts, blunts_size, sizeof(struct MEMSTATS_BLUNT_STRUCT), memstats_compare_blunts);
+
+    fprintf(stderr, "\n%-32s %12s %14s\n", "blunt", "allocations", "bytes");
+    for (size_t i = 0; i < blunts_size; i++)
+    {
+        char name[33];
+        if (!blunts[i].name)
+            snprintf(name, sizeof(name), "(top level)");
+        else if (blunts[i].owner)
+            snprintf(name, sizeof(name), "%s.%s", blunts[i].owner, blunts[i].name);
+        else
+            snprintf(name, sizeof(name), "%s", blunts[i].name);
+
+        fprintf(stderr, "%-32s %12lu %14lu\n", name, blunts[i].allocations, blunts[i].bytes);
+    }
+
+    free(blunts);
+}
+
+// Protocol buffer encoding of the profile.proto messages pprof reads
+
+typedef struct MEMSTATS_BUFFER_STRUCT
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} memstats_buffer_T;
+
+typedef struct MEMSTATS_PPROF_STRUCT
+{
+    memstats_buffer_T profile;
+    char **strings;
+    size_t strings_size;
+    // String index of the name of every function, whose id is its index plus one
+    size_t *functions;
+    size_t functions_size;
+    uint64_t *stack;
+    size_t stack_capacity;
+} memstats_pprof_T;
+
+static void memstats_buffer_write(memstats_buffer_T *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        buffer->capacity = (buffer->size + size) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (!buffer->data)
+        {
+            log_error("Failed to allocate memory for the heap profile\n");
+            error_exit(1);
+        }
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void memstats_buffer_varint(memstats_buffer_T *buffer, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t size = 0;
+    do
+    {
+        bytes[size] = value & 0x7f;
+        value >>= 7;
+        if (value)
+            bytes[size] |= 0x80;
+        size++;
+    } while (value);
+    memstats_buffer_write(buffer, bytes, size);
+}
+
+static void memstats_buffer_uint(memstats_buffer_T *buffer, int field, uint64_t value)
+{
+    memstats_buffer_varint(buffer, (uint64_t)field << 3);
+    memstats_buffer_varint(buffer, value);
+}
+
+static void memstats_buffer_bytes(memstats_buffer_T *buffer, int field, const void *data, size_t size)
+{
+    memstats_buffer_varint(buffer, (uint64_t)field << 3 | 2);
+    memstats_buffer_varint(buffer, size);
+    memstats_buffer_write(buffer, data, size);
+}
+
+static void memstats_buffer_message(memstats_buffer_T *buffer, int field, memstats_buffer_T *message)
+{
+    memstats_buffer_bytes(buffer, field, message->data, message->size);
+    message->size = 0;
+}
+
+static size_t memstats_pprof_string(memstats_pprof_T *pprof, const char *string)
+{
+    for (size_t i = 0; i < pprof->strings_size; i++)
+    {
+        if (strcmp(pprof->strings[i], string) == 0)
+            return i;
+    }
+
+    pprof->strings = realloc(pprof->strings, (pprof->strings_size + 1) * sizeof(char *));
+    if (!pprof->strings || !(pprof->strings[pprof->strings_size] = strdup(string)))
+    {
+        log_error("Failed to allocate memory for the heap profile\n");
+        error_exit(1);
+    }
+    return pprof->strings_size++;
+}
+
+// Every function has a single location, with the same id
+static uint64_t memstats_pprof_function(memstats_pprof_T *pprof, const char *name)
+{
+    size_t string = memstats_pprof_string(pprof, name);
+    for (size_t i = 0; i < pprof->functions_size; i++)
+    {
+        if (pprof->functions[i] == string)
+            return i + 1;
+    }
+
+    pprof->functions = realloc(pprof->functions, (pprof->functions_size + 1) * sizeof(size_t));
+    if (!pprof->functions)
+    {
+        log_error("Failed to allocate memory for the heap profile\n");
+        error_exit(1);
+    }
+    pprof->functions[pprof->functions_size++] = string;
+    return pprof->functions_size;
+}
+
+static void memstats_pprof_value_type(memstats_pprof_T *pprof, int field, const char *type, const char *unit)
+{
+    memstats_buffer_T value_type = {0};
+    memstats_buffer_uint(&value_type, 1, memstats_pprof_string(pprof, type));
+    memstats_buffer_uint(&value_type, 2, memstats_pprof_string(pprof, unit));
+    memstats_buffer_message(&pprof->profile, field, &value_type);
+    free(value_type.data);
+}
+
+static void memstats_pprof_frame(memstats_pprof_T *pprof, memstats_frame_T *frame, size_t depth)
+{
+    char name[256];
+    if (frame->owner)
+        snprintf(name, sizeof(name), "%s.%s", frame->owner, frame->name);
+    else
+        snprintf(name, sizeof(name), "%s", frame->name);
+
+    if (depth + 2 > pprof->stack_capacity)
+    {
+        pprof->stack_capacity = (depth + 2) * 2;
+        pprof->stack = realloc(pprof->stack, pprof->stack_capacity * sizeof(uint64_t));
+        if (!pprof->stack)
+        {
+            log_error("Failed to allocate memory for the heap profile\n");
+            error_exit(1);
+        }
+    }
+    pprof->stack[depth] = memstats_pprof_function(pprof, name);
+
+    memstats_buffer_T sample = {0};
+    memstats_buffer_T packed = {0};
+    for (memstats_site_T *site = frame->sites; site; site = site->next)
+    {
+        // Stacks are written from their innermost location, which is the tag of the blocks
+        char tag[64];
+        snprintf(tag, sizeof(tag), "[%s]", memstats_tag_to_string(site->tag));
+        memstats_buffer_varint(&packed, memstats_pprof_function(pprof, tag));
+        for (size_t i = depth + 1; i > 0; i--)
+        {
+            memstats_buffer_varint(&packed, pprof->stack[i - 1]);
+        }
+        memstats_buffer_message(&sample, 1, &packed);
+
+        memstats_buffer_varint(&packed, site->allocations);
+        memstats_buffer_varint(&packed, site->bytes);
+        memstats_buffer_varint(&packed, site->live_blocks);
+        memstats_buffer_varint(&packed, site->live_bytes);
+        memstats_buffer_message(&sample, 2, &packed);
+
+        memstats_buffer_message(&pprof->profile, 2, &sample);
+    }
+    free(sample.data);
+    free(packed.data);
+
+    for (memstats_frame_T *child = frame->children; child; child = child->next)
+    {
+        memstats_pprof_frame(pprof, child, depth + 1);
+    }
+}
+
+void memstats_write_pprof(memstats_T *memstats, FILE *file)
+{
+    memstats_pprof_T pprof;
+    memset(&pprof, 0, sizeof(struct MEMSTATS_PPROF_STRUCT));
+    memstats_pprof_string(&pprof, "");
+
+    memstats_pprof_value_type(&pprof, 1, "alloc_objects", "count");
+    memstats_pprof_value_type(&pprof, 1, "alloc_space", "bytes");
+    memstats_pprof_value_type(&pprof, 1, "inuse_objects", "count");
+    memstats_pprof_value_type(&pprof, 1, "inuse_space", "bytes");
+
+    pthread_mutex_lock(&memstats->lock);
+    memstats_pprof_frame(&pprof, memstats->root, 0);
+    pthread_mutex_unlock(&memstats->lock);
+
+    memstats_buffer_T message = {0};
+    memstats_buffer_T line = {0};
+    for (size_t i = 0; i < pprof.functions_size; i++)
+    {
+        memstats_buffer_uint(&line, 1, i + 1);
+        memstats_buffer_uint(&message, 1, i + 1);
+        memstats_buffer_message(&message, 4, &line);
+        memstats_buffer_message(&pprof.profile, 4, &message);
+
+        memstats_buffer_uint(&message, 1, i + 1);
+        memstats_buffer_uint(&message, 2, pprof.functions[i]);
+        memstats_buffer_uint(&message, 3, pprof.functions[i]);
+        memstats_buffer_message(&pprof.profile, 5, &message);
+    }
+    free(message.data);
+    free(line.data);
+
+    // Every block is recorded, so each sample stands for itself
+    memstats_pprof_value_type(&pprof, 11, "space", "bytes");
+    memstats_buffer_uint(&pprof.profile, 12, 1);
+    memstats_buffer_uint(&pprof.profile, 14, memstats_pprof_string(&pprof, "inuse_space"));
+
+    for (size_t i = 0; i < pprof.strings_size; i++)
+    {
+        memstats_buffer_bytes(&pprof.profile, 6, pprof.strings[i], strlen(pprof.strings[i]));
+        free(pprof.strings[i]);
+    }
+
+    fwrite(pprof.profile.data, 1, pprof.profile.size, file);
+
+    free(pprof.profile.data);
+    free(pprof.strings);
+    free(pprof.functions);
+    free(pprof.stack);
+}
@@ -1,4 +1,6 @@
 #include "../include/parser/parser.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include <string.h>
 #include <stdio.h>
@@ -9,18 +11,18 @@ parser_T *init_parser(lexer_T *lexer)
     // Check if lexxer is null
     if (lexer == NULL)
     {
-        fprintf(stderr, "Lexer is null\n");
-        exit(1);
+        log_error("Lexer is null\n");
+        error_exit(1);
     }
 
     // Check if lexer->i is greater than the length of the contents
     if (lexer->i > strlen(lexer->contents))
     {
-        fprintf(stderr, "Lexer index is greater than the length of the contents\n");
-        exit(1);
+        log_error("Lexer index is greater than the length of the contents\n");
+        error_exit(1);
     }
 
-    parser_T *parser = calloc(1, sizeof(struct PARSE_STRUCT));
+    parser_T *parser = heap_calloc(1, sizeof(struct PARSE_STRUCT));
     parser->lexer = lexer;
     parser->current_token = lexer_get_next_token(lexer);
     parser->peek_token = lexer_get_next_token(lexer);
@@ -39,10 +41,10 @@ void parser_eat(parser_T *parser, int token_type)
     }
     else
     {
-        fprintf(stderr, "Unexpected token '%s', expected '%s'\n",
+        log_error("Unexpected token '%s', expected '%s'\n",
                 token_type_to_string(parser->current_token->type),
                 token_type_to_string(token_type));
-        exit(1);
+        error_exit(1);
     }
 }
 
@@ -50,5 +52,6 @@ void parser_eat(parser_T *parser, int token_type)
 AST_T *parser_parse(parser_T *parser)
 {
     AST_COMPOUND_T *root = (AST_COMPOUND_T *)parser_parse_statements(parser);
+    parser_mark_pure_functions(parser);
     return (AST_T *)root;
 }
@@ -1,4 +1,6 @@
 #include "../include/parser/parser_expressions.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include <string.h>
 #include <stdio.h>
@@ -52,14 +54,14 @@ AST_T *parser_parse_function_call(parser_T *parser)
 
     AST_FUNCTION_CALL_T *ast_function_call = (AST_FUNCTION_CALL_T *)init_ast(AST_FUNCTION_CALL);
     ast_function_call->function_call_name = function_name;
-    ast_function_call->function_call_arguments = calloc(1, sizeof(struct AST_STRUCT *));
+    ast_function_call->function_call_arguments = heap_calloc(1, sizeof(struct AST_STRUCT *));
 
     while (parser->current_token->type != TOKEN_RPAREN)
     {
         AST_T *ast_expression = parser_parse_expression(parser);
 
         int last_idx = ++ast_function_call->function_call_arguments_size;
-        ast_function_call->function_call_arguments = realloc(
+        ast_function_call->function_call_arguments = heap_realloc(
             ast_function_call->function_call_arguments,
             (last_idx + 1) * sizeof(struct AST_STRUCT *));
 
@@ -82,8 +84,9 @@ AST_T *parser_parse_string(parser_T *parser)
     char *value = parser->current_token->value;
     parser_eat(parser, TOKEN_STRING);
 
-    AST_STRING_T *ast_string = (AST_STRING_T *)init_ast(AST_STRING);
-    ast_string->string_value = value;
+    AST_STRING_T *ast_string = init_ast_string(value, strlen(value));
+    // Hashed now, so that comparing the literal while running never writes into the tree
+    ast_string_hash(ast_string);
 
     return (AST_T *)ast_string;
 }
@@ -142,8 +145,10 @@ AST_T *parser_parse_dot_expression(parser_T *parser)
     {
         parser_eat(parser, TOKEN_EQUALS);
         AST_VARIABLE_ASSIGNMENT_T *ast_variable_assignment = (AST_VARIABLE_ASSIGNMENT_T *)init_ast(AST_VARIABLE_ASSIGNMENT);
-        ast_variable_assignment->variable_assignment_name = strcat(variable_name, ".");
-        ast_variable_assignment->variable_assignment_name = strcat(ast_variable_assignment->variable_assignment_name, dot_index_chars);
+        // Name in form 'name.index', in its own buffer since the token's value has no room for it
+        char *assignment_name = heap_malloc(strlen(variable_name) + strlen(dot_index_chars) + 2);
+        sprintf(assignment_name, "%s.%s", variable_name, dot_index_chars);
+        ast_variable_assignment->variable_assignment_name = assignment_name;
         ast_variable_assignment->variable_assignment_value = parser_parse_expression(parser);
 
         return (AST_T *)ast_variable_assignment;
@@ -210,8 +215,8 @@ AST_T *parser_parse_variable_count(parser_T *parser)
 
     if (count <= 0)
     {
-        fprintf(stderr, "Variable count must be greater than 0\n");
-        exit(1);
+        log_error("Variable count must be greater than 0\n");
+        error_exit(1);
     }
 
     ast_variable_count->variable_count_value = count;
@@ -257,6 +262,7 @@ AST_T *parser_parse_array(parser_T *parser)
     parser_eat(parser, TOKEN_LSQUARE);
 
     AST_ARRAY_T *ast_array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    ast_array->array_literal = 1;
 
     while (parser->current_token->type != TOKEN_RSQUARE)
     {
@@ -266,7 +272,7 @@ AST_T *parser_parse_array(parser_T *parser)
 
         // size_t expression_size = ast_get_size(ast_expression);
 
-        ast_array->array_value = realloc(
+        ast_array->array_value = heap_realloc(
             ast_array->array_value,
             (last_idx + 1) * sizeof(struct AST_STRUCT *));
 
@@ -424,7 +430,7 @@ AST_T *parser_parse_expression_with_precedence(parser_T *parser, int precedence)
             break;
         default:
             log_error("Unknown token type: %s\n", token_type_to_string(token_type));
-            exit(1);
+            error_exit(1);
         }
     }
     return left;
@@ -472,8 +478,8 @@ AST_T *parser_parse_factor_with_precedence(parser_T *parser, int precedence)
     }
     else
     {
-        fprintf(stderr, "Unexpected token: %s\n", token_type_to_string(parser->current_token->type));
-        exit(1);
+        log_error("Unexpected token: %s\n", token_type_to_string(parser->current_token->type));
+        error_exit(1);
     }
     return node;
 }
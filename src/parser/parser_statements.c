@@ -1,13 +1,264 @@
 #include "../include/parser/parser_statements.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include <string.h>
 #include <stdio.h>
 
+// Marks the smoke statements of a blunt body that call the blunt itself.
+// Smokes inside light loops and nested blunts never leave this blunt, so they are skipped.
+static void parser_mark_tail_calls(AST_T *node, const char *function_name)
+{
+    if (!node)
+        return;
+
+    switch (node->type)
+    {
+    case AST_COMPOUND:
+        for (size_t i = 0; i < ((AST_COMPOUND_T *)node)->compound_size; i++)
+            parser_mark_tail_calls(((AST_COMPOUND_T *)node)->compound_value[i], function_name);
+        break;
+    case AST_IF_ELSE_BRANCH:
+        for (size_t i = 0; i < ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_size; i++)
+            parser_mark_tail_calls(((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_value[i], function_name);
+        break;
+    case AST_IF:
+        parser_mark_tail_calls(((AST_IF_T *)node)->if_body, function_name);
+        break;
+    case AST_ELSEIF:
+        parser_mark_tail_calls(((AST_ELSEIF_T *)node)->elseif_body, function_name);
+        break;
+    case AST_ELSE:
+        parser_mark_tail_calls(((AST_ELSE_T *)node)->else_body, function_name);
+        break;
+    case AST_RETURN:
+    {
+        AST_RETURN_T *return_node = (AST_RETURN_T *)node;
+        if (return_node->return_value &&
+            return_node->return_value->type == AST_FUNCTION_CALL &&
+            strcmp(((AST_FUNCTION_CALL_T *)return_node->return_value)->function_call_name, function_name) == 0)
+        {
+            LOG_PRINT("Tail call to %s found\n", function_name);
+            return_node->return_tail_call = 1;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Collects the names a blunt body binds by itself: rolled variables and light iterators.
+static void parser_collect_local_names(AST_T *node, char ***names, size_t *names_size)
+{
+    if (!node)
+        return;
+
+    switch (node->type)
+    {
+    case AST_COMPOUND:
+        for (size_t i = 0; i < ((AST_COMPOUND_T *)node)->compound_size; i++)
+            parser_collect_local_names(((AST_COMPOUND_T *)node)->compound_value[i], names, names_size);
+        break;
+    case AST_IF_ELSE_BRANCH:
+        for (size_t i = 0; i < ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_size; i++)
+            parser_collect_local_names(((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_value[i], names, names_size);
+        break;
+    case AST_IF:
+        parser_collect_local_names(((AST_IF_T *)node)->if_body, names, names_size);
+        break;
+    case AST_ELSEIF:
+        parser_collect_local_names(((AST_ELSEIF_T *)node)->elseif_body, names, names_size);
+        break;
+    case AST_ELSE:
+        parser_collect_local_names(((AST_ELSE_T *)node)->else_body, names, names_size);
+        break;
+    case AST_FOR_LOOP:
+        *names = heap_realloc(*names, (*names_size + 1) * sizeof(char *));
+        // A loop over lines has no iterator, its line variable is the one it defines
+        if (((AST_FOR_LOOP_T *)node)->for_loop_lines)
+            (*names)[(*names_size)++] = ((AST_VARIABLE_T *)((AST_FOR_LOOP_T *)node)->for_loop_variable)->variable_name;
+        else
+            (*names)[(*names_size)++] = ((AST_VARIABLE_T *)((AST_FOR_LOOP_T *)node)->for_loop_increment)->variable_name;
+        parser_collect_local_names(((AST_FOR_LOOP_T *)node)->for_loop_body, names, names_size);
+        break;
+    case AST_VARIABLE_DEFINITION:
+        *names = heap_realloc(*names, (*names_size + 1) * sizeof(char *));
+        (*names)[(*names_size)++] = ((AST_VARIABLE_DEFINITION_T *)node)->variable_definition_variable_name;
+        break;
+    default:
+        break;
+    }
+}
+
+// Checks a name against the local names, ignoring a trailing '.index' of dot assignments.
+static int parser_is_local_name(const char *name, char **names, size_t names_size)
+{
+    size_t length = strcspn(name, ".");
+    for (size_t i = 0; i < names_size; i++)
+    {
+        if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// The read-only array builtins a pure blunt may call, unless a blunt of the script hides one of them.
+static int parser_is_array_builtin(parser_T *parser, const char *name)
+{
+    if (strcmp(name, "sum") != 0 && strcmp(name, "min") != 0 && strcmp(name, "max") != 0 && strcmp(name, "count") != 0)
+        return 0;
+
+    for (size_t i = 0; i < parser->function_definitions_size; i++)
+    {
+        if (strcmp(parser->function_definitions[i]->function_definition_name, name) == 0)
+            return 0;
+    }
+    return 1;
+}
+
+// Checks that a node only reads and writes local names and calls nothing but the blunt itself, len and the array builtins.
+// Reading an outer variable is rejected too, otherwise a cached result could go stale.
+static int parser_is_pure_node(parser_T *parser, AST_T *node, const char *function_name, char **names, size_t names_size)
+{
+    if (!node)
+        return 1;
+
+    switch (node->type)
+    {
+    case AST_INT:
+    case AST_STRING:
+    case AST_DOT_DOT:
+    case AST_NOOP:
+    case AST_FUNCTION_DEFINITION:
+        return 1;
+    case AST_COMPOUND:
+        for (size_t i = 0; i < ((AST_COMPOUND_T *)node)->compound_size; i++)
+            if (!parser_is_pure_node(parser, ((AST_COMPOUND_T *)node)->compound_value[i], function_name, names, names_size))
+                return 0;
+        return 1;
+    case AST_ARRAY:
+        for (size_t i = 0; i < ((AST_ARRAY_T *)node)->array_size; i++)
+            if (!parser_is_pure_node(parser, ((AST_ARRAY_T *)node)->array_value[i], function_name, names, names_size))
+                return 0;
+        return 1;
+    case AST_IF_ELSE_BRANCH:
+        for (size_t i = 0; i < ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_size; i++)
+            if (!parser_is_pure_node(parser, ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_value[i], function_name, names, names_size))
+                return 0;
+        return 1;
+    case AST_IF:
+        return parser_is_pure_node(parser, ((AST_IF_T *)node)->if_condition, function_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_IF_T *)node)->if_body, function_name, names, names_size);
+    case AST_ELSEIF:
+        return parser_is_pure_node(parser, ((AST_ELSEIF_T *)node)->elseif_condition, function_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_ELSEIF_T *)node)->elseif_body, function_name, names, names_size);
+    case AST_ELSE:
+        return parser_is_pure_node(parser, ((AST_ELSE_T *)node)->else_body, function_name, names, names_size);
+    case AST_FOR_LOOP:
+        // Reading lines depends on the file and moves through it
+        if (((AST_FOR_LOOP_T *)node)->for_loop_lines)
+            return 0;
+        return parser_is_pure_node(parser, ((AST_FOR_LOOP_T *)node)->for_loop_variable, function_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_FOR_LOOP_T *)node)->for_loop_condition, function_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_FOR_LOOP_T *)node)->for_loop_body, function_name, names, names_size);
+    case AST_RETURN:
+        return parser_is_pure_node(parser, ((AST_RETURN_T *)node)->return_value, function_name, names, names_size);
+    case AST_NESTED_EXPRESSION:
+        return parser_is_pure_node(parser, ((AST_NESTED_EXPRESSION_T *)node)->nested_expression, function_name, names, names_size);
+    case AST_NOT:
+        return parser_is_pure_node(parser, ((AST_NOT_T *)node)->not_expression, function_name, names, names_size);
+    case AST_ADD_OP:
+    case AST_SUB_OP:
+    case AST_MUL_OP:
+    case AST_DIV_OP:
+    case AST_GT_OP:
+    case AST_LT_OP:
+    case AST_GTE_OP:
+    case AST_LTE_OP:
+    case AST_AND_OP:
+    case AST_OR_OP:
+    case AST_EQUAL_OP:
+        return parser_is_pure_node(parser, ((AST_ADD_OP_T *)node)->left, function_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_ADD_OP_T *)node)->right, function_name, names, names_size);
+    case AST_VARIABLE:
+        return parser_is_local_name(((AST_VARIABLE_T *)node)->variable_name, names, names_size);
+    case AST_VARIABLE_DEFINITION:
+        return parser_is_pure_node(parser, ((AST_VARIABLE_DEFINITION_T *)node)->variable_definition_value, function_name, names, names_size);
+    case AST_VARIABLE_ASSIGNMENT:
+        return parser_is_local_name(((AST_VARIABLE_ASSIGNMENT_T *)node)->variable_assignment_name, names, names_size) &&
+               parser_is_pure_node(parser, ((AST_VARIABLE_ASSIGNMENT_T *)node)->variable_assignment_value, function_name, names, names_size);
+    case AST_FUNCTION_CALL:
+    {
+        AST_FUNCTION_CALL_T *function_call = (AST_FUNCTION_CALL_T *)node;
+        if (strcmp(function_call->function_call_name, function_name) != 0 &&
+            strcmp(function_call->function_call_name, "len") != 0 &&
+            !parser_is_array_builtin(parser, function_call->function_call_name))
+            return 0;
+
+        for (size_t i = 0; i < function_call->function_call_arguments_size; i++)
+            if (!parser_is_pure_node(parser, function_call->function_call_arguments[i], function_name, names, names_size))
+                return 0;
+        return 1;
+    }
+    case AST_DOT_EXPRESSION:
+    {
+        AST_DOT_EXPRESSION_T *dot_expression = (AST_DOT_EXPRESSION_T *)node;
+        if (!parser_is_local_name(dot_expression->dot_expression_variable_name, names, names_size))
+            return 0;
+
+        // Method calls may print or keep, so they are never pure
+        if (dot_expression->dot_index->type == AST_FUNCTION_CALL)
+            return 0;
+
+        // 'x.i = value' is parsed as the dot expression 'x' with the assignment 'i = value' as index
+        return parser_is_pure_node(parser, dot_expression->dot_index, function_name, names, names_size);
+    }
+    case AST_DOT_DOT_EXPRESSION:
+    {
+        AST_DOT_DOT_EXPRESSION_T *dot_dot_expression = (AST_DOT_DOT_EXPRESSION_T *)node;
+        return parser_is_local_name(dot_dot_expression->dot_dot_expression_variable_name, names, names_size) &&
+               parser_is_pure_node(parser, dot_dot_expression->dot_dot_first_index, function_name, names, names_size) &&
+               parser_is_pure_node(parser, dot_dot_expression->dot_dot_last_index, function_name, names, names_size);
+    }
+    default:
+        return 0;
+    }
+}
+
+// A blunt is pure when its body has no print, no keep and touches nothing outside its own arguments and locals.
+static int parser_is_pure_function(parser_T *parser, AST_FUNCTION_DEFINITION_T *function_definition)
+{
+    char **names = heap_calloc(function_definition->function_definition_arguments_size + 1, sizeof(char *));
+    size_t names_size = 0;
+
+    for (size_t i = 0; i < function_definition->function_definition_arguments_size; i++)
+        names[names_size++] = ((AST_VARIABLE_T *)function_definition->function_definition_arguments[i])->variable_name;
+
+    parser_collect_local_names(function_definition->function_definition_body, &names, &names_size);
+
+    int pure = parser_is_pure_node(parser, function_definition->function_definition_body,
+                                   function_definition->function_definition_name,
+                                   names,
+                                   names_size);
+    heap_free(names);
+
+    LOG_PRINT("Blunt %s is %s\n", function_definition->function_definition_name, pure ? "pure" : "not pure");
+    return pure;
+}
+
+// Blunts defined later in the script hide builtins from the ones before, so purity waits for the end of the parse.
+void parser_mark_pure_functions(parser_T *parser)
+{
+    for (size_t i = 0; i < parser->function_definitions_size; i++)
+        parser->function_definitions[i]->function_definition_pure = parser_is_pure_function(parser, parser->function_definitions[i]);
+}
+
 // Parses a series of statements and returns them as a compound AST node.
 AST_T *parser_parse_statements(parser_T *parser)
 {
     AST_COMPOUND_T *compound = (AST_COMPOUND_T *)init_ast(AST_COMPOUND);
-    compound->compound_value = calloc(1, sizeof(struct AST_STRUCT *));
+    compound->compound_value = heap_calloc(1, sizeof(struct AST_STRUCT *));
 
     LOG_PRINT("Parsing statement: %s\n", parser->current_token->value);
     AST_T *ast_statement = parser_parse_statement(parser);
@@ -31,7 +282,7 @@ AST_T *parser_parse_statements(parser_T *parser)
         AST_T *ast_statement = parser_parse_statement(parser);
 
         compound->compound_size++;
-        compound->compound_value = realloc(
+        compound->compound_value = heap_realloc(
             compound->compound_value,
             (compound->compound_size + 1) * sizeof(struct AST_STRUCT *));
         compound->compound_value[compound->compound_size - 1] = ast_statement;
@@ -93,9 +344,9 @@ AST_T *parser_parse_statement(parser_T *parser)
     case TOKEN_EOF:
         return NULL;
     default:
-        fprintf(stderr, "Unexpected token '%s'\n",
+        log_error("Unexpected token '%s'\n",
                 token_type_to_string(parser->current_token->type));
-        exit(1);
+        error_exit(1);
     }
 }
 
@@ -144,14 +395,14 @@ AST_T *parser_parse_function_definition(parser_T *parser)
 
     AST_FUNCTION_DEFINITION_T *ast_function_definition = (AST_FUNCTION_DEFINITION_T *)init_ast(AST_FUNCTION_DEFINITION);
     ast_function_definition->function_definition_name = function_name;
-    ast_function_definition->function_definition_arguments = calloc(1, sizeof(struct AST_STRUCT *));
+    ast_function_definition->function_definition_arguments = heap_calloc(1, sizeof(struct AST_STRUCT *));
 
     while (parser->current_token->type != TOKEN_RPAREN)
     {
         AST_T *ast_variable = parser_parse_function_argument(parser);
 
         int last_idx = ++ast_function_definition->function_definition_arguments_size;
-        ast_function_definition->function_definition_arguments = realloc(
+        ast_function_definition->function_definition_arguments = heap_realloc(
             ast_function_definition->function_definition_arguments,
             (last_idx + 1) * sizeof(struct AST_STRUCT *));
 
@@ -172,6 +423,12 @@ AST_T *parser_parse_function_definition(parser_T *parser)
     LOG_PRINT("Parsed function body\n");
     parser_eat(parser, TOKEN_RBRACE);
 
+    parser_mark_tail_calls(ast_function_definition->function_definition_body, function_name);
+
+    parser->function_definitions = heap_realloc(parser->function_definitions,
+                                                (parser->function_definitions_size + 1) * sizeof(AST_FUNCTION_DEFINITION_T *));
+    parser->function_definitions[parser->function_definitions_size++] = ast_function_definition;
+
     return (AST_T *)ast_function_definition;
 }
 
@@ -200,7 +457,7 @@ AST_T *parser_parse_ifelse_statement(parser_T *parser)
     parser_eat(parser, TOKEN_RBRACE);
 
     AST_IF_ELSE_BRANCH_T *ast_ifelse = (AST_IF_ELSE_BRANCH_T *)init_ast(AST_IF_ELSE_BRANCH);
-    ast_ifelse->if_else_compound_value = calloc(1, sizeof(struct AST_STRUCT *));
+    ast_ifelse->if_else_compound_value = heap_calloc(1, sizeof(struct AST_STRUCT *));
     ast_ifelse->if_else_compound_size = 1;
     ast_ifelse->if_else_compound_value[0] = (AST_T *)ast_if;
 
@@ -218,7 +475,7 @@ AST_T *parser_parse_ifelse_statement(parser_T *parser)
         parser_eat(parser, TOKEN_RBRACE);
 
         ast_ifelse->if_else_compound_size++;
-        ast_ifelse->if_else_compound_value = realloc(
+        ast_ifelse->if_else_compound_value = heap_realloc(
             ast_ifelse->if_else_compound_value,
             ast_ifelse->if_else_compound_size * sizeof(struct AST_STRUCT *));
 
@@ -234,7 +491,7 @@ AST_T *parser_parse_ifelse_statement(parser_T *parser)
         ast_else->else_body = parser_parse_statements(parser);
         parser_eat(parser, TOKEN_RBRACE);
         ast_ifelse->if_else_compound_size++;
-        ast_ifelse->if_else_compound_value = realloc(
+        ast_ifelse->if_else_compound_value = heap_realloc(
             ast_ifelse->if_else_compound_value,
             ast_ifelse->if_else_compound_size * sizeof(struct AST_STRUCT *));
 
@@ -252,9 +509,40 @@ AST_T *parser_parse_for_loop(parser_T *parser)
 
     AST_FOR_LOOP_T *ast_for = (AST_FOR_LOOP_T *)init_ast(AST_FOR_LOOP);
 
+    if (parser->current_token->type == TOKEN_PARALLEL)
+    {
+        LOG_PRINT("Parsing parallel for loop\n");
+        parser_eat(parser, TOKEN_PARALLEL);
+        ast_for->for_loop_parallel = 1;
+    }
+
     LOG_PRINT("Parsing for loop variable\n");
     ast_for->for_loop_variable = parser_parse_id(parser);
 
+    // 'light line with "path"' parses as an assignment, of the file whose lines the loop reads into line
+    if (ast_for->for_loop_variable->type == AST_VARIABLE_ASSIGNMENT)
+    {
+        LOG_PRINT("Parsing for loop over lines\n");
+        AST_VARIABLE_ASSIGNMENT_T *ast_assignment = (AST_VARIABLE_ASSIGNMENT_T *)ast_for->for_loop_variable;
+        if (ast_for->for_loop_parallel || strchr(ast_assignment->variable_assignment_name, '.'))
+        {
+            log_error("Lines can only be read into a plain variable by a sequential loop\n");
+            error_exit(1);
+        }
+
+        AST_VARIABLE_T *ast_variable = (AST_VARIABLE_T *)init_ast(AST_VARIABLE);
+        ast_variable->variable_name = ast_assignment->variable_assignment_name;
+        ast_for->for_loop_variable = (AST_T *)ast_variable;
+        ast_for->for_loop_lines = ast_assignment->variable_assignment_value;
+
+        LOG_PRINT("Parsing for loop body\n");
+        parser_eat(parser, TOKEN_LBRACE);
+        ast_for->for_loop_body = parser_parse_statements(parser);
+        parser_eat(parser, TOKEN_RBRACE);
+
+        return (AST_T *)ast_for;
+    }
+
     LOG_PRINT("Parsing for loop iterator\n");
     // Check if the current token is a for iterator otherwise create a new variable
     if (parser->current_token->type != TOKEN_FOR_ITERATOR)
@@ -0,0 +1,224 @@
+#include "../include/pool/pool.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct POOL_WORKER_STRUCT
+{
+    pool_T *pool;
+    size_t worker;
+} pool_worker_T;
+
+// Takes the next chunk of the worker, stealing one from another worker when its own deque is empty
+static int pool_take_chunk(pool_T *pool, size_t worker, size_t *chunk)
+{
+    pool_deque_T *own = &pool->deques[worker];
+    pthread_mutex_lock(&own->lock);
+    if (own->top < own->bottom)
+    {
+        *chunk = --own->bottom;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (size_t i = 1; i < pool->threads_size; i++)
+    {
+        pool_deque_T *victim = &pool->deques[(worker + i) % pool->threads_size];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->top < victim->bottom)
+        {
+            *chunk = victim->top++;
+            pthread_mutex_unlock(&victim->lock);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->chunks_stolen++;
+            pthread_mutex_unlock(&pool->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return 0;
+}
+
+static void pool_work(pool_T *pool, size_t worker)
+{
+    size_t chunk = 0;
+    while (pool_take_chunk(pool, worker, &chunk))
+    {
+        size_t begin = pool->begin + chunk * pool->grain;
+        size_t end = begin + pool->grain < pool->end ? begin + pool->grain : pool->end;
+        pool->task(pool->context, worker, begin, end);
+    }
+}
+
+static void *pool_thread(void *argument)
+{
+    pool_worker_T *worker = argument;
+    pool_T *pool = worker->pool;
+    unsigned long seen_generation = 0;
+
+    // Samples read the shadow stack of the thread running the program, so only that thread takes them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    while (1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen_generation && !pool->shutting_down)
+        {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutting_down)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen_generation = pool->generation;
+        heap_attach(pool->heap);
+        LOGGING_ENABLED = pool->logging;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_work(pool, worker->worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->workers_busy == 0)
+        {
+            pthread_cond_signal(&pool->work_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+size_t pool_default_threads()
+{
+    char *threads = getenv(POOL_THREADS_ENV);
+    if (threads && atoi(threads) > 0)
+    {
+        return atoi(threads);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? cpus : 1;
+}
+
+pool_T *init_pool(size_t threads_size)
+{
+    pool_T *pool = heap_calloc(1, sizeof(struct POOL_STRUCT));
+    if (!pool)
+    {
+        log_error("Failed to allocate memory for pool\n");
+        error_exit(1);
+    }
+
+    pool->threads_size = threads_size ? threads_size : pool_default_threads();
+    pool->threads = heap_calloc(pool->threads_size, sizeof(pthread_t));
+    pool->workers = heap_calloc(pool->threads_size, sizeof(struct POOL_WORKER_STRUCT));
+    pool->deques = heap_calloc(pool->threads_size, sizeof(pool_deque_T));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (size_t i = 0; i < pool->threads_size; i++)
+    {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (size_t i = 1; i < pool->threads_size; i++)
+    {
+        pool_worker_T *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, worker) != 0)
+        {
+            log_error("Failed to start pool thread %lu\n", i);
+            error_exit(1);
+        }
+    }
+
+    LOG_PRINT("Started pool with %lu threads\n", pool->threads_size);
+
+    return pool;
+}
+
+void pool_run(pool_T *pool, size_t begin, size_t end, size_t grain, pool_task_T task, void *context)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+
+    grain = grain ? grain : 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+
+    // Deal the chunks out in contiguous shares, so that workers only steal once they run dry
+    for (size_t i = 0; i < pool->threads_size; i++)
+    {
+        pool->deques[i].top = chunks * i / pool->threads_size;
+        pool->deques[i].bottom = chunks * (i + 1) / pool->threads_size;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->begin = begin;
+    pool->end = end;
+    pool->grain = grain;
+    pool->heap = heap_current();
+    pool->logging = LOGGING_ENABLED;
+    if (pool->threads_size > 1)
+    {
+        heap_set_concurrent(pool->heap, 1);
+    }
+    pool->workers_busy = pool->threads_size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->workers_busy > 0)
+    {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->threads_size > 1)
+    {
+        heap_set_concurrent(pool->heap, 0);
+    }
+}
+
+void pool_free(pool_T *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 1; i < pool->threads_size; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (size_t i = 0; i < pool->threads_size; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    heap_free(pool->workers);
+    heap_free(pool->deques);
+    heap_free(pool->threads);
+    heap_free(pool);
+}
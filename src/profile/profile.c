@@ -0,0 +1,226 @@
+#include "../include/profile/profile.h"
+#include "../include/heap/heap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct PROFILE_BLUNT_STRUCT
+{
+    const char *owner;
+    const char *name;
+    unsigned long calls;
+    unsigned long inclusive_ns;
+    unsigned long exclusive_ns;
+} profile_blunt_T;
+
+static unsigned long profile_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+static int profile_same_blunt(const char *owner, const char *name, const char *other_owner, const char *other_name)
+{
+    if (owner != other_owner && (!owner || !other_owner || strcmp(owner, other_owner) != 0))
+        return 0;
+
+    return name == other_name || strcmp(name, other_name) == 0;
+}
+
+static profile_frame_T *init_profile_frame(profile_frame_T *parent, const char *owner, const char *name)
+{
+    profile_frame_T *frame = heap_calloc(1, sizeof(struct PROFILE_FRAME_STRUCT));
+    frame->owner = owner;
+    frame->name = name;
+    frame->parent = parent;
+    return frame;
+}
+
+profile_T *init_profile()
+{
+    profile_T *profile = heap_calloc(1, sizeof(struct PROFILE_STRUCT));
+    profile->heap = heap_current();
+    profile->root = init_profile_frame(NULL, NULL, "main");
+    profile->current = NULL;
+    return profile;
+}
+
+void profile_start(profile_T *profile)
+{
+    profile->current = profile->root;
+    profile->root->calls++;
+    profile->root->start_ns = profile_now();
+}
+
+void profile_stop(profile_T *profile)
+{
+    while (profile->current)
+    {
+        profile_exit(profile);
+    }
+}
+
+void profile_enter(profile_T *profile, const char *owner, const char *name)
+{
+    profile_frame_T *parent = profile->current;
+    profile_frame_T *frame = parent->children;
+    while (frame && !profile_same_blunt(frame->owner, frame->name, owner, name))
+    {
+        frame = frame->next;
+    }
+
+    if (!frame)
+    {
+        heap_T *previous_heap = heap_use(profile->heap);
+        frame = init_profile_frame(parent, owner, name);
+        heap_use(previous_heap);
+        frame->next = parent->children;
+        parent->children = frame;
+    }
+
+    frame->calls++;
+    profile->current = frame;
+    frame->start_ns = profile_now();
+}
+
+void profile_exit(profile_T *profile)
+{
+    profile_frame_T *frame = profile->current;
+    unsigned long elapsed = profile_now() - frame->start_ns;
+    frame->inclusive_ns += elapsed;
+    if (frame->parent)
+    {
+        frame->parent->children_ns += elapsed;
+    }
+    profile->current = frame->parent;
+}
+
+void profile_repeat(profile_T *profile)
+{
+    profile->current->calls++;
+}
+
+// Recursive calls are nested in their own stack, so only the outermost one adds to the inclusive time
+static int profile_is_recursive(profile_frame_T *frame)
+{
+    for (profile_frame_T *ancestor = frame->parent; ancestor; ancestor = ancestor->parent)
+    {
+        if (ancestor->parent && profile_same_blunt(ancestor->owner, ancestor->name, frame->owner, frame->name))
+            return 1;
+    }
+    return 0;
+}
+
+static void profile_collect(profile_frame_T *frame, profile_blunt_T **blunts, size_t *blunts_size)
+{
+    for (profile_frame_T *child = frame->children; child; child = child->next)
+    {
+        profile_blunt_T *blunt = NULL;
+        for (size_t i = 0; i < *blunts_size && !blunt; i++)
+        {
+            if (profile_same_blunt((*blunts)[i].owner, (*blunts)[i].name, child->owner, child->name))
+                blunt = &(*blunts)[i];
+        }
+
+        if (!blunt)
+        {
+            *blunts = heap_realloc(*blunts, (*blunts_size + 1) * sizeof(struct PROFILE_BLUNT_STRUCT));
+            blunt = &(*blunts)[(*blunts_size)++];
+            memset(blunt, 0, sizeof(struct PROFILE_BLUNT_STRUCT));
+            blunt->owner = child->owner;
+            blunt->name = child->name;
+        }
+
+        blunt->calls += child->calls;
+        blunt->exclusive_ns += child->inclusive_ns - child->children_ns;
+        if (!profile_is_recursive(child))
+        {
+            blunt->inclusive_ns += child->inclusive_ns;
+        }
+
+        profile_collect(child, blunts, blunts_size);
+    }
+}
+
+static int profile_compare_blunts(const void *left, const void *right)
+{
+    const profile_blunt_T *a = left;
+    const profile_blunt_T *b = right;
+    if (a->exclusive_ns != b->exclusive_ns)
+        return a->exclusive_ns < b->exclusive_ns ? 1 : -1;
+
+    return a->calls < b->calls ? 1 : a->calls > b->calls ? -1 : 0;
+}
+
+void profile_print_stats(profile_T *profile)
+{
+    profile_blunt_T *blunts = NULL;
+    size_t blunts_size = 0;
+    profile_collect(profile->root, &blunts, &blunts_size);
+    qsort(blunts, blunts_size, sizeof(struct PROFILE_BLUNT_STRUCT), profile_compare_blunts);
+
+    unsigned long calls = 0;
+    for (size_t i = 0; i < blunts_size; i++)
+        calls += blunts[i].calls;
+
+    fprintf(stderr, "Profile: %lu calls in %.3f ms, %.3f ms at the top level\n",
+            calls,
+            profile->root->inclusive_ns / 1e6,
+            (profile->root->inclusive_ns - profile->root->children_ns) / 1e6);
+    fprintf(stderr, "%-32s %12s %16s %16s\n", "blunt", "calls", "inclusive ms", "exclusive ms");
+    for (size_t i = 0; i < blunts_size; i++)
+    {
+        char name[33];
+        if (blunts[i].owner)
+            snprintf(name, sizeof(name), "%s.%s", blunts[i].owner, blunts[i].name);
+        else
+            snprintf(name, sizeof(name), "%s", blunts[i].name);
+
+        fprintf(stderr, "%-32s %12lu %16.3f %16.3f\n",
+                name,
+                blunts[i].calls,
+                blunts[i].inclusive_ns / 1e6,
+                blunts[i].exclusive_ns / 1e6);
+    }
+
+    heap_free(blunts);
+}
+
+static void profile_write_frame(profile_frame_T *frame, FILE *file, char **stack, size_t *stack_capacity, size_t stack_size)
+{
+    size_t name_size = strlen(frame->name) + (frame->owner ? strlen(frame->owner) + 1 : 0) + 1;
+    if (stack_size + name_size + 1 > *stack_capacity)
+    {
+        *stack_capacity = (stack_size + name_size + 1) * 2;
+        *stack = heap_realloc(*stack, *stack_capacity);
+    }
+
+    char *end = *stack + stack_size;
+    if (stack_size)
+        *end++ = ';';
+    if (frame->owner)
+        end += sprintf(end, "%s.", frame->owner);
+    end += sprintf(end, "%s", frame->name);
+    size_t frame_stack_size = end - *stack;
+
+    // Stacks that took less than a microsecond of their own still show up through their callees
+    unsigned long exclusive_us = (frame->inclusive_ns - frame->children_ns) / 1000;
+    if (exclusive_us)
+    {
+        fprintf(file, "%s %lu\n", *stack, exclusive_us);
+    }
+
+    for (profile_frame_T *child = frame->children; child; child = child->next)
+    {
+        profile_write_frame(child, file, stack, stack_capacity, frame_stack_size);
+    }
+}
+
+void profile_write_folded(profile_T *profile, FILE *file)
+{
+    char *stack = NULL;
+    size_t stack_capacity = 0;
+    profile_write_frame(profile->root, file, &stack, &stack_capacity, 0);
+    heap_free(stack);
+}
@@ -0,0 +1,275 @@
+#include "../include/sample/sample.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// The sampler the SIGPROF handler fills, NULL while no timer runs
+static _Atomic(sample_T *) sample_active = NULL;
+static struct sigaction sample_previous_action;
+
+static void sample_handler(int signal)
+{
+    (void)signal;
+    sample_T *sample = atomic_load(&sample_active);
+    if (!sample)
+    {
+        return;
+    }
+    atomic_signal_fence(memory_order_acquire);
+
+    int depth = sample->depth < SAMPLE_STACK_SIZE ? sample->depth : SAMPLE_STACK_SIZE;
+    int kind = sample->kind;
+    unsigned long id = ++sample->samples;
+    if (kind >= 0 && kind < SAMPLE_KINDS)
+    {
+        sample->kinds[kind]++;
+    }
+
+    if (depth == 0)
+    {
+        sample->top_level++;
+        return;
+    }
+
+    sample->stack[depth - 1]->self++;
+    for (int i = 0; i < depth; i++)
+    {
+        sample_function_T *function = sample->stack[i];
+        if (function->last_sample != id)
+        {
+            function->last_sample = id;
+            function->total++;
+        }
+    }
+}
+
+sample_T *init_sample()
+{
+    sample_T *sample = heap_calloc(1, sizeof(struct SAMPLE_STRUCT));
+    sample->heap = heap_current();
+    sample->kind = AST_NOOP;
+    sample->slots_capacity = 64;
+    sample->slots = heap_calloc(sample->slots_capacity, sizeof(struct SAMPLE_SLOT_STRUCT));
+    return sample;
+}
+
+void sample_start(sample_T *sample)
+{
+    sample_T *expected = NULL;
+    if (!atomic_compare_exchange_strong(&sample_active, &expected, sample))
+    {
+        log_error("Another interpreter is already sampling\n");
+        error_exit(1);
+    }
+
+    sample->depth = 0;
+    sample->kind = AST_NOOP;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = sample_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &sample_previous_action);
+
+    struct itimerval timer = {
+        .it_interval = {.tv_sec = 0, .tv_usec = SAMPLE_INTERVAL_US},
+        .it_value = {.tv_sec = 0, .tv_usec = SAMPLE_INTERVAL_US},
+    };
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void sample_stop(sample_T *sample)
+{
+    if (atomic_load(&sample_active) != sample)
+    {
+        return;
+    }
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(struct itimerval));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sigaction(SIGPROF, &sample_previous_action, NULL);
+    atomic_store(&sample_active, NULL);
+
+    sample->depth = 0;
+    sample->kind = AST_NOOP;
+}
+
+static size_t sample_slot_index(sample_T *sample, const char *owner, const char *name)
+{
+    uintptr_t hash = ((uintptr_t)name >> 3) * 31 + ((uintptr_t)owner >> 3);
+    size_t index = (hash ^ (hash >> 17)) & (sample->slots_capacity - 1);
+    while (sample->slots[index].name && (sample->slots[index].name != name || sample->slots[index].owner != owner))
+    {
+        index = (index + 1) & (sample->slots_capacity - 1);
+    }
+    return index;
+}
+
+static void sample_grow_slots(sample_T *sample)
+{
+    sample_slot_T *slots = sample->slots;
+    size_t slots_capacity = sample->slots_capacity;
+
+    sample->slots_capacity *= 2;
+    sample->slots = heap_calloc(sample->slots_capacity, sizeof(struct SAMPLE_SLOT_STRUCT));
+    for (size_t i = 0; i < slots_capacity; i++)
+    {
+        if (slots[i].name)
+        {
+            sample->slots[sample_slot_index(sample, slots[i].owner, slots[i].name)] = slots[i];
+        }
+    }
+    heap_free(slots);
+}
+
+// Call sites are told apart by the address of their names, which only the first call compares
+static sample_function_T *sample_find_function(sample_T *sample, const char *owner, const char *name)
+{
+    size_t index = sample_slot_index(sample, owner, name);
+    if (sample->slots[index].name)
+    {
+        return sample->slots[index].function;
+    }
+
+    heap_T *previous_heap = heap_use(sample->heap);
+    sample_function_T *function = sample->functions;
+    while (function && !(strcmp(function->name, name) == 0 &&
+                         (function->owner == owner || (function->owner && owner && strcmp(function->owner, owner) == 0))))
+    {
+        function = function->next;
+    }
+
+    if (!function)
+    {
+        function = heap_calloc(1, sizeof(struct SAMPLE_FUNCTION_STRUCT));
+        function->owner = owner;
+        function->name = name;
+        function->next = sample->functions;
+        sample->functions = function;
+    }
+
+    sample->slots[index].owner = owner;
+    sample->slots[index].name = name;
+    sample->slots[index].function = function;
+    if (++sample->slots_size * 2 > sample->slots_capacity)
+    {
+        sample_grow_slots(sample);
+    }
+
+    heap_use(previous_heap);
+    return function;
+}
+
+void sample_enter(sample_T *sample, const char *owner, const char *name)
+{
+    sample_function_T *function = sample_find_function(sample, owner, name);
+    int depth = sample->depth;
+    if (depth < SAMPLE_STACK_SIZE)
+    {
+        sample->stack[depth] = function;
+        // The handler must never see a depth covering a function that is not written yet
+        atomic_signal_fence(memory_order_release);
+    }
+    sample->depth = depth + 1;
+}
+
+void sample_exit(sample_T *sample)
+{
+    sample->depth = sample->depth - 1;
+}
+
+int sample_set_kind(sample_T *sample, int kind)
+{
+    int previous = sample->kind;
+    sample->kind = kind;
+    return previous;
+}
+
+static int sample_compare_functions(const void *left, const void *right)
+{
+    const sample_function_T *a = *(sample_function_T *const *)left;
+    const sample_function_T *b = *(sample_function_T *const *)right;
+    if (a->self != b->self)
+        return a->self < b->self ? 1 : -1;
+
+    return a->total < b->total ? 1 : a->total > b->total ? -1 : 0;
+}
+
+typedef struct SAMPLE_KIND_STRUCT
+{
+    int kind;
+    unsigned long samples;
+} sample_kind_T;
+
+static int sample_compare_kinds(const void *left, const void *right)
+{
+    const sample_kind_T *a = left;
+    const sample_kind_T *b = right;
+    return a->samples < b->samples ? 1 : a->samples > b->samples ? -1 : 0;
+}
+
+static double sample_percent(sample_T *sample, unsigned long count)
+{
+    return sample->samples ? 100.0 * count / sample->samples : 0.0;
+}
+
+void sample_write_histogram(sample_T *sample, FILE *file)
+{
+    fprintf(file, "Samples: %lu, one every %d us of CPU time\n\n", sample->samples, SAMPLE_INTERVAL_US);
+
+    size_t functions_size = 0;
+    for (sample_function_T *function = sample->functions; function; function = function->next)
+        functions_size++;
+
+    sample_function_T **functions = heap_calloc(functions_size ? functions_size : 1, sizeof(sample_function_T *));
+    size_t i = 0;
+    for (sample_function_T *function = sample->functions; function; function = function->next)
+        functions[i++] = function;
+    qsort(functions, functions_size, sizeof(sample_function_T *), sample_compare_functions);
+
+    fprintf(file, "%-32s %10s %8s %10s %8s\n", "blunt", "self", "self %", "total", "total %");
+    fprintf(file, "%-32s %10lu %7.1f%%\n", "(top level)", sample->top_level, sample_percent(sample, sample->top_level));
+    for (i = 0; i < functions_size; i++)
+    {
+        if (!functions[i]->total)
+            continue;
+
+        char name[33];
+        if (functions[i]->owner)
+            snprintf(name, sizeof(name), "%s.%s", functions[i]->owner, functions[i]->name);
+        else
+            snprintf(name, sizeof(name), "%s", functions[i]->name);
+
+        fprintf(file, "%-32s %10lu %7.1f%% %10lu %7.1f%%\n",
+                name,
+                functions[i]->self,
+                sample_percent(sample, functions[i]->self),
+                functions[i]->total,
+                sample_percent(sample, functions[i]->total));
+    }
+    heap_free(functions);
+
+    sample_kind_T kinds[SAMPLE_KINDS];
+    for (int kind = 0; kind < SAMPLE_KINDS; kind++)
+    {
+        kinds[kind].kind = kind;
+        kinds[kind].samples = sample->kinds[kind];
+    }
+    qsort(kinds, SAMPLE_KINDS, sizeof(struct SAMPLE_KIND_STRUCT), sample_compare_kinds);
+
+    fprintf(file, "\n%-32s %10s %8s\n", "node kind", "self", "self %");
+    for (int kind = 0; kind < SAMPLE_KINDS && kinds[kind].samples; kind++)
+    {
+        fprintf(file, "%-32s %10lu %7.1f%%\n",
+                ast_type_to_string(kinds[kind].kind),
+                kinds[kind].samples,
+                sample_percent(sample, kinds[kind].samples));
+    }
+}
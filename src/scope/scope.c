@@ -1,10 +1,16 @@
 #include "../include/io/logger.h"
+#include "../include/heap/heap.h"
+#include "../include/memstats/memstats.h"
+#include "../include/stats/stats.h"
 #include "../include/scope/scope.h"
 #include <string.h>
 
 scope_T *init_scope()
 {
-    scope_T *scope = calloc(1, sizeof(struct SCOPE_STRUCT));
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_SCOPE;
+    scope_T *scope = heap_calloc(1, sizeof(struct SCOPE_STRUCT));
+    heap_tag = tag;
 
     scope->function_definitions = (void *)0;
     scope->function_definitions_size = 0;
@@ -19,7 +25,10 @@ scope_T *init_scope()
 
 scope_stack_T *init_scope_stack()
 {
-    scope_stack_T *stack = calloc(1, sizeof(struct SCOPE_STACK_STRUCT));
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_SCOPE;
+    scope_stack_T *stack = heap_calloc(1, sizeof(struct SCOPE_STACK_STRUCT));
+    heap_tag = tag;
     stack->scope = (void *)0;
     stack->parent = (void *)0;
 
@@ -33,7 +42,7 @@ void free_scope_stack(scope_stack_T *stack)
         free_scope_stack(stack->parent);
     }
 
-    free(stack);
+    heap_free(stack);
 }
 
 scope_stack_T *push_scope_to_stack(scope_stack_T *stack, scope_T *scope)
@@ -41,6 +50,14 @@ scope_stack_T *push_scope_to_stack(scope_stack_T *stack, scope_T *scope)
     scope_stack_T *new_stack = init_scope_stack();
     new_stack->scope = scope;
     new_stack->parent = stack;
+    new_stack->depth = stack->depth + 1;
+
+    if (stats_active)
+    {
+        stats_active->scope_pushes++;
+        if (new_stack->depth > stats_active->peak_scope_depth)
+            stats_active->peak_scope_depth = new_stack->depth;
+    }
 
     LOG_PRINT("Pushing scope to stack\n");
     LOG_PRINT("Parent scope: %p\n", stack->scope);
@@ -57,7 +74,7 @@ scope_stack_T *pop_scope_from_stack(scope_stack_T *stack)
     LOG_PRINT("Parent scope: %p\n", parent_stack ? parent_stack->scope : NULL);
     LOG_PRINT("Popped scope: %p\n", stack->scope);
 
-    free(stack);
+    heap_free(stack);
     return parent_stack;
 }
 
@@ -89,18 +106,22 @@ AST_T *scope_add_function_definition(scope_T *scope, AST_T *fdef)
 {
     scope->function_definitions_size += 1;
 
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_SCOPE;
     if (scope->function_definitions == (void *)0)
     {
-        scope->function_definitions = calloc(1, sizeof(struct AST_STRUCT *));
+        scope->function_definitions = heap_calloc(1, sizeof(struct AST_STRUCT *));
     }
     else
     {
         scope->function_definitions =
-            realloc(
+            heap_realloc(
                 scope->function_definitions,
                 scope->function_definitions_size * sizeof(struct AST_STRUCT **));
     }
 
+    heap_tag = tag;
+
     scope->function_definitions[scope->function_definitions_size - 1] =
         fdef;
 
@@ -128,20 +149,35 @@ AST_T *scope_get_function_definition(scope_T *scope, const char *fname)
 
 AST_T *scope_add_variable_definition(scope_T *scope, AST_T *vdef)
 {
+    // Rolling a name again in the same scope rebinds it, so loops do not grow their scope
+    char *name = ((AST_VARIABLE_DEFINITION_T *)vdef)->variable_definition_variable_name;
+    for (int i = 0; i < scope->variable_definitions_size; i++)
+    {
+        AST_VARIABLE_DEFINITION_T *existing = scope->variable_definitions[i];
+        if (strcmp(existing->variable_definition_variable_name, name) == 0)
+        {
+            scope->variable_definitions[i] = vdef;
+            return vdef;
+        }
+    }
+
+    int tag = heap_tag;
+    heap_tag = MEMSTATS_SCOPE;
     if (scope->variable_definitions == (void *)0)
     {
-        scope->variable_definitions = calloc(1, sizeof(struct AST_STRUCT *));
+        scope->variable_definitions = heap_calloc(1, sizeof(struct AST_STRUCT *));
         scope->variable_definitions[0] = vdef;
         scope->variable_definitions_size += 1;
     }
     else
     {
         scope->variable_definitions_size += 1;
-        scope->variable_definitions = realloc(
+        scope->variable_definitions = heap_realloc(
             scope->variable_definitions,
             scope->variable_definitions_size * sizeof(struct AST_STRUCT *));
         scope->variable_definitions[scope->variable_definitions_size - 1] = vdef;
     }
+    heap_tag = tag;
 
     return vdef;
 }
@@ -0,0 +1,771 @@
+// For struct ucred
+#define _GNU_SOURCE
+#include "../include/serve/serve.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Written by the handlers into the daemon's pipe, which is all a handler may safely do
+#define SERVE_SIGNAL_CHILD 'c'
+#define SERVE_SIGNAL_STOP 's'
+
+static int serve_signal_pipe = -1;
+
+// Writes the path of the socket to buffer, making the directory of the user in /tmp first when create is set
+static const char *serve_find_socket_path(char *buffer, size_t size, int create)
+{
+    const char *path = getenv(SERVE_SOCKET_ENV);
+    if (path)
+    {
+        return path[0] ? path : NULL;
+    }
+
+    // The runtime directory already belongs to the user alone
+    const char *runtime_directory = getenv("XDG_RUNTIME_DIR");
+    if (runtime_directory && runtime_directory[0])
+    {
+        int length = snprintf(buffer, size, "%s/blunt.sock", runtime_directory);
+        if (length > 0 && (size_t)length < size)
+        {
+            return buffer;
+        }
+    }
+
+    // Anyone may create a directory in /tmp, so one of that name that is not the user's own is not used
+    snprintf(buffer, size, "/tmp/blunt-%d", (int)getuid());
+    if (create)
+    {
+        mkdir(buffer, 0700);
+    }
+    struct stat status;
+    if (lstat(buffer, &status) != 0 || !S_ISDIR(status.st_mode) || status.st_uid != getuid() || (status.st_mode & 077))
+    {
+        return NULL;
+    }
+
+    size_t length = strlen(buffer);
+    snprintf(buffer + length, size - length, "/blunt.sock");
+    return buffer;
+}
+
+const char *serve_socket_path(char *buffer, size_t size)
+{
+    return serve_find_socket_path(buffer, size, 0);
+}
+
+// Checks that the process at the other end of a connection runs as the user
+static int serve_peer_is_user(int fd)
+{
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0 && credentials.uid == getuid();
+}
+
+static int serve_address(const char *socket_path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        return 0;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 1;
+}
+
+static int serve_connect(const char *socket_path)
+{
+    struct sockaddr_un address;
+    if (!serve_address(socket_path, &address))
+    {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void serve_signal(int signal)
+{
+    int saved_errno = errno;
+    char byte = signal == SIGCHLD ? SERVE_SIGNAL_CHILD : SERVE_SIGNAL_STOP;
+    ssize_t written = write(serve_signal_pipe, &byte, 1);
+    (void)written;
+    errno = saved_errno;
+}
+
+static int serve_listen(serve_T *serve)
+{
+    struct sockaddr_un address;
+    if (!serve_address(serve->socket_path, &address))
+    {
+        fprintf(stderr, "The socket path %s is too long\n", serve->socket_path);
+        return 0;
+    }
+
+    // A socket nobody answers on is left over from a daemon that died, one that answers is in use
+    int running = serve_connect(serve->socket_path);
+    if (running >= 0)
+    {
+        close(running);
+        fprintf(stderr, "A daemon is already serving on %s\n", serve->socket_path);
+        return 0;
+    }
+    unlink(serve->socket_path);
+
+    serve->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (serve->listener < 0)
+    {
+        fprintf(stderr, "Could not create a socket\n");
+        return 0;
+    }
+    fcntl(serve->listener, F_SETFD, FD_CLOEXEC);
+    // Accepting stops at the first client not there yet instead of waiting for it
+    fcntl(serve->listener, F_SETFL, O_NONBLOCK);
+
+    // Only the user may connect, since the daemon runs whatever script it is given as that user
+    mode_t mask = umask(0177);
+    int bound = bind(serve->listener, (struct sockaddr *)&address, sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(serve->listener, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Could not listen on %s\n", serve->socket_path);
+        return 0;
+    }
+    return 1;
+}
+
+static void serve_start_signals(serve_T *serve)
+{
+    if (pipe(serve->signals) != 0)
+    {
+        serve->signals[0] = serve->signals[1] = -1;
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(serve->signals[i], F_SETFL, O_NONBLOCK);
+        fcntl(serve->signals[i], F_SETFD, FD_CLOEXEC);
+    }
+    serve_signal_pipe = serve->signals[1];
+
+    struct sigaction action = {0};
+    action.sa_handler = serve_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // A client gone before its status is sent must not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+}
+
+static void serve_script_free(serve_script_T *script)
+{
+    if (script->blunt)
+    {
+        blunt_free(script->blunt);
+    }
+    free(script->path);
+    free(script);
+}
+
+// Drops the script run the longest time ago, to make room for another
+static void serve_evict(serve_T *serve)
+{
+    serve_script_T **oldest = &serve->scripts;
+    for (serve_script_T **script = &serve->scripts; *script; script = &(*script)->next)
+    {
+        if ((*script)->used < (*oldest)->used)
+        {
+            oldest = script;
+        }
+    }
+
+    serve_script_T *evicted = *oldest;
+    *oldest = evicted->next;
+    serve_script_free(evicted);
+    serve->scripts_size--;
+}
+
+// Returns the script at path, dropping what the daemon kept of it when the file changed since.
+// The daemon never parses: a script without a cache file matching it is parsed by the child that
+// runs it, which writes the cache file the daemon maps the tree from on a later run.
+static serve_script_T *serve_script(serve_T *serve, const char *path)
+{
+    struct stat status;
+    int found = stat(path, &status) == 0;
+
+    serve_script_T **link = &serve->scripts;
+    for (; *link; link = &(*link)->next)
+    {
+        if (strcmp((*link)->path, path) == 0)
+        {
+            break;
+        }
+    }
+
+    serve_script_T *script = *link;
+    if (!script || !found || script->size != status.st_size || script->inode != status.st_ino ||
+        script->mtime.tv_sec != status.st_mtim.tv_sec || script->mtime.tv_nsec != status.st_mtim.tv_nsec)
+    {
+        if (script)
+        {
+            *link = script->next;
+            serve_script_free(script);
+            serve->scripts_size--;
+        }
+        if (serve->scripts_size == SERVE_SCRIPTS)
+        {
+            serve_evict(serve);
+        }
+
+        script = calloc(1, sizeof(struct SERVE_SCRIPT_STRUCT));
+        if (!script || !(script->path = strdup(path)))
+        {
+            fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+            exit(1);
+        }
+        if (found)
+        {
+            script->mtime = status.st_mtim;
+            script->size = status.st_size;
+            script->inode = status.st_ino;
+        }
+
+        script->next = serve->scripts;
+        serve->scripts = script;
+        serve->scripts_size++;
+    }
+    script->used = ++serve->clock;
+
+    if (!script->blunt && found)
+    {
+        script->blunt = init_blunt();
+        if (!script->blunt)
+        {
+            fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+            exit(1);
+        }
+        if (blunt_load_cached_file(script->blunt, script->path) != BLUNT_OK)
+        {
+            blunt_free(script->blunt);
+            script->blunt = NULL;
+        }
+    }
+    return script;
+}
+
+static long serve_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+// Reads what arrived of a request without waiting for more, the descriptors riding along with its first bytes.
+// Returns 1 once the whole request arrived, 0 while more is to come, -1 when the client is to be dropped.
+static int serve_receive(serve_client_T *client)
+{
+    while (1)
+    {
+        char control[CMSG_SPACE(SERVE_DESCRIPTORS * sizeof(int))];
+        struct iovec vector = {client->request + client->size, SERVE_REQUEST_SIZE - client->size};
+        struct msghdr message = {0};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t read_size = recvmsg(client->connection, &message, MSG_DONTWAIT);
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        if (read_size <= 0)
+        {
+            return -1;
+        }
+
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS && !client->received && count == SERVE_DESCRIPTORS)
+            {
+                memcpy(client->descriptors, CMSG_DATA(header), SERVE_DESCRIPTORS * sizeof(int));
+                client->received = 1;
+            }
+        }
+        client->size += read_size;
+
+        // The request is the working directory and the path, each ending in a NUL
+        char *end = memchr(client->request, '\0', client->size);
+        if (end && memchr(end + 1, '\0', client->size - (end + 1 - client->request)))
+        {
+            return client->received ? 1 : -1;
+        }
+        if (client->size == SERVE_REQUEST_SIZE)
+        {
+            return -1;
+        }
+    }
+}
+
+// Closes the client's descriptors and frees its request, leaving the connection open
+static void serve_client_free(serve_client_T *client)
+{
+    if (client->received)
+    {
+        for (int i = 0; i < SERVE_DESCRIPTORS; i++)
+        {
+            close(client->descriptors[i]);
+        }
+    }
+    free(client->request);
+}
+
+// Takes a client out of the list, filling its place with the last one
+static void serve_remove_client(serve_T *serve, int index)
+{
+    serve->clients[index] = serve->clients[--serve->clients_size];
+}
+
+static void serve_drop_client(serve_T *serve, int index)
+{
+    serve_client_free(&serve->clients[index]);
+    close(serve->clients[index].connection);
+    serve_remove_client(serve, index);
+}
+
+// Runs a script in the child of a request, as main.c would, with the client's descriptors and directory
+static _Noreturn void serve_child(serve_T *serve, serve_script_T *script, serve_client_T *client)
+{
+    close(serve->listener);
+    close(serve->signals[0]);
+    close(serve->signals[1]);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    // The connections and terminals of other clients must see their end when the daemon closes them, not when this run ends
+    for (int i = 0; i < serve->clients_size; i++)
+    {
+        if (&serve->clients[i] != client)
+        {
+            serve_client_free(&serve->clients[i]);
+            close(serve->clients[i].connection);
+        }
+    }
+    for (int i = 0; i < serve->workers; i++)
+    {
+        if (serve->runs[i].pid)
+        {
+            close(serve->runs[i].connection);
+        }
+    }
+    close(client->connection);
+
+    // A descriptor received as 0, 1 or 2, when the daemon started without them, would be closed or
+    // overwritten while the others move into place, so all of them first go above those
+    int descriptors[SERVE_DESCRIPTORS];
+    for (int i = 0; i < SERVE_DESCRIPTORS; i++)
+    {
+        descriptors[i] = fcntl(client->descriptors[i], F_DUPFD_CLOEXEC, SERVE_DESCRIPTORS);
+        if (descriptors[i] < 0)
+        {
+            exit(1);
+        }
+        close(client->descriptors[i]);
+    }
+    for (int i = 0; i < SERVE_DESCRIPTORS; i++)
+    {
+        dup2(descriptors[i], i);
+        if (descriptors[i] != i)
+        {
+            close(descriptors[i]);
+        }
+    }
+
+    const char *directory = client->request;
+    if (chdir(directory) != 0)
+    {
+        fprintf(stderr, "Could not change to directory %s\n", directory);
+        exit(1);
+    }
+
+    // Loaded like main.c loads it, so a script with an error gets the same message from the daemon
+    blunt_T *blunt = script->blunt;
+    blunt_status_T status = BLUNT_OK;
+    if (!blunt)
+    {
+        blunt = init_blunt();
+        if (!blunt)
+        {
+            fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+            exit(1);
+        }
+        blunt_set_cache(blunt, 1);
+        status = blunt_load_file(blunt, script->path);
+    }
+    if (status == BLUNT_OK)
+    {
+        status = blunt_run(blunt);
+    }
+    if (status != BLUNT_OK)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s", blunt_error(blunt));
+    }
+    exit(status == BLUNT_OK ? 0 : 1);
+}
+
+static void serve_send_status(int connection, int32_t exit_code)
+{
+    ssize_t written;
+    do
+    {
+        written = write(connection, &exit_code, sizeof(exit_code));
+    } while (written < 0 && errno == EINTR);
+    close(connection);
+}
+
+// Takes the clients waiting in the backlog, as many as there is room for
+static void serve_accept(serve_T *serve)
+{
+    while (serve->clients_size < SERVE_CLIENTS)
+    {
+        int connection = accept4(serve->listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connection < 0)
+        {
+            return;
+        }
+        if (!serve_peer_is_user(connection))
+        {
+            close(connection);
+            continue;
+        }
+
+        serve_client_T *client = &serve->clients[serve->clients_size];
+        memset(client, 0, sizeof(*client));
+        client->connection = connection;
+        client->request = malloc(SERVE_REQUEST_SIZE);
+        if (!client->request)
+        {
+            close(connection);
+            continue;
+        }
+        client->deadline = serve_now_ms() + SERVE_REQUEST_TIMEOUT_MS;
+        client->order = ++serve->arrivals;
+        serve->clients_size++;
+    }
+}
+
+// Forks the child running the request of a client, whose connection then waits for the child to end
+static void serve_start(serve_T *serve, int index)
+{
+    serve_client_T *client = &serve->clients[index];
+    const char *path = client->request + strlen(client->request) + 1;
+    serve_script_T *script = serve_script(serve, path);
+
+    // Whatever stdio holds would be written again by the child
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        serve_child(serve, script, client);
+    }
+
+    int connection = client->connection;
+    serve_client_free(client);
+    serve_remove_client(serve, index);
+    if (pid < 0)
+    {
+        serve_send_status(connection, 1);
+        return;
+    }
+
+    for (int i = 0; i < serve->workers; i++)
+    {
+        if (serve->runs[i].pid == 0)
+        {
+            serve->runs[i].pid = pid;
+            serve->runs[i].connection = connection;
+            serve->running++;
+            break;
+        }
+    }
+}
+
+// Starts the requests that arrived, first come first served, while workers are free
+static void serve_dispatch(serve_T *serve)
+{
+    while (serve->running < serve->workers)
+    {
+        int first = -1;
+        for (int i = 0; i < serve->clients_size; i++)
+        {
+            if (serve->clients[i].complete && (first < 0 || serve->clients[i].order < serve->clients[first].order))
+            {
+                first = i;
+            }
+        }
+        if (first < 0)
+        {
+            return;
+        }
+        serve_start(serve, first);
+    }
+}
+
+// Milliseconds until the first request still arriving runs out of time, -1 when none is
+static int serve_timeout(serve_T *serve)
+{
+    long timeout = -1;
+    long now = serve_now_ms();
+    for (int i = 0; i < serve->clients_size; i++)
+    {
+        if (!serve->clients[i].complete)
+        {
+            long left = serve->clients[i].deadline > now ? serve->clients[i].deadline - now : 0;
+            timeout = timeout < 0 || left < timeout ? left : timeout;
+        }
+    }
+    return (int)timeout;
+}
+
+// Sends every child that ended its exit status, 128 plus the signal for one that was killed, like a shell
+static void serve_reap(serve_T *serve)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        int32_t exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        for (int i = 0; i < serve->workers; i++)
+        {
+            if (serve->runs[i].pid == pid)
+            {
+                serve_send_status(serve->runs[i].connection, exit_code);
+                serve->runs[i].pid = 0;
+                serve->running--;
+                break;
+            }
+        }
+    }
+}
+
+int serve_run(int workers)
+{
+    char socket_buffer[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    const char *socket_path = serve_find_socket_path(socket_buffer, sizeof(socket_buffer), 1);
+    if (!socket_path)
+    {
+        fprintf(stderr, "There is no socket to serve on, %s is empty or the socket directory is not yours alone\n", SERVE_SOCKET_ENV);
+        return 1;
+    }
+
+    serve_T serve = {0};
+    serve.socket_path = socket_path;
+    serve.listener = -1;
+    serve.workers = workers > 0 ? workers : 1;
+    serve.runs = calloc(serve.workers, sizeof(serve_run_T));
+
+    serve_start_signals(&serve);
+    if (!serve.runs || serve.signals[0] < 0 || !serve_listen(&serve))
+    {
+        if (serve.listener >= 0)
+        {
+            close(serve.listener);
+        }
+        free(serve.runs);
+        return 1;
+    }
+    fprintf(stderr, "Serving on %s, running up to %d scripts at a time\n", socket_path, serve.workers);
+
+    int stopping = 0;
+    while (!stopping)
+    {
+        // Requests that arrived wait for a worker, while the others keep arriving
+        struct pollfd events[2 + SERVE_CLIENTS];
+        events[0] = (struct pollfd){serve.signals[0], POLLIN, 0};
+        events[1] = (struct pollfd){serve.clients_size < SERVE_CLIENTS ? serve.listener : -1, POLLIN, 0};
+        for (int i = 0; i < serve.clients_size; i++)
+        {
+            events[2 + i] = (struct pollfd){serve.clients[i].complete ? -1 : serve.clients[i].connection, POLLIN, 0};
+        }
+        if (poll(events, 2 + serve.clients_size, serve_timeout(&serve)) < 0)
+        {
+            continue;
+        }
+
+        if (events[0].revents & POLLIN)
+        {
+            char bytes[64];
+            ssize_t size = read(serve.signals[0], bytes, sizeof(bytes));
+            for (ssize_t i = 0; i < size; i++)
+            {
+                stopping |= bytes[i] == SERVE_SIGNAL_STOP;
+            }
+            serve_reap(&serve);
+        }
+
+        // Backwards, since dropping a client moves the last one, already read, into its place
+        long now = serve_now_ms();
+        for (int i = serve.clients_size - 1; i >= 0; i--)
+        {
+            serve_client_T *client = &serve.clients[i];
+            if (client->complete)
+            {
+                continue;
+            }
+            int received = events[2 + i].revents ? serve_receive(client) : 0;
+            if (received < 0 || (received == 0 && now >= client->deadline))
+            {
+                serve_drop_client(&serve, i);
+                continue;
+            }
+            client->complete = received;
+        }
+
+        if (events[1].revents & POLLIN)
+        {
+            serve_accept(&serve);
+        }
+        serve_dispatch(&serve);
+    }
+
+    // Runs still going finish on their own, but their clients no longer get a status
+    unlink(socket_path);
+    close(serve.listener);
+    while (serve.scripts)
+    {
+        serve_script_T *next = serve.scripts->next;
+        serve_script_free(serve.scripts);
+        serve.scripts = next;
+    }
+    for (int i = 0; i < serve.workers; i++)
+    {
+        if (serve.runs[i].pid)
+        {
+            close(serve.runs[i].connection);
+        }
+    }
+    while (serve.clients_size > 0)
+    {
+        serve_drop_client(&serve, serve.clients_size - 1);
+    }
+    free(serve.runs);
+    fprintf(stderr, "Stopped serving on %s\n", socket_path);
+    return 0;
+}
+
+int serve_request(const char *socket_path, const char *filename, int *exit_code)
+{
+    char path[PATH_MAX];
+    char directory[PATH_MAX];
+    // A script that cannot be found is left to the interpreter, which says so
+    if (!realpath(filename, path) || !getcwd(directory, sizeof(directory)))
+    {
+        return 0;
+    }
+    size_t directory_size = strlen(directory) + 1;
+    size_t path_size = strlen(path) + 1;
+    if (directory_size + path_size > SERVE_REQUEST_SIZE)
+    {
+        return 0;
+    }
+
+    int connection = serve_connect(socket_path);
+    if (connection < 0)
+    {
+        return 0;
+    }
+    // Another user listening there would get the user's terminal and run the script as themselves
+    if (!serve_peer_is_user(connection))
+    {
+        close(connection);
+        return 0;
+    }
+
+    char request[SERVE_REQUEST_SIZE];
+    memcpy(request, directory, directory_size);
+    memcpy(request + directory_size, path, path_size);
+
+    int descriptors[SERVE_DESCRIPTORS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(descriptors))];
+    memset(control, 0, sizeof(control));
+    struct iovec vector = {request, directory_size + path_size};
+    struct msghdr message = {0};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+    memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    ssize_t sent;
+    do
+    {
+        sent = sendmsg(connection, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    // Nothing ran yet, so the script can still run here
+    if (sent != (ssize_t)(directory_size + path_size))
+    {
+        close(connection);
+        return 0;
+    }
+
+    int32_t status;
+    size_t size = 0;
+    while (size < sizeof(status))
+    {
+        ssize_t read_size = read(connection, (char *)&status + size, sizeof(status) - size);
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_size <= 0)
+        {
+            break;
+        }
+        size += read_size;
+    }
+    close(connection);
+
+    // The script may have run in part, so it is not run again
+    if (size < sizeof(status))
+    {
+        fprintf(stderr, "The daemon stopped before the script ended\n");
+        status = 1;
+    }
+    *exit_code = status;
+    return 1;
+}
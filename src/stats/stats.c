@@ -0,0 +1,123 @@
+#include "../include/stats/stats.h"
+#include "../include/io/error.h"
+#include "../include/io/logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+_Thread_local stats_T *stats_active = NULL;
+
+stats_T *init_stats()
+{
+    // Like the memory statistics, they stay out of the heap so --mem-stats does not count them
+    stats_T *stats = calloc(1, sizeof(struct STATS_STRUCT));
+    if (!stats)
+    {
+        log_error("Failed to allocate memory for statistics\n");
+        error_exit(1);
+    }
+    stats->nodes = stats->parsed_nodes;
+    return stats;
+}
+
+void stats_free(stats_T *stats)
+{
+    free(stats);
+}
+
+long stats_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+typedef struct STATS_NODE_ROW_STRUCT
+{
+    int type;
+    unsigned long parsed;
+    unsigned long run;
+} stats_node_row_T;
+
+static int stats_compare_node_rows(const void *left, const void *right)
+{
+    const stats_node_row_T *a = left;
+    const stats_node_row_T *b = right;
+    unsigned long a_total = a->parsed + a->run;
+    unsigned long b_total = b->parsed + b->run;
+    return a_total < b_total ? 1 : a_total > b_total ? -1 : 0;
+}
+
+const char *stats_phase_to_string(int phase)
+{
+    switch (phase)
+    {
+    case STATS_READ:
+        return "read";
+    case STATS_LEX:
+        return "lex";
+    case STATS_PARSE:
+        return "parse";
+    case STATS_RUN:
+        return "run";
+    default:
+        return "unknown";
+    }
+}
+
+void stats_print(stats_T *stats)
+{
+    long total_ns = 0;
+    for (int phase = 0; phase < STATS_PHASES; phase++)
+        total_ns += stats->phases_ns[phase];
+
+    fprintf(stderr, "Stats: %.3f ms in total\n", total_ns / 1e6);
+    fprintf(stderr, "%-32s %12s %8s\n", "phase", "ms", "%");
+    for (int phase = 0; phase < STATS_PHASES; phase++)
+    {
+        // A tree from its cache file was never lexed, and mapping the file took the place of parsing it
+        if (stats->cached && phase == STATS_LEX)
+        {
+            fprintf(stderr, "%-32s %12s %8s\n", "lex (cached)", "-", "-");
+            continue;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", stats_phase_to_string(phase), stats->cached && phase == STATS_PARSE ? " (cached)" : "");
+        fprintf(stderr, "%-32s %12.3f %7.1f%%\n",
+                name,
+                stats->phases_ns[phase] / 1e6,
+                total_ns ? 100.0 * stats->phases_ns[phase] / total_ns : 0.0);
+    }
+
+    stats_node_row_T rows[AST_NOOP + 1];
+    unsigned long parsed = 0;
+    unsigned long run = 0;
+    for (int type = 0; type <= AST_NOOP; type++)
+    {
+        rows[type].type = type;
+        rows[type].parsed = stats->parsed_nodes[type];
+        rows[type].run = stats->run_nodes[type];
+        parsed += rows[type].parsed;
+        run += rows[type].run;
+    }
+    qsort(rows, AST_NOOP + 1, sizeof(struct STATS_NODE_ROW_STRUCT), stats_compare_node_rows);
+
+    if (stats->cached)
+    {
+        fprintf(stderr, "\nTokens: none, the tree came from its cache file\n");
+        fprintf(stderr, "Nodes: %lu in the cached tree, %lu created while running\n", parsed, run);
+    }
+    else
+    {
+        fprintf(stderr, "\nTokens: %lu\n", stats->tokens);
+        fprintf(stderr, "Nodes: %lu parsed, %lu created while running\n", parsed, run);
+    }
+    fprintf(stderr, "%-32s %12s %12s\n", "node type", "parsed", "running");
+    for (int i = 0; i <= AST_NOOP && rows[i].parsed + rows[i].run; i++)
+    {
+        fprintf(stderr, "%-32s %12lu %12lu\n", ast_type_to_string(rows[i].type), rows[i].parsed, rows[i].run);
+    }
+
+    fprintf(stderr, "\nScopes: %lu pushed, %d deep at the peak\n", stats->scope_pushes, stats->peak_scope_depth);
+    fprintf(stderr, "Calls: %lu of blunts and methods, %lu of builtins\n", stats->user_calls, stats->calls - stats->user_calls);
+}
@@ -1,11 +1,12 @@
 #include "../include/token/token.h"
+#include "../include/heap/heap.h"
 #include "../include/io/logger.h"
 #include <stdlib.h>
 
 // Initialize a token with the given type and value
 token_T *init_token(int type, char *value)
 {
-    token_T *token = calloc(1, sizeof(struct TOKEN_STRUCT));
+    token_T *token = heap_calloc(1, sizeof(struct TOKEN_STRUCT));
     token->type = type;
     token->value = value;
     return token;
@@ -47,6 +48,7 @@ lexer_id_map_T id_map[] = {
     {ID_FOR, TOKEN_FOR},
     {ID_FOR_ITERATOR, TOKEN_FOR_ITERATOR},
     {ID_SAVE, TOKEN_SAVE},
+    {ID_PARALLEL, TOKEN_PARALLEL},
     {"\0", 0} // End of map marker
 };
 
@@ -124,6 +126,8 @@ const char *token_type_to_string(int type)
         return "TOKEN_FOR_ITER";
     case TOKEN_SAVE:
         return "TOKEN_SAVE";
+    case TOKEN_PARALLEL:
+        return "TOKEN_PARALLEL";
     default:
         LOG_PRINT("Unknown token type: %d\n", type);
         return "TOKEN_UNKNOWN";
@@ -1,5 +1,8 @@
 #include "../include/visitor/visitor.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
+#include "../include/io/output.h"
 #include "../include/token/token.h"
 #include "../include/scope/scope.h"
 #include "../include/ast/AST.h"
@@ -9,28 +12,52 @@
 // Function definitions
 visitor_T *init_visitor()
 {
-    visitor_T *visitor = calloc(1, sizeof(struct VISITOR_STRUCT));
+    visitor_T *visitor = heap_calloc(1, sizeof(struct VISITOR_STRUCT));
     if (!visitor)
     {
         log_error("Failed to allocate memory for visitor\n");
-        exit(1);
+        error_exit(1);
     }
 
     visitor->global_scope = init_scope();
     visitor->scope_stack = init_scope_stack();
     visitor->current_function = NULL;
+    visitor->memo = NULL;
+    visitor->profile = NULL;
+    visitor->sample = NULL;
+    visitor->memstats = NULL;
+    visitor->pool = NULL;
+    visitor->heap = heap_current();
+    visitor->input = NULL;
+    visitor->parallel_worker = 0;
 
     return visitor;
 }
 
+static AST_T *visitor_visit_node(visitor_T *visitor, AST_T *node);
+
 AST_T *visitor_visit(visitor_T *visitor, AST_T *node)
 {
     if (!node)
     {
         log_error("Node is NULL\n");
-        exit(1);
+        error_exit(1);
+    }
+
+    // Sampling costs this branch when it is off
+    if (!visitor->sample)
+    {
+        return visitor_visit_node(visitor, node);
     }
 
+    int kind = sample_set_kind(visitor->sample, node->type);
+    AST_T *result = visitor_visit_node(visitor, node);
+    sample_set_kind(visitor->sample, kind);
+    return result;
+}
+
+static AST_T *visitor_visit_node(visitor_T *visitor, AST_T *node)
+{
     switch (node->type)
     {
     case AST_VARIABLE_DEFINITION:
@@ -63,8 +90,17 @@ AST_T *visitor_visit(visitor_T *visitor, AST_T *node)
     case AST_DIV_OP:
     case AST_ADD_OP:
     case AST_SUB_OP:
+    case AST_GT_OP:
+    case AST_LT_OP:
+    case AST_GTE_OP:
+    case AST_LTE_OP:
+    case AST_AND_OP:
+    case AST_OR_OP:
+    case AST_EQUAL_OP:
     case AST_NESTED_EXPRESSION:
         return visitor_visit_term(visitor, node);
+    case AST_NOT:
+        return visitor_visit_not(visitor, (AST_NOT_T *)node);
     case AST_FOR_LOOP:
         return visitor_visit_for_loop(visitor, (AST_FOR_LOOP_T *)node);
     case AST_SAVE:
@@ -82,7 +118,7 @@ int visitor_get_node_value(visitor_T *visitor, AST_T *node)
     if (!node)
     {
         log_error("Node is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Getting value of node: %s\n", ast_type_to_string(node->type));
@@ -115,10 +151,10 @@ int visitor_get_node_value(visitor_T *visitor, AST_T *node)
     case AST_STRING:
 
         log_error("Cannot get value of a string node\n");
-        exit(1);
+        error_exit(1);
     default:
         log_error("Unknown node type\n");
-        exit(1);
+        error_exit(1);
     }
 }
 
@@ -157,7 +193,7 @@ void builtin_print(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
         if (!arguments[i])
         {
             log_error("Argument %lu is NULL\n", i);
-            exit(1);
+            error_exit(1);
         }
 
         LOG_PRINT("Printing argument %lu with type: %s\n", i, ast_type_to_string(arguments[i]->type));
@@ -166,10 +202,10 @@ void builtin_print(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
         switch (visited_ast->type)
         {
         case AST_STRING:
-            printf("%s", ((AST_STRING_T *)visited_ast)->string_value);
+            output_write(ast_string_value((AST_STRING_T *)visited_ast), ast_string_length((AST_STRING_T *)visited_ast));
             break;
         case AST_INT:
-            printf("%d", ((AST_INT_T *)visited_ast)->int_value);
+            output_write_int(((AST_INT_T *)visited_ast)->int_value);
             break;
         case AST_VARIABLE_DEFINITION:
             LOG_PRINT("Variable definition value: %s\n", ast_type_to_string(((AST_VARIABLE_DEFINITION_T *)visited_ast)->variable_definition_value->type));
@@ -177,22 +213,43 @@ void builtin_print(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
             break;
         case AST_ARRAY:
             LOG_PRINT("Array size: %lu\n", ((AST_ARRAY_T *)visited_ast)->array_size);
+            // Arrays of ints are formatted in one go
+            if (((AST_ARRAY_T *)visited_ast)->array_ints)
+            {
+                output_write_ints(((AST_ARRAY_T *)visited_ast)->array_ints, ((AST_ARRAY_T *)visited_ast)->array_size);
+                break;
+            }
+            // and fields without boxing them
+            if (((AST_ARRAY_T *)visited_ast)->array_fields)
+            {
+                AST_ARRAY_FIELD_T *fields = ((AST_ARRAY_T *)visited_ast)->array_fields;
+                for (size_t j = 0; j < ((AST_ARRAY_T *)visited_ast)->array_size; j++)
+                {
+                    output_write(fields[j].field_value, fields[j].field_length);
+                    if (j < ((AST_ARRAY_T *)visited_ast)->array_size - 1)
+                    {
+                        output_write(" ", 1);
+                    }
+                }
+                break;
+            }
             for (size_t j = 0; j < ((AST_ARRAY_T *)visited_ast)->array_size; j++)
             {
-                builtin_print(visitor, (AST_T **)&((AST_ARRAY_T *)visited_ast)->array_value[j], 1);
+                AST_T *element = ast_array_get((AST_ARRAY_T *)visited_ast, j);
+                builtin_print(visitor, &element, 1);
                 if (j < ((AST_ARRAY_T *)visited_ast)->array_size - 1)
                 {
-                    printf(" ");
+                    output_write(" ", 1);
                 }
             }
             break;
         default:
             log_error("Unsupported type for printing\n");
-            exit(1);
+            error_exit(1);
         }
         if (i < arguments_size - 1)
         {
-            printf(" ");
+            output_write(" ", 1);
         }
     }
 }
@@ -200,7 +257,7 @@ void builtin_print(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
 void builtin_println(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
 {
     builtin_print(visitor, arguments, arguments_size);
-    printf("\n");
+    output_write("\n", 1);
 }
 
 int builtin_len(visitor_T *visitor, AST_T *node)
@@ -216,14 +273,14 @@ int builtin_len(visitor_T *visitor, AST_T *node)
     if (node->type == AST_STRING)
     {
         string = (AST_STRING_T *)node;
-        return strlen(string->string_value) + 1;
+        return ast_string_length(string) + 1;
     }
 
     AST_T *visited_ast = visitor_visit(visitor, node);
     if (visited_ast->type == AST_STRING)
     {
         string = (AST_STRING_T *)visited_ast;
-        return strlen(string->string_value) + 1;
+        return ast_string_length(string) + 1;
     }
 
     if (visited_ast->type == AST_ARRAY)
@@ -233,5 +290,5 @@ int builtin_len(visitor_T *visitor, AST_T *node)
     }
 
     log_error("Unsupported type for len\n");
-    exit(1);
+    error_exit(1);
 }
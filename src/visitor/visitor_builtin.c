@@ -0,0 +1,568 @@
+#include "../include/visitor/visitor_builtin.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/kernel/kernel.h"
+#include "../include/pool/pool.h"
+#include "../include/io/logger.h"
+#include "../include/ast/AST.h"
+#include "../include/input/input_csv.h"
+#include <stdio.h>
+#include <string.h>
+
+static void builtin_check_arguments(const char *name, size_t arguments_size, size_t expected)
+{
+    if (arguments_size != expected)
+    {
+        log_error("%s expects %lu arguments, got %lu\n", name, expected, arguments_size);
+        error_exit(1);
+    }
+}
+
+// Evaluates an array argument. A 'roll N x' variable still holding a single value becomes a run-length array.
+static AST_ARRAY_T *builtin_array_argument(visitor_T *visitor, const char *name, AST_T *argument)
+{
+    AST_T *value = visitor_visit(visitor, argument);
+    if (value->type == AST_ARRAY)
+    {
+        return (AST_ARRAY_T *)value;
+    }
+
+    if (argument->type == AST_VARIABLE)
+    {
+        AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(visitor, ((AST_VARIABLE_T *)argument)->variable_name);
+        int count = visitor_get_variable_count(visitor, (AST_VARIABLE_T *)argument);
+        if (count > 1)
+        {
+            AST_ARRAY_T *array = init_ast_array_filled(count, variable_definition->variable_definition_value);
+            variable_definition->variable_definition_value = (AST_T *)array;
+            return array;
+        }
+    }
+
+    log_error("%s expects an array, got %s\n", name, ast_type_to_string(value->type));
+    error_exit(1);
+}
+
+static int32_t *builtin_int_elements(const char *name, AST_ARRAY_T *array, int writable)
+{
+    int32_t *ints = ast_array_ints(array, writable);
+    if (!ints)
+    {
+        log_error("%s expects an array of ints\n", name);
+        error_exit(1);
+    }
+
+    return ints;
+}
+
+// Checks that an array is run-length encoded with an int in every run, so it can be reduced run by run without expanding it
+static int builtin_int_runs(AST_ARRAY_T *array)
+{
+    if (!array->array_runs)
+    {
+        return 0;
+    }
+
+    for (size_t run = 0; run < array->array_runs_size; run++)
+    {
+        if (array->array_runs[run].run_value->type != AST_INT)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int32_t builtin_run_int(AST_ARRAY_T *array, size_t run)
+{
+    return ((AST_INT_T *)array->array_runs[run].run_value)->int_value;
+}
+
+static size_t builtin_run_length(AST_ARRAY_T *array, size_t run)
+{
+    return ast_array_run_end(array, run) - array->array_runs[run].run_start;
+}
+
+static int builtin_int_argument(visitor_T *visitor, const char *name, AST_T *argument)
+{
+    AST_T *value = visitor_visit(visitor, argument);
+    if (value->type != AST_INT)
+    {
+        log_error("%s expects an int, got %s\n", name, ast_type_to_string(value->type));
+        error_exit(1);
+    }
+
+    return ((AST_INT_T *)value)->int_value;
+}
+
+static AST_T *builtin_int_result(int value)
+{
+    AST_INT_T *result = (AST_INT_T *)init_ast(AST_INT);
+    result->int_value = value;
+    return (AST_T *)result;
+}
+
+AST_T *builtin_sum(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("sum", arguments_size, 1);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "sum", arguments[0]);
+    if (array->array_size == 0)
+    {
+        return builtin_int_result(0);
+    }
+
+    if (builtin_int_runs(array))
+    {
+        // Wraps around like the kernels do
+        uint32_t sum = 0;
+        for (size_t run = 0; run < array->array_runs_size; run++)
+        {
+            sum += (uint32_t)builtin_run_int(array, run) * (uint32_t)builtin_run_length(array, run);
+        }
+        return builtin_int_result((int32_t)sum);
+    }
+
+    int32_t *ints = builtin_int_elements("sum", array, 0);
+    return builtin_int_result(kernel_get()->sum(ints, array->array_size));
+}
+
+AST_T *builtin_min(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("min", arguments_size, 1);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "min", arguments[0]);
+    if (array->array_size == 0)
+    {
+        log_error("min of an empty array\n");
+        error_exit(1);
+    }
+
+    if (builtin_int_runs(array))
+    {
+        int32_t min = builtin_run_int(array, 0);
+        for (size_t run = 1; run < array->array_runs_size; run++)
+        {
+            if (builtin_run_int(array, run) < min)
+            {
+                min = builtin_run_int(array, run);
+            }
+        }
+        return builtin_int_result(min);
+    }
+
+    int32_t *ints = builtin_int_elements("min", array, 0);
+    return builtin_int_result(kernel_get()->min(ints, array->array_size));
+}
+
+AST_T *builtin_max(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("max", arguments_size, 1);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "max", arguments[0]);
+    if (array->array_size == 0)
+    {
+        log_error("max of an empty array\n");
+        error_exit(1);
+    }
+
+    if (builtin_int_runs(array))
+    {
+        int32_t max = builtin_run_int(array, 0);
+        for (size_t run = 1; run < array->array_runs_size; run++)
+        {
+            if (builtin_run_int(array, run) > max)
+            {
+                max = builtin_run_int(array, run);
+            }
+        }
+        return builtin_int_result(max);
+    }
+
+    int32_t *ints = builtin_int_elements("max", array, 0);
+    return builtin_int_result(kernel_get()->max(ints, array->array_size));
+}
+
+AST_T *builtin_count(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("count", arguments_size, 2);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "count", arguments[0]);
+    int value = builtin_int_argument(visitor, "count", arguments[1]);
+    if (array->array_size == 0)
+    {
+        return builtin_int_result(0);
+    }
+
+    if (builtin_int_runs(array))
+    {
+        size_t count = 0;
+        for (size_t run = 0; run < array->array_runs_size; run++)
+        {
+            if (builtin_run_int(array, run) == value)
+            {
+                count += builtin_run_length(array, run);
+            }
+        }
+        return builtin_int_result(count);
+    }
+
+    int32_t *ints = builtin_int_elements("count", array, 0);
+    return builtin_int_result(kernel_get()->count(ints, array->array_size, value));
+}
+
+AST_T *builtin_fill(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("fill", arguments_size, 2);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "fill", arguments[0]);
+    AST_T *value = visitor_visit(visitor, arguments[1]);
+
+    // A packed array that nobody shares is filled in place, anything else becomes a single run
+    if (array->array_ints && !array->array_shared && value->type == AST_INT)
+    {
+        kernel_get()->fill(array->array_ints, array->array_size, ((AST_INT_T *)value)->int_value);
+    }
+    else
+    {
+        ast_array_fill(array, value);
+    }
+
+    return (AST_T *)array;
+}
+
+AST_T *builtin_scale(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("scale", arguments_size, 2);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "scale", arguments[0]);
+    int factor = builtin_int_argument(visitor, "scale", arguments[1]);
+    if (array->array_size == 0)
+    {
+        return (AST_T *)array;
+    }
+
+    int32_t *ints = builtin_int_elements("scale", array, 1);
+    kernel_get()->scale(ints, array->array_size, factor);
+
+    return (AST_T *)array;
+}
+
+AST_T *builtin_add(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("add", arguments_size, 2);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "add", arguments[0]);
+    AST_ARRAY_T *other = builtin_array_argument(visitor, "add", arguments[1]);
+    if (array->array_size != other->array_size)
+    {
+        log_error("add expects arrays of the same length, got %lu and %lu\n", array->array_size, other->array_size);
+        error_exit(1);
+    }
+    if (array->array_size == 0)
+    {
+        return (AST_T *)array;
+    }
+
+    // Take the written ints first, so that a copy made for sharing does not change what other reads
+    int32_t *ints = builtin_int_elements("add", array, 1);
+    int32_t *other_ints = builtin_int_elements("add", other, 0);
+    kernel_get()->add(ints, other_ints, array->array_size);
+
+    return (AST_T *)array;
+}
+
+// Arrays are reduced in chunks of this many elements. The chunks do not depend on the number of
+// threads, so neither does the order in which the blunt combines values.
+#define REDUCE_CHUNK 4096
+// Below this size the threads cost more than they save
+#define REDUCE_PARALLEL_THRESHOLD (4 * REDUCE_CHUNK)
+
+typedef struct REDUCE_WORKER_STRUCT
+{
+    visitor_T *visitor;
+    AST_FUNCTION_CALL_T *call;
+    // Errors of the worker stop it and are raised again on the calling thread after the fold
+    error_trap_T trap;
+    int failed;
+} reduce_worker_T;
+
+typedef struct REDUCE_STRUCT
+{
+    visitor_T *visitor;
+    AST_FUNCTION_DEFINITION_T *function_definition;
+    int32_t *ints;
+    size_t size;
+    AST_T *init;
+    AST_T **partials;
+    reduce_worker_T *workers;
+} reduce_T;
+
+// A call of the blunt whose two arguments are replaced before every evaluation
+static AST_FUNCTION_CALL_T *reduce_init_call(AST_FUNCTION_DEFINITION_T *function_definition)
+{
+    AST_FUNCTION_CALL_T *call = (AST_FUNCTION_CALL_T *)init_ast(AST_FUNCTION_CALL);
+    call->function_call_name = function_definition->function_definition_name;
+    call->function_call_arguments = heap_calloc(2, sizeof(struct AST_STRUCT *));
+    call->function_call_arguments_size = 2;
+    return call;
+}
+
+static AST_T *reduce_combine(visitor_T *visitor, AST_FUNCTION_CALL_T *call, AST_T *left, AST_T *right)
+{
+    call->function_call_arguments[0] = left;
+    call->function_call_arguments[1] = right;
+    return visitor_visit_function_call(visitor, call);
+}
+
+static void reduce_run_chunks(void *context, size_t worker, size_t begin, size_t end)
+{
+    reduce_T *reduce = context;
+    reduce_worker_T *reduce_worker = &reduce->workers[worker];
+    if (reduce_worker->failed)
+    {
+        return;
+    }
+
+    error_trap_set(&reduce_worker->trap);
+    if (setjmp(reduce_worker->trap.jump) != 0)
+    {
+        reduce_worker->failed = 1;
+        error_trap_clear(&reduce_worker->trap);
+        return;
+    }
+
+    if (!reduce_worker->visitor)
+    {
+        // The blunt is never written while running, so every worker calls the same definition
+        reduce_worker->visitor = init_parallel_worker(reduce->visitor);
+        reduce_worker->call = reduce_init_call(reduce->function_definition);
+    }
+
+    for (size_t chunk = begin; chunk < end; chunk++)
+    {
+        size_t first = chunk * REDUCE_CHUNK;
+        size_t last = first + REDUCE_CHUNK < reduce->size ? first + REDUCE_CHUNK : reduce->size;
+
+        // Only the first chunk starts from init, the others from their first element
+        AST_T *partial = chunk == 0 ? reduce->init : builtin_int_result(reduce->ints[first++]);
+        for (size_t i = first; i < last; i++)
+        {
+            partial = reduce_combine(reduce_worker->visitor, reduce_worker->call, partial, builtin_int_result(reduce->ints[i]));
+        }
+        reduce->partials[chunk] = partial;
+    }
+
+    error_trap_clear(&reduce_worker->trap);
+}
+
+AST_T *builtin_reduce(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("reduce", arguments_size, 3);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "reduce", arguments[0]);
+
+    if (arguments[1]->type != AST_VARIABLE)
+    {
+        log_error("reduce expects the name of a blunt\n");
+        error_exit(1);
+    }
+    AST_FUNCTION_DEFINITION_T *function_definition = visitor_get_function_definition(visitor, ((AST_VARIABLE_T *)arguments[1])->variable_name);
+    if (!function_definition || function_definition->function_definition_arguments_size != 2)
+    {
+        log_error("reduce expects a blunt of two arguments, got %s\n", ((AST_VARIABLE_T *)arguments[1])->variable_name);
+        error_exit(1);
+    }
+
+    AST_T *init = visitor_visit(visitor, arguments[2]);
+    AST_FUNCTION_CALL_T *call = reduce_init_call(function_definition);
+
+    // Only pure blunts over large int arrays can be evaluated out of order, everything else is folded in order
+    int32_t *ints = NULL;
+    if (array->array_size >= REDUCE_PARALLEL_THRESHOLD &&
+        function_definition->function_definition_pure &&
+        init->type == AST_INT &&
+        !visitor->parallel_worker)
+    {
+        ints = ast_array_ints(array, 0);
+    }
+
+    if (!ints)
+    {
+        AST_T *result = init;
+        for (size_t i = 0; i < array->array_size; i++)
+        {
+            result = reduce_combine(visitor, call, result, ast_array_get(array, i));
+        }
+        return result;
+    }
+
+    pool_T *pool = visitor_get_pool(visitor);
+    reduce_T *reduce = heap_calloc(1, sizeof(struct REDUCE_STRUCT));
+    reduce->visitor = visitor;
+    reduce->function_definition = function_definition;
+    reduce->ints = ints;
+    reduce->size = array->array_size;
+    reduce->init = init;
+
+    size_t chunks = (array->array_size + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+    reduce->partials = heap_calloc(chunks, sizeof(struct AST_STRUCT *));
+    reduce->workers = heap_calloc(pool->threads_size, sizeof(struct REDUCE_WORKER_STRUCT));
+
+    LOG_PRINT("Reducing %lu ints in %lu chunks on %lu threads\n", reduce->size, chunks, pool->threads_size);
+    pool_run(pool, 0, chunks, 1, reduce_run_chunks, reduce);
+    for (size_t i = 0; i < pool->threads_size; i++)
+    {
+        if (reduce->workers[i].failed)
+        {
+            error_raise(&reduce->workers[i].trap);
+        }
+    }
+
+    // The partials are combined in chunk order, which is what makes the result repeatable
+    AST_T *result = reduce->partials[0];
+    for (size_t chunk = 1; chunk < chunks; chunk++)
+    {
+        result = reduce_combine(visitor, call, result, reduce->partials[chunk]);
+    }
+
+    for (size_t i = 0; i < pool->threads_size; i++)
+    {
+        if (reduce->workers[i].visitor)
+        {
+            free_parallel_worker(reduce->workers[i].visitor);
+        }
+    }
+    heap_free(reduce->workers);
+    heap_free(reduce->partials);
+    heap_free(reduce);
+
+    return result;
+}
+
+// Copies an evaluated string argument into a buffer ending in '\0', which slices do not have
+static char *builtin_string_value(const char *name, const char *expected, AST_T *value)
+{
+    if (value->type != AST_STRING)
+    {
+        log_error("%s expects %s, got %s\n", name, expected, ast_type_to_string(value->type));
+        error_exit(1);
+    }
+
+    AST_STRING_T *string = (AST_STRING_T *)value;
+    return heap_strndup(ast_string_value(string), ast_string_length(string));
+}
+
+static input_T *builtin_input(visitor_T *visitor)
+{
+    if (!visitor->input)
+    {
+        visitor->input = init_input();
+    }
+    return visitor->input;
+}
+
+input_stream_T *builtin_input_stream(visitor_T *visitor, const char *name, AST_T *path)
+{
+    if (!path)
+    {
+        return input_open(builtin_input(visitor), NULL);
+    }
+
+    char *path_value = builtin_string_value(name, "a path", visitor_visit(visitor, path));
+    input_stream_T *stream = input_open(builtin_input(visitor), path_value);
+    heap_free(path_value);
+    return stream;
+}
+
+static input_stream_T *builtin_input_argument(visitor_T *visitor, const char *name, AST_T **arguments, size_t arguments_size)
+{
+    if (arguments_size > 1)
+    {
+        log_error("%s expects at most 1 argument, got %lu\n", name, arguments_size);
+        error_exit(1);
+    }
+
+    return builtin_input_stream(visitor, name, arguments_size ? arguments[0] : NULL);
+}
+
+AST_T *builtin_readln(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    AST_STRING_T *line = input_read_line(builtin_input_argument(visitor, "readln", arguments, arguments_size));
+    if (!line)
+    {
+        return (AST_T *)init_ast_string("", 0);
+    }
+
+    return (AST_T *)line;
+}
+
+AST_T *builtin_eof(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    return builtin_int_result(input_eof(builtin_input_argument(visitor, "eof", arguments, arguments_size)));
+}
+
+AST_T *builtin_loadcsv(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("loadcsv", arguments_size, 2);
+
+    char *path = builtin_string_value("loadcsv", "a path", visitor_visit(visitor, arguments[0]));
+
+    // A column is named by its index, or by its name in the header row
+    AST_T *column = visitor_visit(visitor, arguments[1]);
+    AST_ARRAY_T *array;
+    if (column->type == AST_INT)
+    {
+        array = input_load_csv(builtin_input(visitor), path, ((AST_INT_T *)column)->int_value, NULL);
+    }
+    else
+    {
+        char *column_name = builtin_string_value("loadcsv", "a column index or name", column);
+        array = input_load_csv(builtin_input(visitor), path, -1, column_name);
+        heap_free(column_name);
+    }
+
+    heap_free(path);
+    return (AST_T *)array;
+}
+
+AST_T *builtin_mapfile(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    if (arguments_size != 1 && arguments_size != 2)
+    {
+        log_error("mapfile expects 1 or 2 arguments, got %lu\n", arguments_size);
+        error_exit(1);
+    }
+
+    char *path = builtin_string_value("mapfile", "a path", visitor_visit(visitor, arguments[0]));
+    int shared = arguments_size == 2;
+    size_t size = 0;
+    if (shared)
+    {
+        int requested = builtin_int_argument(visitor, "mapfile", arguments[1]);
+        if (requested < 0)
+        {
+            log_error("mapfile expects a size of 0 or more, got %d\n", requested);
+            error_exit(1);
+        }
+        size = requested;
+    }
+
+    AST_ARRAY_T *array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    array->array_ints = input_map_ints(builtin_input(visitor), path, &size, shared);
+    array->array_size = size;
+    array->array_mapped = shared ? AST_ARRAY_MAPPED_SHARED : AST_ARRAY_MAPPED_PRIVATE;
+
+    heap_free(path);
+    return (AST_T *)array;
+}
+
+AST_T *builtin_sync(visitor_T *visitor, AST_T **arguments, size_t arguments_size)
+{
+    builtin_check_arguments("sync", arguments_size, 1);
+    AST_ARRAY_T *array = builtin_array_argument(visitor, "sync", arguments[0]);
+    if (!array->array_mapped)
+    {
+        log_error("sync expects an array mapped to a file\n");
+        error_exit(1);
+    }
+
+    if (array->array_mapped == AST_ARRAY_MAPPED_SHARED)
+    {
+        input_sync_ints(array->array_ints, array->array_size);
+    }
+    return (AST_T *)array;
+}
@@ -1,4 +1,6 @@
 #include "../include/visitor/visitor_expression.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include "../include/scope/scope.h"
 #include "../include/visitor/visitor.h"
@@ -20,14 +22,26 @@ AST_T *visitor_visit_array(visitor_T *visitor, AST_ARRAY_T *node)
 {
     LOG_PRINT("Visiting array\n");
 
+    if (!node->array_literal)
+    {
+        // Arrays built at runtime hold values that are already visited
+        return (AST_T *)node;
+    }
+
+    // The literal stays as parsed, its elements are visited into a new array
+    AST_ARRAY_T *array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
+    array->array_value = heap_calloc(node->array_size ? node->array_size : 1, sizeof(struct AST_STRUCT *));
+    array->array_size = node->array_size;
     for (size_t i = 0; i < node->array_size; i++)
     {
         LOG_PRINT("Visiting array element %lu\n", i);
-        AST_T *array_value = visitor_visit(visitor, node->array_value[i]);
-        node->array_value[i] = array_value;
+        array->array_value[i] = visitor_visit(visitor, node->array_value[i]);
     }
 
-    return (AST_T *)node;
+    // Arrays of ints keep their elements inline instead of one node per element
+    ast_array_pack(array);
+
+    return (AST_T *)array;
 }
 
 AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *node)
@@ -37,7 +51,7 @@ AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *no
     if (!node->dot_expression_variable_name)
     {
         log_error("Dot expression variable name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_T *variable = (AST_VARIABLE_T *)init_ast(AST_VARIABLE);
@@ -48,7 +62,7 @@ AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *no
     if (!node->dot_index)
     {
         log_error("Dot index is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_T *dot_index = NULL;
@@ -74,13 +88,13 @@ AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *no
         if (!variable_definition)
         {
             log_error("Variable definition for %s not found\n", node->dot_expression_variable_name);
-            exit(1);
+            error_exit(1);
         }
 
         if (variable_definition->variable_definition_value->type != AST_RUNTIME_FUNCTION_DEFINITION)
         {
             log_error("Variable definition for %s is not a function\n", node->dot_expression_variable_name);
-            exit(1);
+            error_exit(1);
         }
 
         AST_RUNTIME_FUNCTION_DEFINITION_T *function_definition = (AST_RUNTIME_FUNCTION_DEFINITION_T *)(variable_definition->variable_definition_value);
@@ -101,7 +115,7 @@ AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *no
     if (dot_index->type != AST_INT)
     {
         log_error("Dot index must be an integer\n");
-        exit(1);
+        error_exit(1);
     }
 
     int index = ((AST_INT_T *)dot_index)->int_value;
@@ -110,19 +124,60 @@ AST_T *visitor_visit_dot_expression(visitor_T *visitor, AST_DOT_EXPRESSION_T *no
     {
         AST_VARIABLE_ASSIGNMENT_T *variable_assignment = (AST_VARIABLE_ASSIGNMENT_T *)init_ast(AST_VARIABLE_ASSIGNMENT);
 
-        // Create variable name in form 'name.index'
-        char *variable_name = strcat(node->dot_expression_variable_name, ".");
-        variable_name = strcat(variable_name, ((AST_VARIABLE_ASSIGNMENT_T *)node->dot_index)->variable_assignment_name);
+        // Create variable name in form 'name.index', in its own buffer since the node's name has no room for it
+        char *index_name = ((AST_VARIABLE_ASSIGNMENT_T *)node->dot_index)->variable_assignment_name;
+        int tag = heap_tag;
+        heap_tag = MEMSTATS_STRING;
+        char *variable_name = heap_malloc(strlen(node->dot_expression_variable_name) + strlen(index_name) + 2);
+        heap_tag = tag;
+        sprintf(variable_name, "%s.%s", node->dot_expression_variable_name, index_name);
         LOG_PRINT("Variable dot name: %s\n", variable_name);
         variable_assignment->variable_assignment_name = variable_name;
         variable_assignment->variable_assignment_value = ((AST_VARIABLE_ASSIGNMENT_T *)node->dot_index)->variable_assignment_value;
 
-        return visitor_visit_variable_assignment_with_index(visitor, variable_assignment, index);
+        AST_T *result = visitor_visit_variable_assignment_with_index(visitor, variable_assignment, index);
+        heap_free(variable_name);
+        heap_free(variable_assignment);
+        return result;
     }
 
     return visitor_visit_variable_with_index(visitor, variable, index);
 }
 
+AST_T *visitor_visit_dot_expression_read(visitor_T *visitor, AST_DOT_EXPRESSION_T *node, AST_INT_T *scratch)
+{
+    int type = node->dot_index ? node->dot_index->type : AST_NOOP;
+    if (!node->dot_expression_variable_name || type == AST_NOOP || type == AST_VARIABLE_ASSIGNMENT ||
+        type == AST_FUNCTION_CALL || type == AST_DOT_DOT)
+    {
+        return visitor_visit_dot_expression(visitor, node);
+    }
+
+    AST_T *dot_index = visitor_visit(visitor, node->dot_index);
+    if (dot_index->type != AST_INT)
+    {
+        log_error("Dot index must be an integer\n");
+        error_exit(1);
+    }
+    int index = ((AST_INT_T *)dot_index)->int_value;
+
+    // Reading 4 bytes of a packed array needs no node, anything else goes the usual way
+    AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(visitor, node->dot_expression_variable_name);
+    if (variable_definition && variable_definition->variable_definition_value->type == AST_ARRAY)
+    {
+        AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
+        if (array->array_ints && index >= 0 && (size_t)index < array->array_size)
+        {
+            scratch->int_value = array->array_ints[index];
+            return (AST_T *)scratch;
+        }
+    }
+
+    AST_VARIABLE_T *variable = (AST_VARIABLE_T *)init_ast(AST_VARIABLE);
+    variable->variable_name = node->dot_expression_variable_name;
+    return visitor_visit_variable_with_index(visitor, variable, index);
+}
+
 AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSION_T *node)
 {
     LOG_PRINT("Visiting dot dot expression\n");
@@ -130,7 +185,7 @@ AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSI
     if (!node->dot_dot_expression_variable_name)
     {
         log_error("Dot dot expression variable name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_T *variable = (AST_VARIABLE_T *)init_ast(AST_VARIABLE);
@@ -141,13 +196,13 @@ AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSI
     if (!node->dot_dot_first_index)
     {
         log_error("Dot dot first index is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (!node->dot_dot_last_index)
     {
         log_error("Dot dot last index is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(visitor, node->dot_dot_expression_variable_name);
@@ -155,7 +210,7 @@ AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSI
     if (!variable_definition)
     {
         log_error("Variable definition for %s not found\n", node->dot_dot_expression_variable_name);
-        exit(1);
+        error_exit(1);
     }
 
     AST_T *dot_dot_first_index = visitor_visit(visitor, node->dot_dot_first_index);
@@ -175,7 +230,7 @@ AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSI
     else
     {
         log_error("Unsupported type for first index in dot dot notation\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (dot_dot_last_index->type == AST_INT)
@@ -189,7 +244,7 @@ AST_T *visitor_visit_dot_dot_expression(visitor_T *visitor, AST_DOT_DOT_EXPRESSI
     else
     {
         log_error("Unsupported type for last index in dot dot notation\n");
-        exit(1);
+        error_exit(1);
     }
 
     return visitor_visit_variable_with_dot_dot(visitor, variable, first_index, last_index);
@@ -1,21 +1,140 @@
 #include "../include/visitor/visitor_function.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include "../include/scope/scope.h"
+#include "../include/stats/stats.h"
 #include "../include/ast/AST.h"
 #include <stdio.h>
 #include <string.h>
 
+static AST_T *visitor_call_function(visitor_T *visitor, AST_FUNCTION_CALL_T *node);
+
+static AST_T *visitor_call_runtime_function(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *node, AST_FUNCTION_CALL_T *function_call);
+
 AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node)
+{
+    // Profiling, sampling and memory statistics cost this branch when they are off
+    if (!visitor->profile && !visitor->sample && !visitor->memstats)
+    {
+        return visitor_call_function(visitor, node);
+    }
+
+    if (visitor->profile)
+        profile_enter(visitor->profile, NULL, node->function_call_name);
+    if (visitor->sample)
+        sample_enter(visitor->sample, NULL, node->function_call_name);
+    if (visitor->memstats)
+        memstats_enter(visitor->memstats, NULL, node->function_call_name);
+    AST_T *result = visitor_call_function(visitor, node);
+    if (visitor->memstats)
+        memstats_exit(visitor->memstats);
+    if (visitor->sample)
+        sample_exit(visitor->sample);
+    if (visitor->profile)
+        profile_exit(visitor->profile);
+    return result;
+}
+
+AST_T *visitor_visit_runtime_function_call(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *node, AST_FUNCTION_CALL_T *function_call)
+{
+    if (!visitor->profile && !visitor->sample && !visitor->memstats)
+    {
+        return visitor_call_runtime_function(visitor, node, function_call);
+    }
+
+    if (visitor->profile)
+        profile_enter(visitor->profile, node->runtime_function_definition_name, function_call->function_call_name);
+    if (visitor->sample)
+        sample_enter(visitor->sample, node->runtime_function_definition_name, function_call->function_call_name);
+    if (visitor->memstats)
+        memstats_enter(visitor->memstats, node->runtime_function_definition_name, function_call->function_call_name);
+    AST_T *result = visitor_call_runtime_function(visitor, node, function_call);
+    if (visitor->memstats)
+        memstats_exit(visitor->memstats);
+    if (visitor->sample)
+        sample_exit(visitor->sample);
+    if (visitor->profile)
+        profile_exit(visitor->profile);
+    return result;
+}
+
+// Builtins added after the first ones, called only when the script defines no blunt of the same name
+static AST_T *visitor_call_builtin(visitor_T *visitor, AST_FUNCTION_CALL_T *node)
+{
+    if (strcmp(node->function_call_name, "sum") == 0)
+    {
+        return builtin_sum(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "min") == 0)
+    {
+        return builtin_min(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "max") == 0)
+    {
+        return builtin_max(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "count") == 0)
+    {
+        return builtin_count(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "reduce") == 0)
+    {
+        return builtin_reduce(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "fill") == 0)
+    {
+        return builtin_fill(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "scale") == 0)
+    {
+        return builtin_scale(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "add") == 0)
+    {
+        return builtin_add(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "readln") == 0)
+    {
+        return builtin_readln(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "eof") == 0)
+    {
+        return builtin_eof(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "loadcsv") == 0)
+    {
+        return builtin_loadcsv(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "mapfile") == 0)
+    {
+        return builtin_mapfile(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+    else if (strcmp(node->function_call_name, "sync") == 0)
+    {
+        return builtin_sync(visitor, node->function_call_arguments, node->function_call_arguments_size);
+    }
+
+    return NULL;
+}
+
+static AST_T *visitor_call_function(visitor_T *visitor, AST_FUNCTION_CALL_T *node)
 {
     if (!node->function_call_name)
     {
         log_error("Function call name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Visiting function call\n");
     LOG_PRINT("Function name: %s\n", node->function_call_name);
 
+    // Every call that is not one of a blunt or a method is one of a builtin
+    if (stats_active)
+    {
+        stats_active->calls++;
+    }
+
     if (strcmp(node->function_call_name, "print") == 0)
     {
         builtin_print(visitor, node->function_call_arguments, node->function_call_arguments_size);
@@ -23,7 +142,7 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
     }
     else if (strcmp(node->function_call_name, "exit") == 0)
     {
-        exit(0);
+        error_exit(0);
     }
     else if (strcmp(node->function_call_name, "println") == 0)
     {
@@ -39,26 +158,15 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
     }
     else
     {
-        AST_FUNCTION_DEFINITION_T *function_definition = NULL;
-        scope_stack_T *current_scope_stack = visitor->scope_stack;
-
-        while (current_scope_stack)
-        {
-            function_definition = scope_get_function_definition(current_scope_stack->scope, node->function_call_name);
-            if (function_definition)
-            {
-                LOG_PRINT("Function definition found in scope %p\n", current_scope_stack->scope);
-                break;
-            }
-            current_scope_stack = current_scope_stack->parent;
-        }
+        AST_FUNCTION_DEFINITION_T *function_definition = visitor_get_function_definition(visitor, node->function_call_name);
 
+        // A blunt of the script hides a builtin of the same name, so scripts written before it keep working
         if (!function_definition)
         {
-            function_definition = scope_get_function_definition(visitor->global_scope, node->function_call_name);
-            if (function_definition)
+            AST_T *result = visitor_call_builtin(visitor, node);
+            if (result)
             {
-                LOG_PRINT("Function definition found in global scope %p\n", visitor->global_scope);
+                return result;
             }
         }
 
@@ -67,7 +175,12 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
             if (!function_definition->function_definition_body)
             {
                 log_error("Function definition body is NULL\n");
-                exit(1);
+                error_exit(1);
+            }
+
+            if (stats_active)
+            {
+                stats_active->user_calls++;
             }
 
             // Make a copy for runtime function definition
@@ -79,15 +192,15 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
             visitor->current_function = runtime_function_definition;
 
             size_t arguments_size = function_definition->function_definition_arguments_size;
-            AST_VARIABLE_DEFINITION_T **arguments = calloc(arguments_size, sizeof(struct AST_VARIABLE_DEFINITION_T *));
+            AST_VARIABLE_DEFINITION_T **arguments = heap_calloc(arguments_size, sizeof(struct AST_VARIABLE_DEFINITION_T *));
 
             for (size_t i = 0; i < arguments_size; i++)
             {
-                AST_VARIABLE_DEFINITION_T *argument_copy = calloc(1, sizeof(struct AST_VARIABLE_DEFINITION_STRUCT));
+                AST_VARIABLE_DEFINITION_T *argument_copy = heap_calloc(1, sizeof(struct AST_VARIABLE_DEFINITION_STRUCT));
                 if (!argument_copy)
                 {
                     log_error("Failed to allocate memory for argument_copy\n");
-                    exit(1);
+                    error_exit(1);
                 }
 
                 AST_VARIABLE_T *original_argument = function_definition->function_definition_arguments[i];
@@ -97,12 +210,12 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
                     log_error("Not enough arguments provided for function '%s' expected argument '%s'\n",
                               node->function_call_name,
                               original_argument->variable_name);
-                    exit(1);
+                    error_exit(1);
                 }
 
                 LOG_PRINT("Passed argument type: %s\n", ast_type_to_string(node->function_call_arguments[i]->type));
 
-                argument_copy->variable_definition_variable_name = strdup(original_argument->variable_name);
+                argument_copy->variable_definition_variable_name = heap_strdup(original_argument->variable_name);
                 argument_copy->variable_definition_value = visitor_visit(visitor, node->function_call_arguments[i]);
                 argument_copy->variable_definition_variable_count = (AST_VARIABLE_COUNT_T *)init_ast(AST_VARIABLE_COUNT);
                 ((AST_VARIABLE_COUNT_T *)(argument_copy->variable_definition_variable_count))->variable_count_value = 1;
@@ -113,6 +226,11 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
                     int count = visitor_get_variable_count(visitor, (AST_VARIABLE_T *)node->function_call_arguments[i]);
                     ((AST_VARIABLE_COUNT_T *)(argument_copy->variable_definition_variable_count))->variable_count_value = count;
                 }
+                else if (argument_copy->variable_definition_value->type == AST_ARRAY)
+                {
+                    // An array passed by value counts as many elements as it holds
+                    ((AST_VARIABLE_COUNT_T *)(argument_copy->variable_definition_variable_count))->variable_count_value = ((AST_ARRAY_T *)argument_copy->variable_definition_value)->array_size;
+                }
 
                 arguments[i] = argument_copy;
 
@@ -122,6 +240,25 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
                           ((AST_VARIABLE_COUNT_T *)(argument_copy->variable_definition_variable_count))->variable_count_value);
             }
 
+            memo_key_T *memo_key = NULL;
+            if (visitor->memo && function_definition->function_definition_pure)
+            {
+                AST_T **argument_values = heap_calloc(arguments_size + 1, sizeof(struct AST_STRUCT *));
+                for (size_t i = 0; i < arguments_size; i++)
+                    argument_values[i] = arguments[i]->variable_definition_value;
+
+                memo_key = memo_make_key(visitor->memo, function_definition, argument_values, arguments_size);
+                heap_free(argument_values);
+
+                AST_T *memoized = memo_key ? memo_lookup(visitor->memo, memo_key) : NULL;
+                if (memoized)
+                {
+                    LOG_PRINT("Memoized result found for %s\n", function_definition->function_definition_name);
+                    memo_free_key(visitor->memo, memo_key);
+                    return memoized;
+                }
+            }
+
             visitor->scope_stack = push_scope_to_stack(visitor->scope_stack, init_scope());
 
             for (size_t i = 0; i < arguments_size; i++)
@@ -134,7 +271,7 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
 
                 // Add the argument to runtime function definition variables
                 runtime_function_definition->function_definition_variables_size++;
-                runtime_function_definition->function_definition_variables = realloc(
+                runtime_function_definition->function_definition_variables = heap_realloc(
                     runtime_function_definition->function_definition_variables,
                     sizeof(struct AST_VARIABLE_DEFINITION_STRUCT *) * runtime_function_definition->function_definition_variables_size);
                 runtime_function_definition->function_definition_variables[runtime_function_definition->function_definition_variables_size - 1] = arguments[i];
@@ -147,18 +284,52 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
 
             AST_T *function_body = visitor_visit(visitor, function_definition->function_definition_body);
 
+            // Smoking a call to the same blunt reuses the current frame instead of recursing
+            while (function_body->type == AST_RETURN &&
+                   ((AST_RETURN_T *)function_body)->return_tail_call &&
+                   visitor_get_function_definition(visitor, ((AST_FUNCTION_CALL_T *)((AST_RETURN_T *)function_body)->return_value)->function_call_name) == function_definition)
+            {
+                LOG_PRINT("Reusing frame for tail call to %s\n", function_definition->function_definition_name);
+                if (visitor->profile)
+                {
+                    profile_repeat(visitor->profile);
+                }
+                if (stats_active)
+                {
+                    stats_active->calls++;
+                    stats_active->user_calls++;
+                }
+                visitor_rebind_tail_call_arguments(visitor,
+                                                   runtime_function_definition,
+                                                   arguments,
+                                                   arguments_size,
+                                                   (AST_FUNCTION_CALL_T *)((AST_RETURN_T *)function_body)->return_value);
+                function_body = visitor_visit(visitor, function_definition->function_definition_body);
+            }
+
             if (function_body->type == AST_RETURN)
             {
                 LOG_PRINT("Visiting return value from function call\n");
                 AST_T *result = visitor_visit(visitor, ((AST_RETURN_T *)function_body)->return_value);
 
                 visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
+
+                if (memo_key)
+                {
+                    memo_insert(visitor->memo, memo_key, result);
+                }
                 return result;
             }
 
             visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
             visitor->current_function = NULL;
 
+            // Blunts that smoke nothing return themselves, which is never cached
+            if (memo_key)
+            {
+                memo_free_key(visitor->memo, memo_key);
+            }
+
             LOG_PRINT("Returning runtime function definition\n");
             ast_print(runtime_function_definition, 0);
 
@@ -167,10 +338,83 @@ AST_T *visitor_visit_function_call(visitor_T *visitor, AST_FUNCTION_CALL_T *node
     }
 
     log_error("Function '%s' not defined\n", node->function_call_name);
-    exit(1);
+    error_exit(1);
 }
 
-AST_T *visitor_visit_runtime_function_call(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *node, AST_FUNCTION_CALL_T *function_call)
+AST_FUNCTION_DEFINITION_T *visitor_get_function_definition(visitor_T *visitor, char *function_name)
+{
+    scope_stack_T *current_scope_stack = visitor->scope_stack;
+
+    while (current_scope_stack)
+    {
+        AST_FUNCTION_DEFINITION_T *function_definition = scope_get_function_definition(current_scope_stack->scope, function_name);
+        if (function_definition)
+        {
+            LOG_PRINT("Function definition found in scope %p\n", current_scope_stack->scope);
+            return function_definition;
+        }
+        current_scope_stack = current_scope_stack->parent;
+    }
+
+    AST_FUNCTION_DEFINITION_T *function_definition = scope_get_function_definition(visitor->global_scope, function_name);
+    if (function_definition)
+    {
+        LOG_PRINT("Function definition found in global scope %p\n", visitor->global_scope);
+    }
+
+    return function_definition;
+}
+
+void visitor_rebind_tail_call_arguments(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *runtime_function_definition, AST_VARIABLE_DEFINITION_T **arguments, size_t arguments_size, AST_FUNCTION_CALL_T *tail_call)
+{
+    AST_T **values = heap_calloc(arguments_size, sizeof(struct AST_STRUCT *));
+    int *counts = heap_calloc(arguments_size, sizeof(int));
+
+    // Every new argument is evaluated against the old bindings before any of them is replaced
+    for (size_t i = 0; i < arguments_size; i++)
+    {
+        if (i >= tail_call->function_call_arguments_size)
+        {
+            log_error("Not enough arguments provided for function '%s' expected argument '%s'\n",
+                      tail_call->function_call_name,
+                      arguments[i]->variable_definition_variable_name);
+            error_exit(1);
+        }
+
+        values[i] = visitor_visit(visitor, tail_call->function_call_arguments[i]);
+        counts[i] = 1;
+
+        if (tail_call->function_call_arguments[i]->type == AST_VARIABLE)
+        {
+            counts[i] = visitor_get_variable_count(visitor, (AST_VARIABLE_T *)tail_call->function_call_arguments[i]);
+        }
+        else if (values[i]->type == AST_ARRAY)
+        {
+            counts[i] = ((AST_ARRAY_T *)values[i])->array_size;
+        }
+    }
+
+    for (size_t i = 0; i < arguments_size; i++)
+    {
+        arguments[i]->variable_definition_value = values[i];
+        ((AST_VARIABLE_COUNT_T *)(arguments[i]->variable_definition_variable_count))->variable_count_value = counts[i];
+    }
+
+    heap_free(values);
+    heap_free(counts);
+
+    // Drop everything the previous iteration rolled, kept or defined, leaving only the arguments
+    // The arguments go back in their slots, since rolling one of them again replaced its definition
+    scope_T *frame = visitor->scope_stack->scope;
+    for (size_t i = 0; i < arguments_size; i++)
+        frame->variable_definitions[i] = arguments[i];
+    frame->variable_definitions_size = arguments_size;
+    frame->function_definitions_size = 0;
+    runtime_function_definition->function_definition_variables_size = arguments_size;
+    visitor->current_function = runtime_function_definition;
+}
+
+static AST_T *visitor_call_runtime_function(visitor_T *visitor, AST_RUNTIME_FUNCTION_DEFINITION_T *node, AST_FUNCTION_CALL_T *function_call)
 {
     LOG_PRINT("Visiting runtime function call\n");
 
@@ -211,7 +455,7 @@ AST_T *visitor_visit_runtime_function_call(visitor_T *visitor, AST_RUNTIME_FUNCT
     if (call_definition == NULL)
     {
         log_error("Function definition for %s not found\n", function_to_call_name);
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Function definition found\n");
@@ -229,7 +473,8 @@ AST_T *visitor_visit_runtime_function_call(visitor_T *visitor, AST_RUNTIME_FUNCT
         visitor_add_variable_definition(visitor, (AST_T *)variable_definition);
     }
 
-    AST_T *result = visitor_visit_function_call(visitor, function_call);
+    // The method already has its frame in the profile, the samples and the memory statistics
+    AST_T *result = visitor_call_function(visitor, function_call);
 
     // Pop scope stack
     visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
@@ -273,7 +518,7 @@ AST_T *visitor_visit_function_call_from_definition(visitor_T *visitor, AST_RUNTI
     if (call_definition == NULL)
     {
         log_error("Function definition for %s not found\n", function_to_call_name);
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Function definition found\n");
@@ -303,13 +548,13 @@ AST_T *visitor_visit_function_definition(visitor_T *visitor, AST_FUNCTION_DEFINI
     if (!node->function_definition_name)
     {
         log_error("Function definition name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (!node->function_definition_body)
     {
         log_error("Function definition body is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Visiting function definition\n");
@@ -323,7 +568,7 @@ AST_T *visitor_visit_function_definition(visitor_T *visitor, AST_FUNCTION_DEFINI
         if (!argument)
         {
             log_error("Function definition argument %lu is NULL\n", i);
-            exit(1);
+            error_exit(1);
         }
 
         LOG_PRINT("Function argument %lu [%s]\n", i, ast_type_to_string(argument->base.type));
@@ -331,7 +576,7 @@ AST_T *visitor_visit_function_definition(visitor_T *visitor, AST_FUNCTION_DEFINI
         if (!argument->variable_name)
         {
             log_error("Function definition argument name is NULL\n");
-            exit(1);
+            error_exit(1);
         }
 
         LOG_PRINT("Function argument %lu: %s\n", i, argument->variable_name);
@@ -0,0 +1,478 @@
+#include "../include/visitor/visitor_idiom.h"
+#include "../include/heap/heap.h"
+#include "../include/kernel/kernel.h"
+#include "../include/io/logger.h"
+#include "../include/ast/AST.h"
+#include <stdio.h>
+#include <string.h>
+
+// Number of elements evaluated at a time, small enough for the temporaries to live on the stack
+#define IDIOM_BLOCK 1024
+// Largest expression a loop body may hold, in nodes
+#define IDIOM_MAX_NODES 64
+
+typedef enum
+{
+    IDIOM_CONSTANT,
+    IDIOM_INDEX,
+    IDIOM_ELEMENT,
+    IDIOM_ADD,
+    IDIOM_SUB,
+    IDIOM_MUL,
+} idiom_kind_T;
+
+/**
+ * @brief Structure representing a compiled element expression of a loop body.
+ */
+typedef struct IDIOM_EXPRESSION_STRUCT
+{
+    idiom_kind_T kind;
+    // IDIOM_CONSTANT
+    int32_t value;
+    // IDIOM_ELEMENT: array.(iterator + offset)
+    AST_ARRAY_T *array;
+    long offset;
+    struct IDIOM_EXPRESSION_STRUCT *left;
+    struct IDIOM_EXPRESSION_STRUCT *right;
+} idiom_expression_T;
+
+/**
+ * @brief Structure representing a loop being compiled.
+ */
+typedef struct IDIOM_STRUCT
+{
+    visitor_T *visitor;
+    char *iterator_name;
+    // The only variable the body writes, which expressions must not read as a scalar
+    char *target_name;
+    // The array a map writes, NULL for accumulations
+    AST_ARRAY_T *target_array;
+    // The variable the condition compares the iterator to, NULL for an int
+    char *bound_name;
+    long start;
+    long end;
+    idiom_expression_T nodes[IDIOM_MAX_NODES];
+    size_t nodes_size;
+} idiom_T;
+
+static idiom_expression_T *idiom_new_node(idiom_T *idiom, idiom_kind_T kind)
+{
+    if (idiom->nodes_size == IDIOM_MAX_NODES)
+    {
+        return NULL;
+    }
+
+    idiom_expression_T *node = &idiom->nodes[idiom->nodes_size++];
+    memset(node, 0, sizeof(idiom_expression_T));
+    node->kind = kind;
+    return node;
+}
+
+static int idiom_is_iterator(idiom_T *idiom, AST_T *node)
+{
+    return node->type == AST_VARIABLE && strcmp(((AST_VARIABLE_T *)node)->variable_name, idiom->iterator_name) == 0;
+}
+
+// Matches iterator, iterator + k, k + iterator and iterator - k
+static int idiom_compile_index(idiom_T *idiom, AST_T *index, long *offset)
+{
+    if (index->type == AST_NESTED_EXPRESSION)
+    {
+        return idiom_compile_index(idiom, ((AST_NESTED_EXPRESSION_T *)index)->nested_expression, offset);
+    }
+
+    if (idiom_is_iterator(idiom, index))
+    {
+        *offset = 0;
+        return 1;
+    }
+
+    if (index->type == AST_ADD_OP)
+    {
+        AST_ADD_OP_T *add = (AST_ADD_OP_T *)index;
+        if (idiom_is_iterator(idiom, add->left) && add->right->type == AST_INT)
+        {
+            *offset = ((AST_INT_T *)add->right)->int_value;
+            return 1;
+        }
+        if (add->left->type == AST_INT && idiom_is_iterator(idiom, add->right))
+        {
+            *offset = ((AST_INT_T *)add->left)->int_value;
+            return 1;
+        }
+    }
+
+    if (index->type == AST_SUB_OP)
+    {
+        AST_SUB_OP_T *sub = (AST_SUB_OP_T *)index;
+        if (idiom_is_iterator(idiom, sub->left) && sub->right->type == AST_INT)
+        {
+            *offset = -(long)((AST_INT_T *)sub->right)->int_value;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Returns the array behind a variable as packed ints, or NULL if it is not an int array
+static AST_ARRAY_T *idiom_resolve_array(idiom_T *idiom, char *variable_name)
+{
+    AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(idiom->visitor, variable_name);
+    if (!variable_definition)
+    {
+        return NULL;
+    }
+
+    AST_T *value = variable_definition->variable_definition_value;
+    if (value->type != AST_ARRAY)
+    {
+        // A 'roll N x with <int>' variable that was never written is an array of N equal ints
+        size_t count = ((AST_VARIABLE_COUNT_T *)variable_definition->variable_definition_variable_count)->variable_count_value;
+        if (value->type != AST_INT || count < 2)
+        {
+            return NULL;
+        }
+        value = (AST_T *)init_ast_array_filled(count, value);
+        variable_definition->variable_definition_value = value;
+    }
+
+    AST_ARRAY_T *array = (AST_ARRAY_T *)value;
+
+    // Expanding a sparse array only pays off when the loop touches most of it
+    if (array->array_runs && (size_t)(idiom->end - idiom->start) * 2 < array->array_size)
+    {
+        return NULL;
+    }
+
+    return ast_array_ints(array, 0) ? array : NULL;
+}
+
+static int idiom_in_bounds(idiom_T *idiom, AST_ARRAY_T *array, long offset)
+{
+    return idiom->start + offset >= 0 && idiom->end - 1 + offset < (long)array->array_size;
+}
+
+static idiom_expression_T *idiom_compile(idiom_T *idiom, AST_T *node)
+{
+    switch (node->type)
+    {
+    case AST_INT:
+    {
+        idiom_expression_T *constant = idiom_new_node(idiom, IDIOM_CONSTANT);
+        if (constant)
+            constant->value = ((AST_INT_T *)node)->int_value;
+        return constant;
+    }
+    case AST_NESTED_EXPRESSION:
+        return idiom_compile(idiom, ((AST_NESTED_EXPRESSION_T *)node)->nested_expression);
+    case AST_VARIABLE:
+    {
+        char *variable_name = ((AST_VARIABLE_T *)node)->variable_name;
+        if (strcmp(variable_name, idiom->iterator_name) == 0)
+        {
+            return idiom_new_node(idiom, IDIOM_INDEX);
+        }
+
+        // Any other int is loop invariant, as long as the body does not write it
+        if (strcmp(variable_name, idiom->target_name) == 0)
+        {
+            return NULL;
+        }
+        AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(idiom->visitor, variable_name);
+        if (!variable_definition || variable_definition->variable_definition_value->type != AST_INT)
+        {
+            return NULL;
+        }
+        idiom_expression_T *constant = idiom_new_node(idiom, IDIOM_CONSTANT);
+        if (constant)
+            constant->value = ((AST_INT_T *)variable_definition->variable_definition_value)->int_value;
+        return constant;
+    }
+    case AST_DOT_EXPRESSION:
+    {
+        AST_DOT_EXPRESSION_T *dot_expression = (AST_DOT_EXPRESSION_T *)node;
+        AST_ARRAY_T *array = idiom_resolve_array(idiom, dot_expression->dot_expression_variable_name);
+        if (!array)
+        {
+            return NULL;
+        }
+
+        if (dot_expression->dot_index->type == AST_INT)
+        {
+            // A fixed element of an array the loop does not write is a constant
+            long index = ((AST_INT_T *)dot_expression->dot_index)->int_value;
+            if (array == idiom->target_array || index < 0 || index >= (long)array->array_size)
+            {
+                return NULL;
+            }
+            idiom_expression_T *constant = idiom_new_node(idiom, IDIOM_CONSTANT);
+            if (constant)
+                constant->value = array->array_ints[index];
+            return constant;
+        }
+
+        long offset = 0;
+        if (!idiom_compile_index(idiom, dot_expression->dot_index, &offset) || !idiom_in_bounds(idiom, array, offset))
+        {
+            return NULL;
+        }
+
+        // Elements behind the iterator have already been written by earlier iterations
+        if (array == idiom->target_array && offset < 0)
+        {
+            return NULL;
+        }
+
+        idiom_expression_T *element = idiom_new_node(idiom, IDIOM_ELEMENT);
+        if (element)
+        {
+            element->array = array;
+            element->offset = offset;
+        }
+        return element;
+    }
+    case AST_ADD_OP:
+    case AST_SUB_OP:
+    case AST_MUL_OP:
+    {
+        // The three operators share their layout
+        AST_ADD_OP_T *operation = (AST_ADD_OP_T *)node;
+        idiom_kind_T kind = node->type == AST_ADD_OP ? IDIOM_ADD : node->type == AST_SUB_OP ? IDIOM_SUB
+                                                                                             : IDIOM_MUL;
+        idiom_expression_T *expression = idiom_new_node(idiom, kind);
+        if (!expression)
+        {
+            return NULL;
+        }
+        expression->left = idiom_compile(idiom, operation->left);
+        expression->right = expression->left ? idiom_compile(idiom, operation->right) : NULL;
+        return expression->right ? expression : NULL;
+    }
+    default:
+        return NULL;
+    }
+}
+
+static void idiom_evaluate(const kernel_T *kernel, idiom_expression_T *expression, long base, size_t size, int32_t *out)
+{
+    switch (expression->kind)
+    {
+    case IDIOM_CONSTANT:
+        kernel->fill(out, size, expression->value);
+        return;
+    case IDIOM_INDEX:
+        for (size_t i = 0; i < size; i++)
+            out[i] = (int32_t)(base + i);
+        return;
+    case IDIOM_ELEMENT:
+        memcpy(out, expression->array->array_ints + base + expression->offset, size * sizeof(int32_t));
+        return;
+    default:
+        break;
+    }
+
+    idiom_evaluate(kernel, expression->left, base, size, out);
+
+    if (expression->kind == IDIOM_MUL && expression->right->kind == IDIOM_CONSTANT)
+    {
+        kernel->scale(out, size, expression->right->value);
+        return;
+    }
+
+    int32_t right[IDIOM_BLOCK];
+    idiom_evaluate(kernel, expression->right, base, size, right);
+    switch (expression->kind)
+    {
+    case IDIOM_ADD:
+        kernel->add(out, right, size);
+        break;
+    case IDIOM_SUB:
+        kernel->sub(out, right, size);
+        break;
+    default:
+        kernel->mul(out, right, size);
+        break;
+    }
+}
+
+// Reads the end of the iteration from 'iterator < n' or 'iterator <= n'
+static int idiom_compile_condition(idiom_T *idiom, AST_T *condition)
+{
+    if (condition->type != AST_LT_OP && condition->type != AST_LTE_OP)
+    {
+        return 0;
+    }
+
+    // Both comparisons share their layout
+    AST_LT_OP_T *comparison = (AST_LT_OP_T *)condition;
+    if (!idiom_is_iterator(idiom, comparison->left))
+    {
+        return 0;
+    }
+
+    long end = 0;
+    if (comparison->right->type == AST_INT)
+    {
+        end = ((AST_INT_T *)comparison->right)->int_value;
+    }
+    else if (comparison->right->type == AST_VARIABLE && !idiom_is_iterator(idiom, comparison->right))
+    {
+        AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(idiom->visitor, ((AST_VARIABLE_T *)comparison->right)->variable_name);
+        if (!variable_definition || variable_definition->variable_definition_value->type != AST_INT)
+        {
+            return 0;
+        }
+        end = ((AST_INT_T *)variable_definition->variable_definition_value)->int_value;
+        idiom->bound_name = ((AST_VARIABLE_T *)comparison->right)->variable_name;
+    }
+    else
+    {
+        return 0;
+    }
+
+    idiom->end = condition->type == AST_LTE_OP ? end + 1 : end;
+    return 1;
+}
+
+// The end is read once, so a body writing the variable it comes from must run the slow way
+static int idiom_writes_bound(idiom_T *idiom)
+{
+    return idiom->bound_name && strcmp(idiom->bound_name, idiom->target_name) == 0;
+}
+
+static int idiom_run_map(idiom_T *idiom, AST_DOT_EXPRESSION_T *statement)
+{
+    AST_VARIABLE_ASSIGNMENT_T *assignment = (AST_VARIABLE_ASSIGNMENT_T *)statement->dot_index;
+    if (strcmp(assignment->variable_assignment_name, idiom->iterator_name) != 0)
+    {
+        return 0;
+    }
+
+    idiom->target_name = statement->dot_expression_variable_name;
+    if (idiom_writes_bound(idiom))
+    {
+        return 0;
+    }
+
+    idiom->target_array = idiom_resolve_array(idiom, idiom->target_name);
+    if (!idiom->target_array || !idiom_in_bounds(idiom, idiom->target_array, 0))
+    {
+        return 0;
+    }
+
+    idiom_expression_T *expression = idiom_compile(idiom, assignment->variable_assignment_value);
+    if (!expression)
+    {
+        return 0;
+    }
+
+    LOG_PRINT("Running light loop over %s as a map from %ld to %ld\n", idiom->target_name, idiom->start, idiom->end);
+
+    const kernel_T *kernel = kernel_get();
+    int32_t *ints = ast_array_ints(idiom->target_array, 1);
+    int32_t block[IDIOM_BLOCK];
+    for (long base = idiom->start; base < idiom->end; base += IDIOM_BLOCK)
+    {
+        size_t size = idiom->end - base < IDIOM_BLOCK ? idiom->end - base : IDIOM_BLOCK;
+        // The whole block is read before it is written, so reads ahead of the iterator see old values
+        idiom_evaluate(kernel, expression, base, size, block);
+        memcpy(ints + base, block, size * sizeof(int32_t));
+    }
+
+    return 1;
+}
+
+static int idiom_run_accumulate(idiom_T *idiom, AST_VARIABLE_ASSIGNMENT_T *statement)
+{
+    idiom->target_name = statement->variable_assignment_name;
+    if (strcmp(idiom->target_name, idiom->iterator_name) == 0 || idiom_writes_bound(idiom) ||
+        statement->variable_assignment_value->type != AST_ADD_OP)
+    {
+        return 0;
+    }
+
+    AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(idiom->visitor, idiom->target_name);
+    if (!variable_definition || variable_definition->variable_definition_value->type != AST_INT)
+    {
+        return 0;
+    }
+
+    // Accept both 'total = total + e' and 'total = e + total'
+    AST_ADD_OP_T *add = (AST_ADD_OP_T *)statement->variable_assignment_value;
+    AST_T *term = NULL;
+    if (add->left->type == AST_VARIABLE && strcmp(((AST_VARIABLE_T *)add->left)->variable_name, idiom->target_name) == 0)
+    {
+        term = add->right;
+    }
+    else if (add->right->type == AST_VARIABLE && strcmp(((AST_VARIABLE_T *)add->right)->variable_name, idiom->target_name) == 0)
+    {
+        term = add->left;
+    }
+    if (!term)
+    {
+        return 0;
+    }
+
+    idiom_expression_T *expression = idiom_compile(idiom, term);
+    if (!expression)
+    {
+        return 0;
+    }
+
+    LOG_PRINT("Running light loop into %s as an accumulation from %ld to %ld\n", idiom->target_name, idiom->start, idiom->end);
+
+    const kernel_T *kernel = kernel_get();
+    uint32_t total = (uint32_t)((AST_INT_T *)variable_definition->variable_definition_value)->int_value;
+    int32_t block[IDIOM_BLOCK];
+    for (long base = idiom->start; base < idiom->end; base += IDIOM_BLOCK)
+    {
+        size_t size = idiom->end - base < IDIOM_BLOCK ? idiom->end - base : IDIOM_BLOCK;
+        idiom_evaluate(kernel, expression, base, size, block);
+        total += (uint32_t)kernel->sum(block, size);
+    }
+
+    AST_INT_T *result = (AST_INT_T *)init_ast(AST_INT);
+    result->int_value = (int32_t)total;
+    variable_definition->variable_definition_value = (AST_T *)result;
+
+    return 1;
+}
+
+int visitor_run_loop_idiom(visitor_T *visitor, AST_FOR_LOOP_T *node, AST_T *condition, AST_VARIABLE_DEFINITION_T *increment_variable_definition)
+{
+    if (node->for_loop_body->type != AST_COMPOUND || ((AST_COMPOUND_T *)node->for_loop_body)->compound_size != 1)
+    {
+        return 0;
+    }
+
+    idiom_T *idiom = heap_calloc(1, sizeof(struct IDIOM_STRUCT));
+    idiom->visitor = visitor;
+    idiom->iterator_name = ((AST_VARIABLE_T *)node->for_loop_increment)->variable_name;
+    idiom->target_name = "";
+    idiom->start = ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value;
+
+    int ran = 0;
+    if (idiom_compile_condition(idiom, condition) && idiom->start < idiom->end)
+    {
+        AST_T *statement = ((AST_COMPOUND_T *)node->for_loop_body)->compound_value[0];
+        if (statement->type == AST_DOT_EXPRESSION &&
+            ((AST_DOT_EXPRESSION_T *)statement)->dot_index->type == AST_VARIABLE_ASSIGNMENT)
+        {
+            ran = idiom_run_map(idiom, (AST_DOT_EXPRESSION_T *)statement);
+        }
+        else if (statement->type == AST_VARIABLE_ASSIGNMENT)
+        {
+            ran = idiom_run_accumulate(idiom, (AST_VARIABLE_ASSIGNMENT_T *)statement);
+        }
+    }
+
+    if (ran)
+    {
+        // Leave the iterator where the interpreted loop would have left it
+        ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value = idiom->end;
+    }
+
+    heap_free(idiom);
+    return ran;
+}
@@ -0,0 +1,566 @@
+#include "../include/visitor/visitor_parallel.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
+#include "../include/pool/pool.h"
+#include "../include/io/logger.h"
+#include "../include/scope/scope.h"
+#include "../include/ast/AST.h"
+#include <stdio.h>
+#include <string.h>
+
+// Chunks handed out per thread, so that stealing can even out bodies of uneven cost
+#define PARALLEL_CHUNKS_PER_THREAD 8
+
+typedef struct PARALLEL_WORKER_STRUCT
+{
+    visitor_T *visitor;
+    AST_VARIABLE_DEFINITION_T *iterator_definition;
+    // Errors of the worker stop it and are raised again on the calling thread after the loop
+    error_trap_T trap;
+    int failed;
+} parallel_worker_T;
+
+typedef struct PARALLEL_STRUCT
+{
+    visitor_T *visitor;
+    AST_FOR_LOOP_T *node;
+    AST_T *condition;
+    char *array_name;
+    char *iterator_name;
+
+    // Names rolled by the body that are visible at the node being checked
+    char **local_names;
+    size_t local_names_size;
+    size_t local_names_capacity;
+
+    parallel_worker_T *workers;
+} parallel_T;
+
+static void parallel_reject(parallel_T *parallel, const char *reason, const char *name)
+{
+    char message[256];
+    snprintf(message, sizeof(message), reason, name);
+    log_error("Cannot run light parallel %s: %s\n", parallel->array_name, message);
+    error_exit(1);
+}
+
+static int parallel_is_local_name(parallel_T *parallel, const char *name)
+{
+    if (strcmp(name, parallel->iterator_name) == 0)
+    {
+        return 1;
+    }
+
+    for (size_t i = 0; i < parallel->local_names_size; i++)
+    {
+        if (strcmp(parallel->local_names[i], name) == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void parallel_add_local_name(parallel_T *parallel, char *name)
+{
+    if (parallel->local_names_size == parallel->local_names_capacity)
+    {
+        parallel->local_names_capacity = parallel->local_names_capacity ? parallel->local_names_capacity * 2 : 8;
+        parallel->local_names = heap_realloc(parallel->local_names, parallel->local_names_capacity * sizeof(char *));
+    }
+    parallel->local_names[parallel->local_names_size++] = name;
+}
+
+// Performs up front the writes that reading a variable from outside the body may do lazily:
+// flattening and hashing strings, and packing arrays handed to the numeric builtins
+static void parallel_freeze(parallel_T *parallel, char *name, int builtin_argument)
+{
+    AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(parallel->visitor, name);
+    if (!variable_definition)
+    {
+        return;
+    }
+
+    AST_T *value = variable_definition->variable_definition_value;
+    size_t count = ((AST_VARIABLE_COUNT_T *)variable_definition->variable_definition_variable_count)->variable_count_value;
+    if (builtin_argument && value->type != AST_ARRAY && count > 1)
+    {
+        value = (AST_T *)init_ast_array_filled(count, value);
+        variable_definition->variable_definition_value = value;
+    }
+
+    if (value->type == AST_STRING)
+    {
+        ast_string_hash((AST_STRING_T *)value);
+        return;
+    }
+
+    if (value->type != AST_ARRAY)
+    {
+        return;
+    }
+
+    AST_ARRAY_T *array = (AST_ARRAY_T *)value;
+    if (builtin_argument)
+    {
+        ast_array_ints(array, 0);
+    }
+
+    if (array->array_value)
+    {
+        for (size_t i = 0; i < array->array_size; i++)
+        {
+            if (array->array_value[i]->type == AST_STRING)
+            {
+                ast_string_hash((AST_STRING_T *)array->array_value[i]);
+            }
+        }
+    }
+    for (size_t run = 0; run < array->array_runs_size; run++)
+    {
+        if (array->array_runs[run].run_value->type == AST_STRING)
+        {
+            ast_string_hash((AST_STRING_T *)array->array_runs[run].run_value);
+        }
+    }
+}
+
+static void parallel_check(parallel_T *parallel, AST_T *node);
+
+// Checks a node whose definitions are only visible inside it, like the body of an if
+static void parallel_check_nested(parallel_T *parallel, AST_T *node)
+{
+    size_t local_names_size = parallel->local_names_size;
+    parallel_check(parallel, node);
+    parallel->local_names_size = local_names_size;
+}
+
+static void parallel_check_variable(parallel_T *parallel, char *name, int builtin_argument)
+{
+    if (strcmp(name, parallel->array_name) == 0)
+    {
+        parallel_reject(parallel, "%s can only be used as an element at the iterator or in len", name);
+    }
+
+    if (!parallel_is_local_name(parallel, name))
+    {
+        parallel_freeze(parallel, name, builtin_argument);
+    }
+}
+
+static void parallel_check_function_call(parallel_T *parallel, AST_FUNCTION_CALL_T *function_call)
+{
+    char *name = function_call->function_call_name;
+    int builtin = strcmp(name, "sum") == 0 || strcmp(name, "min") == 0 || strcmp(name, "max") == 0 || strcmp(name, "count") == 0;
+    if ((!builtin && strcmp(name, "len") != 0) || (builtin && visitor_get_function_definition(parallel->visitor, name)))
+    {
+        parallel_reject(parallel, "the body calls %s, only len, sum, min, max and count can be called", name);
+    }
+
+    for (size_t i = 0; i < function_call->function_call_arguments_size; i++)
+    {
+        AST_T *argument = function_call->function_call_arguments[i];
+        if (argument->type != AST_VARIABLE)
+        {
+            parallel_check(parallel, argument);
+            continue;
+        }
+
+        // The length of the iterated array does not change while the loop runs
+        char *argument_name = ((AST_VARIABLE_T *)argument)->variable_name;
+        if (!builtin && strcmp(argument_name, parallel->array_name) == 0)
+        {
+            continue;
+        }
+        parallel_check_variable(parallel, argument_name, builtin);
+    }
+}
+
+static void parallel_check_dot_expression(parallel_T *parallel, AST_DOT_EXPRESSION_T *dot_expression)
+{
+    char *name = dot_expression->dot_expression_variable_name;
+    AST_T *index = dot_expression->dot_index;
+
+    if (index->type == AST_FUNCTION_CALL)
+    {
+        parallel_reject(parallel, "the body calls a method of %s", name);
+    }
+
+    int iterated_array = strcmp(name, parallel->array_name) == 0;
+
+    // 'x.i = value' is parsed as the dot expression 'x' with the assignment 'i = value' as index
+    if (index->type == AST_VARIABLE_ASSIGNMENT)
+    {
+        AST_VARIABLE_ASSIGNMENT_T *assignment = (AST_VARIABLE_ASSIGNMENT_T *)index;
+        if (iterated_array && strcmp(assignment->variable_assignment_name, parallel->iterator_name) != 0)
+        {
+            parallel_reject(parallel, "%s can only be written at the iterator", name);
+        }
+        if (!iterated_array && !parallel_is_local_name(parallel, name))
+        {
+            parallel_reject(parallel, "the body writes %s, which is defined outside of it", name);
+        }
+        if (!parallel_is_local_name(parallel, assignment->variable_assignment_name))
+        {
+            parallel_freeze(parallel, assignment->variable_assignment_name, 0);
+        }
+        parallel_check(parallel, assignment->variable_assignment_value);
+        return;
+    }
+
+    if (iterated_array)
+    {
+        // Any other element may be written by another worker at the same time
+        if (index->type != AST_VARIABLE || strcmp(((AST_VARIABLE_T *)index)->variable_name, parallel->iterator_name) != 0)
+        {
+            parallel_reject(parallel, "%s can only be read at the iterator", name);
+        }
+        return;
+    }
+
+    if (!parallel_is_local_name(parallel, name))
+    {
+        parallel_freeze(parallel, name, 0);
+    }
+    parallel_check(parallel, index);
+}
+
+static void parallel_check_for_loop(parallel_T *parallel, AST_FOR_LOOP_T *for_loop)
+{
+    if (for_loop->for_loop_lines)
+    {
+        parallel_reject(parallel, "a nested loop reads the lines of a file into %s", ((AST_VARIABLE_T *)for_loop->for_loop_variable)->variable_name);
+    }
+
+    char *iterator_name = ((AST_VARIABLE_T *)for_loop->for_loop_increment)->variable_name;
+    if (strcmp(iterator_name, parallel->iterator_name) == 0)
+    {
+        parallel_reject(parallel, "a nested loop reuses the iterator %s", iterator_name);
+    }
+    if (!parallel_is_local_name(parallel, iterator_name) && visitor_get_variable_definition(parallel->visitor, iterator_name))
+    {
+        parallel_reject(parallel, "a nested loop writes %s, which is defined outside of the body", iterator_name);
+    }
+
+    parallel_check_variable(parallel, ((AST_VARIABLE_T *)for_loop->for_loop_variable)->variable_name, 0);
+
+    size_t local_names_size = parallel->local_names_size;
+    parallel_add_local_name(parallel, iterator_name);
+    parallel_check(parallel, for_loop->for_loop_condition);
+    parallel_check(parallel, for_loop->for_loop_body);
+    parallel->local_names_size = local_names_size;
+}
+
+static void parallel_check(parallel_T *parallel, AST_T *node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    switch (node->type)
+    {
+    case AST_NOOP:
+    case AST_INT:
+    case AST_STRING:
+    case AST_VARIABLE_COUNT:
+    case AST_DOT_DOT:
+        return;
+    case AST_VARIABLE:
+        parallel_check_variable(parallel, ((AST_VARIABLE_T *)node)->variable_name, 0);
+        return;
+    case AST_ARRAY:
+        for (size_t i = 0; i < ((AST_ARRAY_T *)node)->array_size; i++)
+            parallel_check(parallel, ((AST_ARRAY_T *)node)->array_value[i]);
+        return;
+    case AST_COMPOUND:
+        for (size_t i = 0; i < ((AST_COMPOUND_T *)node)->compound_size; i++)
+            parallel_check(parallel, ((AST_COMPOUND_T *)node)->compound_value[i]);
+        return;
+    case AST_ADD_OP:
+    case AST_SUB_OP:
+    case AST_MUL_OP:
+    case AST_DIV_OP:
+    case AST_GT_OP:
+    case AST_LT_OP:
+    case AST_GTE_OP:
+    case AST_LTE_OP:
+    case AST_AND_OP:
+    case AST_OR_OP:
+    case AST_EQUAL_OP:
+        parallel_check(parallel, ((AST_ADD_OP_T *)node)->left);
+        parallel_check(parallel, ((AST_ADD_OP_T *)node)->right);
+        return;
+    case AST_NOT:
+        parallel_check(parallel, ((AST_NOT_T *)node)->not_expression);
+        return;
+    case AST_NESTED_EXPRESSION:
+        parallel_check(parallel, ((AST_NESTED_EXPRESSION_T *)node)->nested_expression);
+        return;
+    case AST_IF_ELSE_BRANCH:
+        for (size_t i = 0; i < ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_size; i++)
+            parallel_check(parallel, ((AST_IF_ELSE_BRANCH_T *)node)->if_else_compound_value[i]);
+        return;
+    case AST_IF:
+        parallel_check(parallel, ((AST_IF_T *)node)->if_condition);
+        parallel_check_nested(parallel, ((AST_IF_T *)node)->if_body);
+        return;
+    case AST_ELSEIF:
+        parallel_check(parallel, ((AST_ELSEIF_T *)node)->elseif_condition);
+        parallel_check_nested(parallel, ((AST_ELSEIF_T *)node)->elseif_body);
+        return;
+    case AST_ELSE:
+        parallel_check_nested(parallel, ((AST_ELSE_T *)node)->else_body);
+        return;
+    case AST_VARIABLE_DEFINITION:
+    {
+        AST_VARIABLE_DEFINITION_T *variable_definition = (AST_VARIABLE_DEFINITION_T *)node;
+        char *name = variable_definition->variable_definition_variable_name;
+        if (strcmp(name, parallel->iterator_name) == 0 || strcmp(name, parallel->array_name) == 0)
+        {
+            parallel_reject(parallel, "the body rolls %s again", name);
+        }
+        parallel_check(parallel, variable_definition->variable_definition_value);
+        parallel_add_local_name(parallel, name);
+        return;
+    }
+    case AST_VARIABLE_ASSIGNMENT:
+    {
+        AST_VARIABLE_ASSIGNMENT_T *assignment = (AST_VARIABLE_ASSIGNMENT_T *)node;
+        char *name = assignment->variable_assignment_name;
+        if (strcmp(name, parallel->iterator_name) == 0)
+        {
+            parallel_reject(parallel, "the body writes the iterator %s", name);
+        }
+        if (!parallel_is_local_name(parallel, name))
+        {
+            parallel_reject(parallel, "the body writes %s, which is defined outside of it", name);
+        }
+        parallel_check(parallel, assignment->variable_assignment_value);
+        return;
+    }
+    case AST_FUNCTION_CALL:
+        parallel_check_function_call(parallel, (AST_FUNCTION_CALL_T *)node);
+        return;
+    case AST_DOT_EXPRESSION:
+        parallel_check_dot_expression(parallel, (AST_DOT_EXPRESSION_T *)node);
+        return;
+    case AST_DOT_DOT_EXPRESSION:
+    {
+        // Slicing marks the sliced array as shared, which is a write
+        AST_DOT_DOT_EXPRESSION_T *dot_dot_expression = (AST_DOT_DOT_EXPRESSION_T *)node;
+        if (!parallel_is_local_name(parallel, dot_dot_expression->dot_dot_expression_variable_name))
+        {
+            parallel_reject(parallel, "the body slices %s, which is defined outside of it", dot_dot_expression->dot_dot_expression_variable_name);
+        }
+        parallel_check(parallel, dot_dot_expression->dot_dot_first_index);
+        parallel_check(parallel, dot_dot_expression->dot_dot_last_index);
+        return;
+    }
+    case AST_FOR_LOOP:
+        parallel_check_for_loop(parallel, (AST_FOR_LOOP_T *)node);
+        return;
+    default:
+        parallel_reject(parallel, "the body contains a %s", ast_type_to_string(node->type));
+    }
+}
+
+// Reads the end of the range from a condition of the form 'i < n' or 'i <= n'
+static size_t parallel_range_end(parallel_T *parallel)
+{
+    AST_T *condition = parallel->condition;
+    AST_LT_OP_T *comparison = (AST_LT_OP_T *)condition;
+    if ((condition->type != AST_LT_OP && condition->type != AST_LTE_OP) ||
+        comparison->left->type != AST_VARIABLE ||
+        strcmp(((AST_VARIABLE_T *)comparison->left)->variable_name, parallel->iterator_name) != 0)
+    {
+        parallel_reject(parallel, "the condition must compare %s with < or <=", parallel->iterator_name);
+    }
+
+    // The bound is evaluated once, so it may only read what the body cannot write
+    parallel_check(parallel, comparison->right);
+    int end = visitor_get_node_value(parallel->visitor, comparison->right);
+    if (condition->type == AST_LTE_OP)
+    {
+        end++;
+    }
+
+    return end > 0 ? end : 0;
+}
+
+// Makes the iterated array safe to write one element per worker
+static AST_ARRAY_T *parallel_prepare_array(parallel_T *parallel)
+{
+    AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(parallel->visitor, parallel->array_name);
+    AST_T *value = variable_definition->variable_definition_value;
+    size_t count = ((AST_VARIABLE_COUNT_T *)variable_definition->variable_definition_variable_count)->variable_count_value;
+
+    if (value->type != AST_ARRAY)
+    {
+        if (count < 2)
+        {
+            parallel_reject(parallel, "%s is not an array", parallel->array_name);
+        }
+        value = (AST_T *)init_ast_array_filled(count, value);
+        variable_definition->variable_definition_value = value;
+    }
+
+    // Packed and run-length arrays change representation on some writes, boxed elements never do
+    AST_ARRAY_T *array = (AST_ARRAY_T *)value;
+    ast_array_make_private(array);
+    return array;
+}
+
+pool_T *visitor_get_pool(visitor_T *visitor)
+{
+    if (!visitor->pool)
+    {
+        heap_T *previous_heap = heap_use(visitor->heap);
+        visitor->pool = init_pool(0);
+        heap_use(previous_heap);
+    }
+
+    return visitor->pool;
+}
+
+visitor_T *init_parallel_worker(visitor_T *visitor)
+{
+    visitor_T *worker = init_visitor();
+    heap_free(worker->global_scope);
+    free_scope_stack(worker->scope_stack);
+    worker->global_scope = visitor->global_scope;
+    worker->current_function = visitor->current_function;
+    worker->parallel_worker = 1;
+    worker->scope_stack = push_scope_to_stack(visitor->scope_stack, init_scope());
+
+    return worker;
+}
+
+void free_parallel_worker(visitor_T *worker)
+{
+    scope_T *frame = worker->scope_stack->scope;
+    pop_scope_from_stack(worker->scope_stack);
+    heap_free(frame->variable_definitions);
+    heap_free(frame->function_definitions);
+    heap_free(frame);
+    heap_free(worker);
+}
+
+static parallel_worker_T *parallel_start_worker(parallel_T *parallel, size_t worker)
+{
+    parallel_worker_T *parallel_worker = &parallel->workers[worker];
+    if (parallel_worker->visitor)
+    {
+        return parallel_worker;
+    }
+
+    // The worker's frame sits on top of the loop's scopes and shadows the shared iterator with its own
+    visitor_T *visitor = init_parallel_worker(parallel->visitor);
+    AST_VARIABLE_DEFINITION_T *iterator_definition = (AST_VARIABLE_DEFINITION_T *)init_ast(AST_VARIABLE_DEFINITION);
+    iterator_definition->variable_definition_variable_name = parallel->iterator_name;
+    iterator_definition->variable_definition_value = init_ast(AST_INT);
+    iterator_definition->variable_definition_variable_count = (struct AST_VARIABLE_COUNT *)init_ast(AST_VARIABLE_COUNT);
+    ((AST_VARIABLE_COUNT_T *)iterator_definition->variable_definition_variable_count)->variable_count_value = 1;
+    visitor_add_variable_definition(visitor, (AST_T *)iterator_definition);
+
+    parallel_worker->visitor = visitor;
+    parallel_worker->iterator_definition = iterator_definition;
+
+    return parallel_worker;
+}
+
+static void parallel_run_chunk(void *context, size_t worker, size_t begin, size_t end)
+{
+    parallel_T *parallel = context;
+    if (parallel->workers[worker].failed)
+    {
+        return;
+    }
+
+    error_trap_set(&parallel->workers[worker].trap);
+    if (setjmp(parallel->workers[worker].trap.jump) != 0)
+    {
+        parallel->workers[worker].failed = 1;
+        error_trap_clear(&parallel->workers[worker].trap);
+        return;
+    }
+
+    parallel_worker_T *parallel_worker = parallel_start_worker(parallel, worker);
+    visitor_T *visitor = parallel_worker->visitor;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        // A fresh int per iteration, since the body may store the iterator in the array
+        AST_INT_T *iterator = (AST_INT_T *)init_ast(AST_INT);
+        iterator->int_value = i;
+        parallel_worker->iterator_definition->variable_definition_value = (AST_T *)iterator;
+
+        // The tree is never written while running, so every worker visits the same body
+        visitor->scope_stack = push_scope_to_stack(visitor->scope_stack, init_scope());
+        visitor_visit(visitor, parallel->node->for_loop_body);
+        scope_T *scope = visitor->scope_stack->scope;
+        visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
+        heap_free(scope->variable_definitions);
+        heap_free(scope->function_definitions);
+        heap_free(scope);
+    }
+
+    error_trap_clear(&parallel_worker->trap);
+}
+
+void visitor_run_parallel_loop(visitor_T *visitor, AST_FOR_LOOP_T *node, AST_T *condition, AST_VARIABLE_DEFINITION_T *increment_variable_definition)
+{
+    parallel_T *parallel = heap_calloc(1, sizeof(struct PARALLEL_STRUCT));
+    parallel->visitor = visitor;
+    parallel->node = node;
+    parallel->condition = condition;
+    parallel->array_name = ((AST_VARIABLE_T *)node->for_loop_variable)->variable_name;
+    parallel->iterator_name = ((AST_VARIABLE_T *)node->for_loop_increment)->variable_name;
+
+    int start = ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value;
+    if (start < 0)
+    {
+        parallel_reject(parallel, "%s starts below 0", parallel->iterator_name);
+    }
+    size_t begin = start;
+    size_t end = parallel_range_end(parallel);
+    parallel_check(parallel, node->for_loop_body);
+    AST_ARRAY_T *array = parallel_prepare_array(parallel);
+
+    size_t threads_size = visitor_get_pool(visitor)->threads_size;
+    parallel->workers = heap_calloc(threads_size, sizeof(struct PARALLEL_WORKER_STRUCT));
+    size_t grain = begin < end ? (end - begin) / (threads_size * PARALLEL_CHUNKS_PER_THREAD) : 1;
+
+    LOG_PRINT("Running light parallel %s from %lu to %lu on %lu threads\n", parallel->array_name, begin, end, threads_size);
+    pool_run(visitor->pool, begin, end, grain, parallel_run_chunk, parallel);
+
+    for (size_t i = 0; i < threads_size; i++)
+    {
+        if (parallel->workers[i].failed)
+        {
+            error_raise(&parallel->workers[i].trap);
+        }
+    }
+
+    for (size_t i = 0; i < threads_size; i++)
+    {
+        if (parallel->workers[i].visitor)
+        {
+            free_parallel_worker(parallel->workers[i].visitor);
+        }
+    }
+
+    // Every element was written as a separate node, pack them again if they are all ints
+    ast_array_pack(array);
+
+    // Leave the iterator where the sequential loop would have left it
+    if (begin < end)
+    {
+        ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value = end;
+    }
+
+    heap_free(parallel->workers);
+    heap_free(parallel->local_names);
+    heap_free(parallel);
+}
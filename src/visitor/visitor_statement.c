@@ -1,4 +1,7 @@
 #include "../include/visitor/visitor_statement.h"
+#include "../include/visitor/visitor_builtin.h"
+#include "../include/heap/heap.h"
+#include "../include/io/error.h"
 #include "../include/io/logger.h"
 #include "../include/scope/scope.h"
 #include "../include/ast/AST.h"
@@ -27,7 +30,7 @@ AST_T *visitor_visit_return(visitor_T *visitor, AST_RETURN_T *node)
     if (!node->return_value)
     {
         log_error("Return value is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Visiting return [type]: %s\n", ast_type_to_string(node->return_value->type));
@@ -79,28 +82,60 @@ AST_T *visitor_visit_not(visitor_T *visitor, AST_NOT_T *node)
     AST_T *factor = visitor_visit_factor(visitor, node->not_expression);
     if (factor->type == AST_INT)
     {
-        AST_INT_T *int_factor = (AST_INT_T *)factor;
-        int_factor->int_value = !int_factor->int_value;
-        return factor;
+        // The factor may be the value of a variable, so the result is a new int
+        AST_INT_T *result = (AST_INT_T *)init_ast(AST_INT);
+        result->int_value = !((AST_INT_T *)factor)->int_value;
+        return (AST_T *)result;
     }
     log_error("Unsupported type for NOT operation: %s\n", ast_type_to_string(factor->type));
-    exit(1);
+    error_exit(1);
+}
+
+// Runs 'light line with "path"', defining line to each line of the file in turn
+static AST_T *visitor_visit_lines_loop(visitor_T *visitor, AST_FOR_LOOP_T *node)
+{
+    input_stream_T *stream = builtin_input_stream(visitor, "light", node->for_loop_lines);
+
+    visitor->scope_stack = push_scope_to_stack(visitor->scope_stack, init_scope());
+
+    AST_VARIABLE_DEFINITION_T *line_definition = (AST_VARIABLE_DEFINITION_T *)init_ast(AST_VARIABLE_DEFINITION);
+    line_definition->variable_definition_variable_name = ((AST_VARIABLE_T *)node->for_loop_variable)->variable_name;
+    line_definition->variable_definition_variable_count = (AST_T *)init_ast(AST_VARIABLE_COUNT);
+    ((AST_VARIABLE_COUNT_T *)line_definition->variable_definition_variable_count)->variable_count_value = 1;
+
+    AST_STRING_T *line;
+    while ((line = input_read_line(stream)))
+    {
+        // The body may have assigned line or defined it again, so every line starts from the loop's own definition
+        line_definition->variable_definition_value = (AST_T *)line;
+        visitor_add_variable_definition(visitor, (AST_T *)line_definition);
+        visitor_visit(visitor, node->for_loop_body);
+    }
+
+    visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
+
+    return init_ast(AST_NOOP);
 }
 
 AST_T *visitor_visit_for_loop(visitor_T *visitor, AST_FOR_LOOP_T *node)
 {
     LOG_PRINT("Visiting for loop\n");
 
+    if (node->for_loop_lines)
+    {
+        return visitor_visit_lines_loop(visitor, node);
+    }
+
     if (!node->for_loop_increment)
     {
         log_error("For loop increment is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (node->for_loop_increment->type != AST_VARIABLE)
     {
         log_error("For loop increment must be a variable\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_DEFINITION_T *for_variable_definition = visitor_get_variable_definition(
@@ -110,7 +145,7 @@ AST_T *visitor_visit_for_loop(visitor_T *visitor, AST_FOR_LOOP_T *node)
     if (!for_variable_definition)
     {
         log_error("For loop variable definition not found\n");
-        exit(1);
+        error_exit(1);
     }
 
     // Search for the increment variable definition
@@ -143,30 +178,53 @@ AST_T *visitor_visit_for_loop(visitor_T *visitor, AST_FOR_LOOP_T *node)
     if (increment_variable_definition->variable_definition_value->type != AST_INT)
     {
         log_error("Increment variable must be an integer\n");
-        exit(1);
+        error_exit(1);
     }
 
-    if (!node->for_loop_condition)
+    // The loop counts in an int of its own, since the value it starts from may be a literal of the tree
+    AST_INT_T *increment_value = (AST_INT_T *)init_ast(AST_INT);
+    increment_value->int_value = ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value;
+    increment_variable_definition->variable_definition_value = (AST_T *)increment_value;
+
+    AST_T *condition = node->for_loop_condition;
+    if (!condition)
     {
-        // Creating default condition i < var count
+        // Creating default condition i < var count, for the count the variable has in this run
         LOG_PRINT("For loop condition is NULL, creating default one\n");
-        AST_LT_OP_T *condition = (AST_LT_OP_T *)init_ast(AST_LT_OP);
-        condition->left = node->for_loop_increment;
+        AST_LT_OP_T *default_condition = (AST_LT_OP_T *)init_ast(AST_LT_OP);
+        default_condition->left = node->for_loop_increment;
 
         AST_VARIABLE_COUNT_T *variable_count = for_variable_definition->variable_definition_variable_count;
         AST_INT_T *int_value = (AST_INT_T *)init_ast(AST_INT);
         int_value->int_value = variable_count->variable_count_value;
-        condition->right = (AST_T *)int_value;
+        default_condition->right = (AST_T *)int_value;
+
+        condition = (AST_T *)default_condition;
+    }
 
-        node->for_loop_condition = (AST_T *)condition;
+    // Inside a parallel loop the kernels could repack arrays other workers are reading, so workers always interpret
+    if (node->for_loop_parallel && !visitor->parallel_worker)
+    {
+        visitor_run_parallel_loop(visitor, node, condition, increment_variable_definition);
+        visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
+        return init_ast(AST_NOOP);
+    }
+
+    // Simple bodies over int arrays run as native kernels, everything else is interpreted
+    if (!visitor->parallel_worker && visitor_run_loop_idiom(visitor, node, condition, increment_variable_definition))
+    {
+        visitor->scope_stack = pop_scope_from_stack(visitor->scope_stack);
+        return init_ast(AST_NOOP);
     }
 
-    while (visitor_get_node_value(visitor, node->for_loop_condition))
+    while (visitor_get_node_value(visitor, condition))
     {
         visitor_visit(visitor, node->for_loop_body);
 
-        // Increment by one the value of increment variable
-        ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value++;
+        // Increment by one the value of increment variable, in a fresh int since the body may have stored the old one
+        AST_INT_T *next_value = (AST_INT_T *)init_ast(AST_INT);
+        next_value->int_value = ((AST_INT_T *)increment_variable_definition->variable_definition_value)->int_value + 1;
+        increment_variable_definition->variable_definition_value = (AST_T *)next_value;
     }
 
     // Pop the scope for the for loop
@@ -182,7 +240,7 @@ AST_T *visitor_visit_save(visitor_T *visitor, AST_SAVE_T *node)
     if (!visitor->current_function)
     {
         log_error("Save must be called inside a function definition\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_T *save_variable = node->save_value;
@@ -195,7 +253,7 @@ AST_T *visitor_visit_save(visitor_T *visitor, AST_SAVE_T *node)
     if (!variable_definition)
     {
         log_error("Variable definition for %s not found\n", save_variable->variable_name);
-        exit(1);
+        error_exit(1);
     }
 
     // Get the value of the variable
@@ -214,7 +272,7 @@ AST_T *visitor_visit_save(visitor_T *visitor, AST_SAVE_T *node)
     // Add the variable to the function definition variables
     // Realloc
     visitor->current_function->function_definition_variables_size++;
-    visitor->current_function->function_definition_variables = realloc(
+    visitor->current_function->function_definition_variables = heap_realloc(
         visitor->current_function->function_definition_variables,
         (visitor->current_function->function_definition_variables_size + 1) * sizeof(struct AST_VARIABLE_DEFINITION_STRUCT *));
     // Add the variable to the end of the array
@@ -223,6 +281,16 @@ AST_T *visitor_visit_save(visitor_T *visitor, AST_SAVE_T *node)
     return init_ast(AST_NOOP);
 }
 
+// Operands are only read, so an element of a packed array is read into scratch instead of a node of its own
+static AST_T *visitor_visit_operand(visitor_T *visitor, AST_T *node, AST_INT_T *scratch)
+{
+    if (node->type == AST_DOT_EXPRESSION)
+    {
+        return visitor_visit_dot_expression_read(visitor, (AST_DOT_EXPRESSION_T *)node, scratch);
+    }
+    return visitor_visit_factor(visitor, node);
+}
+
 AST_T *visitor_visit_term(visitor_T *visitor, AST_T *node)
 {
     if (node->type == AST_NESTED_EXPRESSION)
@@ -242,8 +310,11 @@ AST_T *visitor_visit_term(visitor_T *visitor, AST_T *node)
         return visitor_visit_factor(visitor, node);
     }
 
-    AST_T *left = visitor_visit_factor(visitor, op->left);
-    AST_T *right = visitor_visit_factor(visitor, op->right);
+    // Neither operand is returned or kept, every result below is a node of its own
+    AST_INT_T left_scratch = {{AST_INT}, 0};
+    AST_INT_T right_scratch = {{AST_INT}, 0};
+    AST_T *left = visitor_visit_operand(visitor, op->left, &left_scratch);
+    AST_T *right = visitor_visit_operand(visitor, op->right, &right_scratch);
 
     if (left->type == AST_INT && right->type == AST_INT)
     {
@@ -299,7 +370,7 @@ AST_T *visitor_visit_term(visitor_T *visitor, AST_T *node)
             break;
         default:
             log_error("Unknown operation: %s\n", ast_type_to_string(node->type));
-            exit(1);
+            error_exit(1);
         }
 
         return result;
@@ -310,21 +381,35 @@ AST_T *visitor_visit_term(visitor_T *visitor, AST_T *node)
         AST_STRING_T *left_string = (AST_STRING_T *)left;
         AST_STRING_T *right_string = (AST_STRING_T *)right;
 
-        AST_STRING_T *result = (AST_STRING_T *)init_ast(AST_STRING);
+        AST_INT_T *comparison = NULL;
         switch (node->type)
         {
         case AST_ADD_OP:
-            LOG_PRINT("Concatenating %s with %s\n", left_string->string_value, right_string->string_value);
-            result->string_value = calloc(strlen(left_string->string_value) + strlen(right_string->string_value) + 1, sizeof(char));
-            strcat(result->string_value, left_string->string_value);
-            strcat(result->string_value, right_string->string_value);
-            break;
+            LOG_PRINT("Concatenating strings of length %lu and %lu\n", ast_string_length(left_string), ast_string_length(right_string));
+            return (AST_T *)ast_string_concat(left_string, right_string);
+        case AST_EQUAL_OP:
+            comparison = (AST_INT_T *)init_ast(AST_INT);
+            comparison->int_value = ast_string_equal(left_string, right_string);
+            LOG_PRINT("Comparing strings for equality: %d\n", comparison->int_value);
+            return (AST_T *)comparison;
+        case AST_GT_OP:
+        case AST_LT_OP:
+        case AST_GTE_OP:
+        case AST_LTE_OP:
+        {
+            int order = ast_string_compare(left_string, right_string);
+            comparison = (AST_INT_T *)init_ast(AST_INT);
+            comparison->int_value = node->type == AST_GT_OP    ? order > 0
+                                    : node->type == AST_LT_OP  ? order < 0
+                                    : node->type == AST_GTE_OP ? order >= 0
+                                                               : order <= 0;
+            LOG_PRINT("Comparing strings with %s: %d\n", ast_type_to_string(node->type), comparison->int_value);
+            return (AST_T *)comparison;
+        }
         default:
             log_error("Unknown operation for strings: %s\n", ast_type_to_string(node->type));
-            exit(1);
+            error_exit(1);
         }
-
-        return result;
     }
 
     LOG_PRINT("Term: %s\n", ast_type_to_string(node->type));
@@ -364,7 +449,7 @@ AST_T *visitor_visit_factor(visitor_T *visitor, AST_T *node)
         return visitor_visit_string(visitor, (AST_STRING_T *)node);
     default:
         log_error("Unknown node type: %s\n", ast_type_to_string(node->type));
-        exit(1);
+        error_exit(1);
     }
 
     return node;
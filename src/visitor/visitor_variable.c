@@ -1,4 +1,6 @@
 #include "../include/visitor/visitor_variable.h"
+#include "../include/io/error.h"
+#include "../include/heap/heap.h"
 #include "../include/io/logger.h"
 #include "../include/scope/scope.h"
 #include "../include/ast/AST.h"
@@ -10,7 +12,7 @@ AST_T *visitor_visit_variable_definition(visitor_T *visitor, AST_VARIABLE_DEFINI
     if (!node->variable_definition_variable_name)
     {
         log_error("Variable definition name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Visiting variable definition\n");
@@ -25,17 +27,20 @@ AST_T *visitor_visit_variable_definition(visitor_T *visitor, AST_VARIABLE_DEFINI
     if (!node->variable_definition_value)
     {
         log_error("Variable definition value is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
-    AST_T *variable_value = visitor_visit(visitor, node->variable_definition_value);
-    node->variable_definition_value = variable_value;
+    // The node only describes the definition, every visit binds the value in a definition of its own
+    AST_VARIABLE_DEFINITION_T *variable_definition = (AST_VARIABLE_DEFINITION_T *)init_ast(AST_VARIABLE_DEFINITION);
+    variable_definition->variable_definition_variable_name = node->variable_definition_variable_name;
+    variable_definition->variable_definition_value = visitor_visit(visitor, node->variable_definition_value);
+    variable_definition->variable_definition_variable_count = node->variable_definition_variable_count;
 
-    LOG_PRINT("Variable value type: %s\n", ast_type_to_string(variable_value->type));
+    LOG_PRINT("Variable value type: %s\n", ast_type_to_string(variable_definition->variable_definition_value->type));
 
-    visitor_add_variable_definition(visitor, (AST_T *)node);
+    visitor_add_variable_definition(visitor, (AST_T *)variable_definition);
 
-    return (AST_T *)node;
+    return (AST_T *)variable_definition;
 }
 
 AST_T *visitor_visit_variable(visitor_T *visitor, AST_VARIABLE_T *node)
@@ -52,7 +57,7 @@ AST_T *visitor_visit_variable_with_index(visitor_T *visitor, AST_VARIABLE_T *nod
     if (!variable_definition)
     {
         log_error("Variable '%s' not defined\n", node->variable_name);
-        exit(1);
+        error_exit(1);
     }
 
     LOG_PRINT("Variable found: %s [type: %s]\n", node->variable_name, ast_type_to_string(variable_definition->variable_definition_value->type));
@@ -65,13 +70,19 @@ AST_T *visitor_visit_variable_with_index(visitor_T *visitor, AST_VARIABLE_T *nod
     if (variable_definition->variable_definition_variable_count <= index)
     {
         log_error("Index out of bounds\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (variable_definition->variable_definition_value->type == AST_ARRAY)
     {
         AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
-        return array->array_value[index];
+        // Loaded arrays have as many elements as the file has rows, whatever count they were rolled with
+        if ((size_t)index >= array->array_size)
+        {
+            log_error("Index out of bounds\n");
+            error_exit(1);
+        }
+        return ast_array_get(array, index);
     }
 
     return variable_definition->variable_definition_value;
@@ -86,20 +97,18 @@ AST_T *visitor_visit_last_variable(visitor_T *visitor, AST_VARIABLE_T *node)
     if (!variable_definition)
     {
         log_error("Variable '%s' not defined\n", node->variable_name);
-        exit(1);
+        error_exit(1);
     }
 
     if (variable_definition->variable_definition_value->type == AST_ARRAY)
     {
         AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
-        return array->array_value[array->array_size - 1];
+        return ast_array_get(array, array->array_size - 1);
     }
     else if (variable_definition->variable_definition_value->type == AST_STRING)
     {
         AST_STRING_T *string = (AST_STRING_T *)variable_definition->variable_definition_value;
-        AST_STRING_T *last_char = (AST_STRING_T *)init_ast(AST_STRING);
-        last_char->string_value = &(string->string_value)[strlen(string->string_value) - 1];
-        return (AST_T *)last_char;
+        return (AST_T *)ast_string_slice(string, ast_string_length(string) - 1, 1);
     }
     else
     {
@@ -114,13 +123,13 @@ AST_T *visitor_visit_variable_with_dot_dot(visitor_T *visitor, AST_VARIABLE_T *n
     if (first_index > last_index)
     {
         log_error("First index must be less than last index\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (first_index < 0 || last_index < 0)
     {
         log_error("First index and last index must be greater than or equal to 0\n");
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_DEFINITION_T *variable_definition = visitor_get_variable_definition(visitor, node->variable_name);
@@ -130,48 +139,32 @@ AST_T *visitor_visit_variable_with_dot_dot(visitor_T *visitor, AST_VARIABLE_T *n
     if (last_index > length_of_variable)
     {
         log_error("Last index must be less than the length of the variable\n");
-        exit(1);
+        error_exit(1);
     }
     if (first_index > length_of_variable)
     {
         log_error("First index must be less than the length of the variable\n");
-        exit(1);
+        error_exit(1);
     }
 
     switch (variable_definition->variable_definition_value->type)
     {
     case AST_ARRAY:
     {
-        // Create a new array with the values from the first index to the last index excluded
+        // Slice the values from the first index to the last index excluded
         AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
-        AST_ARRAY_T *new_array = (AST_ARRAY_T *)init_ast(AST_ARRAY);
-        new_array->array_size = last_index - first_index;
-        new_array->array_value = calloc(new_array->array_size, sizeof(struct AST_STRUCT *));
-        for (size_t i = 0; i < new_array->array_size; i++)
-        {
-            new_array->array_value[i] = array->array_value[first_index + i];
-        }
-        return (AST_T *)new_array;
+        return (AST_T *)ast_array_slice(array, first_index, last_index - first_index);
     }
     case AST_STRING:
     {
-        // Create a new string with the values from the first index to the last index
+        // Slice the characters from the first index to the last index excluded
         AST_STRING_T *string = (AST_STRING_T *)variable_definition->variable_definition_value;
-        int length = last_index - first_index;
-        char *new_string = calloc(length + 1, sizeof(char));
-        for (size_t i = 0; i < length; i++)
-        {
-            new_string[i] = string->string_value[first_index + i];
-        }
-        new_string[length] = '\0';
-        AST_STRING_T *new_string_node = (AST_STRING_T *)init_ast(AST_STRING);
-        new_string_node->string_value = new_string;
-        return (AST_T *)new_string_node;
+        return (AST_T *)ast_string_slice(string, first_index, last_index - first_index);
     }
     default:
     {
         log_error("Variable definition value must be an array or string\n");
-        exit(1);
+        error_exit(1);
     }
     }
 }
@@ -188,25 +181,29 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
     if (!node->variable_assignment_name)
     {
         log_error("Variable assignment name is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (!node->variable_assignment_value)
     {
         log_error("Variable assignment value is NULL\n");
-        exit(1);
+        error_exit(1);
     }
 
     // Check if name is in form 'name.index'
     char *dot = strchr(node->variable_assignment_name, '.');
     if (dot)
     {
-        char *variable_name = strtok(node->variable_assignment_name, ".");
-        char *indexName = strtok(NULL, ".");
-        if (!variable_name || !indexName)
+        // The name belongs to the tree, so the variable name is copied out of it instead of cut in place
+        int tag = heap_tag;
+        heap_tag = MEMSTATS_STRING;
+        char *variable_name = heap_strndup(node->variable_assignment_name, dot - node->variable_assignment_name);
+        heap_tag = tag;
+        char *indexName = dot + 1;
+        if (!*variable_name || !*indexName)
         {
             log_error("Invalid dot expression\n");
-            exit(1);
+            error_exit(1);
         }
         LOG_PRINT("Variable name: %s\tindex: %s\n", variable_name, indexName);
 
@@ -214,8 +211,9 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
         if (!variable_definition)
         {
             log_error("Variable '%s' not defined\n", variable_name);
-            exit(1);
+            error_exit(1);
         }
+        heap_free(variable_name);
 
         int index = atoi(indexName);
         // If index is not an integer search for variable with that name
@@ -225,13 +223,13 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
             if (!index_definition)
             {
                 log_error("Index '%s' not defined\n", index);
-                exit(1);
+                error_exit(1);
             }
             AST_T *index_value = visitor_visit(visitor, index_definition->variable_definition_value);
             if (index_value->type != AST_INT)
             {
                 log_error("Index must be an integer\n");
-                exit(1);
+                error_exit(1);
             }
             index = ((AST_INT_T *)index_value)->int_value;
         }
@@ -239,7 +237,7 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
         if (index >= variable_definition->variable_definition_variable_count || index < 0)
         {
             log_error("Index out of bounds\n");
-            exit(1);
+            error_exit(1);
         }
 
         if (variable_definition->variable_definition_value->type == AST_ARRAY)
@@ -249,34 +247,19 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
             if (array->array_size <= index)
             {
                 log_error("Index out of bounds\n");
-                exit(1);
+                error_exit(1);
             }
-            array->array_value[index] = visitor_visit(visitor, node->variable_assignment_value);
-            return (AST_T *)array->array_value[index];
+            return ast_array_set(array, index, visitor_visit(visitor, node->variable_assignment_value));
         }
         else
         {
-            LOG_PRINT("Variable is not an array, changing the value to array\n");
-            AST_T *old_value = variable_definition->variable_definition_value;
-            variable_definition->variable_definition_value = (AST_ARRAY_T *)init_ast(AST_ARRAY);
-            AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
-            array->array_size = ((AST_VARIABLE_COUNT_T *)variable_definition->variable_definition_variable_count)->variable_count_value;
-            array->array_value = calloc(array->array_size, sizeof(struct AST_STRUCT *));
-            for (int i = 0; i < array->array_size; i++)
-            {
-                if (i == index)
-                {
-                    LOG_PRINT("Setting index %d to new value\n", i);
-                    array->array_value[i] = visitor_visit(visitor, node->variable_assignment_value);
-                }
-                else
-                {
-                    LOG_PRINT("Copying old value to index %d\n", i);
-                    array->array_value[i] = old_value;
-                }
-            }
+            LOG_PRINT("Variable is not an array, changing the value to a run-length array\n");
+            AST_T *new_value = visitor_visit(visitor, node->variable_assignment_value);
+            size_t count = ((AST_VARIABLE_COUNT_T *)variable_definition->variable_definition_variable_count)->variable_count_value;
+            AST_ARRAY_T *array = init_ast_array_filled(count, variable_definition->variable_definition_value);
+            variable_definition->variable_definition_value = (AST_T *)array;
 
-            return (AST_T *)array->array_value[index];
+            return ast_array_set(array, index, new_value);
         }
     }
 
@@ -284,7 +267,7 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
     if (!variable_definition)
     {
         log_error("Variable '%s' not defined\n", node->variable_assignment_name);
-        exit(1);
+        error_exit(1);
     }
 
     if (index == -1)
@@ -296,14 +279,13 @@ AST_T *visitor_visit_variable_assignment_with_index(visitor_T *visitor, AST_VARI
     if (variable_definition->variable_definition_variable_count <= index)
     {
         log_error("Index out of bounds\n");
-        exit(1);
+        error_exit(1);
     }
 
     if (variable_definition->variable_definition_value->type == AST_ARRAY)
     {
         AST_ARRAY_T *array = (AST_ARRAY_T *)variable_definition->variable_definition_value;
-        array->array_value[index] = visitor_visit(visitor, node->variable_assignment_value);
-        return array->array_value[index];
+        return ast_array_set(array, index, visitor_visit(visitor, node->variable_assignment_value));
     }
 
     return visitor_visit_variable_assignment(visitor, node);
@@ -331,7 +313,7 @@ int visitor_get_variable_count(visitor_T *visitor, AST_VARIABLE_T *node)
     if (!variable_definition)
     {
         log_error("Variable '%s' not defined\n", node->variable_name);
-        exit(1);
+        error_exit(1);
     }
 
     AST_VARIABLE_COUNT_T *variable_count = (AST_VARIABLE_COUNT_T *)(variable_definition->variable_definition_variable_count);
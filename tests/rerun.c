@@ -0,0 +1,210 @@
+// Host that loads one program and runs it many times, alone and from several threads at once,
+// failing when a run prints anything else than the first one or the interpreter keeps memory
+// of its past runs
+#include "../src/include/blunt/blunt.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// Runs once the memory of the first runs is in use, and how much more may be in use after them
+#define RERUN_WARMUP 100
+#define RERUN_RUNS 1000
+#define RERUN_GROWTH_KB 4096
+
+// Interpreters sharing the program of the first one, each on its own thread
+#define RERUN_THREADS 3
+#define RERUN_THREAD_RUNS 200
+
+// Re-rolls variables in loops and calls memoized pure blunts, the runs that used to write into the tree
+static const char *rerun_source =
+    "blunt fib(n)\n"
+    "{\n"
+    "    if(n < 2) {\n"
+    "        smoke n;\n"
+    "    }\n"
+    "    smoke fib(n-1) + fib(n-2)\n"
+    "}\n"
+    "blunt square(n)\n"
+    "{\n"
+    "    smoke n * n\n"
+    "}\n"
+    "roll 100 numbers with 1;\n"
+    "roll total with 0;\n"
+    "light numbers\n"
+    "{\n"
+    "    roll doubled with numbers.i * 2;\n"
+    "    numbers.i = numbers.i + i;\n"
+    "    total = total + numbers.i + doubled;\n"
+    "}\n"
+    "println(\"Total:\", total);\n"
+    "roll memoized with 0;\n"
+    "light numbers\n"
+    "{\n"
+    "    roll call with fib(i / 5) + square(i);\n"
+    "    memoized = memoized + call;\n"
+    "}\n"
+    "println(\"Memoized:\", memoized, fib(12));\n"
+    "roll 100 squares with 0;\n"
+    "light parallel squares\n"
+    "{\n"
+    "    squares.i = i * i;\n"
+    "}\n"
+    "println(\"Squares:\", sum(squares), squares);\n"
+    "roll text with \"Smoke a\" + \" \" + \"blunt\";\n"
+    "roll part with text.6..;\n"
+    "println(\"Slice:\", part);\n";
+
+typedef struct RERUN_STRUCT
+{
+    blunt_T *blunt;
+    // What the first run printed, which every other run must print too
+    const char *expected;
+    size_t expected_size;
+    int runs;
+    int failed;
+} rerun_T;
+
+static long rerun_max_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void *rerun(void *argument)
+{
+    rerun_T *rerun = argument;
+    for (int i = 0; i < rerun->runs; i++)
+    {
+        if (blunt_run(rerun->blunt) != BLUNT_OK)
+        {
+            fprintf(stderr, "Run %d failed: %s", i, blunt_error(rerun->blunt));
+            rerun->failed = 1;
+            return NULL;
+        }
+
+        size_t size;
+        const char *output = blunt_output(rerun->blunt, &size);
+        if (size != rerun->expected_size || memcmp(output, rerun->expected, size) != 0)
+        {
+            fprintf(stderr, "Run %d printed\n%.*s\ninstead of\n%.*s\n",
+                    i, (int)size, output, (int)rerun->expected_size, rerun->expected);
+            rerun->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Runs the program from interpreters sharing it, all at the same time
+static int rerun_threads(blunt_T *source, const char *expected, size_t expected_size)
+{
+    rerun_T reruns[RERUN_THREADS] = {0};
+    pthread_t threads[RERUN_THREADS];
+    int started = 0;
+    int failed = 0;
+
+    for (int i = 0; i < RERUN_THREADS; i++)
+    {
+        reruns[i].blunt = init_blunt();
+        if (!reruns[i].blunt)
+        {
+            fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+            failed = 1;
+            break;
+        }
+        blunt_set_memo(reruns[i].blunt, 1);
+        blunt_set_capture(reruns[i].blunt, 1);
+        blunt_share(reruns[i].blunt, source);
+        reruns[i].expected = expected;
+        reruns[i].expected_size = expected_size;
+        reruns[i].runs = RERUN_THREAD_RUNS;
+    }
+
+    for (; !failed && started < RERUN_THREADS; started++)
+    {
+        if (pthread_create(&threads[started], NULL, rerun, &reruns[started]) != 0)
+        {
+            fprintf(stderr, "Failed to start thread %d\n", started);
+            failed = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        failed |= reruns[i].failed;
+    }
+
+    for (int i = 0; i < RERUN_THREADS; i++)
+    {
+        if (reruns[i].blunt)
+        {
+            blunt_free(reruns[i].blunt);
+        }
+    }
+    if (!failed)
+    {
+        printf("%d threads ran the shared program %d times each\n", RERUN_THREADS, RERUN_THREAD_RUNS);
+    }
+    return !failed;
+}
+
+int main()
+{
+    blunt_T *blunt = init_blunt();
+    if (!blunt)
+    {
+        fprintf(stderr, "Failed to allocate memory for the interpreter\n");
+        return 1;
+    }
+
+    // Memoization and the thread pool are kept across runs, so they are exercised too
+    blunt_set_memo(blunt, 1);
+    blunt_set_capture(blunt, 1);
+    if (blunt_load(blunt, rerun_source) != BLUNT_OK || blunt_run(blunt) != BLUNT_OK)
+    {
+        fprintf(stderr, "%s", blunt_error(blunt));
+        blunt_free(blunt);
+        return 1;
+    }
+
+    size_t expected_size;
+    const char *output = blunt_output(blunt, &expected_size);
+    char *expected = malloc(expected_size + 1);
+    memcpy(expected, output, expected_size);
+    expected[expected_size] = '\0';
+    printf("%s", expected);
+
+    rerun_T rerun_alone = {.blunt = blunt, .expected = expected, .expected_size = expected_size};
+    int status = 1;
+    rerun_alone.runs = RERUN_WARMUP;
+    rerun(&rerun_alone);
+    if (!rerun_alone.failed)
+    {
+        long warm_kb = rerun_max_rss_kb();
+        rerun_alone.runs = RERUN_RUNS;
+        rerun(&rerun_alone);
+        if (!rerun_alone.failed)
+        {
+            long growth_kb = rerun_max_rss_kb() - warm_kb;
+            printf("%d runs printed the same and grew the max RSS by %ld KB\n", RERUN_RUNS, growth_kb);
+            status = growth_kb > RERUN_GROWTH_KB;
+            if (status)
+            {
+                fprintf(stderr, "Runs keep memory of the previous ones, more than %d KB\n", RERUN_GROWTH_KB);
+            }
+        }
+    }
+
+    if (!status && !rerun_threads(blunt, expected, expected_size))
+    {
+        status = 1;
+    }
+
+    free(expected);
+    blunt_free(blunt);
+    return status;
+}